@@ -15,6 +15,9 @@
  * License along with mpv.  If not, see <http://www.gnu.org/licenses/>.
  */
 
+#include <math.h>
+#include <pthread.h>
+
 #include <libavutil/frame.h>
 #include <libavutil/mem.h>
 
@@ -79,6 +82,21 @@ struct mp_aframe *mp_aframe_new_ref(struct mp_aframe *frame)
     return dst;
 }
 
+// Return a new reference to the given range of samples of frame. The audio
+// data is not copied; both frames share the same refcounted buffers (writing
+// to either of them will copy the data first).
+struct mp_aframe *mp_aframe_new_view(struct mp_aframe *frame, int offset,
+                                     int samples)
+{
+    assert(offset >= 0 && samples >= 0);
+    assert(offset + samples <= mp_aframe_get_size(frame));
+
+    struct mp_aframe *dst = mp_aframe_new_ref(frame);
+    mp_aframe_skip_samples(dst, offset);
+    mp_aframe_set_size(dst, samples);
+    return dst;
+}
+
 // Revert to state after mp_aframe_create().
 void mp_aframe_reset(struct mp_aframe *frame)
 {
@@ -520,20 +538,229 @@ bool mp_aframe_set_silence(struct mp_aframe *f, int offset, int samples)
     return true;
 }
 
+#define MIX_i(d, s, num, gain, low, center, high)                              \
+    for (int n = 0; n < (num); n++)                                            \
+        (d)[n] = MPCLAMP(llrint(((double)(d)[n] - (center)) +                  \
+                                ((double)(s)[n] - (center)) * (gain)) +        \
+                         (center), (low), (high))
+
+#define MIX_f(d, s, num, gain)                                                 \
+    for (int n = 0; n < (num); n++)                                            \
+        (d)[n] = (d)[n] + (s)[n] * (gain)
+
+// Add samples from src (scaled by gain) to dst. Integer samples are clipped,
+// float samples are not. Both frames must have the same format.
+bool mp_aframe_mix_samples(struct mp_aframe *dst, int dst_offset,
+                           struct mp_aframe *src, int src_offset,
+                           int samples, float gain)
+{
+    if (!mp_aframe_config_equals(dst, src))
+        return false;
+
+    if (mp_aframe_get_size(dst) < dst_offset + samples ||
+        mp_aframe_get_size(src) < src_offset + samples)
+        return false;
+
+    uint8_t **s = mp_aframe_get_data_ro(src);
+    uint8_t **d = mp_aframe_get_data_rw(dst);
+    if (!s || !d)
+        return false;
+
+    int format = mp_aframe_get_format(dst);
+    int planes = mp_aframe_get_planes(dst);
+    size_t sstride = mp_aframe_get_sstride(dst);
+    int num = samples * (sstride / af_fmt_to_bytes(format));
+
+    for (int p = 0; p < planes; p++) {
+        void *dp = d[p] + dst_offset * sstride;
+        void *sp = s[p] + src_offset * sstride;
+        switch (af_fmt_from_planar(format)) {
+        case AF_FORMAT_U8:
+            MIX_i((uint8_t *)dp, (uint8_t *)sp, num, gain, 0, 128, 255);
+            break;
+        case AF_FORMAT_S16:
+            MIX_i((int16_t *)dp, (int16_t *)sp, num, gain,
+                  INT16_MIN, 0, INT16_MAX);
+            break;
+        case AF_FORMAT_S32:
+            MIX_i((int32_t *)dp, (int32_t *)sp, num, gain,
+                  INT32_MIN, 0, INT32_MAX);
+            break;
+        case AF_FORMAT_FLOAT:
+            MIX_f((float *)dp, (float *)sp, num, gain);
+            break;
+        case AF_FORMAT_DOUBLE:
+            MIX_f((double *)dp, (double *)sp, num, gain);
+            break;
+        default:
+            return false;
+        }
+    }
+
+    return true;
+}
+
+#define RAMP_i(d, samples, ch, start, step, low, center, high)                 \
+    for (int n = 0; n < (samples); n++) {                                      \
+        float g = (start) + (step) * n;                                        \
+        for (int c = 0; c < (ch); c++) {                                       \
+            int i = n * (ch) + c;                                              \
+            (d)[i] = MPCLAMP(llrint(((double)(d)[i] - (center)) * g) +         \
+                             (center), (low), (high));                         \
+        }                                                                      \
+    }
+
+#define RAMP_f(d, samples, ch, start, step)                                    \
+    for (int n = 0; n < (samples); n++) {                                      \
+        float g = (start) + (step) * n;                                        \
+        for (int c = 0; c < (ch); c++)                                         \
+            (d)[n * (ch) + c] *= g;                                            \
+    }
+
+// Scale the samples with a gain that changes linearly from start to end.
+bool mp_aframe_gain_ramp(struct mp_aframe *f, int offset, int samples,
+                         float start, float end)
+{
+    if (mp_aframe_get_size(f) < offset + samples)
+        return false;
+
+    if (start == 1.0f && end == 1.0f)
+        return true;
+
+    uint8_t **d = mp_aframe_get_data_rw(f);
+    if (!d)
+        return false;
+
+    int format = mp_aframe_get_format(f);
+    int planes = mp_aframe_get_planes(f);
+    size_t sstride = mp_aframe_get_sstride(f);
+    int ch = sstride / af_fmt_to_bytes(format);
+    float step = samples ? (end - start) / samples : 0;
+
+    for (int p = 0; p < planes; p++) {
+        void *dp = d[p] + offset * sstride;
+        switch (af_fmt_from_planar(format)) {
+        case AF_FORMAT_U8:
+            RAMP_i((uint8_t *)dp, samples, ch, start, step, 0, 128, 255);
+            break;
+        case AF_FORMAT_S16:
+            RAMP_i((int16_t *)dp, samples, ch, start, step,
+                   INT16_MIN, 0, INT16_MAX);
+            break;
+        case AF_FORMAT_S32:
+            RAMP_i((int32_t *)dp, samples, ch, start, step,
+                   INT32_MIN, 0, INT32_MAX);
+            break;
+        case AF_FORMAT_FLOAT:
+            RAMP_f((float *)dp, samples, ch, start, step);
+            break;
+        case AF_FORMAT_DOUBLE:
+            RAMP_f((double *)dp, samples, ch, start, step);
+            break;
+        default:
+            return false;
+        }
+    }
+
+    return true;
+}
+
+// Number of distinct buffer sizes a pool keeps around.
+#define POOL_CLASSES 4
+
 struct mp_aframe_pool {
-    AVBufferPool *avpool;
-    int element_size;
+    // Since a pool can be shared by several filters with different frame
+    // sizes, it manages a small number of AVBufferPools with different
+    // element sizes. Unused entries have avpool==NULL.
+    struct {
+        AVBufferPool *avpool;
+        int element_size;
+        uint64_t last_use;
+    } classes[POOL_CLASSES];
+    uint64_t use_counter;
 };
 
-struct mp_aframe_pool *mp_aframe_pool_create(void *ta_parent)
+static pthread_once_t pool_account_once = PTHREAD_ONCE_INIT;
+static struct ta_account *pool_account_ptr;
+
+static void pool_account_init(void)
+{
+    pool_account_ptr =
+        ta_account_get("filter-pools", ta_account_get("filters", NULL));
+}
+
+// Buffers are allocated and freed without any context, so the account is
+// looked up once and shared by all pools.
+static struct ta_account *pool_account(void)
 {
-    return talloc_zero(ta_parent, struct mp_aframe_pool);
+    pthread_once(&pool_account_once, pool_account_init);
+    return pool_account_ptr;
+}
+
+static void pool_free_buffer(void *opaque, uint8_t *data)
+{
+    ta_account_add(pool_account(), -(intptr_t)opaque, -1);
+    av_free(data);
+}
+
+// Like the default AVBufferPool allocator, but accounts the memory.
+static AVBufferRef *pool_alloc_buffer(int size)
+{
+    uint8_t *data = av_malloc(size);
+    if (!data)
+        return NULL;
+    AVBufferRef *buf = av_buffer_create(data, size, pool_free_buffer,
+                                        (void *)(intptr_t)size, 0);
+    if (!buf) {
+        av_free(data);
+        return NULL;
+    }
+    ta_account_add(pool_account(), size, 1);
+    return buf;
 }
 
 static void mp_aframe_pool_destructor(void *p)
 {
     struct mp_aframe_pool *pool = p;
-    av_buffer_pool_uninit(&pool->avpool);
+    for (int n = 0; n < POOL_CLASSES; n++)
+        av_buffer_pool_uninit(&pool->classes[n].avpool);
+}
+
+struct mp_aframe_pool *mp_aframe_pool_create(void *ta_parent)
+{
+    struct mp_aframe_pool *pool = talloc_zero(ta_parent, struct mp_aframe_pool);
+    talloc_set_destructor(pool, mp_aframe_pool_destructor);
+    return pool;
+}
+
+static AVBufferPool *pool_get_class(struct mp_aframe_pool *pool, int size)
+{
+    int best = -1, lru = 0;
+    for (int n = 0; n < POOL_CLASSES; n++) {
+        int el = pool->classes[n].element_size;
+        // Don't waste memory by serving small requests from huge buffers.
+        if (pool->classes[n].avpool && el >= size && el / 4 <= size &&
+            (best < 0 || el < pool->classes[best].element_size))
+            best = n;
+        if (pool->classes[n].last_use < pool->classes[lru].last_use)
+            lru = n;
+    }
+
+    if (best < 0) {
+        size_t alloc = ta_calc_prealloc_elems(size);
+        if (alloc >= INT_MAX)
+            return NULL;
+        best = lru;
+        // Buffers still in use are freed once they are unreferenced.
+        av_buffer_pool_uninit(&pool->classes[best].avpool);
+        pool->classes[best].element_size = alloc;
+        pool->classes[best].avpool = av_buffer_pool_init(alloc, pool_alloc_buffer);
+        if (!pool->classes[best].avpool)
+            return NULL;
+    }
+
+    pool->classes[best].last_use = ++pool->use_counter;
+    return pool->classes[best].avpool;
 }
 
 // Like mp_aframe_allocate(), but use the pool to allocate data.
@@ -548,17 +775,9 @@ int mp_aframe_pool_allocate(struct mp_aframe_pool *pool, struct mp_aframe *frame
     if (size <= 0 || mp_aframe_is_allocated(frame))
         return -1;
 
-    if (!pool->avpool || size > pool->element_size) {
-        size_t alloc = ta_calc_prealloc_elems(size);
-        if (alloc >= INT_MAX)
-            return -1;
-        av_buffer_pool_uninit(&pool->avpool);
-        pool->element_size = alloc;
-        pool->avpool = av_buffer_pool_init(pool->element_size, NULL);
-        if (!pool->avpool)
-            return -1;
-        talloc_set_destructor(pool, mp_aframe_pool_destructor);
-    }
+    AVBufferPool *avpool = pool_get_class(pool, size);
+    if (!avpool)
+        return -1;
 
     // Yes, you have to do all this shit manually.
     // At least it's less stupid than av_frame_get_buffer(), which just wipes
@@ -570,7 +789,7 @@ int mp_aframe_pool_allocate(struct mp_aframe_pool *pool, struct mp_aframe *frame
         av_mallocz_array(planes, sizeof(av_frame->extended_data[0]));
     if (!av_frame->extended_data)
         abort();
-    av_frame->buf[0] = av_buffer_pool_get(pool->avpool);
+    av_frame->buf[0] = av_buffer_pool_get(avpool);
     if (!av_frame->buf[0])
         return -1;
     av_frame->linesize[0] = samples * sstride;
@@ -11,6 +11,8 @@ struct mp_chmap;
 struct mp_aframe *mp_aframe_from_avframe(struct AVFrame *av_frame);
 struct mp_aframe *mp_aframe_create(void);
 struct mp_aframe *mp_aframe_new_ref(struct mp_aframe *frame);
+struct mp_aframe *mp_aframe_new_view(struct mp_aframe *frame, int offset,
+                                     int samples);
 
 void mp_aframe_reset(struct mp_aframe *frame);
 void mp_aframe_unref_data(struct mp_aframe *frame);
@@ -62,6 +64,11 @@ bool mp_aframe_copy_samples(struct mp_aframe *dst, int dst_offset,
                             struct mp_aframe *src, int src_offset,
                             int samples);
 bool mp_aframe_set_silence(struct mp_aframe *f, int offset, int samples);
+bool mp_aframe_mix_samples(struct mp_aframe *dst, int dst_offset,
+                           struct mp_aframe *src, int src_offset,
+                           int samples, float gain);
+bool mp_aframe_gain_ramp(struct mp_aframe *f, int offset, int samples,
+                         float start, float end);
 
 struct mp_aframe_pool;
 struct mp_aframe_pool *mp_aframe_pool_create(void *ta_parent);
@@ -32,8 +32,11 @@ struct mp_audio_buffer {
     int sstride;
     int num_planes;
     uint8_t *data[MP_NUM_CHANNELS];
+    uint8_t *peek[MP_NUM_CHANNELS];
     int allocated;
+    int start;      // offset of the first buffered sample in data
     int num_samples;
+    uint64_t bytes_copied;
 };
 
 struct mp_audio_buffer *mp_audio_buffer_create(void *talloc_ctx)
@@ -52,6 +55,7 @@ void mp_audio_buffer_reinit_fmt(struct mp_audio_buffer *ab, int format,
     ab->channels = *channels;
     ab->srate = srate;
     ab->allocated = 0;
+    ab->start = 0;
     ab->num_samples = 0;
     ab->sstride = af_fmt_to_bytes(ab->format);
     ab->num_planes = 1;
@@ -62,10 +66,34 @@ void mp_audio_buffer_reinit_fmt(struct mp_audio_buffer *ab, int format,
     }
 }
 
+// All integer parameters are in samples.
+// dst and src can overlap.
+static void copy_planes(struct mp_audio_buffer *ab,
+                        uint8_t **dst, int dst_offset,
+                        uint8_t **src, int src_offset, int length)
+{
+    ab->bytes_copied += (uint64_t)length * ab->sstride * ab->num_planes;
+    for (int n = 0; n < ab->num_planes; n++) {
+        memmove((char *)dst[n] + dst_offset * ab->sstride,
+                (char *)src[n] + src_offset * ab->sstride,
+                length * ab->sstride);
+    }
+}
+
+// Move the buffered data to the start of the allocation.
+static void compact(struct mp_audio_buffer *ab)
+{
+    if (ab->start) {
+        copy_planes(ab, ab->data, 0, ab->data, ab->start, ab->num_samples);
+        ab->start = 0;
+    }
+}
+
 // Make the total size of the internal buffer at least this number of samples.
 void mp_audio_buffer_preallocate_min(struct mp_audio_buffer *ab, int samples)
 {
     if (samples > ab->allocated) {
+        compact(ab);
         for (int n = 0; n < ab->num_planes; n++) {
             ab->data[n] = talloc_realloc(ab, ab->data[n], char,
                                          ab->sstride * samples);
@@ -81,16 +109,12 @@ int mp_audio_buffer_get_write_available(struct mp_audio_buffer *ab)
     return ab->allocated - ab->num_samples;
 }
 
-// All integer parameters are in samples.
-// dst and src can overlap.
-static void copy_planes(struct mp_audio_buffer *ab,
-                        uint8_t **dst, int dst_offset,
-                        uint8_t **src, int src_offset, int length)
+// Make sure the given number of samples can be added after the buffered data.
+static void reserve_tail(struct mp_audio_buffer *ab, int samples)
 {
-    for (int n = 0; n < ab->num_planes; n++) {
-        memmove((char *)dst[n] + dst_offset * ab->sstride,
-                (char *)src[n] + src_offset * ab->sstride,
-                length * ab->sstride);
+    if (ab->start + ab->num_samples + samples > ab->allocated) {
+        compact(ab);
+        mp_audio_buffer_preallocate_min(ab, ab->num_samples + samples);
     }
 }
 
@@ -98,8 +122,9 @@ static void copy_planes(struct mp_audio_buffer *ab,
 // If the buffer is not large enough, it is transparently resized.
 void mp_audio_buffer_append(struct mp_audio_buffer *ab, void **ptr, int samples)
 {
-    mp_audio_buffer_preallocate_min(ab, ab->num_samples + samples);
-    copy_planes(ab, ab->data, ab->num_samples, (uint8_t **)ptr, 0, samples);
+    reserve_tail(ab, samples);
+    copy_planes(ab, ab->data, ab->start + ab->num_samples,
+                (uint8_t **)ptr, 0, samples);
     ab->num_samples += samples;
 }
 
@@ -107,19 +132,26 @@ void mp_audio_buffer_append(struct mp_audio_buffer *ab, void **ptr, int samples)
 void mp_audio_buffer_prepend_silence(struct mp_audio_buffer *ab, int samples)
 {
     assert(samples >= 0);
-    mp_audio_buffer_preallocate_min(ab, ab->num_samples + samples);
-    copy_planes(ab, ab->data, samples, ab->data, 0, ab->num_samples);
+    if (samples > ab->start) {
+        reserve_tail(ab, samples);
+        copy_planes(ab, ab->data, ab->start + samples,
+                    ab->data, ab->start, ab->num_samples);
+        ab->start += samples;
+    }
+    ab->start -= samples;
     ab->num_samples += samples;
-    for (int n = 0; n < ab->num_planes; n++)
-        af_fill_silence(ab->data[n], samples * ab->sstride, ab->format);
+    for (int n = 0; n < ab->num_planes; n++) {
+        af_fill_silence(ab->data[n] + ab->start * ab->sstride,
+                        samples * ab->sstride, ab->format);
+    }
 }
 
 void mp_audio_buffer_duplicate(struct mp_audio_buffer *ab, int samples)
 {
     assert(samples >= 0 && samples <= ab->num_samples);
-    mp_audio_buffer_preallocate_min(ab, ab->num_samples + samples);
-    copy_planes(ab, ab->data, ab->num_samples,
-                ab->data, ab->num_samples - samples, samples);
+    reserve_tail(ab, samples);
+    int end = ab->start + ab->num_samples;
+    copy_planes(ab, ab->data, end, ab->data, end - samples, samples);
     ab->num_samples += samples;
 }
 
@@ -127,20 +159,26 @@ void mp_audio_buffer_duplicate(struct mp_audio_buffer *ab, int samples)
 void mp_audio_buffer_peek(struct mp_audio_buffer *ab, uint8_t ***ptr,
                           int *samples)
 {
-    *ptr = ab->data;
+    for (int n = 0; n < ab->num_planes; n++)
+        ab->peek[n] = ab->data[n] + ab->start * ab->sstride;
+    *ptr = ab->peek;
     *samples = ab->num_samples;
 }
 
 // Skip leading samples. (Used with mp_audio_buffer_peek() to read data.)
+// This does not move the remaining data.
 void mp_audio_buffer_skip(struct mp_audio_buffer *ab, int samples)
 {
     assert(samples >= 0 && samples <= ab->num_samples);
-    copy_planes(ab, ab->data, 0, ab->data, samples, ab->num_samples - samples);
+    ab->start += samples;
     ab->num_samples -= samples;
+    if (!ab->num_samples)
+        ab->start = 0;
 }
 
 void mp_audio_buffer_clear(struct mp_audio_buffer *ab)
 {
+    ab->start = 0;
     ab->num_samples = 0;
 }
 
@@ -150,6 +188,12 @@ int mp_audio_buffer_samples(struct mp_audio_buffer *ab)
     return ab->num_samples;
 }
 
+// Return the total number of bytes copied into or within the buffer.
+uint64_t mp_audio_buffer_get_bytes_copied(struct mp_audio_buffer *ab)
+{
+    return ab->bytes_copied;
+}
+
 // Return amount of buffered audio in seconds.
 double mp_audio_buffer_seconds(struct mp_audio_buffer *ab)
 {
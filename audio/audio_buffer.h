@@ -18,6 +18,8 @@
 #ifndef MP_AUDIO_BUFFER_H
 #define MP_AUDIO_BUFFER_H
 
+#include <stdint.h>
+
 struct mp_audio_buffer;
 struct mp_chmap;
 
@@ -35,5 +37,6 @@ void mp_audio_buffer_skip(struct mp_audio_buffer *ab, int samples);
 void mp_audio_buffer_clear(struct mp_audio_buffer *ab);
 int mp_audio_buffer_samples(struct mp_audio_buffer *ab);
 double mp_audio_buffer_seconds(struct mp_audio_buffer *ab);
+uint64_t mp_audio_buffer_get_bytes_copied(struct mp_audio_buffer *ab);
 
 #endif
@@ -17,6 +17,8 @@
 
 #include <stdio.h>
 #include <stdlib.h>
+#include <math.h>
+#include <inttypes.h>
 #include <unistd.h>
 #include <stdbool.h>
 #include <assert.h>
@@ -47,6 +49,8 @@ struct priv {
     uint32_t skip_samples, trim_samples;
     bool preroll_done;
     double next_pts;
+    double start_pts;
+    int64_t discarded;
     AVRational codec_timebase;
     bool eof_returned;
 
@@ -138,6 +142,7 @@ static bool init(struct mp_filter *da, struct mp_codec_params *codec,
     }
 
     ctx->next_pts = MP_NOPTS_VALUE;
+    ctx->start_pts = MP_NOPTS_VALUE;
 
     return true;
 }
@@ -159,7 +164,24 @@ static void reset(struct mp_filter *da)
     ctx->trim_samples = 0;
     ctx->preroll_done = false;
     ctx->next_pts = MP_NOPTS_VALUE;
+    ctx->start_pts = MP_NOPTS_VALUE;
     ctx->eof_returned = false;
+    if (ctx->discarded)
+        MP_VERBOSE(da, "discarded %"PRId64" samples before seek target\n",
+                   ctx->discarded);
+    ctx->discarded = 0;
+}
+
+static int control(struct mp_filter *da, enum dec_ctrl cmd, void *arg)
+{
+    struct priv *ctx = da->priv;
+
+    switch (cmd) {
+    case ADCTRL_SET_START_PTS:
+        ctx->start_pts = *(double *)arg;
+        return CONTROL_TRUE;
+    }
+    return CONTROL_UNKNOWN;
 }
 
 static bool send_packet(struct mp_filter *da, struct demux_packet *mpkt)
@@ -254,10 +276,28 @@ static bool receive_frame(struct mp_filter *da, struct mp_frame *out)
         priv->trim_samples -= trim;
     }
 
-    *out = MAKE_FRAME(MP_FRAME_AUDIO, mpframe);
+    // Discard audio before the hr-seek target here, instead of decoding it
+    // to the end of the filter chain and letting the player skip it.
+    double pts = mp_aframe_get_pts(mpframe);
+    if (priv->start_pts != MP_NOPTS_VALUE && pts != MP_NOPTS_VALUE &&
+        pts < priv->start_pts)
+    {
+        double rate = mp_aframe_get_effective_rate(mpframe);
+        int64_t discard = llrint((priv->start_pts - pts) * rate);
+        discard = MPCLAMP(discard, 0, mp_aframe_get_size(mpframe));
+        mp_aframe_skip_samples(mpframe, discard);
+        priv->discarded += discard;
+    }
 
     av_frame_unref(priv->avframe);
 
+    if (mp_aframe_get_size(mpframe) == 0) {
+        talloc_free(mpframe);
+        return true;
+    }
+
+    *out = MAKE_FRAME(MP_FRAME_AUDIO, mpframe);
+
     return true;
 }
 
@@ -291,6 +331,7 @@ static struct mp_decoder *create(struct mp_filter *parent,
 
     struct priv *priv = da->priv;
     priv->public.f = da;
+    priv->public.control = control;
 
     if (!init(da, codec, decoder)) {
         talloc_free(da);
@@ -75,6 +75,9 @@ struct priv {
     int bytes_queued;
     int bytes_to_slide;
     int8_t *buf_queue;
+    // Current queue data: either buf_queue, or the start of the data in s->in
+    // (if it contained the entire queue, see fill_queue()).
+    int8_t *queue;
     // overlap
     int samples_overlap;
     int samples_standing;
@@ -94,16 +97,27 @@ struct priv {
 
 static bool reinit(struct mp_filter *f);
 
+#define UNROLL_PADDING (4 * 4)
+
 // Return whether it got enough data for filtering.
-static bool fill_queue(struct priv *s)
+static bool fill_queue(struct mp_filter *f)
 {
+    struct priv *s = f->priv;
     int bytes_in = s->in ? mp_aframe_get_size(s->in) * s->bytes_per_frame : 0;
     int offset = 0;
 
+    if (s->queue != s->buf_queue) {
+        // The queued data is still part of s->in, so sliding it away is just
+        // skipping input data (below).
+        s->queue = s->buf_queue;
+        s->bytes_queued = 0;
+    }
+
     if (s->bytes_to_slide > 0) {
         if (s->bytes_to_slide < s->bytes_queued) {
             int bytes_move = s->bytes_queued - s->bytes_to_slide;
             memmove(s->buf_queue, s->buf_queue + s->bytes_to_slide, bytes_move);
+            mp_filter_internal_add_bytes_copied(f, bytes_move);
             s->bytes_to_slide = 0;
             s->bytes_queued = bytes_move;
         } else {
@@ -120,10 +134,20 @@ static bool fill_queue(struct priv *s)
     int bytes_needed = s->bytes_queue - s->bytes_queued;
     assert(bytes_needed >= 0);
 
+    // If the input frame contains the whole queue, use it in place. (The
+    // padding is for the unrolled loop in best_overlap_offset_s16().)
+    if (!s->bytes_queued && bytes_in >= s->bytes_queue + UNROLL_PADDING) {
+        mp_aframe_skip_samples(s->in, offset / s->bytes_per_frame);
+        s->queue = (int8_t *)mp_aframe_get_data_ro(s->in)[0];
+        s->bytes_queued = s->bytes_queue;
+        return true;
+    }
+
     int bytes_copy = MPMIN(bytes_needed, bytes_in);
     if (bytes_copy > 0) {
         uint8_t **planes = mp_aframe_get_data_ro(s->in);
         memcpy(s->buf_queue + s->bytes_queued, planes[0] + offset, bytes_copy);
+        mp_filter_internal_add_bytes_copied(f, bytes_copy);
         s->bytes_queued += bytes_copy;
         offset += bytes_copy;
         bytes_needed -= bytes_copy;
@@ -135,8 +159,6 @@ static bool fill_queue(struct priv *s)
     return bytes_needed == 0;
 }
 
-#define UNROLL_PADDING (4 * 4)
-
 static int best_overlap_offset_float(struct priv *s)
 {
     float best_corr = INT_MIN;
@@ -149,7 +171,7 @@ static int best_overlap_offset_float(struct priv *s)
     for (int i = s->num_channels; i < s->samples_overlap; i++)
         *ppc++ = *pw++ **po++;
 
-    float *search_start = (float *)s->buf_queue + s->num_channels;
+    float *search_start = (float *)s->queue + s->num_channels;
     for (int off = 0; off < s->frames_search; off++) {
         float corr = 0;
         float *ps = search_start;
@@ -178,7 +200,7 @@ static int best_overlap_offset_s16(struct priv *s)
     for (long i = s->num_channels; i < s->samples_overlap; i++)
         *ppc++ = (*pw++ **po++) >> 15;
 
-    int16_t *search_start = (int16_t *)s->buf_queue + s->num_channels;
+    int16_t *search_start = (int16_t *)s->queue + s->num_channels;
     for (int off = 0; off < s->frames_search; off++) {
         int64_t corr = 0;
         int16_t *ps = search_start;
@@ -209,7 +231,7 @@ static void output_overlap_float(struct priv *s, void *buf_out,
     float *pout = buf_out;
     float *pb   = s->table_blend;
     float *po   = s->buf_overlap;
-    float *pin  = (float *)(s->buf_queue + bytes_off);
+    float *pin  = (float *)(s->queue + bytes_off);
     for (int i = 0; i < s->samples_overlap; i++) {
         *pout++ = *po - *pb++ *(*po - *pin++);
         po++;
@@ -222,7 +244,7 @@ static void output_overlap_s16(struct priv *s, void *buf_out,
     int16_t *pout = buf_out;
     int32_t *pb   = s->table_blend;
     int16_t *po   = s->buf_overlap;
-    int16_t *pin  = (int16_t *)(s->buf_queue + bytes_off);
+    int16_t *pin  = (int16_t *)(s->queue + bytes_off);
     for (int i = 0; i < s->samples_overlap; i++) {
         *pout++ = *po - ((*pb++ *(*po - *pin++)) >> 16);
         po++;
@@ -277,7 +299,7 @@ static void process(struct mp_filter *f)
             s->current_pts = mp_aframe_end_pts(s->in);
     }
 
-    if (!fill_queue(s) && !drain) {
+    if (!fill_queue(f) && !drain) {
         TA_FREEP(&s->in);
         mp_pin_out_request_data_next(s->in_pin);
         return;
@@ -311,13 +333,14 @@ static void process(struct mp_filter *f)
             s->output_overlap(s, pout + out_offset, bytes_off);
         }
         memcpy(pout + out_offset + s->bytes_overlap,
-               s->buf_queue + bytes_off + s->bytes_overlap,
+               s->queue + bytes_off + s->bytes_overlap,
                s->bytes_standing);
+        mp_filter_internal_add_bytes_copied(f, s->bytes_standing);
         out_offset += s->bytes_stride;
 
         // input stride
         memcpy(s->buf_overlap,
-               s->buf_queue + bytes_off + s->bytes_stride,
+               s->queue + bytes_off + s->bytes_stride,
                s->bytes_overlap);
         tf = s->frames_stride_scaled + s->frames_stride_error;
         ti = (int)tf;
@@ -326,7 +349,8 @@ static void process(struct mp_filter *f)
     }
     // Drain remaining buffered data.
     if (drain && s->bytes_queued) {
-        memcpy(pout + out_offset, s->buf_queue, s->bytes_queued);
+        memcpy(pout + out_offset, s->queue, s->bytes_queued);
+        mp_filter_internal_add_bytes_copied(f, s->bytes_queued);
         out_offset += s->bytes_queued;
         s->bytes_queued = 0;
     }
@@ -335,9 +359,18 @@ static void process(struct mp_filter *f)
     // This filter can have a negative delay when scale > 1:
     // output corresponding to some length of input can be decided and written
     // after receiving only a part of that input.
+    double in_duration = 0;
+    if (s->in) {
+        in_duration = mp_aframe_duration(s->in);
+        // If the queue is part of s->in, don't count the queued data twice.
+        if (s->queue != s->buf_queue) {
+            in_duration -= (double)s->bytes_queued / s->bytes_per_frame /
+                           mp_aframe_get_effective_rate(s->in);
+        }
+    }
     float delay = (out_offset * s->speed + s->bytes_queued - s->bytes_to_slide) /
                     s->bytes_per_frame / mp_aframe_get_effective_rate(out)
-                  + (s->in ? mp_aframe_duration(s->in) : 0);
+                  + in_duration;
 
     if (s->current_pts != MP_NOPTS_VALUE)
         mp_aframe_set_pts(out, s->current_pts - delay);
@@ -492,6 +525,7 @@ static bool reinit(struct mp_filter *f)
         return false;
     }
 
+    s->queue = s->buf_queue;
     s->bytes_queued = 0;
     s->bytes_to_slide = 0;
 
@@ -539,6 +573,7 @@ static void reset(struct mp_filter *f)
     s->bytes_to_slide = 0;
     s->frames_stride_error = 0;
     memset(s->buf_overlap, 0, s->bytes_overlap);
+    s->queue = s->buf_queue;
     TA_FREEP(&s->in);
 }
 
@@ -579,7 +614,7 @@ static struct mp_filter *af_scaletempo_create(struct mp_filter *parent,
     s->opts = talloc_steal(s, options);
     s->speed = 1.0;
     s->cur_format = talloc_steal(s, mp_aframe_create());
-    s->out_pool = mp_aframe_pool_create(s);
+    s->out_pool = mp_filter_get_aframe_pool(f);
 
     struct mp_autoconvert *conv = mp_autoconvert_create(f);
     if (!conv)
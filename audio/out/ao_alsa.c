@@ -62,6 +62,7 @@ struct ao_alsa_opts {
     int ignore_chmap;
     int buffer_time;
     int frags;
+    int mmap;
 };
 
 #define OPT_BASE_STRUCT struct ao_alsa_opts
@@ -75,6 +76,7 @@ static const struct m_sub_options ao_alsa_conf = {
         OPT_FLAG("alsa-ignore-chmap", ignore_chmap, 0),
         OPT_INTRANGE("alsa-buffer-time", buffer_time, 0, 0, INT_MAX),
         OPT_INTRANGE("alsa-periods", frags, 0, 0, INT_MAX),
+        OPT_FLAG("alsa-mmap", mmap, 0),
         {0}
     },
     .defaults = &(const struct ao_alsa_opts) {
@@ -98,6 +100,8 @@ struct priv {
     double delay_before_pause;
     snd_pcm_uframes_t buffersize;
     snd_pcm_uframes_t outburst;
+    bool mmap;
+    snd_pcm_uframes_t mmap_offset;
 
     snd_output_t *output;
 
@@ -647,6 +651,63 @@ static void uninit(struct ao *ao)
 alsa_error: ;
 }
 
+static int set_access(struct ao *ao, snd_pcm_hw_params_t *params, bool planar)
+{
+    struct priv *p = ao->priv;
+
+    p->mmap = false;
+    if (p->opts->mmap) {
+        snd_pcm_access_t access = planar ? SND_PCM_ACCESS_MMAP_NONINTERLEAVED
+                                         : SND_PCM_ACCESS_MMAP_INTERLEAVED;
+        if (snd_pcm_hw_params_set_access(p->alsa, params, access) >= 0) {
+            p->mmap = true;
+            return 0;
+        }
+        MP_VERBOSE(ao, "mmap access not supported.\n");
+    }
+
+    snd_pcm_access_t access = planar ? SND_PCM_ACCESS_RW_NONINTERLEAVED
+                                     : SND_PCM_ACCESS_RW_INTERLEAVED;
+    return snd_pcm_hw_params_set_access(p->alsa, params, access);
+}
+
+// Whether the mmap areas use exactly the layout of ao->format, so that the
+// push code can write into them directly.
+static bool areas_match_format(struct ao *ao, const snd_pcm_channel_area_t *areas)
+{
+    unsigned int bits = af_fmt_to_bytes(ao->format) * 8;
+    bool planar = af_fmt_is_planar(ao->format);
+    for (int c = 0; c < ao->channels.num; c++) {
+        const snd_pcm_channel_area_t *a = &areas[c];
+        if (planar) {
+            if (a->first != 0 || a->step != bits)
+                return false;
+        } else {
+            if (a->addr != areas[0].addr || a->first != c * bits ||
+                a->step != bits * ao->channels.num)
+                return false;
+        }
+    }
+    return true;
+}
+
+static bool probe_direct_write(struct ao *ao)
+{
+    struct priv *p = ao->priv;
+
+    if (!p->mmap || ao_need_conversion(&p->convert))
+        return false;
+
+    const snd_pcm_channel_area_t *areas;
+    snd_pcm_uframes_t offset, frames = 1;
+    if (snd_pcm_avail_update(p->alsa) < 0 ||
+        snd_pcm_mmap_begin(p->alsa, &areas, &offset, &frames) < 0)
+        return false;
+    bool ok = areas_match_format(ao, areas);
+    snd_pcm_mmap_commit(p->alsa, offset, 0);
+    return ok;
+}
+
 #define INIT_DEVICE_ERR_GENERIC -1
 #define INIT_DEVICE_ERR_HWPARAMS -2
 static int init_device(struct ao *ao, int mode)
@@ -696,14 +757,10 @@ static int init_device(struct ao *ao, int mode)
     }
     dump_hw_params(ao, "HW params after rate:\n", alsa_hwparams);
 
-    snd_pcm_access_t access = af_fmt_is_planar(ao->format)
-                                    ? SND_PCM_ACCESS_RW_NONINTERLEAVED
-                                    : SND_PCM_ACCESS_RW_INTERLEAVED;
-    err = snd_pcm_hw_params_set_access(p->alsa, alsa_hwparams, access);
+    err = set_access(ao, alsa_hwparams, af_fmt_is_planar(ao->format));
     if (err < 0 && af_fmt_is_planar(ao->format)) {
         ao->format = af_fmt_from_planar(ao->format);
-        access = SND_PCM_ACCESS_RW_INTERLEAVED;
-        err = snd_pcm_hw_params_set_access(p->alsa, alsa_hwparams, access);
+        err = set_access(ao, alsa_hwparams, false);
     }
     CHECK_ALSA_ERROR("Unable to set access type");
     dump_hw_params(ao, "HW params after access:\n", alsa_hwparams);
@@ -873,6 +930,12 @@ static int init_device(struct ao *ao, int mode)
 
     p->convert.channels = ao->channels.num;
 
+    ao->direct_write = probe_direct_write(ao);
+    if (p->mmap) {
+        MP_VERBOSE(ao, "using mmap access%s\n",
+                   ao->direct_write ? " (direct write)" : "");
+    }
+
     return 0;
 
 alsa_error:
@@ -1102,6 +1165,35 @@ static void reset(struct ao *ao)
 alsa_error: ;
 }
 
+// Recover from a failed write or mmap operation. Returns false if the error
+// is fatal, true if the operation can be retried.
+static bool recover_write_error(struct ao *ao, int res, int flags)
+{
+    struct priv *p = ao->priv;
+
+    if (res == -EINTR || res == -EAGAIN) /* retry */
+        return true;
+    if (!check_device_present(ao, res))
+        return false;
+
+    if (res == -ESTRPIPE) {  /* suspend */
+        resume_device(ao);
+    } else if (res == -EPIPE) {
+        // For some reason, writing a smaller fragment at the end
+        // immediately underruns.
+        if (!(flags & AOPLAY_FINAL_CHUNK))
+            MP_WARN(ao, "Device underrun detected.\n");
+    } else {
+        MP_ERR(ao, "Write error: %s\n", snd_strerror(res));
+    }
+    int err = snd_pcm_prepare(p->alsa);
+    CHECK_ALSA_ERROR("pcm prepare error");
+    return true;
+
+alsa_error:
+    return false;
+}
+
 static int play(struct ao *ao, void **data, int samples, int flags)
 {
     struct priv *p = ao->priv;
@@ -1115,41 +1207,86 @@ static int play(struct ao *ao, void **data, int samples, int flags)
 
     do {
         if (af_fmt_is_planar(ao->format)) {
-            res = snd_pcm_writen(p->alsa, data, samples);
+            res = p->mmap ? snd_pcm_mmap_writen(p->alsa, data, samples)
+                          : snd_pcm_writen(p->alsa, data, samples);
         } else {
-            res = snd_pcm_writei(p->alsa, data[0], samples);
+            res = p->mmap ? snd_pcm_mmap_writei(p->alsa, data[0], samples)
+                          : snd_pcm_writei(p->alsa, data[0], samples);
         }
 
-        if (res == -EINTR || res == -EAGAIN) { /* retry */
-            res = 0;
-        } else if (!check_device_present(ao, res)) {
-            goto alsa_error;
-        } else if (res < 0) {
-            if (res == -ESTRPIPE) {  /* suspend */
-                resume_device(ao);
-            } else if (res == -EPIPE) {
-                // For some reason, writing a smaller fragment at the end
-                // immediately underruns.
-                if (!(flags & AOPLAY_FINAL_CHUNK))
-                    MP_WARN(ao, "Device underrun detected.\n");
-            } else {
-                MP_ERR(ao, "Write error: %s\n", snd_strerror(res));
-            }
-            res = snd_pcm_prepare(p->alsa);
-            int err = res;
-            CHECK_ALSA_ERROR("pcm prepare error");
+        if (res < 0) {
+            if (!recover_write_error(ao, res, flags))
+                return -1;
             res = 0;
         }
     } while (res == 0);
 
     p->paused = false;
 
-    return res < 0 ? -1 : res;
+    return res;
+}
 
-alsa_error:
+// Number of times begin_write() tries to recover from errors before giving up.
+#define MAX_BEGIN_WRITE_RETRIES 5
+
+static int begin_write(struct ao *ao, void **planes, int *samples)
+{
+    struct priv *p = ao->priv;
+
+    for (int retry = 0; retry <= MAX_BEGIN_WRITE_RETRIES; retry++) {
+        int err = snd_pcm_avail_update(p->alsa);
+        if (err >= 0) {
+            const snd_pcm_channel_area_t *areas;
+            snd_pcm_uframes_t frames = MPMIN(*samples, err);
+            err = snd_pcm_mmap_begin(p->alsa, &areas, &p->mmap_offset, &frames);
+            if (err >= 0) {
+                if (!areas_match_format(ao, areas)) {
+                    MP_ERR(ao, "Unexpected mmap area layout.\n");
+                    snd_pcm_mmap_commit(p->alsa, p->mmap_offset, 0);
+                    return -1;
+                }
+                int num_planes = af_fmt_is_planar(ao->format)
+                                 ? ao->channels.num : 1;
+                for (int n = 0; n < num_planes; n++) {
+                    const snd_pcm_channel_area_t *a = &areas[n];
+                    planes[n] = (char *)a->addr +
+                                (a->first + p->mmap_offset * a->step) / 8;
+                }
+                *samples = frames;
+                return 0;
+            }
+        }
+        if (!recover_write_error(ao, err, 0))
+            return -1;
+    }
+    MP_ERR(ao, "Giving up after repeated mmap errors.\n");
     return -1;
 }
 
+static int end_write(struct ao *ao, int samples, int flags)
+{
+    struct priv *p = ao->priv;
+
+    snd_pcm_sframes_t res = snd_pcm_mmap_commit(p->alsa, p->mmap_offset, samples);
+    if (res < 0)
+        return recover_write_error(ao, res, flags) ? 0 : -1;
+
+    // Unlike the write functions, committing doesn't start the device.
+    if (snd_pcm_state(p->alsa) == SND_PCM_STATE_PREPARED) {
+        snd_pcm_sframes_t avail = snd_pcm_avail_update(p->alsa);
+        if ((flags & AOPLAY_FINAL_CHUNK) ||
+            (avail >= 0 && (snd_pcm_sframes_t)(p->buffersize - p->outburst) >= avail))
+        {
+            int err = snd_pcm_start(p->alsa);
+            CHECK_ALSA_WARN("pcm start error");
+        }
+    }
+
+    p->paused = false;
+
+    return res;
+}
+
 #define MAX_POLL_FDS 20
 static int audio_wait(struct ao *ao, pthread_mutex_t *lock)
 {
@@ -1242,6 +1379,8 @@ const struct ao_driver audio_out_alsa = {
     .control   = control,
     .get_space = get_space,
     .play      = play,
+    .begin_write = begin_write,
+    .end_write = end_write,
     .get_delay = get_delay,
     .pause     = audio_pause,
     .resume    = audio_resume,
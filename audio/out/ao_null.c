@@ -59,6 +59,9 @@ struct priv {
 
     struct m_channels channel_layouts;
     int format;
+
+    double start_time;
+    int64_t played;     // samples
 };
 
 static void drain(struct ao *ao)
@@ -111,6 +114,7 @@ static int init(struct ao *ao)
     priv->buffersize = priv->outburst * bursts + priv->latency;
 
     priv->last_time = mp_time_sec();
+    priv->start_time = priv->last_time;
 
     ao->period_size = priv->outburst;
 
@@ -120,6 +124,14 @@ static int init(struct ao *ao)
 // close audio device
 static void uninit(struct ao *ao)
 {
+    struct priv *priv = ao->priv;
+
+    if (ao->untimed && priv->played) {
+        double time = mp_time_sec() - priv->start_time;
+        double secs = priv->played / (double)ao->samplerate;
+        MP_VERBOSE(ao, "Played %.1f s of audio in %.3f s: %.1fx realtime\n",
+                   secs, time, secs / MPMAX(time, 1e-9));
+    }
 }
 
 static void wait_drain(struct ao *ao)
@@ -187,6 +199,7 @@ static int play(struct ao *ao, void **data, int samples, int flags)
         accepted = bursts * priv->outburst;
     }
     priv->buffered += accepted;
+    priv->played += accepted;
     return accepted;
 }
 
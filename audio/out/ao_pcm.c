@@ -21,9 +21,15 @@
 
 #include "config.h"
 
+#include <assert.h>
+#include <limits.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <pthread.h>
 
 #include <libavutil/common.h>
 
@@ -33,8 +39,12 @@
 #include "audio/format.h"
 #include "ao.h"
 #include "internal.h"
+#include "common/common.h"
 #include "common/msg.h"
 #include "osdep/endian.h"
+#include "osdep/io.h"
+#include "osdep/threads.h"
+#include "osdep/timer.h"
 
 #ifdef __MINGW32__
 // for GetFileType to detect pipes
@@ -42,69 +52,308 @@
 #include <io.h>
 #endif
 
+// The output is written in blocks of this size by a separate thread. The
+// size is a multiple of the alignment required for O_DIRECT.
+#define BLOCK_SIZE (1 << 20)
+#define NUM_BLOCKS 8
+#define BLOCK_ALIGN 4096
+
+#define HEADER_MAX 128
+
+enum {
+    WAVE_AUTO,
+    WAVE_RF64,
+    WAVE_W64,
+};
+
+struct block {
+    uint8_t *data;
+    int size;
+};
+
 struct priv {
     char *outputfilename;
     int waveheader;
     int append;
+    int wave_format;
+    int direct_io;
     uint64_t data_length;
-    FILE *fp;
+    int fd;
+    int64_t header_pos;
+    bool direct;
+    double start_time;
+
+    pthread_t thread;
+    pthread_mutex_t lock;
+    pthread_cond_t wakeup;
+
+    // --- protected by lock
+    struct block blocks[NUM_BLOCKS];
+    int first_full;     // index of the oldest block queued for writing
+    int num_full;       // number of blocks queued for writing
+    bool terminate;
+    bool need_wakeup;   // for audio_wait()
+    uint64_t written;   // bytes written to the file
+
+    // --- owned by the AO thread
+    int fill_pos;       // bytes in the block after the last queued block
 };
 
 #define WAV_ID_RIFF 0x46464952 /* "RIFF" */
+#define WAV_ID_RF64 0x34364652 /* "RF64" */
 #define WAV_ID_WAVE 0x45564157 /* "WAVE" */
+#define WAV_ID_JUNK 0x4b4e554a /* "JUNK" */
+#define WAV_ID_DS64 0x34367364 /* "ds64" */
 #define WAV_ID_FMT  0x20746d66 /* "fmt " */
 #define WAV_ID_DATA 0x61746164 /* "data" */
 #define WAV_ID_PCM  0x0001
 #define WAV_ID_FLOAT_PCM  0x0003
 #define WAV_ID_FORMAT_EXTENSIBLE 0xfffe
 
-static void fput16le(uint16_t val, FILE *fp)
+// Sony Wave64 GUIDs; the first 4 bytes are the RIFF FourCC.
+static const uint8_t w64_guid_riff[16] = {'r', 'i', 'f', 'f',
+    0x2E, 0x91, 0xCF, 0x11, 0xA5, 0xD6, 0x28, 0xDB, 0x04, 0xC1, 0x00, 0x00};
+static const uint8_t w64_guid_suffix[12] = {
+    0xF3, 0xAC, 0xD3, 0x11, 0x8C, 0xD1, 0x00, 0xC0, 0x4F, 0x8E, 0xDB, 0x8A};
+
+struct header {
+    uint8_t data[HEADER_MAX];
+    int size;
+};
+
+static void put16le(struct header *h, uint16_t val)
+{
+    assert(h->size + 2 <= HEADER_MAX);
+    h->data[h->size++] = val;
+    h->data[h->size++] = val >> 8;
+}
+
+static void put32le(struct header *h, uint32_t val)
 {
-    uint8_t bytes[2] = {val, val >> 8};
-    fwrite(bytes, 1, 2, fp);
+    put16le(h, val);
+    put16le(h, val >> 16);
 }
 
-static void fput32le(uint32_t val, FILE *fp)
+static void put64le(struct header *h, uint64_t val)
 {
-    uint8_t bytes[4] = {val, val >> 8, val >> 16, val >> 24};
-    fwrite(bytes, 1, 4, fp);
+    put32le(h, val);
+    put32le(h, val >> 32);
 }
 
-static void write_wave_header(struct ao *ao, FILE *fp, uint64_t data_length)
+static void put_w64_guid(struct header *h, const char *fourcc)
+{
+    assert(h->size + 16 <= HEADER_MAX);
+    memcpy(h->data + h->size, fourcc, 4);
+    memcpy(h->data + h->size + 4, w64_guid_suffix, 12);
+    h->size += 16;
+}
+
+// WAVEFORMATEXTENSIBLE, 40 bytes.
+static void put_wave_format(struct ao *ao, struct header *h)
 {
     uint16_t fmt = ao->format == AF_FORMAT_FLOAT ? WAV_ID_FLOAT_PCM : WAV_ID_PCM;
     int bits = af_fmt_to_bytes(ao->format) * 8;
 
-    // Master RIFF chunk
-    fput32le(WAV_ID_RIFF, fp);
-    // RIFF chunk size: 'WAVE' + 'fmt ' + 4 + 40 +
-    // data chunk hdr (8) + data length
-    fput32le(12 + 40 + 8 + data_length, fp);
-    fput32le(WAV_ID_WAVE, fp);
-
-    // Format chunk
-    fput32le(WAV_ID_FMT, fp);
-    fput32le(40, fp);
-    fput16le(WAV_ID_FORMAT_EXTENSIBLE, fp);
-    fput16le(ao->channels.num, fp);
-    fput32le(ao->samplerate, fp);
-    fput32le(ao->bps, fp);
-    fput16le(ao->channels.num * (bits / 8), fp);
-    fput16le(bits, fp);
+    put16le(h, WAV_ID_FORMAT_EXTENSIBLE);
+    put16le(h, ao->channels.num);
+    put32le(h, ao->samplerate);
+    put32le(h, ao->bps);
+    put16le(h, ao->channels.num * (bits / 8));
+    put16le(h, bits);
 
     // Extension chunk
-    fput16le(22, fp);
-    fput16le(bits, fp);
-    fput32le(mp_chmap_to_waveext(&ao->channels), fp);
+    put16le(h, 22);
+    put16le(h, bits);
+    put32le(h, mp_chmap_to_waveext(&ao->channels));
     // 2 bytes format + 14 bytes guid
-    fput32le(fmt, fp);
-    fput32le(0x00100000, fp);
-    fput32le(0xAA000080, fp);
-    fput32le(0x719B3800, fp);
+    put32le(h, fmt);
+    put32le(h, 0x00100000);
+    put32le(h, 0xAA000080);
+    put32le(h, 0x719B3800);
+}
+
+// Build the file header. With WAVE_AUTO, a normal RIFF header is written if
+// the sizes fit into it, and the header is upgraded to RF64 otherwise. The
+// space for the ds64 chunk is reserved with a JUNK chunk.
+static void write_wave_header(struct ao *ao, struct header *h,
+                              uint64_t data_length)
+{
+    struct priv *priv = ao->priv;
+    h->size = 0;
+
+    if (priv->wave_format == WAVE_W64) {
+        uint64_t header_size = 40 + 24 + 40 + 24;
+        memcpy(h->data, w64_guid_riff, 16);
+        h->size = 16;
+        put64le(h, header_size + data_length);
+        put_w64_guid(h, "wave");
+
+        put_w64_guid(h, "fmt ");
+        put64le(h, 24 + 40);
+        put_wave_format(ao, h);
+
+        put_w64_guid(h, "data");
+        put64le(h, 24 + data_length);
+        return;
+    }
+
+    // Master RIFF chunk size: 'WAVE' + ds64 chunk (8 + 28) + fmt chunk
+    // (8 + 40) + data chunk hdr (8) + data length
+    uint64_t riff_size = 4 + 36 + 48 + 8 + data_length;
+    bool rf64 = priv->wave_format == WAVE_RF64 || riff_size > UINT32_MAX;
+
+    put32le(h, rf64 ? WAV_ID_RF64 : WAV_ID_RIFF);
+    put32le(h, rf64 ? UINT32_MAX : riff_size);
+    put32le(h, WAV_ID_WAVE);
+
+    put32le(h, rf64 ? WAV_ID_DS64 : WAV_ID_JUNK);
+    put32le(h, 28);
+    put64le(h, rf64 ? riff_size : 0);
+    put64le(h, rf64 ? data_length : 0);
+    int sstride = ao->channels.num * af_fmt_to_bytes(ao->format);
+    put64le(h, rf64 ? data_length / sstride : 0);
+    put32le(h, 0); // table length
+
+    put32le(h, WAV_ID_FMT);
+    put32le(h, 40);
+    put_wave_format(ao, h);
+
+    put32le(h, WAV_ID_DATA);
+    put32le(h, rf64 ? UINT32_MAX : data_length);
+}
+
+static bool write_all(int fd, uint8_t *data, int size)
+{
+    while (size > 0) {
+        ssize_t r = write(fd, data, size);
+        if (r < 0 && errno == EINTR)
+            continue;
+        if (r <= 0)
+            return false;
+        data += r;
+        size -= r;
+    }
+    return true;
+}
+
+static void *writer_thread(void *arg)
+{
+    struct ao *ao = arg;
+    struct priv *priv = ao->priv;
+    bool failed = false;
+
+    mpthread_set_name("ao/pcm");
+
+    mp_mutex_lock(&priv->lock);
+    while (1) {
+        if (!priv->num_full) {
+            if (priv->terminate)
+                break;
+            mp_cond_wait(&priv->wakeup, &priv->lock);
+            continue;
+        }
+        struct block *b = &priv->blocks[priv->first_full];
+        mp_mutex_unlock(&priv->lock);
+
+#ifdef O_DIRECT
+        // Only the final block can be unaligned.
+        if (priv->direct && b->size % BLOCK_ALIGN) {
+            fcntl(priv->fd, F_SETFL, fcntl(priv->fd, F_GETFL) & ~O_DIRECT);
+            priv->direct = false;
+        }
+#endif
+        if (!failed && !write_all(priv->fd, b->data, b->size)) {
+            MP_ERR(ao, "Error writing to %s: %s\n", priv->outputfilename,
+                   mp_strerror(errno));
+            failed = true;
+        }
 
-    // Data chunk
-    fput32le(WAV_ID_DATA, fp);
-    fput32le(data_length, fp);
+        mp_mutex_lock(&priv->lock);
+        priv->written += b->size;
+        priv->first_full = (priv->first_full + 1) % NUM_BLOCKS;
+        priv->num_full -= 1;
+        priv->need_wakeup = true;
+        pthread_cond_broadcast(&priv->wakeup);
+    }
+    mp_mutex_unlock(&priv->lock);
+    return NULL;
+}
+
+// Hand the partially filled block to the writer thread.
+static void queue_block(struct priv *priv)
+{
+    mp_mutex_lock(&priv->lock);
+    assert(priv->num_full < NUM_BLOCKS);
+    int index = (priv->first_full + priv->num_full) % NUM_BLOCKS;
+    priv->blocks[index].size = priv->fill_pos;
+    priv->num_full += 1;
+    priv->fill_pos = 0;
+    pthread_cond_broadcast(&priv->wakeup);
+    mp_mutex_unlock(&priv->lock);
+}
+
+// Copy data into the blocks, and queue them for writing when full. The caller
+// must make sure there's enough space.
+static void write_data(struct priv *priv, uint8_t *data, int size)
+{
+    while (size > 0) {
+        mp_mutex_lock(&priv->lock);
+        int index = (priv->first_full + priv->num_full) % NUM_BLOCKS;
+        mp_mutex_unlock(&priv->lock);
+        int copy = MPMIN(size, BLOCK_SIZE - priv->fill_pos);
+        memcpy(priv->blocks[index].data + priv->fill_pos, data, copy);
+        priv->fill_pos += copy;
+        data += copy;
+        size -= copy;
+        if (priv->fill_pos == BLOCK_SIZE)
+            queue_block(priv);
+    }
+}
+
+// Free buffer space in bytes.
+static int64_t get_free_bytes(struct priv *priv)
+{
+    mp_mutex_lock(&priv->lock);
+    int64_t space = (NUM_BLOCKS - priv->num_full) * (int64_t)BLOCK_SIZE;
+    mp_mutex_unlock(&priv->lock);
+    return MPMAX(space - priv->fill_pos, 0);
+}
+
+static int open_output(struct ao *ao)
+{
+    struct priv *priv = ao->priv;
+
+    int flags = O_WRONLY | O_CREAT | O_BINARY | O_CLOEXEC;
+    if (!priv->append)
+        flags |= O_TRUNC;
+    priv->fd = open(priv->outputfilename, flags, 0666);
+    if (priv->fd < 0)
+        return -1;
+
+    priv->header_pos = 0;
+    if (priv->append) {
+        priv->header_pos = lseek(priv->fd, 0, SEEK_END);
+        if (priv->header_pos < 0)
+            priv->header_pos = 0;
+    }
+
+    if (priv->direct_io) {
+#ifdef O_DIRECT
+        if (priv->header_pos % BLOCK_ALIGN) {
+            MP_WARN(ao, "Appending at unaligned position, not using O_DIRECT.\n");
+        } else if (fcntl(priv->fd, F_SETFL,
+                         fcntl(priv->fd, F_GETFL) | O_DIRECT) < 0)
+        {
+            MP_WARN(ao, "Could not enable O_DIRECT: %s\n", mp_strerror(errno));
+        } else {
+            priv->direct = true;
+        }
+#else
+        MP_WARN(ao, "O_DIRECT is not supported on this platform.\n");
+#endif
+    }
+
+    return 0;
 }
 
 static int init(struct ao *ao)
@@ -152,60 +401,149 @@ static int init(struct ao *ao)
             priv->waveheader ? "WAVE" : "RAW PCM", ao->samplerate,
             ao->channels.num, af_fmt_to_str(ao->format));
 
-    priv->fp = fopen(priv->outputfilename, priv->append ? "ab" : "wb");
-    if (!priv->fp) {
+    if (open_output(ao) < 0) {
         MP_ERR(ao, "Failed to open %s for writing!\n", priv->outputfilename);
         return -1;
     }
-    if (priv->waveheader)  // Reserve space for wave header
-        write_wave_header(ao, priv->fp, 0x7ffff000);
+
+    for (int n = 0; n < NUM_BLOCKS; n++) {
+        uint8_t *mem = talloc_size(priv, BLOCK_SIZE + BLOCK_ALIGN);
+        priv->blocks[n].data = (uint8_t *)MP_ALIGN_UP((uintptr_t)mem, BLOCK_ALIGN);
+    }
+
+    pthread_mutex_init(&priv->lock, NULL);
+    pthread_cond_init(&priv->wakeup, NULL);
+    if (pthread_create(&priv->thread, NULL, writer_thread, ao)) {
+        pthread_cond_destroy(&priv->wakeup);
+        pthread_mutex_destroy(&priv->lock);
+        close(priv->fd);
+        return -1;
+    }
+
+    if (priv->waveheader) { // Reserve space for wave header
+        struct header h;
+        write_wave_header(ao, &h, 0x7ffff000);
+        write_data(priv, h.data, h.size);
+    }
     ao->untimed = true;
+    priv->start_time = mp_time_sec();
 
     return 0;
 }
 
+// Wait until all queued blocks have been written.
+static void flush(struct priv *priv)
+{
+    if (priv->fill_pos)
+        queue_block(priv);
+    mp_mutex_lock(&priv->lock);
+    while (priv->num_full)
+        mp_cond_wait(&priv->wakeup, &priv->lock);
+    mp_mutex_unlock(&priv->lock);
+}
+
 // close audio device
 static void uninit(struct ao *ao)
 {
     struct priv *priv = ao->priv;
 
+    flush(priv);
+    mp_mutex_lock(&priv->lock);
+    priv->terminate = true;
+    pthread_cond_broadcast(&priv->wakeup);
+    mp_mutex_unlock(&priv->lock);
+    pthread_join(priv->thread, NULL);
+
+    double time = mp_time_sec() - priv->start_time;
+    double secs = priv->data_length / (double)ao->bps;
+    MP_VERBOSE(ao, "Wrote %.1f MiB (%.1f s of audio) in %.3f s: %.1f MiB/s, "
+               "%.1fx realtime\n", priv->written / (1024.0 * 1024.0), secs, time,
+               priv->written / (1024.0 * 1024.0) / MPMAX(time, 1e-9),
+               secs / MPMAX(time, 1e-9));
+
+#ifdef O_DIRECT
+    if (priv->direct)
+        fcntl(priv->fd, F_SETFL, fcntl(priv->fd, F_GETFL) & ~O_DIRECT);
+#endif
+
     if (priv->waveheader) {    // Rewrite wave header
         bool broken_seek = false;
 #ifdef __MINGW32__
         // Windows, in its usual idiocy "emulates" seeks on pipes so it always
         // looks like they work. So we have to detect them brute-force.
         broken_seek = FILE_TYPE_DISK !=
-            GetFileType((HANDLE)_get_osfhandle(_fileno(priv->fp)));
+            GetFileType((HANDLE)_get_osfhandle(priv->fd));
 #endif
-        if (broken_seek || fseek(priv->fp, 0, SEEK_SET) != 0)
+        if (broken_seek || lseek(priv->fd, priv->header_pos, SEEK_SET) < 0) {
             MP_ERR(ao, "Could not seek to start, WAV size headers not updated!\n");
-        else {
-            if (priv->data_length > 0xfffff000) {
-                MP_ERR(ao, "File larger than allowed for "
-                       "WAV files, may play truncated!\n");
-                priv->data_length = 0xfffff000;
-            }
-            write_wave_header(ao, priv->fp, priv->data_length);
+        } else {
+            struct header h;
+            write_wave_header(ao, &h, priv->data_length);
+            if (priv->wave_format == WAVE_AUTO && !memcmp(h.data, "RF64", 4))
+                MP_VERBOSE(ao, "Output larger than 4 GiB, using RF64 header.\n");
+            if (!write_all(priv->fd, h.data, h.size))
+                MP_ERR(ao, "Could not update WAV header!\n");
         }
     }
-    fclose(priv->fp);
+    close(priv->fd);
+    pthread_cond_destroy(&priv->wakeup);
+    pthread_mutex_destroy(&priv->lock);
 }
 
 static int get_space(struct ao *ao)
 {
-    return 65536;
+    struct priv *priv = ao->priv;
+    return MPMIN(get_free_bytes(priv) / ao->sstride, INT_MAX);
 }
 
 static int play(struct ao *ao, void **data, int samples, int flags)
 {
     struct priv *priv = ao->priv;
+    samples = MPMIN(samples, get_space(ao));
     int len = samples * ao->sstride;
 
-    fwrite(data[0], len, 1, priv->fp);
+    write_data(priv, data[0], len);
     priv->data_length += len;
     return samples;
 }
 
+// Audio not written to the file yet.
+static double get_delay(struct ao *ao)
+{
+    struct priv *priv = ao->priv;
+    int64_t buffered = NUM_BLOCKS * (int64_t)BLOCK_SIZE - get_free_bytes(priv);
+    return buffered / (double)ao->bps;
+}
+
+static void drain(struct ao *ao)
+{
+    flush(ao->priv);
+}
+
+static int audio_wait(struct ao *ao, pthread_mutex_t *lock)
+{
+    struct priv *priv = ao->priv;
+
+    mp_mutex_lock(&priv->lock);
+    mp_mutex_unlock(lock);
+    while (!priv->need_wakeup)
+        mp_cond_wait(&priv->wakeup, &priv->lock);
+    priv->need_wakeup = false;
+    mp_mutex_unlock(&priv->lock);
+    mp_mutex_lock(lock);
+    return 0;
+}
+
+static void wakeup(struct ao *ao)
+{
+    struct priv *priv = ao->priv;
+
+    mp_mutex_lock(&priv->lock);
+    priv->need_wakeup = true;
+    pthread_cond_broadcast(&priv->wakeup);
+    mp_mutex_unlock(&priv->lock);
+}
+
 #define OPT_BASE_STRUCT struct priv
 
 const struct ao_driver audio_out_pcm = {
@@ -215,12 +553,21 @@ const struct ao_driver audio_out_pcm = {
     .uninit    = uninit,
     .get_space = get_space,
     .play      = play,
+    .get_delay = get_delay,
+    .drain     = drain,
+    .wait      = audio_wait,
+    .wakeup    = wakeup,
     .priv_size = sizeof(struct priv),
     .priv_defaults = &(const struct priv) { .waveheader = 1 },
     .options = (const struct m_option[]) {
         OPT_STRING("file", outputfilename, M_OPT_FILE),
         OPT_FLAG("waveheader", waveheader, 0),
         OPT_FLAG("append", append, 0),
+        OPT_CHOICE("wave-format", wave_format, 0,
+                   ({"auto", WAVE_AUTO},
+                    {"rf64", WAVE_RF64},
+                    {"w64", WAVE_W64})),
+        OPT_FLAG("direct-io", direct_io, 0),
         {0}
     },
     .options_prefix = "ao-pcm",
@@ -56,6 +56,10 @@ struct ao {
     // Used for push based API only.
     int period_size;
 
+    // Set by the driver on init if begin_write/end_write can be used instead
+    // of play(). Used for push based API only.
+    bool direct_write;
+
     // The device as selected by the user, usually using ao_device_desc.name
     // from an entry from the list returned by driver->list_devices. If the
     // default device should be used, this is set to NULL.
@@ -110,6 +114,7 @@ extern const struct ao_driver ao_api_pull;
  *          drain
  *          wait
  *          wakeup
+ *          begin_write/end_write (if ao->direct_write is set)
  *  b) ->play must be NULL. ->resume must be provided, and should make the
  *     audio API start calling the audio callback. Your audio callback should
  *     in turn call ao_read_data() to get audio data. Most functions are
@@ -153,6 +158,16 @@ struct ao_driver {
     int (*get_space)(struct ao *ao);
     // push based: see ao_play()
     int (*play)(struct ao *ao, void **data, int samples, int flags);
+    // push based: optional alternative to play(), used if ao->direct_write is
+    // set. Map at most *samples samples of the device buffer, and return
+    // pointers to them in planes (one pointer per plane, in ao->format
+    // layout). *samples is set to the number of mapped samples, which can be
+    // less than requested (e.g. on buffer wraparound). Returns <0 on error.
+    int (*begin_write)(struct ao *ao, void **planes, int *samples);
+    // Queue the given number of samples previously mapped with begin_write().
+    // flags and the return value are as with play(). 0 is returned if the
+    // data was lost due to error recovery, and has to be written again.
+    int (*end_write)(struct ao *ao, int samples, int flags);
     // push based: see ao_get_delay()
     double (*get_delay)(struct ao *ao);
     // push based: block until all queued audio is played (optional)
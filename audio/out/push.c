@@ -16,6 +16,7 @@
  */
 
 #include <stddef.h>
+#include <string.h>
 #include <pthread.h>
 #include <inttypes.h>
 #include <unistd.h>
@@ -80,9 +81,9 @@ static int control(struct ao *ao, enum aocontrol cmd, void *arg)
     int r = CONTROL_UNKNOWN;
     if (ao->driver->control) {
         struct ao_push_state *p = ao->api_priv;
-        pthread_mutex_lock(&p->lock);
+        mp_mutex_lock(&p->lock);
         r = ao->driver->control(ao, cmd, arg);
-        pthread_mutex_unlock(&p->lock);
+        mp_mutex_unlock(&p->lock);
     }
     return r;
 }
@@ -99,16 +100,16 @@ static double unlocked_get_delay(struct ao *ao)
 static double get_delay(struct ao *ao)
 {
     struct ao_push_state *p = ao->api_priv;
-    pthread_mutex_lock(&p->lock);
+    mp_mutex_lock(&p->lock);
     double delay = unlocked_get_delay(ao);
-    pthread_mutex_unlock(&p->lock);
+    mp_mutex_unlock(&p->lock);
     return delay;
 }
 
 static void reset(struct ao *ao)
 {
     struct ao_push_state *p = ao->api_priv;
-    pthread_mutex_lock(&p->lock);
+    mp_mutex_lock(&p->lock);
     if (ao->driver->reset)
         ao->driver->reset(ao);
     mp_audio_buffer_clear(p->buffer);
@@ -116,30 +117,30 @@ static void reset(struct ao *ao)
     if (p->still_playing)
         wakeup_playthread(ao);
     p->still_playing = false;
-    pthread_mutex_unlock(&p->lock);
+    mp_mutex_unlock(&p->lock);
 }
 
 static void audio_pause(struct ao *ao)
 {
     struct ao_push_state *p = ao->api_priv;
-    pthread_mutex_lock(&p->lock);
+    mp_mutex_lock(&p->lock);
     if (ao->driver->pause)
         ao->driver->pause(ao);
     p->paused = true;
     wakeup_playthread(ao);
-    pthread_mutex_unlock(&p->lock);
+    mp_mutex_unlock(&p->lock);
 }
 
 static void resume(struct ao *ao)
 {
     struct ao_push_state *p = ao->api_priv;
-    pthread_mutex_lock(&p->lock);
+    mp_mutex_lock(&p->lock);
     if (ao->driver->resume)
         ao->driver->resume(ao);
     p->paused = false;
     p->expected_end_time = 0;
     wakeup_playthread(ao);
-    pthread_mutex_unlock(&p->lock);
+    mp_mutex_unlock(&p->lock);
 }
 
 static void drain(struct ao *ao)
@@ -149,7 +150,7 @@ static void drain(struct ao *ao)
 
     MP_VERBOSE(ao, "draining...\n");
 
-    pthread_mutex_lock(&p->lock);
+    mp_mutex_lock(&p->lock);
     if (p->paused)
         goto done;
 
@@ -161,7 +162,7 @@ static void drain(struct ao *ao)
     // an upper bound timeout.
     struct timespec until = mp_rel_time_to_timespec(maxbuffer);
     while (p->still_playing && mp_audio_buffer_samples(p->buffer) > 0) {
-        if (pthread_cond_timedwait(&p->wakeup, &p->lock, &until)) {
+        if (mp_cond_timedwait(&p->wakeup, &p->lock, &until)) {
             MP_WARN(ao, "Draining is taking too long, aborting.\n");
             goto done;
         }
@@ -175,7 +176,7 @@ static void drain(struct ao *ao)
     }
 
 done:
-    pthread_mutex_unlock(&p->lock);
+    mp_mutex_unlock(&p->lock);
 
     reset(ao);
 }
@@ -208,18 +209,18 @@ static int unlocked_get_space(struct ao *ao)
 static int get_space(struct ao *ao)
 {
     struct ao_push_state *p = ao->api_priv;
-    pthread_mutex_lock(&p->lock);
+    mp_mutex_lock(&p->lock);
     int space = unlocked_get_space(ao);
-    pthread_mutex_unlock(&p->lock);
+    mp_mutex_unlock(&p->lock);
     return space;
 }
 
 static bool get_eof(struct ao *ao)
 {
     struct ao_push_state *p = ao->api_priv;
-    pthread_mutex_lock(&p->lock);
+    mp_mutex_lock(&p->lock);
     bool eof = !p->still_playing;
-    pthread_mutex_unlock(&p->lock);
+    mp_mutex_unlock(&p->lock);
     return eof;
 }
 
@@ -227,7 +228,7 @@ static int play(struct ao *ao, void **data, int samples, int flags)
 {
     struct ao_push_state *p = ao->api_priv;
 
-    pthread_mutex_lock(&p->lock);
+    mp_mutex_lock(&p->lock);
 
     int write_samples = mp_audio_buffer_get_write_available(p->buffer);
     write_samples = MPMIN(write_samples, samples);
@@ -252,7 +253,7 @@ static int play(struct ao *ao, void **data, int samples, int flags)
         // will send new data as soon as it's available.
         wakeup_playthread(ao);
     }
-    pthread_mutex_unlock(&p->lock);
+    mp_mutex_unlock(&p->lock);
     return write_samples;
 }
 
@@ -278,6 +279,41 @@ static bool realloc_silence(struct ao *ao, int samples)
     return true;
 }
 
+// Write the audio directly into the device buffer, and apply the gain there.
+// If planes is NULL, write silence. Returns the number of samples written.
+static int play_direct(struct ao *ao, uint8_t **planes, int samples, int flags)
+{
+    bool planar = af_fmt_is_planar(ao->format);
+    int num_planes = planar ? ao->channels.num : 1;
+    int sstride = af_fmt_to_bytes(ao->format) * (planar ? 1 : ao->channels.num);
+    int written = 0;
+    while (written < samples) {
+        void *dst[MP_NUM_CHANNELS];
+        int num = samples - written;
+        if (ao->driver->begin_write(ao, dst, &num) < 0)
+            return written ? written : -1;
+        if (num <= 0)
+            break;
+        for (int n = 0; n < num_planes; n++) {
+            if (planes) {
+                memcpy(dst[n], planes[n] + written * sstride, num * sstride);
+            } else {
+                af_fill_silence(dst[n], num * sstride, ao->format);
+            }
+        }
+        if (planes)
+            ao_post_process_data(ao, dst, num);
+        bool last = written + num == samples;
+        int r = ao->driver->end_write(ao, num, last ? flags : 0);
+        if (r < 0)
+            return written ? written : -1;
+        written += r;
+        if (r > 0 && r < num)
+            break;
+    }
+    return written;
+}
+
 // called locked
 static void ao_play_data(struct ao *ao)
 {
@@ -291,7 +327,11 @@ static void ao_play_data(struct ao *ao)
     int samples;
     if (play_silence) {
         planes = p->silence;
-        samples = realloc_silence(ao, space) ? space : 0;
+        if (ao->direct_write) {
+            samples = af_fmt_is_pcm(ao->format) ? space : 0;
+        } else {
+            samples = realloc_silence(ao, space) ? space : 0;
+        }
     } else {
         mp_audio_buffer_peek(p->buffer, &planes, &samples);
     }
@@ -305,10 +345,13 @@ static void ao_play_data(struct ao *ao)
         samples = samples / ao->period_size * ao->period_size;
     }
     MP_STATS(ao, "start ao fill");
-    ao_post_process_data(ao, (void **)planes, samples);
     int r = 0;
-    if (samples)
+    if (samples && ao->direct_write) {
+        r = play_direct(ao, play_silence ? NULL : planes, samples, flags);
+    } else if (samples) {
+        ao_post_process_data(ao, (void **)planes, samples);
         r = ao->driver->play(ao, (void **)planes, samples, flags);
+    }
     MP_STATS(ao, "end ao fill");
     if (r > samples) {
         MP_ERR(ao, "Audio device returned nonsense value.\n");
@@ -356,7 +399,7 @@ static void *playthread(void *arg)
     struct ao *ao = arg;
     struct ao_push_state *p = ao->api_priv;
     mpthread_set_name("ao");
-    pthread_mutex_lock(&p->lock);
+    mp_mutex_lock(&p->lock);
     while (!p->terminate) {
         bool blocked = ao->driver->initially_blocked && !p->initial_unblocked;
         bool playing = (!p->paused || ao->stream_silence) && !blocked;
@@ -395,9 +438,9 @@ static void *playthread(void *arg)
 
                 if (p->still_playing && timeout > 0) {
                     struct timespec ts = mp_rel_time_to_timespec(timeout);
-                    pthread_cond_timedwait(&p->wakeup, &p->lock, &ts);
+                    mp_cond_timedwait(&p->wakeup, &p->lock, &ts);
                 } else {
-                    pthread_cond_wait(&p->wakeup, &p->lock);
+                    mp_cond_wait(&p->wakeup, &p->lock);
                 }
             } else {
                 // Wait until the device wants us to write more data to it.
@@ -409,7 +452,7 @@ static void *playthread(void *arg)
                     timeout *= 0.25; // wake up if 25% played
                     if (!p->need_wakeup) {
                         struct timespec ts = mp_rel_time_to_timespec(timeout);
-                        pthread_cond_timedwait(&p->wakeup, &p->lock, &ts);
+                        mp_cond_timedwait(&p->wakeup, &p->lock, &ts);
                     }
                 }
             }
@@ -417,7 +460,7 @@ static void *playthread(void *arg)
         }
         p->need_wakeup = false;
     }
-    pthread_mutex_unlock(&p->lock);
+    mp_mutex_unlock(&p->lock);
     return NULL;
 }
 
@@ -434,17 +477,17 @@ static void destroy_no_thread(struct ao *ao)
     }
 
     pthread_cond_destroy(&p->wakeup);
-    pthread_mutex_destroy(&p->lock);
+    mp_mutex_destroy(&p->lock);
 }
 
 static void uninit(struct ao *ao)
 {
     struct ao_push_state *p = ao->api_priv;
 
-    pthread_mutex_lock(&p->lock);
+    mp_mutex_lock(&p->lock);
     p->terminate = true;
     wakeup_playthread(ao);
-    pthread_mutex_unlock(&p->lock);
+    mp_mutex_unlock(&p->lock);
 
     pthread_join(p->thread, NULL);
 
@@ -456,6 +499,7 @@ static int init(struct ao *ao)
     struct ao_push_state *p = ao->api_priv;
 
     pthread_mutex_init(&p->lock, NULL);
+    mp_mutex_set_name(&p->lock, "ao-push");
     pthread_cond_init(&p->wakeup, NULL);
     mp_make_wakeup_pipe(p->wakeup_pipe);
 
@@ -508,12 +552,12 @@ void ao_unblock(struct ao *ao)
 {
     if (ao->api == &ao_api_push) {
         struct ao_push_state *p = ao->api_priv;
-        pthread_mutex_lock(&p->lock);
+        mp_mutex_lock(&p->lock);
         p->need_wakeup = true;
         p->initial_unblocked = true;
         wakeup_playthread(ao);
         pthread_cond_signal(&p->wakeup);
-        pthread_mutex_unlock(&p->lock);
+        mp_mutex_unlock(&p->lock);
     }
 }
 
@@ -544,10 +588,10 @@ int ao_wait_poll(struct ao *ao, struct pollfd *fds, int num_fds,
         .events = POLLIN,
     };
 
-    pthread_mutex_unlock(&p->lock);
+    mp_mutex_unlock(&p->lock);
     int r = poll(p_fds, num_fds + 1, -1);
     r = r < 0 ? -errno : 0;
-    pthread_mutex_lock(&p->lock);
+    mp_mutex_lock(&p->lock);
 
     memcpy(fds, p_fds, num_fds * sizeof(fds[0]));
     bool wakeup = false;
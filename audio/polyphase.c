@@ -0,0 +1,370 @@
+/*
+ * This file is part of mpv.
+ *
+ * mpv is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * mpv is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with mpv.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <assert.h>
+#include <math.h>
+#include <stdint.h>
+#include <string.h>
+
+#include "common/common.h"
+
+#include "chmap.h"
+#include "polyphase.h"
+
+// Use a table with one entry per phase if the rate ratio is a fraction with
+// at most this denominator.
+#define MAX_EXACT_PHASES 1024
+
+// Table resolution for arbitrary ratios (coefficients are interpolated).
+#define INTERP_PHASE_BITS 8
+#define INTERP_PHASES (1 << INTERP_PHASE_BITS)
+#define INTERP_FRAC_BITS (32 - INTERP_PHASE_BITS)
+
+// How far the input rate may deviate from the rate the filter was designed
+// for. Beyond that, the cutoff frequency would be too far off.
+#define MAX_RATE_DEVIATION 0.05
+
+#define KAISER_BETA 9.0
+
+struct mp_polyphase {
+    int channels;
+    bool planar;
+    int in_rate, out_rate;  // nominal rates
+    double fc;              // cutoff relative to the input Nyquist frequency
+    int taps;               // filter length in input samples, multiple of 4
+
+    // Exact mode: per output sample, the position advances by
+    // step_int + step_phase / num_phases input samples.
+    float *exact_coeffs;    // num_phases rows of taps coefficients
+    int num_phases;
+    int step_int, step_phase;
+    int phase;
+
+    // Interpolating mode: position advances by step_fp (32.32 fixed point).
+    bool interp;
+    float *interp_coeffs;   // INTERP_PHASES + 1 rows
+    uint64_t step_fp;
+    uint32_t frac;
+    float *tmp_coeffs;
+
+    // Planar input history. The next output sample uses the taps samples
+    // starting at pos; its center is at pos + taps / 2 - 1 (+ phase/frac).
+    float *hist[MP_NUM_CHANNELS];
+    int hist_alloc;
+    int hist_len;
+    int pos;
+
+    // Set if draining was started; drain_end is the end of the real input.
+    bool draining;
+    int drain_end;
+};
+
+static double bessel_i0(double x)
+{
+    double sum = 1, term = 1;
+    for (int k = 1; k < 100; k++) {
+        term *= (x / (2 * k)) * (x / (2 * k));
+        sum += term;
+        if (term < sum * 1e-15)
+            break;
+    }
+    return sum;
+}
+
+// Kaiser-windowed sinc, x in input samples relative to the center.
+static double kernel(struct mp_polyphase *p, double x)
+{
+    double half = p->taps / 2.0;
+    if (fabs(x) >= half)
+        return 0;
+    double r = x / half;
+    double w = bessel_i0(KAISER_BETA * sqrt(1 - r * r)) / bessel_i0(KAISER_BETA);
+    double u = p->fc * x;
+    double sinc = fabs(u) < 1e-12 ? 1.0 : sin(M_PI * u) / (M_PI * u);
+    return sinc * w;
+}
+
+// Build phases + 1 rows; the last row is only needed for interpolation.
+static float *build_table(struct mp_polyphase *p, int phases)
+{
+    float *table = talloc_array(p, float, (phases + 1) * p->taps);
+    double *c = talloc_array(NULL, double, p->taps);
+    for (int ph = 0; ph <= phases; ph++) {
+        float *row = table + ph * p->taps;
+        double frac = ph / (double)phases;
+        double sum = 0;
+        for (int n = 0; n < p->taps; n++) {
+            c[n] = kernel(p, frac + p->taps / 2 - 1 - n);
+            sum += c[n];
+        }
+        // Unity gain at DC for every phase.
+        for (int n = 0; n < p->taps; n++)
+            row[n] = c[n] / sum;
+    }
+    talloc_free(c);
+    return table;
+}
+
+static int gcd(int a, int b)
+{
+    while (b) {
+        int t = a % b;
+        a = b;
+        b = t;
+    }
+    return a;
+}
+
+struct mp_polyphase *mp_polyphase_create(void *ta_parent, int channels,
+                                         bool planar, int in_rate,
+                                         int out_rate, int filter_size,
+                                         double cutoff)
+{
+    if (channels < 1 || channels > MP_NUM_CHANNELS || in_rate < 1 ||
+        out_rate < 1 || filter_size < 1 || cutoff <= 0 || cutoff > 1)
+        return NULL;
+
+    struct mp_polyphase *p = talloc_zero(ta_parent, struct mp_polyphase);
+    p->channels = channels;
+    p->planar = planar;
+    p->in_rate = in_rate;
+    p->out_rate = out_rate;
+
+    // When downsampling, the filter is widened (in input samples) to keep the
+    // transition band relative to the output rate.
+    double ratio = MPMIN(1.0, out_rate / (double)in_rate);
+    p->fc = cutoff * ratio;
+    p->taps = MP_ALIGN_UP((int)ceil(2 * filter_size / ratio), 4);
+    p->tmp_coeffs = talloc_array(p, float, p->taps);
+
+    int g = gcd(in_rate, out_rate);
+    int l = out_rate / g, m = in_rate / g;
+    if (l <= MAX_EXACT_PHASES) {
+        p->num_phases = l;
+        p->step_int = m / l;
+        p->step_phase = m % l;
+        p->exact_coeffs = build_table(p, l);
+    } else {
+        p->interp = true;
+        p->interp_coeffs = build_table(p, INTERP_PHASES);
+        p->step_fp = llrint(in_rate / (double)out_rate * 4294967296.0);
+    }
+
+    mp_polyphase_reset(p);
+    return p;
+}
+
+bool mp_polyphase_set_in_rate(struct mp_polyphase *p, double in_rate)
+{
+    if (!(fabs(in_rate / p->in_rate - 1) <= MAX_RATE_DEVIATION))
+        return false;
+
+    if (p->exact_coeffs && in_rate == p->in_rate) {
+        if (p->interp) {
+            uint64_t ph = ((uint64_t)p->frac * p->num_phases + (1ULL << 31)) >> 32;
+            if (ph >= p->num_phases) {
+                ph -= p->num_phases;
+                p->pos += 1;
+            }
+            p->phase = ph;
+            p->interp = false;
+        }
+        return true;
+    }
+
+    if (!p->interp_coeffs)
+        p->interp_coeffs = build_table(p, INTERP_PHASES);
+    if (!p->interp) {
+        p->frac = ((uint64_t)p->phase << 32) / p->num_phases;
+        p->interp = true;
+    }
+    p->step_fp = llrint(in_rate / p->out_rate * 4294967296.0);
+    return true;
+}
+
+static double get_step(struct mp_polyphase *p)
+{
+    if (p->interp)
+        return p->step_fp / 4294967296.0;
+    return p->step_int + p->step_phase / (double)p->num_phases;
+}
+
+// Position of the center of the next output sample in the history.
+static double get_center(struct mp_polyphase *p)
+{
+    double frac = p->interp ? p->frac / 4294967296.0
+                            : p->phase / (double)p->num_phases;
+    return p->pos + p->taps / 2 - 1 + frac;
+}
+
+// Drop input that is not needed anymore, and make room for new samples.
+static void hist_reserve(struct mp_polyphase *p, int samples)
+{
+    int drop = MPMIN(p->pos, p->hist_len);
+    if (drop > 0) {
+        for (int c = 0; c < p->channels; c++) {
+            memmove(p->hist[c], p->hist[c] + drop,
+                    (p->hist_len - drop) * sizeof(float));
+        }
+        p->hist_len -= drop;
+        p->pos -= drop;
+        p->drain_end -= drop;
+    }
+
+    if (p->hist_len + samples > p->hist_alloc) {
+        p->hist_alloc = ta_calc_prealloc_elems(p->hist_len + samples);
+        for (int c = 0; c < p->channels; c++)
+            p->hist[c] = talloc_realloc(p, p->hist[c], float, p->hist_alloc);
+    }
+}
+
+static void append_silence(struct mp_polyphase *p, int samples)
+{
+    hist_reserve(p, samples);
+    for (int c = 0; c < p->channels; c++)
+        memset(p->hist[c] + p->hist_len, 0, samples * sizeof(float));
+    p->hist_len += samples;
+}
+
+void mp_polyphase_reset(struct mp_polyphase *p)
+{
+    p->hist_len = 0;
+    p->pos = 0;
+    p->phase = 0;
+    p->frac = 0;
+    p->draining = false;
+    p->drain_end = 0;
+    // The first input sample is at the center of the first output sample.
+    append_silence(p, p->taps / 2 - 1);
+}
+
+int mp_polyphase_get_out_samples(struct mp_polyphase *p, int in_samples)
+{
+    int len = p->hist_len + in_samples;
+    if (!in_samples && !p->draining)
+        len += p->taps / 2 + 1;
+    double avail = len - p->taps - p->pos;
+    if (avail < 0)
+        return 0;
+    return (int)(avail / get_step(p)) + 2;
+}
+
+// Written so that compilers turn it into SSE/NEON code: the 4 independent
+// accumulators map to vector lanes. n is a multiple of 4.
+static float dot_product(const float *restrict a, const float *restrict b,
+                         int n)
+{
+    float s0 = 0, s1 = 0, s2 = 0, s3 = 0;
+    for (int i = 0; i < n; i += 4) {
+        s0 += a[i + 0] * b[i + 0];
+        s1 += a[i + 1] * b[i + 1];
+        s2 += a[i + 2] * b[i + 2];
+        s3 += a[i + 3] * b[i + 3];
+    }
+    return (s0 + s1) + (s2 + s3);
+}
+
+static const float *get_coeffs(struct mp_polyphase *p)
+{
+    if (!p->interp)
+        return p->exact_coeffs + p->phase * p->taps;
+
+    int ph = p->frac >> INTERP_FRAC_BITS;
+    float w = (p->frac & ((1U << INTERP_FRAC_BITS) - 1)) *
+              (1.0f / (1U << INTERP_FRAC_BITS));
+    const float *restrict a = p->interp_coeffs + ph * p->taps;
+    const float *restrict b = a + p->taps;
+    float *restrict c = p->tmp_coeffs;
+    for (int n = 0; n < p->taps; n++)
+        c[n] = a[n] + w * (b[n] - a[n]);
+    return c;
+}
+
+static void advance(struct mp_polyphase *p)
+{
+    if (p->interp) {
+        uint64_t frac = (uint64_t)p->frac + (uint32_t)p->step_fp;
+        p->pos += (p->step_fp >> 32) + (frac >> 32);
+        p->frac = frac;
+    } else {
+        p->pos += p->step_int;
+        p->phase += p->step_phase;
+        if (p->phase >= p->num_phases) {
+            p->phase -= p->num_phases;
+            p->pos += 1;
+        }
+    }
+}
+
+int mp_polyphase_process(struct mp_polyphase *p, float **out, int out_samples,
+                         float **in, int in_samples)
+{
+    if (in) {
+        // Input after an unfinished drain restarts the stream.
+        if (p->draining)
+            mp_polyphase_reset(p);
+        hist_reserve(p, in_samples);
+        if (p->planar) {
+            for (int c = 0; c < p->channels; c++) {
+                memcpy(p->hist[c] + p->hist_len, in[c],
+                       in_samples * sizeof(float));
+            }
+        } else {
+            for (int c = 0; c < p->channels; c++) {
+                float *restrict dst = p->hist[c] + p->hist_len;
+                const float *restrict src = in[0] + c;
+                for (int n = 0; n < in_samples; n++)
+                    dst[n] = src[n * p->channels];
+            }
+        }
+        p->hist_len += in_samples;
+    } else if (!p->draining) {
+        p->draining = true;
+        p->drain_end = p->hist_len;
+        // Enough silence to move the last input sample past the center.
+        append_silence(p, p->taps / 2 + 1);
+    }
+
+    int produced = 0;
+    while (produced < out_samples && p->pos + p->taps <= p->hist_len) {
+        if (p->draining && p->pos + p->taps / 2 - 1 >= p->drain_end)
+            break;
+        const float *coeffs = get_coeffs(p);
+        for (int c = 0; c < p->channels; c++) {
+            float v = dot_product(coeffs, p->hist[c] + p->pos, p->taps);
+            if (p->planar) {
+                out[c][produced] = v;
+            } else {
+                out[0][produced * p->channels + c] = v;
+            }
+        }
+        produced++;
+        advance(p);
+    }
+
+    if (!in && !produced)
+        mp_polyphase_reset(p);
+
+    return produced;
+}
+
+double mp_polyphase_get_delay(struct mp_polyphase *p)
+{
+    double end = p->draining ? p->drain_end : p->hist_len;
+    double buffered = MPMAX(end - get_center(p), 0);
+    return buffered / (p->out_rate * get_step(p));
+}
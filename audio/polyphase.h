@@ -0,0 +1,58 @@
+/*
+ * This file is part of mpv.
+ *
+ * mpv is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * mpv is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with mpv.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef MP_POLYPHASE_H
+#define MP_POLYPHASE_H
+
+#include <stdbool.h>
+
+// Windowed-sinc polyphase resampler for float samples. The filter tables are
+// computed once for the given nominal rates; the input rate can then be
+// adjusted slightly (e.g. for speed compensation) without reinitialization.
+struct mp_polyphase;
+
+// filter_size is the number of filter taps on each side of a sample (scaled
+// up for downsampling), cutoff the filter cutoff relative to the Nyquist
+// frequency of the lower of both rates. planar selects AF_FORMAT_FLOATP
+// instead of AF_FORMAT_FLOAT data layout for both input and output.
+// Returns NULL on invalid parameters.
+struct mp_polyphase *mp_polyphase_create(void *ta_parent, int channels,
+                                         bool planar, int in_rate,
+                                         int out_rate, int filter_size,
+                                         double cutoff);
+
+// Change the effective input rate. Returns false if the new rate is too far
+// away from the nominal input rate, in which case a new instance is needed.
+bool mp_polyphase_set_in_rate(struct mp_polyphase *p, double in_rate);
+
+// Upper bound of the number of output samples mp_polyphase_process() will
+// return for this number of input samples (in_samples==0 for draining).
+int mp_polyphase_get_out_samples(struct mp_polyphase *p, int in_samples);
+
+// Consume all in_samples samples from in (array of plane pointers; only in[0]
+// is used for packed data), and write at most out_samples samples to out.
+// Pass in==NULL to drain the filter; repeat until it returns 0, which also
+// resets the state. Returns the number of output samples.
+int mp_polyphase_process(struct mp_polyphase *p, float **out, int out_samples,
+                         float **in, int in_samples);
+
+// Buffered input, which has not been output yet, in seconds.
+double mp_polyphase_get_delay(struct mp_polyphase *p);
+
+void mp_polyphase_reset(struct mp_polyphase *p);
+
+#endif
@@ -36,6 +36,7 @@
 #include "options/path.h"
 #include "osdep/terminal.h"
 #include "osdep/io.h"
+#include "osdep/threads.h"
 #include "osdep/timer.h"
 
 #include "libmpa/client.h"
@@ -88,6 +89,7 @@ struct mp_log_buffer {
     int level;
     void (*wakeup_cb)(void *ctx);
     void *wakeup_cb_ctx;
+    struct ta_account *account; // also for the queued entries
 };
 
 // Protects some (not all) state in mp_log_root
@@ -108,7 +110,7 @@ static bool match_mod(const char *name, const char *mod)
 static void update_loglevel(struct mp_log *log)
 {
     struct mp_log_root *root = log->root;
-    pthread_mutex_lock(&mp_msg_lock);
+    mp_mutex_lock(&mp_msg_lock);
     log->level = MSGL_STATUS + root->verbose; // default log level
     if (root->really_quiet)
         log->level -= 10;
@@ -124,7 +126,7 @@ static void update_loglevel(struct mp_log *log)
     if (log->root->stats_file)
         log->level = MPMAX(log->level, MSGL_STATS);
     atomic_store(&log->reload_counter, atomic_load(&log->root->reload_counter));
-    pthread_mutex_unlock(&mp_msg_lock);
+    mp_mutex_unlock(&mp_msg_lock);
 }
 
 // Return whether the message at this verbosity level would be actually printed.
@@ -189,17 +191,17 @@ static void flush_status_line(struct mp_log_root *root)
 
 void mp_msg_flush_status_line(struct mp_log *log)
 {
-    pthread_mutex_lock(&mp_msg_lock);
+    mp_mutex_lock(&mp_msg_lock);
     if (log->root)
         flush_status_line(log->root);
-    pthread_mutex_unlock(&mp_msg_lock);
+    mp_mutex_unlock(&mp_msg_lock);
 }
 
 bool mp_msg_has_status_line(struct mpv_global *global)
 {
-    pthread_mutex_lock(&mp_msg_lock);
+    mp_mutex_lock(&mp_msg_lock);
     bool r = global->log->root->status_lines > 0;
-    pthread_mutex_unlock(&mp_msg_lock);
+    mp_mutex_unlock(&mp_msg_lock);
     return r;
 }
 
@@ -295,6 +297,12 @@ static void write_log_file(struct mp_log *log, int lev, char *text)
     fflush(root->log_file);
 }
 
+// Memory accounted for a queued mp_log_buffer_entry.
+static ptrdiff_t entry_size(struct mp_log_buffer_entry *e)
+{
+    return sizeof(*e) + strlen(e->prefix) + strlen(e->text) + 2;
+}
+
 static void write_msg_to_buffers(struct mp_log *log, int lev, char *text)
 {
     struct mp_log_root *root = log->root;
@@ -323,6 +331,7 @@ static void write_msg_to_buffers(struct mp_log *log, int lev, char *text)
                     .text = "log message buffer overflow\n",
                 };
             }
+            ta_account_add(buffer->account, entry_size(entry), 1);
             mp_ring_write(buffer->ring, (unsigned char *)&entry, sizeof(entry));
             if (buffer->wakeup_cb)
                 buffer->wakeup_cb(buffer->wakeup_cb_ctx);
@@ -342,7 +351,7 @@ void mp_msg_va(struct mp_log *log, int lev, const char *format, va_list va)
     if (!mp_msg_test(log, lev))
         return; // do not display
 
-    pthread_mutex_lock(&mp_msg_lock);
+    mp_mutex_lock(&mp_msg_lock);
 
     struct mp_log_root *root = log->root;
 
@@ -391,7 +400,7 @@ void mp_msg_va(struct mp_log *log, int lev, const char *format, va_list va)
         }
     }
 
-    pthread_mutex_unlock(&mp_msg_lock);
+    mp_mutex_unlock(&mp_msg_lock);
 }
 
 static void destroy_log(void *ptr)
@@ -459,6 +468,8 @@ void mp_msg_init(struct mpv_global *global)
     struct mp_log dummy = { .root = root };
     struct mp_log *log = mp_log_new(root, &dummy, "");
 
+    mp_mutex_set_name(&mp_msg_lock, "msg");
+
     global->log = log;
 }
 
@@ -476,7 +487,7 @@ static void reopen_file(char *opt, char **current_path, FILE **file,
     if (!new_path)
         new_path = "";
 
-    pthread_mutex_lock(&mp_msg_lock); // for *current_path/*file
+    mp_mutex_lock(&mp_msg_lock); // for *current_path/*file
 
     char *old_path = *current_path ? *current_path : "";
     if (strcmp(old_path, new_path) != 0) {
@@ -491,7 +502,7 @@ static void reopen_file(char *opt, char **current_path, FILE **file,
         }
     }
 
-    pthread_mutex_unlock(&mp_msg_lock);
+    mp_mutex_unlock(&mp_msg_lock);
 
     if (fail)
         mp_err(global->log, "Failed to open %s file '%s'\n", type, new_path);
@@ -503,7 +514,7 @@ void mp_msg_update_msglevels(struct mpv_global *global, struct MPOpts *opts)
 {
     struct mp_log_root *root = global->log->root;
 
-    pthread_mutex_lock(&mp_msg_lock);
+    mp_mutex_lock(&mp_msg_lock);
 
     root->verbose = opts->verbose;
     root->really_quiet = opts->msg_really_quiet;
@@ -519,7 +530,7 @@ void mp_msg_update_msglevels(struct mpv_global *global, struct MPOpts *opts)
     m_option_type_msglevels.copy(NULL, &root->msg_levels, &opts->msg_levels);
 
     atomic_fetch_add(&root->reload_counter, 1);
-    pthread_mutex_unlock(&mp_msg_lock);
+    mp_mutex_unlock(&mp_msg_lock);
 
     reopen_file(opts->log_file, &root->log_path, &root->log_file,
                 "log", global);
@@ -532,18 +543,18 @@ void mp_msg_force_stderr(struct mpv_global *global, bool force_stderr)
 {
     struct mp_log_root *root = global->log->root;
 
-    pthread_mutex_lock(&mp_msg_lock);
+    mp_mutex_lock(&mp_msg_lock);
     root->force_stderr = force_stderr;
-    pthread_mutex_unlock(&mp_msg_lock);
+    mp_mutex_unlock(&mp_msg_lock);
 }
 
 bool mp_msg_has_log_file(struct mpv_global *global)
 {
     struct mp_log_root *root = global->log->root;
 
-    pthread_mutex_lock(&mp_msg_lock);
+    mp_mutex_lock(&mp_msg_lock);
     bool res = !!root->log_file;
-    pthread_mutex_unlock(&mp_msg_lock);
+    mp_mutex_unlock(&mp_msg_lock);
 
     return res;
 }
@@ -573,23 +584,25 @@ struct mp_log_buffer *mp_msg_log_buffer_new(struct mpv_global *global,
     return NULL;
 #endif
 
-    pthread_mutex_lock(&mp_msg_lock);
+    mp_mutex_lock(&mp_msg_lock);
 
     struct mp_log_buffer *buffer = talloc_ptrtype(NULL, buffer);
     *buffer = (struct mp_log_buffer) {
         .root = root,
         .level = level,
-        .ring = mp_ring_new(buffer, sizeof(void *) * size),
         .wakeup_cb = wakeup_cb,
         .wakeup_cb_ctx = wakeup_cb_ctx,
+        .account = ta_account_get("log-buffers", NULL),
     };
+    ta_set_account(buffer, buffer->account);
+    buffer->ring = mp_ring_new(buffer, sizeof(void *) * size);
     if (!buffer->ring)
         abort();
 
     MP_TARRAY_APPEND(root, root->buffers, root->num_buffers, buffer);
 
     atomic_fetch_add(&root->reload_counter, 1);
-    pthread_mutex_unlock(&mp_msg_lock);
+    mp_mutex_unlock(&mp_msg_lock);
 
     return buffer;
 }
@@ -599,7 +612,7 @@ void mp_msg_log_buffer_destroy(struct mp_log_buffer *buffer)
     if (!buffer)
         return;
 
-    pthread_mutex_lock(&mp_msg_lock);
+    mp_mutex_lock(&mp_msg_lock);
 
     struct mp_log_root *root = buffer->root;
     for (int n = 0; n < root->num_buffers; n++) {
@@ -622,7 +635,7 @@ found:
     talloc_free(buffer);
 
     atomic_fetch_add(&root->reload_counter, 1);
-    pthread_mutex_unlock(&mp_msg_lock);
+    mp_mutex_unlock(&mp_msg_lock);
 }
 
 // Return a queued message, or if the buffer is empty, NULL.
@@ -635,7 +648,9 @@ struct mp_log_buffer_entry *mp_msg_log_buffer_read(struct mp_log_buffer *buffer)
         return NULL;
     if (read != sizeof(ptr))
         abort();
-    return ptr;
+    struct mp_log_buffer_entry *e = ptr;
+    ta_account_add(buffer->account, -entry_size(e), -1);
+    return e;
 }
 
 // Thread-safety: fully thread-safe, but keep in mind that the lifetime of
@@ -16,6 +16,7 @@
 #define HAVE_ZSH_COMP 0
 #define HAVE_ASM 1
 #define HAVE_TEST 0
+#define HAVE_LOCK_PROFILING 0
 #define HAVE_CLANG_DATABASE 0
 #define HAVE_NOEXECSTACK 0
 #define HAVE_LIBM 1
@@ -45,6 +45,7 @@
 #include "timeline.h"
 #include "stheader.h"
 #include "cue.h"
+#include "media_info.h"
 
 // Demuxer list
 extern const demuxer_desc_t demuxer_desc_rawaudio;
@@ -70,11 +71,15 @@ struct demux_opts {
     int64_t max_bytes;
     int64_t max_bytes_bw;
     double min_secs;
+    int readahead_adaptive;
+    double max_secs_adaptive;
     int force_seekable;
     double min_secs_cache;
     int access_references;
     int seekable_cache;
     int create_ccs;
+    int media_info_cache;
+    char *media_info_cache_dir;
 };
 
 #define OPT_BASE_STRUCT struct demux_opts
@@ -86,6 +91,9 @@ const struct m_sub_options demux_conf = {
         OPT_CHOICE("cache", enable_cache, 0,
                    ({"no", 0}, {"auto", -1}, {"yes", 1})),
         OPT_DOUBLE("demuxer-readahead-secs", min_secs, M_OPT_MIN, .min = 0),
+        OPT_FLAG("demuxer-readahead-adaptive", readahead_adaptive, 0),
+        OPT_DOUBLE("demuxer-readahead-max-secs", max_secs_adaptive,
+                   M_OPT_MIN, .min = 0),
         // (The MAX_BYTES sizes may not be accurate because the max field is
         // of double type.)
         OPT_BYTE_SIZE("demuxer-max-bytes", max_bytes, 0, 0, MAX_BYTES),
@@ -96,6 +104,8 @@ const struct m_sub_options demux_conf = {
         OPT_CHOICE("demuxer-seekable-cache", seekable_cache, 0,
                    ({"auto", -1}, {"no", 0}, {"yes", 1})),
         OPT_FLAG("sub-create-cc-track", create_ccs, 0),
+        OPT_FLAG("media-info-cache", media_info_cache, 0),
+        OPT_STRING("media-info-cache-dir", media_info_cache_dir, M_OPT_FILE),
         {0}
     },
     .size = sizeof(struct demux_opts),
@@ -104,6 +114,8 @@ const struct m_sub_options demux_conf = {
         .max_bytes = 150 * 1024 * 1024,
         .max_bytes_bw = 50 * 1024 * 1024,
         .min_secs = 1.0,
+        .readahead_adaptive = 1,
+        .max_secs_adaptive = 60.0,
         .min_secs_cache = 10.0 * 60 * 60,
         .seekable_cache = -1,
         .access_references = 1,
@@ -153,7 +165,8 @@ struct demux_internal {
     bool eof;                   // whether we're in EOF state (reset for retry)
     bool idle;
     bool autoselect;
-    double min_secs;
+    double min_secs;            // current read-ahead target
+    double min_secs_base;       // configured read-ahead (lower bound)
     size_t max_bytes;
     size_t max_bytes_bw;
     bool seekable_cache;
@@ -177,6 +190,13 @@ struct demux_internal {
     double seeking_in_progress; // low level seek state
     int low_level_seeks;        // number of started low level seeks
     double demux_ts;            // last demuxed DTS or PTS
+    uint64_t packet_locks;      // lock acquisitions for packet add/read
+    uint64_t packet_wakeups;    // reader wakeups on packet add/read
+
+    // Last result of DEMUXER_CTRL_GET_READER_STATE. reader_state_gen is
+    // incremented each time a query returns a different state.
+    struct demux_ctrl_reader_state reader_state;
+    uint64_t reader_state_gen;
 
     double ts_offset;           // timestamp offset to apply to everything
 
@@ -189,6 +209,7 @@ struct demux_internal {
 
     size_t total_bytes;         // total sum of packet data buffered
     size_t fw_bytes;            // sum of forward packet data in current_range
+    struct ta_account *cache_account; // total_bytes is accounted to this
 
     // Range from which decoder is reading, and to which demuxer is appending.
     // This is never NULL. This is always ranges[num_ranges - 1].
@@ -205,6 +226,13 @@ struct demux_internal {
     int64_t last_speed_query;
     uint64_t bytes_per_second;
     int64_t next_cache_update;
+    // Adaptive read-ahead (see adapt_readahead()).
+    bool underrun_reported;     // player ran out of packets
+    int64_t ra_bytes;           // bytes read since last rate measurement
+    int64_t ra_busy_us;         // time spent in fill_buffer for ra_bytes
+    double ra_read_rate;        // last measured read rate (bytes/s), or 0
+    int64_t ra_last_adapt;
+    int64_t ra_calm_since;      // last time the target was changed
     // Updated during init only.
     char *stream_base_filename;
 
@@ -303,6 +331,7 @@ struct demux_stream {
     bool skip_to_keyframe;
     bool attached_picture_added;
     bool need_wakeup;       // call wakeup_cb on next reader_head state change
+    bool batch_added;       // demux_add_packets() appended a packet
 
     // for refresh seeks: pos/dts of last packet returned to reader
     int64_t last_ret_pos;
@@ -337,6 +366,7 @@ struct mp_packet_tags {
 static void demuxer_sort_chapters(demuxer_t *demuxer);
 static void *demux_thread(void *pctx);
 static void update_cache(struct demux_internal *in);
+static void adapt_readahead(struct demux_internal *in, int64_t now);
 
 #if 0
 // very expensive check for redundant cached queue state
@@ -588,7 +618,9 @@ static void remove_head_packet(struct demux_queue *queue)
         queue->keyframe_latest = NULL;
     queue->is_bof = false;
 
-    queue->ds->in->total_bytes -= demux_packet_estimate_total_size(dp);
+    size_t bytes = demux_packet_estimate_total_size(dp);
+    queue->ds->in->total_bytes -= bytes;
+    ta_account_add(queue->ds->in->cache_account, -(ptrdiff_t)bytes, -1);
 
     if (queue->num_index && queue->index[0] == dp)
         MP_TARRAY_REMOVE_AT(queue->index, queue->num_index, 0);
@@ -608,7 +640,9 @@ static void clear_queue(struct demux_queue *queue)
     struct demux_packet *dp = queue->head;
     while (dp) {
         struct demux_packet *dn = dp->next;
-        in->total_bytes -= demux_packet_estimate_total_size(dp);
+        size_t bytes = demux_packet_estimate_total_size(dp);
+        in->total_bytes -= bytes;
+        ta_account_add(in->cache_account, -(ptrdiff_t)bytes, -1);
         assert(ds->reader_head != dp);
         talloc_free(dp);
         dp = dn;
@@ -697,6 +731,7 @@ static void ds_clear_reader_state(struct demux_stream *ds)
 static void wakeup_ds(struct demux_stream *ds)
 {
     if (ds->need_wakeup) {
+        ds->in->packet_wakeups++;
         if (ds->wakeup_cb) {
             ds->wakeup_cb(ds->wakeup_cb_ctx);
         } else if (ds->in->wakeup_cb) {
@@ -775,9 +810,9 @@ static void update_stream_selection_state(struct demux_internal *in,
 void demux_set_ts_offset(struct demuxer *demuxer, double offset)
 {
     struct demux_internal *in = demuxer->in;
-    pthread_mutex_lock(&in->lock);
+    mp_mutex_lock(&in->lock);
     in->ts_offset = offset;
-    pthread_mutex_unlock(&in->lock);
+    mp_mutex_unlock(&in->lock);
 }
 
 static void add_missing_streams(struct demux_internal *in,
@@ -883,9 +918,9 @@ void demux_add_sh_stream(struct demuxer *demuxer, struct sh_stream *sh)
 {
     struct demux_internal *in = demuxer->in;
     assert(demuxer == in->d_thread);
-    pthread_mutex_lock(&in->lock);
+    mp_mutex_lock(&in->lock);
     demux_add_sh_stream_locked(in, sh);
-    pthread_mutex_unlock(&in->lock);
+    mp_mutex_unlock(&in->lock);
 }
 
 static void ds_modify_demux_tags(struct demux_stream *ds)
@@ -908,13 +943,13 @@ void demux_set_stream_tags(struct demuxer *demuxer, struct sh_stream *sh,
     struct demux_stream *ds = sh->ds;
     assert(ds); // stream must have been added
 
-    pthread_mutex_lock(&in->lock);
+    mp_mutex_lock(&in->lock);
 
     ds_modify_demux_tags(ds);
     mp_tags_replace(ds->tags_demux->sh, tags);
     talloc_free(tags);
 
-    pthread_mutex_unlock(&in->lock);
+    mp_mutex_unlock(&in->lock);
 }
 
 // Return a stream with the given index. Since streams can only be added during
@@ -924,10 +959,10 @@ void demux_set_stream_tags(struct demuxer *demuxer, struct sh_stream *sh,
 struct sh_stream *demux_get_stream(struct demuxer *demuxer, int index)
 {
     struct demux_internal *in = demuxer->in;
-    pthread_mutex_lock(&in->lock);
+    mp_mutex_lock(&in->lock);
     assert(index >= 0 && index < in->num_streams);
     struct sh_stream *r = in->streams[index];
-    pthread_mutex_unlock(&in->lock);
+    mp_mutex_unlock(&in->lock);
     return r;
 }
 
@@ -935,9 +970,9 @@ struct sh_stream *demux_get_stream(struct demuxer *demuxer, int index)
 int demux_get_num_stream(struct demuxer *demuxer)
 {
     struct demux_internal *in = demuxer->in;
-    pthread_mutex_lock(&in->lock);
+    mp_mutex_lock(&in->lock);
     int r = in->num_streams;
-    pthread_mutex_unlock(&in->lock);
+    mp_mutex_unlock(&in->lock);
     return r;
 }
 
@@ -962,7 +997,7 @@ static void demux_dealloc(struct demux_internal *in)
 {
     for (int n = 0; n < in->num_streams; n++)
         talloc_free(in->streams[n]);
-    pthread_mutex_destroy(&in->lock);
+    mp_mutex_destroy(&in->lock);
     pthread_cond_destroy(&in->wakeup);
     talloc_free(in->d_user);
 }
@@ -994,11 +1029,11 @@ struct demux_free_async_state *demux_free_async(struct demuxer *demuxer)
     if (!in->threading)
         return NULL;
 
-    pthread_mutex_lock(&in->lock);
+    mp_mutex_lock(&in->lock);
     in->thread_terminate = true;
     in->shutdown_async = true;
     pthread_cond_signal(&in->wakeup);
-    pthread_mutex_unlock(&in->lock);
+    mp_mutex_unlock(&in->lock);
 
     return (struct demux_free_async_state *)demuxer->in; // lies
 }
@@ -1022,9 +1057,9 @@ bool demux_free_async_finish(struct demux_free_async_state *state)
 {
     struct demux_internal *in = (struct demux_internal *)state; // reverse lies
 
-    pthread_mutex_lock(&in->lock);
+    mp_mutex_lock(&in->lock);
     bool busy = in->shutdown_async;
-    pthread_mutex_unlock(&in->lock);
+    mp_mutex_unlock(&in->lock);
 
     if (busy)
         return false;
@@ -1064,10 +1099,10 @@ void demux_stop_thread(struct demuxer *demuxer)
     assert(demuxer == in->d_user);
 
     if (in->threading) {
-        pthread_mutex_lock(&in->lock);
+        mp_mutex_lock(&in->lock);
         in->thread_terminate = true;
         pthread_cond_signal(&in->wakeup);
-        pthread_mutex_unlock(&in->lock);
+        mp_mutex_unlock(&in->lock);
         pthread_join(in->thread, NULL);
         in->threading = false;
         in->thread_terminate = false;
@@ -1078,10 +1113,10 @@ void demux_stop_thread(struct demuxer *demuxer)
 void demux_set_wakeup_cb(struct demuxer *demuxer, void (*cb)(void *ctx), void *ctx)
 {
     struct demux_internal *in = demuxer->in;
-    pthread_mutex_lock(&in->lock);
+    mp_mutex_lock(&in->lock);
     in->wakeup_cb = cb;
     in->wakeup_cb_ctx = ctx;
-    pthread_mutex_unlock(&in->lock);
+    mp_mutex_unlock(&in->lock);
 }
 
 const char *stream_type_name(enum stream_type type)
@@ -1116,10 +1151,10 @@ void demuxer_feed_caption(struct sh_stream *stream, demux_packet_t *dp)
 {
     struct demux_internal *in = stream->ds->in;
 
-    pthread_mutex_lock(&in->lock);
+    mp_mutex_lock(&in->lock);
     struct sh_stream *sh = demuxer_get_cc_track_locked(stream);
     if (!sh) {
-        pthread_mutex_unlock(&in->lock);
+        mp_mutex_unlock(&in->lock);
         talloc_free(dp);
         return;
     }
@@ -1127,7 +1162,7 @@ void demuxer_feed_caption(struct sh_stream *stream, demux_packet_t *dp)
     dp->keyframe = true;
     dp->pts = MP_ADD_PTS(dp->pts, -in->ts_offset);
     dp->dts = MP_ADD_PTS(dp->dts, -in->ts_offset);
-    pthread_mutex_unlock(&in->lock);
+    mp_mutex_unlock(&in->lock);
 
     demux_add_packet(sh, dp);
 }
@@ -1375,15 +1410,18 @@ static void adjust_seek_range_on_packet(struct demux_stream *ds,
         attempt_range_joining(ds->in);
 }
 
-void demux_add_packet(struct sh_stream *stream, demux_packet_t *dp)
+// Append a packet to the stream's queue. Takes ownership of dp. Does not wake
+// up the reader; the caller has to do this with wakeup_ds() if
+// ds->batch_added was set.
+static void add_packet_locked(struct sh_stream *stream, demux_packet_t *dp)
 {
-    struct demux_stream *ds = stream ? stream->ds : NULL;
-    if (!dp || !dp->len || !ds || demux_cancel_test(ds->in->d_thread)) {
+    struct demux_stream *ds = stream->ds;
+    struct demux_internal *in = ds->in;
+
+    if (!dp->len) {
         talloc_free(dp);
         return;
     }
-    struct demux_internal *in = ds->in;
-    pthread_mutex_lock(&in->lock);
 
     in->initial_state = false;
 
@@ -1413,7 +1451,6 @@ void demux_add_packet(struct sh_stream *stream, demux_packet_t *dp)
     }
 
     if (drop) {
-        pthread_mutex_unlock(&in->lock);
         talloc_free(dp);
         return;
     }
@@ -1438,6 +1475,7 @@ void demux_add_packet(struct sh_stream *stream, demux_packet_t *dp)
 
     size_t bytes = demux_packet_estimate_total_size(dp);
     ds->in->total_bytes += bytes;
+    ta_account_add(ds->in->cache_account, bytes, 1);
     if (ds->reader_head) {
         ds->fw_packs++;
         ds->fw_bytes += bytes;
@@ -1491,8 +1529,57 @@ void demux_add_packet(struct sh_stream *stream, demux_packet_t *dp)
         }
     }
 
-    wakeup_ds(ds);
-    pthread_mutex_unlock(&in->lock);
+    ds->batch_added = true;
+}
+
+// Append several packets at once, taking the demuxer lock only once, and
+// waking up each affected reader only after all packets were added. For use
+// by demuxer implementations, which should collect the packets read by a
+// single fill_buffer call. The dp->stream field of each packet must be set to
+// the sh_stream index. Takes ownership of all packets.
+void demux_add_packets(struct demuxer *demuxer, struct demux_packet **pkts,
+                       int num_pkts)
+{
+    struct demux_internal *in = demuxer->in;
+    if (demux_cancel_test(in->d_thread)) {
+        for (int n = 0; n < num_pkts; n++)
+            talloc_free(pkts[n]);
+        return;
+    }
+
+    mp_mutex_lock(&in->lock);
+    in->packet_locks++;
+
+    for (int n = 0; n < num_pkts; n++) {
+        struct demux_packet *dp = pkts[n];
+        if (!dp)
+            continue;
+        if (dp->stream < 0 || dp->stream >= in->num_streams) {
+            talloc_free(dp);
+            continue;
+        }
+        add_packet_locked(in->streams[dp->stream], dp);
+    }
+
+    for (int n = 0; n < in->num_streams; n++) {
+        struct demux_stream *ds = in->streams[n]->ds;
+        if (ds->batch_added) {
+            ds->batch_added = false;
+            wakeup_ds(ds);
+        }
+    }
+
+    mp_mutex_unlock(&in->lock);
+}
+
+void demux_add_packet(struct sh_stream *stream, demux_packet_t *dp)
+{
+    if (!dp || !stream || !stream->ds) {
+        talloc_free(dp);
+        return;
+    }
+    dp->stream = stream->index;
+    demux_add_packets(stream->ds->in->d_thread, &dp, 1);
 }
 
 // Returns true if there was "progress" (lock was released temporarily).
@@ -1561,16 +1648,20 @@ static bool read_packet(struct demux_internal *in)
     // for disk or network I/O can take time.
     in->idle = false;
     in->initial_state = false;
-    pthread_mutex_unlock(&in->lock);
+    mp_mutex_unlock(&in->lock);
 
     struct demuxer *demux = in->d_thread;
 
+    int64_t read_start = mp_time_us();
     bool eof = true;
     if (demux->desc->fill_buffer && !demux_cancel_test(demux))
         eof = demux->desc->fill_buffer(demux) <= 0;
+    int64_t read_time = mp_time_us() - read_start;
     update_cache(in);
 
-    pthread_mutex_lock(&in->lock);
+    mp_mutex_lock(&in->lock);
+
+    in->ra_busy_us += read_time;
 
     if (!in->seeking) {
         if (eof) {
@@ -1681,12 +1772,12 @@ static void execute_trackswitch(struct demux_internal *in)
     for (int n = 0; n < in->num_streams; n++)
         any_selected |= in->streams[n]->ds->selected;
 
-    pthread_mutex_unlock(&in->lock);
+    mp_mutex_unlock(&in->lock);
 
     if (in->d_thread->desc->control)
         in->d_thread->desc->control(in->d_thread, DEMUXER_CTRL_SWITCHED_TRACKS, 0);
 
-    pthread_mutex_lock(&in->lock);
+    mp_mutex_lock(&in->lock);
 }
 
 static void execute_seek(struct demux_internal *in)
@@ -1699,7 +1790,7 @@ static void execute_seek(struct demux_internal *in)
     in->low_level_seeks += 1;
     in->initial_state = false;
 
-    pthread_mutex_unlock(&in->lock);
+    mp_mutex_unlock(&in->lock);
 
     MP_VERBOSE(in, "execute seek (to %f flags %d)\n", pts, flags);
 
@@ -1708,7 +1799,7 @@ static void execute_seek(struct demux_internal *in)
 
     MP_VERBOSE(in, "seek done\n");
 
-    pthread_mutex_lock(&in->lock);
+    mp_mutex_lock(&in->lock);
 
     in->seeking_in_progress = MP_NOPTS_VALUE;
 }
@@ -1735,9 +1826,9 @@ static bool thread_work(struct demux_internal *in)
             return true; // read_packet unlocked, so recheck conditions
     }
     if (mp_time_us() >= in->next_cache_update) {
-        pthread_mutex_unlock(&in->lock);
+        mp_mutex_unlock(&in->lock);
         update_cache(in);
-        pthread_mutex_lock(&in->lock);
+        mp_mutex_lock(&in->lock);
         return true;
     }
     return false;
@@ -1747,26 +1838,26 @@ static void *demux_thread(void *pctx)
 {
     struct demux_internal *in = pctx;
     mpthread_set_name("demux");
-    pthread_mutex_lock(&in->lock);
+    mp_mutex_lock(&in->lock);
 
     while (!in->thread_terminate) {
         if (thread_work(in))
             continue;
         pthread_cond_signal(&in->wakeup);
         struct timespec until = mp_time_us_to_timespec(in->next_cache_update);
-        pthread_cond_timedwait(&in->wakeup, &in->lock, &until);
+        mp_cond_timedwait(&in->wakeup, &in->lock, &until);
     }
 
     if (in->shutdown_async) {
-        pthread_mutex_unlock(&in->lock);
+        mp_mutex_unlock(&in->lock);
         demux_shutdown(in);
-        pthread_mutex_lock(&in->lock);
+        mp_mutex_lock(&in->lock);
         in->shutdown_async = false;
         if (in->wakeup_cb)
             in->wakeup_cb(in->wakeup_cb_ctx);
     }
 
-    pthread_mutex_unlock(&in->lock);
+    mp_mutex_unlock(&in->lock);
     return NULL;
 }
 
@@ -1860,7 +1951,8 @@ struct demux_packet *demux_read_packet(struct sh_stream *sh)
     if (!ds)
         return NULL;
     struct demux_internal *in = ds->in;
-    pthread_mutex_lock(&in->lock);
+    mp_mutex_lock(&in->lock);
+    in->packet_locks++;
     if (ds->eager) {
         const char *t = stream_type_name(ds->type);
         MP_DBG(in, "reading packet for %s\n", t);
@@ -1872,7 +1964,7 @@ struct demux_packet *demux_read_packet(struct sh_stream *sh)
             if (in->threading) {
                 MP_VERBOSE(in, "waiting for demux thread (%s)\n", t);
                 pthread_cond_signal(&in->wakeup);
-                pthread_cond_wait(&in->wakeup, &in->lock);
+                mp_cond_wait(&in->wakeup, &in->lock);
             } else {
                 thread_work(in);
             }
@@ -1882,7 +1974,7 @@ struct demux_packet *demux_read_packet(struct sh_stream *sh)
     }
     struct demux_packet *pkt = dequeue_packet(ds);
     pthread_cond_signal(&in->wakeup); // possibly read more
-    pthread_mutex_unlock(&in->lock);
+    mp_mutex_unlock(&in->lock);
     return pkt;
 }
 
@@ -1899,31 +1991,52 @@ struct demux_packet *demux_read_packet(struct sh_stream *sh)
 // read ahead to get the next subtitle packet (as the next packet could be
 // minutes away). In this situation, this function will just return -1.
 int demux_read_packet_async(struct sh_stream *sh, struct demux_packet **out_pkt)
+{
+    *out_pkt = NULL;
+    int r = demux_read_packets_async(sh, out_pkt, 1);
+    return MPMIN(r, 1);
+}
+
+// Like demux_read_packet_async(), but return up to max_pkts packets at once
+// in pkts[], which avoids taking the demuxer lock for each packet. Returns
+// the number of packets written to pkts[] (> 0), or 0 and < 0 as
+// demux_read_packet_async() does. The packets are returned in decoding order,
+// and belong to the caller.
+// Note that the demuxer reader state (bitrate, metadata, reader PTS, refresh
+// position) is updated for all returned packets, so max_pkts should be small.
+int demux_read_packets_async(struct sh_stream *sh, struct demux_packet **pkts,
+                             int max_pkts)
 {
     struct demux_stream *ds = sh ? sh->ds : NULL;
     int r = -1;
-    *out_pkt = NULL;
-    if (!ds)
+    if (!ds || max_pkts < 1)
         return r;
     if (ds->in->threading) {
-        pthread_mutex_lock(&ds->in->lock);
-        *out_pkt = dequeue_packet(ds);
+        mp_mutex_lock(&ds->in->lock);
+        ds->in->packet_locks++;
+        int num = 0;
+        while (num < max_pkts) {
+            struct demux_packet *pkt = dequeue_packet(ds);
+            if (!pkt)
+                break;
+            pkts[num++] = pkt;
+        }
         if (ds->eager) {
-            r = *out_pkt ? 1 : (ds->eof ? -1 : 0);
+            r = num ? num : (ds->eof ? -1 : 0);
             ds->in->reading = true; // enable readahead
             ds->in->eof = false; // force retry
             pthread_cond_signal(&ds->in->wakeup); // possibly read more
         } else {
-            r = *out_pkt ? 1 : -1;
+            r = num ? num : -1;
         }
-        ds->need_wakeup = r != 1;
-        pthread_mutex_unlock(&ds->in->lock);
+        ds->need_wakeup = r < 1;
+        mp_mutex_unlock(&ds->in->lock);
     } else {
         if (ds->in->blocked) {
             r = 0;
         } else {
-            *out_pkt = demux_read_packet(sh);
-            r = *out_pkt ? 1 : -1;
+            pkts[0] = demux_read_packet(sh);
+            r = pkts[0] ? 1 : -1;
         }
         ds->need_wakeup = r != 1;
     }
@@ -1935,9 +2048,9 @@ bool demux_has_packet(struct sh_stream *sh)
 {
     bool has_packet = false;
     if (sh) {
-        pthread_mutex_lock(&sh->ds->in->lock);
+        mp_mutex_lock(&sh->ds->in->lock);
         has_packet = sh->ds->reader_head;
-        pthread_mutex_unlock(&sh->ds->in->lock);
+        mp_mutex_unlock(&sh->ds->in->lock);
     }
     return has_packet;
 }
@@ -1956,10 +2069,10 @@ struct demux_packet *demux_read_any_packet(struct demuxer *demuxer)
                 return pkt;
         }
         // retry after calling this
-        pthread_mutex_lock(&in->lock); // lock only because thread_work unlocks
+        mp_mutex_lock(&in->lock); // lock only because thread_work unlocks
         read_more = thread_work(in);
         read_more &= !in->eof;
-        pthread_mutex_unlock(&in->lock);
+        mp_mutex_unlock(&in->lock);
     }
     return NULL;
 }
@@ -2120,7 +2233,7 @@ void demux_metadata_changed(demuxer_t *demuxer)
     assert(demuxer == demuxer->in->d_thread); // call from demuxer impl. only
     struct demux_internal *in = demuxer->in;
 
-    pthread_mutex_lock(&in->lock);
+    mp_mutex_lock(&in->lock);
 
     for (int n = 0; n < in->num_streams; n++) {
         struct demux_stream *ds = in->streams[n]->ds;
@@ -2128,7 +2241,7 @@ void demux_metadata_changed(demuxer_t *demuxer)
         mp_tags_replace(ds->tags_demux->demux, demuxer->metadata);
     }
 
-    pthread_mutex_unlock(&in->lock);
+    mp_mutex_unlock(&in->lock);
 }
 
 // Called locked, with user demuxer.
@@ -2175,7 +2288,7 @@ void demux_update(demuxer_t *demuxer)
     if (!in->threading)
         update_cache(in);
 
-    pthread_mutex_lock(&in->lock);
+    mp_mutex_lock(&in->lock);
     demuxer->events |= in->events;
     in->events = 0;
     if (demuxer->events & DEMUX_EVENT_METADATA)
@@ -2184,7 +2297,7 @@ void demux_update(demuxer_t *demuxer)
         demux_update_replaygain(demuxer);
     if (demuxer->events & DEMUX_EVENT_DURATION)
         demuxer->duration = in->duration;
-    pthread_mutex_unlock(&in->lock);
+    mp_mutex_unlock(&in->lock);
 }
 
 static void demux_init_cache(struct demuxer *demuxer)
@@ -2239,13 +2352,13 @@ static void demux_init_ccs(struct demuxer *demuxer, struct demux_opts *opts)
     struct demux_internal *in = demuxer->in;
     if (!opts->create_ccs)
         return;
-    pthread_mutex_lock(&in->lock);
+    mp_mutex_lock(&in->lock);
     for (int n = 0; n < in->num_streams; n++) {
         struct sh_stream *sh = in->streams[n];
         if (sh->type == STREAM_VIDEO)
             demuxer_get_cc_track_locked(sh);
     }
-    pthread_mutex_unlock(&in->lock);
+    mp_mutex_unlock(&in->lock);
 }
 
 // Each stream contains a copy of the global demuxer metadata, but this might
@@ -2279,12 +2392,15 @@ static struct demuxer *open_given_type(struct mpv_global *global,
                                        const struct demuxer_desc *desc,
                                        struct stream *stream,
                                        struct demuxer_params *params,
-                                       enum demux_check check)
+                                       enum demux_check check,
+                                       struct mp_media_info *info)
 {
     if (mp_cancel_test(stream->cancel))
         return NULL;
 
+    struct ta_account *account = ta_account_get("demux", NULL);
     struct demuxer *demuxer = talloc_ptrtype(NULL, demuxer);
+    ta_set_account(demuxer, account);
     struct demux_opts *opts = mp_get_config_group(demuxer, global, &demux_conf);
     *demuxer = (struct demuxer) {
         .desc = desc,
@@ -2318,8 +2434,10 @@ static struct demuxer *open_given_type(struct mpv_global *global,
         .seeking_in_progress = MP_NOPTS_VALUE,
         .demux_ts = MP_NOPTS_VALUE,
         .enable_recording = params && params->stream_record,
+        .cache_account = ta_account_get("demux-cache", account),
     };
     pthread_mutex_init(&in->lock, NULL);
+    mp_mutex_set_name(&in->lock, "demux");
     pthread_cond_init(&in->wakeup, NULL);
 
     in->current_range = talloc_ptrtype(in, in->current_range);
@@ -2345,9 +2463,11 @@ static struct demuxer *open_given_type(struct mpv_global *global,
     stream_peek(stream, STREAM_BUFFER_SIZE);
 
     in->d_thread->params = params; // temporary during open()
+    in->d_thread->media_info = info; // same
     int ret = demuxer->desc->open(in->d_thread, check);
     if (ret >= 0) {
         in->d_thread->params = NULL;
+        in->d_thread->media_info = NULL;
         if (in->d_thread->filetype)
             mp_verbose(log, "Detected file format: %s (%s)\n",
                        in->d_thread->filetype, desc->desc);
@@ -2360,6 +2480,8 @@ static struct demuxer *open_given_type(struct mpv_global *global,
             in->d_thread->seekable = true;
             in->d_thread->partially_seekable = true;
         }
+        if (info)
+            mp_media_info_apply(info, in->d_thread);
         demux_init_cuesheet(in->d_thread);
         demux_init_cache(demuxer);
         demux_init_ccs(demuxer, opts);
@@ -2375,6 +2497,7 @@ static struct demuxer *open_given_type(struct mpv_global *global,
             if (seekable < 0)
                 seekable = 1;
         }
+        in->min_secs_base = in->min_secs;
         in->seekable_cache = seekable == 1;
         if (!(params && params->disable_timeline)) {
             struct timeline *tl = timeline_load(global, log, demuxer);
@@ -2383,7 +2506,7 @@ static struct demuxer *open_given_type(struct mpv_global *global,
                 params2.timeline = tl;
                 struct demuxer *sub =
                     open_given_type(global, log, &demuxer_desc_timeline, stream,
-                                    &params2, DEMUX_CHECK_FORCE);
+                                    &params2, DEMUX_CHECK_FORCE, NULL);
                 if (sub) {
                     demuxer = sub;
                 } else {
@@ -2414,6 +2537,9 @@ struct demuxer *demux_open(struct stream *stream, struct demuxer_params *params,
     struct mp_log *log = mp_log_new(NULL, global->log, "!demux");
     struct demuxer *demuxer = NULL;
     char *force_format = params ? params->force_format : NULL;
+    void *tmp = talloc_new(NULL);
+    struct demux_opts *opts = mp_get_config_group(tmp, global, &demux_conf);
+    struct mp_media_info *info = NULL;
 
     if (!force_format)
         force_format = stream->demuxer;
@@ -2434,6 +2560,33 @@ struct demuxer *demux_open(struct stream *stream, struct demuxer_params *params,
         }
     }
 
+    bool use_info_cache = opts->media_info_cache && !check_desc &&
+        !(params && (params->timeline || params->init_fragment.len));
+
+    // If the file was probed before and did not change since, go straight to
+    // the demuxer (and lavf format) that was detected last time.
+    if (use_info_cache) {
+        info = mp_media_info_load(tmp, log, global, opts->media_info_cache_dir,
+                                  stream);
+    }
+    if (info) {
+        for (int n = 0; demuxer_list[n]; n++) {
+            const struct demuxer_desc *desc = demuxer_list[n];
+            if (strcmp(desc->name, info->demuxer) != 0)
+                continue;
+            char *lavf_type = stream->lavf_type;
+            if (!lavf_type)
+                stream->lavf_type = info->filetype;
+            demuxer = open_given_type(global, log, desc, stream, params,
+                                      DEMUX_CHECK_REQUEST, info);
+            stream->lavf_type = lavf_type;
+            if (demuxer)
+                goto opened;
+            mp_verbose(log, "Cached demuxer failed, probing normally.\n");
+            break;
+        }
+    }
+
     // Test demuxers from first to last, one pass for each check_levels[] entry
     for (int pass = 0; check_levels[pass] != -1; pass++) {
         enum demux_check level = check_levels[pass];
@@ -2441,20 +2594,31 @@ struct demuxer *demux_open(struct stream *stream, struct demuxer_params *params,
         for (int n = 0; demuxer_list[n]; n++) {
             const struct demuxer_desc *desc = demuxer_list[n];
             if (!check_desc || desc == check_desc) {
-                demuxer = open_given_type(global, log, desc, stream, params, level);
+                demuxer = open_given_type(global, log, desc, stream, params,
+                                          level, NULL);
                 if (demuxer) {
-                    talloc_steal(demuxer, log);
-                    log = NULL;
-                    demuxer->in->owns_stream =
-                        params ? !params->does_not_own_stream : true;
-                    goto done;
+                    if (use_info_cache && !demuxer->playlist &&
+                        demuxer->desc != &demuxer_desc_timeline)
+                    {
+                        mp_media_info_store(log, global,
+                                            opts->media_info_cache_dir,
+                                            stream, demuxer);
+                    }
+                    goto opened;
                 }
             }
         }
     }
+    goto done;
+
+opened:
+    talloc_steal(demuxer, log);
+    log = NULL;
+    demuxer->in->owns_stream = params ? !params->does_not_own_stream : true;
 
 done:
     talloc_free(log);
+    talloc_free(tmp);
     return demuxer;
 }
 
@@ -2511,12 +2675,12 @@ void demux_flush(demuxer_t *demuxer)
     struct demux_internal *in = demuxer->in;
     assert(demuxer == in->d_user);
 
-    pthread_mutex_lock(&demuxer->in->lock);
+    mp_mutex_lock(&demuxer->in->lock);
     clear_reader_state(in);
     for (int n = 0; n < in->num_ranges; n++)
         clear_cached_range(in, in->ranges[n]);
     free_empty_cached_ranges(in);
-    pthread_mutex_unlock(&demuxer->in->lock);
+    mp_mutex_unlock(&demuxer->in->lock);
 }
 
 // Does some (but not all) things for switching to another range.
@@ -2739,7 +2903,7 @@ int demux_seek(demuxer_t *demuxer, double seek_pts, int flags)
     assert(demuxer == in->d_user);
     int res = 0;
 
-    pthread_mutex_lock(&in->lock);
+    mp_mutex_lock(&in->lock);
 
     if (seek_pts == MP_NOPTS_VALUE)
         goto done;
@@ -2794,7 +2958,7 @@ int demux_seek(demuxer_t *demuxer, double seek_pts, int flags)
 
 done:
     pthread_cond_signal(&in->wakeup);
-    pthread_mutex_unlock(&in->lock);
+    mp_mutex_unlock(&in->lock);
     return res;
 }
 
@@ -2895,7 +3059,7 @@ void demuxer_select_track(struct demuxer *demuxer, struct sh_stream *stream,
 {
     struct demux_internal *in = demuxer->in;
     struct demux_stream *ds = stream->ds;
-    pthread_mutex_lock(&in->lock);
+    mp_mutex_lock(&in->lock);
     // don't flush buffers if stream is already selected / unselected
     if (ds->selected != selected) {
         MP_VERBOSE(in, "%sselect track %d\n", selected ? "" : "de", stream->index);
@@ -2910,7 +3074,7 @@ void demuxer_select_track(struct demuxer *demuxer, struct sh_stream *stream,
             execute_trackswitch(in);
         }
     }
-    pthread_mutex_unlock(&in->lock);
+    mp_mutex_unlock(&in->lock);
 }
 
 void demux_set_stream_autoselect(struct demuxer *demuxer, bool autoselect)
@@ -2928,20 +3092,20 @@ bool demux_stream_is_selected(struct sh_stream *stream)
     if (!stream)
         return false;
     bool r = false;
-    pthread_mutex_lock(&stream->ds->in->lock);
+    mp_mutex_lock(&stream->ds->in->lock);
     r = stream->ds->selected;
-    pthread_mutex_unlock(&stream->ds->in->lock);
+    mp_mutex_unlock(&stream->ds->in->lock);
     return r;
 }
 
 void demux_set_stream_wakeup_cb(struct sh_stream *sh,
                                 void (*cb)(void *ctx), void *ctx)
 {
-    pthread_mutex_lock(&sh->ds->in->lock);
+    mp_mutex_lock(&sh->ds->in->lock);
     sh->ds->wakeup_cb = cb;
     sh->ds->wakeup_cb_ctx = ctx;
     sh->ds->need_wakeup = true;
-    pthread_mutex_unlock(&sh->ds->in->lock);
+    mp_mutex_unlock(&sh->ds->in->lock);
 }
 
 int demuxer_add_attachment(demuxer_t *demuxer, char *name, char *type,
@@ -3000,7 +3164,7 @@ void demux_disable_cache(demuxer_t *demuxer)
     struct demux_internal *in = demuxer->in;
     assert(demuxer == in->d_user);
 
-    pthread_mutex_lock(&in->lock);
+    mp_mutex_lock(&in->lock);
     if (in->seekable_cache) {
         MP_VERBOSE(demuxer, "disabling persistent packet cache\n");
         in->seekable_cache = false;
@@ -3010,7 +3174,21 @@ void demux_disable_cache(demuxer_t *demuxer)
         // Get rid of potential old packets in the current range.
         prune_old_packets(in);
     }
-    pthread_mutex_unlock(&in->lock);
+    mp_mutex_unlock(&in->lock);
+}
+
+// Tell the demuxer that playback ran out of packets. With adaptive read-ahead
+// enabled, this makes it buffer more.
+void demux_report_underrun(struct demuxer *demuxer)
+{
+    struct demux_internal *in = demuxer->in;
+    assert(demuxer == in->d_user);
+
+    mp_mutex_lock(&in->lock);
+    in->underrun_reported = true;
+    adapt_readahead(in, mp_time_us());
+    pthread_cond_signal(&in->wakeup);
+    mp_mutex_unlock(&in->lock);
 }
 
 // Disallow reading any packets and make readers think there is no new data
@@ -3020,14 +3198,99 @@ void demux_block_reading(struct demuxer *demuxer, bool block)
     struct demux_internal *in = demuxer->in;
     assert(demuxer == in->d_user);
 
-    pthread_mutex_lock(&in->lock);
+    mp_mutex_lock(&in->lock);
     in->blocked = block;
     for (int n = 0; n < in->num_streams; n++) {
         in->streams[n]->ds->need_wakeup = true;
         wakeup_ds(in->streams[n]->ds);
     }
     pthread_cond_signal(&in->wakeup);
-    pthread_mutex_unlock(&in->lock);
+    mp_mutex_unlock(&in->lock);
+}
+
+// Compute the next read-ahead target in r->target: grow it if the player ran
+// out of packets, or if the stream can be read only barely faster than it is
+// played, and slowly shrink it again while the stream is read much faster than
+// needed. The result is clamped to [r->min_secs, r->max_secs], and to what fits
+// into r->max_bytes. Returns the reason for a change, or NULL if the target was
+// only clamped. Doesn't access any demuxer state.
+const char *demux_readahead_next(struct demux_readahead *r)
+{
+    double target = r->target;
+    const char *reason = NULL;
+    if (r->underrun) {
+        target *= 2;
+        reason = "underrun";
+    } else if (r->media_rate > 0 && r->read_rate > 0 &&
+               r->read_rate < r->media_rate * 2)
+    {
+        target *= 1.5;
+        reason = "slow input";
+    } else if (r->calm_us >= 10 * MP_SECOND_US &&
+               (r->media_rate <= 0 || r->read_rate > r->media_rate * 8))
+    {
+        target *= 0.75;
+        reason = "stable input";
+    }
+
+    target = MPCLAMP(target, r->min_secs, r->max_secs);
+    // Don't aim for more than fits into the packet queue.
+    if (r->media_rate > 0)
+        target = MPMAX(r->min_secs, MPMIN(target, r->max_bytes / r->media_rate));
+
+    r->target = target;
+    return reason;
+}
+
+// Adjust the read-ahead target (in->min_secs) between the configured value and
+// --demuxer-readahead-max-secs. See demux_readahead_next().
+// Must be called locked.
+static void adapt_readahead(struct demux_internal *in, int64_t now)
+{
+    struct demux_opts *opts = in->opts;
+
+    in->ra_last_adapt = now;
+    if (!opts->readahead_adaptive || opts->max_secs_adaptive <= in->min_secs_base)
+        return;
+
+    // Read rate while actually reading, excluding idle time.
+    if (in->ra_busy_us >= MP_SECOND_US / 4) {
+        in->ra_read_rate = in->ra_bytes / (in->ra_busy_us / (double)MP_SECOND_US);
+        in->ra_bytes = 0;
+        in->ra_busy_us = 0;
+    }
+
+    // Bytes per second of media, estimated from the forward buffer.
+    double buffered = 0;
+    for (int n = 0; n < in->num_streams; n++) {
+        struct demux_stream *ds = in->streams[n]->ds;
+        if (ds->eager && ds->base_ts != MP_NOPTS_VALUE &&
+            ds->queue->last_ts != MP_NOPTS_VALUE)
+            buffered = MPMAX(buffered, ds->queue->last_ts - ds->base_ts);
+    }
+
+    struct demux_readahead r = {
+        .target = in->min_secs,
+        .min_secs = in->min_secs_base,
+        .max_secs = opts->max_secs_adaptive,
+        .max_bytes = in->max_bytes,
+        .underrun = in->underrun_reported,
+        .read_rate = in->ra_read_rate,
+        .media_rate = buffered >= 0.5 ? in->fw_bytes / buffered : 0,
+        .calm_us = now - in->ra_calm_since,
+    };
+    const char *reason = demux_readahead_next(&r);
+    in->underrun_reported = false;
+
+    if (reason)
+        in->ra_calm_since = now;
+    if (fabs(r.target - in->min_secs) >= 0.1) {
+        MP_VERBOSE(in, "Read-ahead target %.1fs -> %.1fs (%s, input %.0f KiB/s, "
+                   "media %.0f KiB/s).\n", in->min_secs, r.target,
+                   reason ? reason : "byte limit", in->ra_read_rate / 1024,
+                   r.media_rate / 1024);
+        in->min_secs = r.target;
+    }
 }
 
 // must be called not locked
@@ -3042,10 +3305,13 @@ static void update_cache(struct demux_internal *in)
     int64_t stream_size = stream_get_size(stream);
     stream_control(stream, STREAM_CTRL_GET_METADATA, &stream_metadata);
 
-    demuxer->total_unbuffered_read_bytes += stream->total_unbuffered_read_bytes;
+    int64_t read_bytes = stream->total_unbuffered_read_bytes;
+    demuxer->total_unbuffered_read_bytes += read_bytes;
     stream->total_unbuffered_read_bytes = 0;
 
-    pthread_mutex_lock(&in->lock);
+    mp_mutex_lock(&in->lock);
+
+    in->ra_bytes += read_bytes;
 
     in->stream_size = stream_size;
     if (stream_metadata) {
@@ -3071,7 +3337,10 @@ static void update_cache(struct demux_internal *in)
     if (in->bytes_per_second)
         in->next_cache_update = now + MP_SECOND_US + 1;
 
-    pthread_mutex_unlock(&in->lock);
+    if (now - in->ra_last_adapt >= MP_SECOND_US)
+        adapt_readahead(in, now);
+
+    mp_mutex_unlock(&in->lock);
 }
 
 // must be called locked
@@ -3092,6 +3361,28 @@ static int cached_stream_control(struct demux_internal *in, int cmd, void *arg)
     return STREAM_ERROR;
 }
 
+static bool reader_state_equal(struct demux_ctrl_reader_state *a,
+                               struct demux_ctrl_reader_state *b)
+{
+    if (a->eof != b->eof || a->underrun != b->underrun || a->idle != b->idle ||
+        a->ts_duration != b->ts_duration || a->ts_reader != b->ts_reader ||
+        a->ts_end != b->ts_end || a->total_bytes != b->total_bytes ||
+        a->fw_bytes != b->fw_bytes || a->seeking != b->seeking ||
+        a->low_level_seeks != b->low_level_seeks || a->ts_last != b->ts_last ||
+        a->bytes_per_second != b->bytes_per_second ||
+        a->readahead_target != b->readahead_target ||
+        a->packet_locks != b->packet_locks ||
+        a->packet_wakeups != b->packet_wakeups ||
+        a->num_seek_ranges != b->num_seek_ranges)
+        return false;
+    for (int n = 0; n < a->num_seek_ranges; n++) {
+        if (a->seek_ranges[n].start != b->seek_ranges[n].start ||
+            a->seek_ranges[n].end != b->seek_ranges[n].end)
+            return false;
+    }
+    return true;
+}
+
 // must be called locked
 static int cached_demux_control(struct demux_internal *in, int cmd, void *arg)
 {
@@ -3128,6 +3419,9 @@ static int cached_demux_control(struct demux_internal *in, int cmd, void *arg)
             .low_level_seeks = in->low_level_seeks,
             .ts_last = in->demux_ts,
             .bytes_per_second = in->bytes_per_second,
+            .readahead_target = in->min_secs,
+            .packet_locks = in->packet_locks,
+            .packet_wakeups = in->packet_wakeups,
         };
         bool any_packets = false;
         for (int n = 0; n < in->num_streams; n++) {
@@ -3158,6 +3452,12 @@ static int cached_demux_control(struct demux_internal *in, int cmd, void *arg)
                     };
             }
         }
+        if (!in->reader_state_gen || !reader_state_equal(r, &in->reader_state))
+        {
+            in->reader_state = *r;
+            in->reader_state_gen++;
+        }
+        r->generation = in->reader_state_gen;
         return CONTROL_OK;
     }
     }
@@ -3180,7 +3480,7 @@ static void thread_demux_control(void *p)
     struct demux_internal *in = demuxer->in;
     int r = CONTROL_UNKNOWN;
 
-    pthread_mutex_unlock(&in->lock);
+    mp_mutex_unlock(&in->lock);
 
     if (cmd == DEMUXER_CTRL_STREAM_CTRL) {
         struct demux_ctrl_stream_ctrl *c = arg;
@@ -3197,7 +3497,7 @@ static void thread_demux_control(void *p)
             r = demuxer->desc->control(demuxer->in->d_thread, cmd, arg);
     }
 
-    pthread_mutex_lock(&in->lock);
+    mp_mutex_lock(&in->lock);
 
     *args->r = r;
 }
@@ -3208,9 +3508,9 @@ int demux_control(demuxer_t *demuxer, int cmd, void *arg)
     assert(demuxer == in->d_user);
 
     if (in->threading) {
-        pthread_mutex_lock(&in->lock);
+        mp_mutex_lock(&in->lock);
         int cr = cached_demux_control(in, cmd, arg);
-        pthread_mutex_unlock(&in->lock);
+        mp_mutex_unlock(&in->lock);
         if (cr != CONTROL_UNKNOWN)
             return cr;
     }
@@ -3219,19 +3519,19 @@ int demux_control(demuxer_t *demuxer, int cmd, void *arg)
     struct demux_control_args args = {demuxer, cmd, arg, &r};
     if (in->threading) {
         MP_VERBOSE(in, "blocking on demuxer thread\n");
-        pthread_mutex_lock(&in->lock);
+        mp_mutex_lock(&in->lock);
         while (in->run_fn)
-            pthread_cond_wait(&in->wakeup, &in->lock);
+            mp_cond_wait(&in->wakeup, &in->lock);
         in->run_fn = thread_demux_control;
         in->run_fn_arg = &args;
         pthread_cond_signal(&in->wakeup);
         while (in->run_fn)
-            pthread_cond_wait(&in->wakeup, &in->lock);
-        pthread_mutex_unlock(&in->lock);
+            mp_cond_wait(&in->wakeup, &in->lock);
+        mp_mutex_unlock(&in->lock);
     } else {
-        pthread_mutex_lock(&in->lock);
+        mp_mutex_lock(&in->lock);
         thread_demux_control(&args);
-        pthread_mutex_unlock(&in->lock);
+        mp_mutex_unlock(&in->lock);
     }
 
     return r;
@@ -38,6 +38,8 @@ enum demux_ctrl {
     DEMUXER_CTRL_GET_READER_STATE,
     DEMUXER_CTRL_GET_BITRATE_STATS, // double[STREAM_TYPE_COUNT]
     DEMUXER_CTRL_REPLACE_STREAM,
+    DEMUXER_CTRL_GET_SEEK_INDEX,    // char** (talloc'ed, serialized index)
+    DEMUXER_CTRL_SET_SEEK_INDEX,    // bstr* (as returned by GET_SEEK_INDEX)
 };
 
 #define MAX_SEEK_RANGES 10
@@ -57,6 +59,12 @@ struct demux_ctrl_reader_state {
     int low_level_seeks; // number of started low level seeks
     double ts_last; // approx. timestamp of demuxer position
     uint64_t bytes_per_second; // low level statistics
+    double readahead_target; // current read-ahead duration the demuxer aims for
+    uint64_t packet_locks; // lock acquisitions for packet handoff
+    uint64_t packet_wakeups; // reader wakeups for packet handoff
+    // Changes (to a value != 0) whenever any other field changes. Values from
+    // different demuxers are not comparable.
+    uint64_t generation;
     // Positions that can be seeked to without incurring the latency of a low
     // level seek.
     int num_seek_ranges;
@@ -101,6 +109,7 @@ enum demux_event {
 
 struct demuxer;
 struct timeline;
+struct mp_media_info;
 
 /**
  * Demuxer description structure
@@ -229,6 +238,8 @@ typedef struct demuxer {
     struct mpv_global *global;
     struct mp_log *log, *glog;
     struct demuxer_params *params;
+    // Results of a previous probe of the same file (only during open()).
+    struct mp_media_info *media_info;
 
     // internal to demux.c
     struct demux_internal *in;
@@ -260,16 +271,33 @@ void demux_free_async_force(struct demux_free_async_state *state);
 bool demux_free_async_finish(struct demux_free_async_state *state);
 
 void demux_add_packet(struct sh_stream *stream, demux_packet_t *dp);
+void demux_add_packets(struct demuxer *demuxer, struct demux_packet **pkts,
+                       int num_pkts);
 void demuxer_feed_caption(struct sh_stream *stream, demux_packet_t *dp);
 
 struct demux_packet *demux_read_packet(struct sh_stream *sh);
 int demux_read_packet_async(struct sh_stream *sh, struct demux_packet **out_pkt);
+int demux_read_packets_async(struct sh_stream *sh, struct demux_packet **pkts,
+                             int max_pkts);
 bool demux_stream_is_selected(struct sh_stream *stream);
 bool demux_has_packet(struct sh_stream *sh);
 void demux_set_stream_wakeup_cb(struct sh_stream *sh,
                                 void (*cb)(void *ctx), void *ctx);
 struct demux_packet *demux_read_any_packet(struct demuxer *demuxer);
 
+// Inputs and result of demux_readahead_next().
+struct demux_readahead {
+    double target;          // current read-ahead target (seconds); result
+    double min_secs;        // configured read-ahead (lower bound)
+    double max_secs;        // --demuxer-readahead-max-secs
+    int64_t max_bytes;      // --demuxer-max-bytes
+    bool underrun;          // player ran out of packets
+    double read_rate;       // measured input read rate (bytes/s), or 0
+    double media_rate;      // media bitrate (bytes/s), or 0 if unknown
+    int64_t calm_us;        // time since the target was last changed
+};
+const char *demux_readahead_next(struct demux_readahead *r);
+
 struct sh_stream *demux_get_stream(struct demuxer *demuxer, int index);
 int demux_get_num_stream(struct demuxer *demuxer);
 
@@ -298,6 +326,7 @@ void demux_set_ts_offset(struct demuxer *demuxer, double offset);
 int demux_control(struct demuxer *demuxer, int cmd, void *arg);
 
 void demux_block_reading(struct demuxer *demuxer, bool block);
+void demux_report_underrun(struct demuxer *demuxer);
 
 void demuxer_select_track(struct demuxer *demuxer, struct sh_stream *stream,
                           double ref_pts, bool selected);
@@ -47,6 +47,8 @@
 
 #include "stream/stream.h"
 #include "demux.h"
+#include "media_info.h"
+#include "seek_index.h"
 #include "stheader.h"
 #include "options/m_config.h"
 #include "options/m_option.h"
@@ -80,6 +82,7 @@ struct demux_lavf_opts {
     int hacks;
     char *sub_cp;
     int rtsp_transport;
+    int seek_index;
 };
 
 const struct m_sub_options demux_lavf_conf = {
@@ -103,6 +106,7 @@ const struct m_sub_options demux_lavf_conf = {
                 {"udp", 1},
                 {"tcp", 2},
                 {"http", 3})),
+        OPT_FLAG("demuxer-lavf-seek-index", seek_index, 0),
         {0}
     },
     .size = sizeof(struct demux_lavf_opts),
@@ -116,6 +120,7 @@ const struct m_sub_options demux_lavf_conf = {
         .probescore = AVPROBE_SCORE_MAX/4 + 1,
         .sub_cp = "auto",
         .rtsp_transport = 2,
+        .seek_index = 1,
     },
 };
 
@@ -214,6 +219,10 @@ typedef struct lavf_priv {
     char *mime_type;
     double seek_delay;
 
+    // Learned seek points for formats without a usable index.
+    struct mp_seek_index *seek_index;
+    int seek_index_stream;
+
     struct demux_lavf_opts *opts;
     double mf_fps;
 
@@ -800,6 +809,24 @@ static void nested_io_close(struct AVFormatContext *s, AVIOContext *pb)
     priv->default_io_close(s, pb);
 }
 
+// Whether the stream layout found by avformat_open_input() matches the cached
+// media info, and the header was enough to set up the decoders.
+static bool lavf_header_complete(demuxer_t *demuxer)
+{
+    lavf_priv_t *priv = demuxer->priv;
+    struct mp_media_info *info = demuxer->media_info;
+    if (priv->avfc->nb_streams != info->num_streams)
+        return false;
+    for (int n = 0; n < priv->avfc->nb_streams; n++) {
+        AVCodecParameters *par = priv->avfc->streams[n]->codecpar;
+        if (par->codec_type == AVMEDIA_TYPE_AUDIO &&
+            (par->codec_id == AV_CODEC_ID_NONE || par->sample_rate <= 0 ||
+             par->channels <= 0))
+            return false;
+    }
+    return true;
+}
+
 static int demux_open_lavf(demuxer_t *demuxer, enum demux_check check)
 {
     AVFormatContext *avfc;
@@ -923,6 +950,10 @@ static int demux_open_lavf(demuxer_t *demuxer, enum demux_check check)
     }
     if (demuxer->params && demuxer->params->skip_lavf_probing)
         probeinfo = false;
+    if (probeinfo && demuxer->media_info && lavf_header_complete(demuxer)) {
+        MP_VERBOSE(demuxer, "Skipping stream info probing (cached).\n");
+        probeinfo = false;
+    }
     if (probeinfo) {
         if (avformat_find_stream_info(avfc, NULL) < 0) {
             MP_ERR(demuxer, "av_find_stream_info() failed\n");
@@ -961,6 +992,19 @@ static int demux_open_lavf(demuxer_t *demuxer, enum demux_check check)
     demuxer->is_network |= priv->format_hack.is_network;
     demuxer->seekable &= !priv->format_hack.no_seek;
 
+    // VBR MP3 without TOC and ADTS AAC have no index, so libavformat has to
+    // estimate and refine the position on each seek.
+    if (lavfdopts->seek_index && demuxer->seekable &&
+        (matches_avinputformat_name(priv, "mp3") ||
+         matches_avinputformat_name(priv, "aac")))
+    {
+        int index = av_find_best_stream(avfc, AVMEDIA_TYPE_AUDIO, -1, -1, NULL, 0);
+        if (index >= 0) {
+            priv->seek_index = mp_seek_index_create(priv, 1.0);
+            priv->seek_index_stream = index;
+        }
+    }
+
     if (priv->avfc->duration > 0) {
         demuxer->duration = (double)priv->avfc->duration / AV_TIME_BASE;
     } else {
@@ -997,7 +1041,13 @@ static int demux_open_lavf(demuxer_t *demuxer, enum demux_check check)
     return 0;
 }
 
-static int demux_lavf_fill_buffer(demuxer_t *demux)
+// Maximum number of packets read by a single fill_buffer call.
+#define PACKET_BATCH 16
+
+// Read a single packet. Returns 1 if *out_dp was set or the packet was
+// skipped, 0 on EOF, -1 on errors, and 2 if no more packets should be read
+// by this fill_buffer call.
+static int read_packet(demuxer_t *demux, struct demux_packet **out_dp)
 {
     lavf_priv_t *priv = demux->priv;
 
@@ -1007,13 +1057,14 @@ static int demux_lavf_fill_buffer(demuxer_t *demux)
     if (r < 0) {
         av_packet_unref(pkt);
         if (r == AVERROR(EAGAIN))
-            return 1;
+            return 2;
         if (r == AVERROR_EOF)
             return 0;
         MP_WARN(demux, "error reading packet.\n");
         return -1;
     }
 
+    int num_streams = priv->num_streams;
     add_new_streams(demux);
     update_metadata(demux);
 
@@ -1021,7 +1072,9 @@ static int demux_lavf_fill_buffer(demuxer_t *demux)
     struct sh_stream *stream = priv->streams[pkt->stream_index];
     AVStream *st = priv->avfc->streams[pkt->stream_index];
 
-    if (!demux_stream_is_selected(stream)) {
+    // (select_tracks() keeps st->discard in sync with the stream selection,
+    // which avoids taking the demuxer lock for each packet.)
+    if (!stream || st->discard == AVDISCARD_ALL) {
         av_packet_unref(pkt);
         return 1; // don't signal EOF if skipping a packet
     }
@@ -1039,6 +1092,7 @@ static int demux_lavf_fill_buffer(demuxer_t *demux)
     dp->duration = pkt->duration * av_q2d(st->time_base);
     dp->pos = pkt->pos;
     dp->keyframe = pkt->flags & AV_PKT_FLAG_KEY;
+    int pkt_stream = pkt->stream_index;
 #if LIBAVFORMAT_VERSION_MICRO >= 100
     if (pkt->flags & AV_PKT_FLAG_DISCARD)
         MP_ERR(demux, "Edit lists are not correctly supported (FFmpeg issue).\n");
@@ -1048,8 +1102,60 @@ static int demux_lavf_fill_buffer(demuxer_t *demux)
     if (priv->format_hack.clear_filepos)
         dp->pos = -1;
 
-    demux_add_packet(stream, dp);
-    return 1;
+    if (priv->seek_index && pkt_stream == priv->seek_index_stream &&
+        dp->keyframe && dp->pts != MP_NOPTS_VALUE)
+        mp_seek_index_add(priv->seek_index, dp->pts, dp->pos);
+
+    dp->stream = stream->index;
+    *out_dp = dp;
+    // Let the player see new streams before more packets are queued.
+    return num_streams != priv->num_streams ? 2 : 1;
+}
+
+// Packets are handed to the demuxer cache in batches, which takes the cache
+// lock only once per batch. Network streams read a single packet per call,
+// since a blocking read would delay the packets already read.
+static int demux_lavf_fill_buffer(demuxer_t *demux)
+{
+    struct demux_packet *pkts[PACKET_BATCH];
+    int num_pkts = 0;
+    int max_pkts = demux->is_network ? 1 : PACKET_BATCH;
+
+    int r = 1;
+    for (int n = 0; n < max_pkts; n++) {
+        struct demux_packet *dp = NULL;
+        r = read_packet(demux, &dp);
+        if (dp)
+            pkts[num_pkts++] = dp;
+        if (r != 1 || demux_cancel_test(demux))
+            break;
+    }
+
+    demux_add_packets(demux, pkts, num_pkts);
+
+    // Report EOF/errors only once all read packets were returned.
+    if (num_pkts || r == 2)
+        return 1;
+    return r;
+}
+
+// Make a learned seek point before the target known to libavformat. Its
+// seek code then goes straight to that position and sets the timestamps from
+// it, instead of estimating the position from the bitrate.
+static void add_seek_index_hint(demuxer_t *demuxer, double seek_pts)
+{
+    lavf_priv_t *priv = demuxer->priv;
+    double pts;
+    int64_t pos;
+
+    if (!priv->seek_index ||
+        !mp_seek_index_find(priv->seek_index, seek_pts, &pts, &pos))
+        return;
+
+    AVStream *st = priv->avfc->streams[priv->seek_index_stream];
+    int64_t ts = llrint(pts / av_q2d(st->time_base));
+    if (av_add_index_entry(st, pos, ts, 0, 0, AVINDEX_KEYFRAME) >= 0)
+        MP_DBG(demuxer, "seek index hint: %f at %"PRId64"\n", pts, pos);
 }
 
 static void demux_seek_lavf(demuxer_t *demuxer, double seek_pts, int flags)
@@ -1075,8 +1181,10 @@ static void demux_seek_lavf(demuxer_t *demuxer, double seek_pts, int flags)
             seek_pts_av = seek_pts * priv->avfc->duration;
         }
     } else {
-        if (!(flags & SEEK_FORWARD))
+        if (!(flags & SEEK_FORWARD)) {
             seek_pts -= priv->seek_delay;
+            add_seek_index_hint(demuxer, seek_pts);
+        }
         seek_pts_av = seek_pts * AV_TIME_BASE;
     }
 
@@ -1108,6 +1216,24 @@ static int demux_lavf_control(demuxer_t *demuxer, int cmd, void *arg)
         select_tracks(demuxer, 0);
         return CONTROL_OK;
     }
+    case DEMUXER_CTRL_GET_SEEK_INDEX: {
+        if (!priv->seek_index || !mp_seek_index_get_count(priv->seek_index))
+            return CONTROL_FALSE;
+        *(char **)arg = mp_seek_index_save(priv->seek_index, NULL,
+                                           stream_get_size(priv->stream));
+        return CONTROL_OK;
+    }
+    case DEMUXER_CTRL_SET_SEEK_INDEX: {
+        if (!priv->seek_index)
+            return CONTROL_FALSE;
+        bstr *data = arg;
+        if (!mp_seek_index_load(priv->seek_index, *data,
+                                stream_get_size(priv->stream)))
+            return CONTROL_ERROR;
+        MP_VERBOSE(demuxer, "Loaded seek index with %d entries.\n",
+                   mp_seek_index_get_count(priv->seek_index));
+        return CONTROL_OK;
+    }
     case DEMUXER_CTRL_IDENTIFY_PROGRAM:
     {
         demux_program_t *prog = arg;
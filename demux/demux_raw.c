@@ -23,6 +23,7 @@
 #include <string.h>
 
 #include <libavcodec/avcodec.h>
+#include <libavutil/buffer.h>
 #include <libavutil/common.h>
 
 #include "common/av_common.h"
@@ -95,6 +96,7 @@ struct priv {
     int frame_size;
     int read_frames;
     double frame_rate;
+    AVBufferRef *mem;   // stream data, if the stream is in memory
 };
 
 static int generic_open(struct demuxer *demuxer)
@@ -106,9 +108,45 @@ static int generic_open(struct demuxer *demuxer)
     if (stream_control(s, STREAM_CTRL_GET_SIZE, &end) == STREAM_OK)
         demuxer->duration = (end / p->frame_size) / p->frame_rate;
 
+    // If the data is already in memory, packets can reference it directly.
+    if (stream_control(s, STREAM_CTRL_GET_BUFFER, &p->mem) != STREAM_OK)
+        p->mem = NULL;
+
     return 0;
 }
 
+static void raw_close(struct demuxer *demuxer)
+{
+    struct priv *p = demuxer->priv;
+    if (p)
+        av_buffer_unref(&p->mem);
+}
+
+// Create a packet referencing the stream's memory buffer, or return NULL.
+static struct demux_packet *read_mem_packet(demuxer_t *demuxer, int len)
+{
+    struct priv *p = demuxer->priv;
+    int64_t pos = stream_tell(demuxer->stream);
+    len = MPMIN(len, p->mem->size - pos);
+    // Packets need padding; the last one is copied.
+    if (pos < 0 || len <= 0 ||
+        pos + len + AV_INPUT_BUFFER_PADDING_SIZE > p->mem->size)
+        return NULL;
+
+    AVBufferRef *ref = av_buffer_ref(p->mem);
+    if (!ref)
+        return NULL;
+    ref->data += pos;
+    ref->size = len;
+    struct demux_packet *dp = new_demux_packet_from_buf(ref);
+    av_buffer_unref(&ref);
+    if (dp) {
+        dp->pos = pos;
+        stream_seek(demuxer->stream, pos + len);
+    }
+    return dp;
+}
+
 static int demux_rawaudio_open(demuxer_t *demuxer, enum demux_check check)
 {
     struct demux_rawaudio_opts *opts =
@@ -157,7 +195,15 @@ static int raw_fill_buffer(demuxer_t *demuxer)
     if (demuxer->stream->eof)
         return 0;
 
-    struct demux_packet *dp = new_demux_packet(p->frame_size * p->read_frames);
+    int size = p->frame_size * p->read_frames;
+    struct demux_packet *dp = p->mem ? read_mem_packet(demuxer, size) : NULL;
+    if (dp) {
+        dp->pts = (dp->pos / p->frame_size) / p->frame_rate;
+        demux_add_packet(p->sh, dp);
+        return 1;
+    }
+
+    dp = new_demux_packet(size);
     if (!dp) {
         MP_ERR(demuxer, "Can't read packet.\n");
         return 1;
@@ -195,5 +241,6 @@ const demuxer_desc_t demuxer_desc_rawaudio = {
     .open = demux_rawaudio_open,
     .fill_buffer = raw_fill_buffer,
     .seek = raw_seek,
+    .close = raw_close,
 };
 
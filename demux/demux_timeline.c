@@ -17,15 +17,69 @@
 
 #include <assert.h>
 #include <limits.h>
+#include <pthread.h>
 
 #include "common/common.h"
 #include "common/msg.h"
+#include "misc/thread_pool.h"
+#include "misc/thread_tools.h"
+#include "options/m_config.h"
+#include "options/m_option.h"
 
 #include "demux.h"
 #include "timeline.h"
 #include "stheader.h"
 #include "stream/stream.h"
 
+struct demux_timeline_opts {
+    int preopen;
+    double prebuffer_secs;
+};
+
+#define OPT_BASE_STRUCT struct demux_timeline_opts
+const struct m_sub_options demux_timeline_conf = {
+    .opts = (const struct m_option[]){
+        OPT_INTRANGE("demuxer-timeline-preopen", preopen, 0, 0, 16),
+        OPT_DOUBLE("demuxer-timeline-prebuffer", prebuffer_secs, M_OPT_MIN,
+                   .min = 0),
+        {0}
+    },
+    .size = sizeof(struct demux_timeline_opts),
+    .defaults = &(const struct demux_timeline_opts){
+        .preopen = 1,
+        .prebuffer_secs = 1.0,
+    },
+};
+
+// Upper bound for packets prebuffered for a single segment.
+#define MAX_PREBUFFER_PACKETS 1000
+
+struct priv;
+
+// Background open and prebuffer of an upcoming segment. Created and destroyed
+// on the demuxer thread; the worker thread owns d and the packet list until
+// it sets done (under priv.lock).
+struct preopen_job {
+    struct priv *p;
+    struct mpv_global *global;
+    struct mp_log *log;
+    struct mp_cancel *cancel;   // slave of the timeline demuxer's cancel
+
+    // Parameters, read-only while the job is running.
+    char *url;
+    bstr init_fragment;
+    bool want[STREAM_TYPE_COUNT];
+    bool prebuffer;
+    double start;               // segment start on the virtual timeline
+    double ts_offset;
+
+    // Results.
+    bool done;
+    struct demuxer *d;          // if NULL on start, opened by the job
+    struct demux_packet **pkts;
+    int num_pkts;
+};
+
 struct segment {
     int index;
     double start, end;
@@ -39,6 +93,12 @@ struct segment {
     // Uses -1 for streams that do not appear in the virtual timeline.
     int *stream_map;
     int num_stream_map;
+
+    // If non-NULL, d is owned by this job until it is finished.
+    struct preopen_job *job;
+    // Packets read ahead by the job, returned before reading from d.
+    struct demux_packet **pkts;
+    int num_pkts, pkts_pos;
 };
 
 // Information for each stream on the virtual timeline. (Mirrors streams
@@ -51,6 +111,7 @@ struct virtual_stream {
 
 struct priv {
     struct timeline *tl;
+    struct demux_timeline_opts *opts;
 
     double duration;
     bool dash;
@@ -66,6 +127,11 @@ struct priv {
     // Total number of packets received past end of segment. Used
     // to be clever about determining when to switch segments.
     int eos_packets;
+
+    // For preopen_job (lock protects preopen_job.done and the results).
+    struct mp_thread_pool *pool;
+    pthread_mutex_t lock;
+    pthread_cond_t wakeup;
 };
 
 static bool target_stream_used(struct segment *seg, int target_index)
@@ -124,7 +190,7 @@ static void reselect_streams(struct demuxer *demuxer)
     for (int n = 0; n < p->num_segments; n++) {
         struct segment *seg = p->segments[n];
         for (int i = 0; i < seg->num_stream_map; i++) {
-            if (!seg->d)
+            if (!seg->d || seg->job)
                 continue;
 
             struct sh_stream *sh = demux_get_stream(seg->d, i);
@@ -139,13 +205,173 @@ static void reselect_streams(struct demuxer *demuxer)
     }
 }
 
-static void close_lazy_segments(struct demuxer *demuxer)
+// Whether seg is one of the segments following the current one that should
+// be opened ahead of time.
+static bool in_preopen_window(struct priv *p, struct segment *seg)
+{
+    int cur = p->current ? p->current->index : -1;
+    return seg->index > cur && seg->index <= cur + p->opts->preopen;
+}
+
+static void flush_prebuffered(struct segment *seg)
+{
+    for (int n = seg->pkts_pos; n < seg->num_pkts; n++)
+        talloc_free(seg->pkts[n]);
+    TA_FREEP(&seg->pkts);
+    seg->num_pkts = seg->pkts_pos = 0;
+}
+
+// Return whether no other segment uses the same source demuxer (only then a
+// job can read from it without interfering with playback).
+static bool segment_owns_demuxer(struct priv *p, struct segment *seg)
+{
+    for (int n = 0; n < p->num_segments; n++) {
+        if (p->segments[n] != seg && p->segments[n]->d == seg->d)
+            return false;
+    }
+    return true;
+}
+
+static void preopen_run(void *ctx)
+{
+    struct preopen_job *job = ctx;
+    struct priv *p = job->p;
+
+    struct demuxer *d = job->d;
+    if (!d) {
+        struct demuxer_params params = {
+            .init_fragment = job->init_fragment,
+            .skip_lavf_probing = true,
+        };
+        d = demux_open_url(job->url, &params, job->cancel, job->global);
+        if (d)
+            demux_disable_cache(d);
+    }
+
+    struct demux_packet **pkts = NULL;
+    int num_pkts = 0;
+    if (d && job->prebuffer) {
+        // Do what switch_segment() would do, and read the first packets.
+        int num_streams = demux_get_num_stream(d);
+        for (int n = 0; n < num_streams; n++) {
+            struct sh_stream *sh = demux_get_stream(d, n);
+            demuxer_select_track(d, sh, MP_NOPTS_VALUE, job->want[sh->type]);
+        }
+        demux_set_ts_offset(d, job->ts_offset);
+        demux_seek(d, job->start, SEEK_HR);
+        while (num_pkts < MAX_PREBUFFER_PACKETS && !mp_cancel_test(job->cancel)) {
+            struct demux_packet *pkt = demux_read_any_packet(d);
+            if (!pkt)
+                break;
+            MP_TARRAY_APPEND(job, pkts, num_pkts, pkt);
+            if (pkt->pts != MP_NOPTS_VALUE &&
+                pkt->pts >= job->start + p->opts->prebuffer_secs)
+                break;
+        }
+    }
+
+    mp_verbose(job->log, "segment %s preopened, %d packets prebuffered\n",
+               job->url, num_pkts);
+
+    pthread_mutex_lock(&p->lock);
+    job->d = d;
+    job->pkts = pkts;
+    job->num_pkts = num_pkts;
+    job->done = true;
+    pthread_cond_broadcast(&p->wakeup);
+    pthread_mutex_unlock(&p->lock);
+}
+
+static void start_preopen(struct demuxer *demuxer, struct segment *seg,
+                          bool prebuffer)
+{
+    struct priv *p = demuxer->priv;
+
+    struct preopen_job *job = talloc_ptrtype(NULL, job);
+    *job = (struct preopen_job){
+        .p = p,
+        .global = demuxer->global,
+        .log = demuxer->log,
+        .cancel = mp_cancel_new(job),
+        .url = seg->url,
+        .init_fragment = p->tl->init_fragment,
+        .prebuffer = prebuffer,
+        .start = seg->start,
+        .ts_offset = seg->start - seg->d_start,
+        .d = seg->d,
+    };
+    mp_cancel_set_parent(job->cancel, demuxer->cancel);
+    for (int n = 0; n < p->num_streams; n++) {
+        struct virtual_stream *vs = p->streams[n];
+        job->want[vs->sh->type] |= vs->selected;
+    }
+
+    MP_VERBOSE(demuxer, "preopening segment %d\n", seg->index);
+
+    seg->job = job;
+    seg->d = NULL;
+    if (!p->pool || !mp_thread_pool_queue(p->pool, preopen_run, job))
+        preopen_run(job);
+}
+
+// Wait for the job of the given segment and give the segment its demuxer back.
+// If use_pkts is set, the prebuffered packets are kept, and the function
+// returns true if there are any. With cancel set, the job is aborted, and a
+// demuxer it opened is discarded.
+static bool finish_preopen(struct demuxer *demuxer, struct segment *seg,
+                           bool use_pkts, bool cancel)
+{
+    struct priv *p = demuxer->priv;
+    struct preopen_job *job = seg->job;
+    if (!job)
+        return false;
+
+    if (cancel)
+        mp_cancel_trigger(job->cancel);
+
+    pthread_mutex_lock(&p->lock);
+    while (!job->done)
+        pthread_cond_wait(&p->wakeup, &p->lock);
+    pthread_mutex_unlock(&p->lock);
+
+    seg->job = NULL;
+    flush_prebuffered(seg);
+
+    struct demuxer *d = job->d;
+    if (d && seg->lazy) {
+        if (cancel) {
+            demux_free(d);
+            d = NULL;
+        } else {
+            // Detach from the job's mp_cancel, which is freed below.
+            mp_cancel_set_parent(d->cancel, demuxer->cancel);
+        }
+    }
+    seg->d = d;
+
+    if (use_pkts && !cancel) {
+        seg->pkts = talloc_steal(NULL, job->pkts);
+        seg->num_pkts = job->num_pkts;
+        job->pkts = NULL;
+    }
+    for (int n = 0; job->pkts && n < job->num_pkts; n++)
+        talloc_free(job->pkts[n]);
+    talloc_free(job);
+
+    associate_streams(demuxer, seg);
+
+    return seg->num_pkts > 0;
+}
+
+static void close_lazy_segments(struct demuxer *demuxer, bool keep_window)
 {
     struct priv *p = demuxer->priv;
 
     // unload previous segment
     for (int n = 0; n < p->num_segments; n++) {
         struct segment *seg = p->segments[n];
+        if (keep_window && in_preopen_window(p, seg))
+            continue;
         if (seg != p->current && seg->d && seg->lazy) {
             demux_free(seg->d);
             seg->d = NULL;
@@ -153,6 +379,32 @@ static void close_lazy_segments(struct demuxer *demuxer)
     }
 }
 
+// Abort preopen jobs that are no longer useful, and start new ones for the
+// segments following the current one. Only the current and the preopened
+// segments keep their demuxers.
+static void update_preopen(struct demuxer *demuxer)
+{
+    struct priv *p = demuxer->priv;
+
+    for (int n = 0; n < p->num_segments; n++) {
+        struct segment *seg = p->segments[n];
+        if (seg->job && !in_preopen_window(p, seg))
+            finish_preopen(demuxer, seg, false, true);
+    }
+
+    close_lazy_segments(demuxer, true);
+
+    for (int n = 0; n < p->num_segments; n++) {
+        struct segment *seg = p->segments[n];
+        if (seg->job || seg == p->current || !in_preopen_window(p, seg))
+            continue;
+        bool prebuffer = !p->dash && p->opts->prebuffer_secs > 0 &&
+                         (!seg->d || segment_owns_demuxer(p, seg));
+        if (!seg->d || prebuffer)
+            start_preopen(demuxer, seg, prebuffer);
+    }
+}
+
 static void reopen_lazy_segments(struct demuxer *demuxer)
 {
     struct priv *p = demuxer->priv;
@@ -160,7 +412,7 @@ static void reopen_lazy_segments(struct demuxer *demuxer)
     if (p->current->d)
         return;
 
-    close_lazy_segments(demuxer);
+    close_lazy_segments(demuxer, true);
 
     struct demuxer_params params = {
         .init_fragment = p->tl->init_fragment,
@@ -185,14 +437,22 @@ static void switch_segment(struct demuxer *demuxer, struct segment *new,
 
     MP_VERBOSE(demuxer, "switch to segment %d\n", new->index);
 
+    if (p->current)
+        flush_prebuffered(p->current);
+
     p->current = new;
+    // The prebuffered packets are only useful if playback simply continues
+    // into the next segment.
+    bool prebuffered = finish_preopen(demuxer, new,
+                                      init && start_pts == new->start, false);
+    update_preopen(demuxer);
     reopen_lazy_segments(demuxer);
     if (!new->d)
         return;
     reselect_streams(demuxer);
     if (!p->dash)
         demux_set_ts_offset(new->d, new->start - new->d_start);
-    if (!p->dash || !init)
+    if ((!p->dash || !init) && !prebuffered)
         demux_seek(new->d, start_pts, flags);
 
     for (int n = 0; n < p->num_streams; n++) {
@@ -233,7 +493,13 @@ static int d_fill_buffer(struct demuxer *demuxer)
     if (!seg || !seg->d)
         return 0;
 
-    struct demux_packet *pkt = demux_read_any_packet(seg->d);
+    struct demux_packet *pkt = NULL;
+    if (seg->pkts_pos < seg->num_pkts) {
+        pkt = seg->pkts[seg->pkts_pos++];
+    } else {
+        flush_prebuffered(seg);
+        pkt = demux_read_any_packet(seg->d);
+    }
     if (!pkt || pkt->pts >= seg->end)
         p->eos_packets += 1;
 
@@ -348,6 +614,12 @@ static int d_open(struct demuxer *demuxer, enum demux_check check)
     if (!p->tl || p->tl->num_parts < 1)
         return -1;
 
+    p->opts = mp_get_config_group(p, demuxer->global, &demux_timeline_conf);
+    pthread_mutex_init(&p->lock, NULL);
+    pthread_cond_init(&p->wakeup, NULL);
+    if (p->opts->preopen > 0)
+        p->pool = mp_thread_pool_create(p, 0, 0, 1);
+
     p->duration = p->tl->parts[p->tl->num_parts].start;
 
     demuxer->chapters = p->tl->chapters;
@@ -428,8 +700,15 @@ static void d_close(struct demuxer *demuxer)
 {
     struct priv *p = demuxer->priv;
     struct demuxer *master = p->tl->demuxer;
+    for (int n = 0; n < p->num_segments; n++) {
+        finish_preopen(demuxer, p->segments[n], false, true);
+        flush_prebuffered(p->segments[n]);
+    }
+    TA_FREEP(&p->pool);
+    pthread_cond_destroy(&p->wakeup);
+    pthread_mutex_destroy(&p->lock);
     p->current = NULL;
-    close_lazy_segments(demuxer);
+    close_lazy_segments(demuxer, false);
     timeline_destroy(p->tl);
     demux_free(master);
 }
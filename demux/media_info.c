@@ -0,0 +1,409 @@
+/*
+ * This file is part of mpv.
+ *
+ * mpv is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * mpv is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with mpv.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <stdio.h>
+#include <string.h>
+#include <stdint.h>
+#include <unistd.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+
+#include <libavutil/md5.h>
+
+#include "mpa_talloc.h"
+
+#include "common/msg.h"
+#include "common/tags.h"
+#include "misc/bstr.h"
+#include "options/path.h"
+#include "osdep/io.h"
+#include "stream/stream.h"
+
+#include "demux.h"
+#include "stheader.h"
+#include "media_info.h"
+
+// One file per media file, named after the MD5 of the absolute path. The file
+// starts with the magic and version, followed by the key (path, mtime, size)
+// and the probed data. All integers are little endian, strings are stored as
+// 32 bit length + bytes (no terminating 0).
+#define MEDIA_INFO_MAGIC "MPAMINFO"
+#define MEDIA_INFO_VERSION 1
+#define MEDIA_INFO_DIR "media_info"
+
+// Sanity limit for entries; real files are a few KB at most.
+#define MEDIA_INFO_MAX_SIZE (4 * 1024 * 1024)
+
+struct file_key {
+    char *path;
+    int64_t mtime;
+    int64_t size;
+};
+
+static bool get_file_key(void *ta_ctx, struct stream *s, struct file_key *key)
+{
+    if (!s->is_local_file || !s->path || s->is_directory)
+        return false;
+
+    // (mp_path_join() ignores cwd if the path is already absolute.)
+    char *cwd = mp_getcwd(ta_ctx);
+    if (!cwd)
+        return false;
+    char *path = mp_path_join(ta_ctx, cwd, s->path);
+
+    struct stat st;
+    if (stat(path, &st) || !S_ISREG(st.st_mode))
+        return false;
+
+    *key = (struct file_key){
+        .path = path,
+        .mtime = st.st_mtime,
+        .size = st.st_size,
+    };
+    return true;
+}
+
+static char *get_entry_filename(void *ta_ctx, struct mpv_global *global,
+                                const char *dir, const char *path)
+{
+    uint8_t md5[16];
+    av_md5_sum(md5, path, strlen(path));
+    char name[33];
+    for (int i = 0; i < 16; i++)
+        snprintf(name + i * 2, 3, "%02X", md5[i]);
+
+    char *base = NULL;
+    if (dir && dir[0]) {
+        base = mp_get_user_path(ta_ctx, global, dir);
+    } else {
+        base = mp_find_user_config_file(ta_ctx, global, MEDIA_INFO_DIR);
+    }
+    if (!base)
+        return NULL;
+    mp_mkdirp(base);
+    return mp_path_join(ta_ctx, base, name);
+}
+
+// --- serialization
+
+static void put_u8(void *ta_ctx, bstr *b, uint8_t v)
+{
+    bstr_xappend(ta_ctx, b, (bstr){&v, 1});
+}
+
+static void put_u32(void *ta_ctx, bstr *b, uint32_t v)
+{
+    uint8_t d[4];
+    for (int n = 0; n < 4; n++)
+        d[n] = v >> (n * 8);
+    bstr_xappend(ta_ctx, b, (bstr){d, 4});
+}
+
+static void put_u64(void *ta_ctx, bstr *b, uint64_t v)
+{
+    put_u32(ta_ctx, b, v & 0xFFFFFFFF);
+    put_u32(ta_ctx, b, v >> 32);
+}
+
+static void put_double(void *ta_ctx, bstr *b, double v)
+{
+    uint64_t i;
+    memcpy(&i, &v, sizeof(i));
+    put_u64(ta_ctx, b, i);
+}
+
+static void put_str(void *ta_ctx, bstr *b, const char *s)
+{
+    bstr str = bstr0(s);
+    put_u32(ta_ctx, b, str.len);
+    bstr_xappend(ta_ctx, b, str);
+}
+
+static void put_tags(void *ta_ctx, bstr *b, struct mp_tags *tags)
+{
+    int num = tags ? tags->num_keys : 0;
+    put_u32(ta_ctx, b, num);
+    for (int n = 0; n < num; n++) {
+        put_str(ta_ctx, b, tags->keys[n]);
+        put_str(ta_ctx, b, tags->values[n]);
+    }
+}
+
+struct reader {
+    bstr data;
+    bool error;
+};
+
+static bstr get_bytes(struct reader *r, size_t len)
+{
+    if (r->error || r->data.len < len) {
+        r->error = true;
+        return (bstr){0};
+    }
+    bstr res = bstr_splice(r->data, 0, len);
+    r->data = bstr_cut(r->data, len);
+    return res;
+}
+
+static uint8_t get_u8(struct reader *r)
+{
+    bstr d = get_bytes(r, 1);
+    return d.len ? d.start[0] : 0;
+}
+
+static uint32_t get_u32(struct reader *r)
+{
+    bstr d = get_bytes(r, 4);
+    uint32_t v = 0;
+    for (int n = 0; n < d.len; n++)
+        v |= (uint32_t)d.start[n] << (n * 8);
+    return v;
+}
+
+static uint64_t get_u64(struct reader *r)
+{
+    uint64_t lo = get_u32(r);
+    uint64_t hi = get_u32(r);
+    return lo | (hi << 32);
+}
+
+static double get_double(struct reader *r)
+{
+    uint64_t i = get_u64(r);
+    double v;
+    memcpy(&v, &i, sizeof(v));
+    return v;
+}
+
+static char *get_str(void *ta_ctx, struct reader *r)
+{
+    uint32_t len = get_u32(r);
+    bstr d = get_bytes(r, len);
+    return r->error ? NULL : bstrto0(ta_ctx, d);
+}
+
+static struct mp_tags *get_tags(void *ta_ctx, struct reader *r)
+{
+    struct mp_tags *tags = talloc_zero(ta_ctx, struct mp_tags);
+    uint32_t num = get_u32(r);
+    for (uint32_t n = 0; n < num && !r->error; n++) {
+        char *key = get_str(tags, r);
+        char *val = get_str(tags, r);
+        if (key && val)
+            mp_tags_set_str(tags, key, val);
+    }
+    return tags;
+}
+
+static bool parse_entry(struct mp_media_info *info, bstr data,
+                        struct file_key *key)
+{
+    struct reader r = {data};
+
+    bstr magic = get_bytes(&r, strlen(MEDIA_INFO_MAGIC));
+    if (!bstr_equals0(magic, MEDIA_INFO_MAGIC) ||
+        get_u32(&r) != MEDIA_INFO_VERSION)
+        return false;
+
+    char *path = get_str(info, &r);
+    int64_t mtime = get_u64(&r);
+    int64_t size = get_u64(&r);
+    if (r.error || strcmp(path, key->path) != 0 || mtime != key->mtime ||
+        size != key->size)
+        return false;
+
+    info->demuxer = get_str(info, &r);
+    info->filetype = get_str(info, &r);
+    if (info->filetype && !info->filetype[0])
+        info->filetype = NULL;
+    info->start_time = get_double(&r);
+    info->duration = get_double(&r);
+
+    uint32_t num_streams = get_u32(&r);
+    for (uint32_t n = 0; n < num_streams && !r.error; n++) {
+        struct mp_media_info_stream st = {0};
+        st.type = get_u8(&r);
+        st.codec = get_str(info, &r);
+        st.samplerate = get_u32(&r);
+        st.channels = get_u32(&r);
+        st.has_replaygain = get_u8(&r);
+        st.replaygain.track_gain = get_double(&r);
+        st.replaygain.track_peak = get_double(&r);
+        st.replaygain.album_gain = get_double(&r);
+        st.replaygain.album_peak = get_double(&r);
+        if (st.type >= STREAM_TYPE_COUNT)
+            r.error = true;
+        MP_TARRAY_APPEND(info, info->streams, info->num_streams, st);
+    }
+
+    info->metadata = get_tags(info, &r);
+
+    uint32_t num_chapters = get_u32(&r);
+    for (uint32_t n = 0; n < num_chapters && !r.error; n++) {
+        struct mp_media_info_chapter ch = {0};
+        ch.pts = get_double(&r);
+        ch.metadata = get_tags(info, &r);
+        MP_TARRAY_APPEND(info, info->chapters, info->num_chapters, ch);
+    }
+
+    return !r.error && info->demuxer && info->demuxer[0];
+}
+
+struct mp_media_info *mp_media_info_load(void *ta_ctx, struct mp_log *log,
+                                         struct mpv_global *global,
+                                         const char *dir, struct stream *s)
+{
+    void *tmp = talloc_new(NULL);
+    struct mp_media_info *info = NULL;
+
+    struct file_key key;
+    if (!get_file_key(tmp, s, &key))
+        goto done;
+
+    char *fname = get_entry_filename(tmp, global, dir, key.path);
+    if (!fname)
+        goto done;
+
+    FILE *f = fopen(fname, "rb");
+    if (!f)
+        goto done;
+    bstr data = {0};
+    char buf[4096];
+    while (data.len < MEDIA_INFO_MAX_SIZE) {
+        size_t r = fread(buf, 1, sizeof(buf), f);
+        if (!r)
+            break;
+        bstr_xappend(tmp, &data, (bstr){buf, r});
+    }
+    fclose(f);
+
+    info = talloc_zero(ta_ctx, struct mp_media_info);
+    if (parse_entry(info, data, &key)) {
+        mp_verbose(log, "Using cached media info from %s\n", fname);
+    } else {
+        mp_verbose(log, "Ignoring stale or invalid media info %s\n", fname);
+        TA_FREEP(&info);
+    }
+
+done:
+    talloc_free(tmp);
+    return info;
+}
+
+void mp_media_info_store(struct mp_log *log, struct mpv_global *global,
+                         const char *dir, struct stream *s,
+                         struct demuxer *demuxer)
+{
+    void *tmp = talloc_new(NULL);
+
+    struct file_key key;
+    if (!get_file_key(tmp, s, &key))
+        goto done;
+
+    char *fname = get_entry_filename(tmp, global, dir, key.path);
+    if (!fname)
+        goto done;
+
+    bstr b = {0};
+    bstr_xappend(tmp, &b, bstr0(MEDIA_INFO_MAGIC));
+    put_u32(tmp, &b, MEDIA_INFO_VERSION);
+    put_str(tmp, &b, key.path);
+    put_u64(tmp, &b, key.mtime);
+    put_u64(tmp, &b, key.size);
+
+    put_str(tmp, &b, demuxer->desc->name);
+    put_str(tmp, &b, demuxer->filetype);
+    put_double(tmp, &b, demuxer->start_time);
+    put_double(tmp, &b, demuxer->duration);
+
+    int num_streams = demux_get_num_stream(demuxer);
+    put_u32(tmp, &b, num_streams);
+    for (int n = 0; n < num_streams; n++) {
+        struct sh_stream *sh = demux_get_stream(demuxer, n);
+        struct mp_codec_params *c = sh->codec;
+        struct replaygain_data rg = {0};
+        if (c->replaygain_data)
+            rg = *c->replaygain_data;
+        put_u8(tmp, &b, sh->type);
+        put_str(tmp, &b, c->codec);
+        put_u32(tmp, &b, c->samplerate);
+        put_u32(tmp, &b, c->channels.num);
+        put_u8(tmp, &b, !!c->replaygain_data);
+        put_double(tmp, &b, rg.track_gain);
+        put_double(tmp, &b, rg.track_peak);
+        put_double(tmp, &b, rg.album_gain);
+        put_double(tmp, &b, rg.album_peak);
+    }
+
+    put_tags(tmp, &b, demuxer->metadata);
+
+    put_u32(tmp, &b, demuxer->num_chapters);
+    for (int n = 0; n < demuxer->num_chapters; n++) {
+        put_double(tmp, &b, demuxer->chapters[n].pts);
+        put_tags(tmp, &b, demuxer->chapters[n].metadata);
+    }
+
+    // Write to a temporary file and rename it, so concurrent players never
+    // see a partially written entry.
+    char *tmpname = talloc_asprintf(tmp, "%s.%d.tmp", fname, (int)getpid());
+    FILE *f = fopen(tmpname, "wb");
+    if (!f)
+        goto done;
+    bool ok = fwrite(b.start, b.len, 1, f) == 1;
+    ok &= fclose(f) == 0;
+    if (ok && rename(tmpname, fname) == 0) {
+        mp_verbose(log, "Wrote media info to %s\n", fname);
+    } else {
+        mp_warn(log, "Could not write media info to %s\n", fname);
+        unlink(tmpname);
+    }
+
+done:
+    talloc_free(tmp);
+}
+
+void mp_media_info_apply(struct mp_media_info *info, struct demuxer *demuxer)
+{
+    if (demuxer->duration < 0 && info->duration >= 0)
+        demuxer->duration = info->duration;
+
+    if (!demuxer->metadata->num_keys)
+        mp_tags_merge(demuxer->metadata, info->metadata);
+
+    if (!demuxer->num_chapters) {
+        for (int n = 0; n < info->num_chapters; n++) {
+            struct mp_media_info_chapter *ch = &info->chapters[n];
+            int idx = demuxer_add_chapter(demuxer, "", ch->pts, -1);
+            mp_tags_merge(demuxer->chapters[idx].metadata, ch->metadata);
+        }
+    }
+
+    // Only trust per-stream data if the layout is the same.
+    int num_streams = demux_get_num_stream(demuxer);
+    if (num_streams != info->num_streams)
+        return;
+    for (int n = 0; n < num_streams; n++) {
+        struct sh_stream *sh = demux_get_stream(demuxer, n);
+        struct mp_media_info_stream *st = &info->streams[n];
+        if (sh->type != st->type)
+            return;
+        if (st->has_replaygain && !sh->codec->replaygain_data) {
+            sh->codec->replaygain_data =
+                talloc_dup(demuxer, &st->replaygain);
+        }
+    }
+}
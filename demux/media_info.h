@@ -0,0 +1,53 @@
+#ifndef MP_DEMUX_MEDIA_INFO_H_
+#define MP_DEMUX_MEDIA_INFO_H_
+
+#include <stdbool.h>
+
+#include "common/common.h"
+#include "demux.h"
+
+struct mpv_global;
+struct mp_log;
+struct stream;
+
+struct mp_media_info_stream {
+    enum stream_type type;
+    char *codec;
+    int samplerate;
+    int channels;
+    bool has_replaygain;
+    struct replaygain_data replaygain;
+};
+
+struct mp_media_info_chapter {
+    double pts;
+    struct mp_tags *metadata;
+};
+
+// Probe results of a local file, as persisted by the media info cache. An
+// entry is only returned if the file's path, mtime and size still match.
+struct mp_media_info {
+    char *demuxer;              // demuxer_desc.name
+    char *filetype;             // demuxer->filetype (lavf format name)
+    double start_time;
+    double duration;            // -1 if unknown
+    struct mp_media_info_stream *streams;
+    int num_streams;
+    struct mp_tags *metadata;
+    struct mp_media_info_chapter *chapters;
+    int num_chapters;
+};
+
+// dir can be NULL or "" to use the default location in the config dir.
+struct mp_media_info *mp_media_info_load(void *ta_ctx, struct mp_log *log,
+                                         struct mpv_global *global,
+                                         const char *dir, struct stream *s);
+void mp_media_info_store(struct mp_log *log, struct mpv_global *global,
+                         const char *dir, struct stream *s,
+                         struct demuxer *demuxer);
+
+// Fill in whatever the (freshly opened) demuxer did not determine itself.
+// Must be called on the demuxer thread's struct during open.
+void mp_media_info_apply(struct mp_media_info *info, struct demuxer *demuxer);
+
+#endif
@@ -0,0 +1,133 @@
+/*
+ * This file is part of mpv.
+ *
+ * mpv is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * mpv is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with mpv.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <inttypes.h>
+#include <math.h>
+
+#include "common/common.h"
+#include "mpa_talloc.h"
+
+#include "seek_index.h"
+
+#define INDEX_MAGIC "# mpa seek index v1"
+
+struct seek_entry {
+    double pts;
+    int64_t pos;
+};
+
+struct mp_seek_index {
+    double min_interval;
+    struct seek_entry *entries;
+    int num_entries;
+};
+
+struct mp_seek_index *mp_seek_index_create(void *ta_parent, double min_interval)
+{
+    struct mp_seek_index *idx = talloc_zero(ta_parent, struct mp_seek_index);
+    idx->min_interval = min_interval;
+    return idx;
+}
+
+// Return the index of the first entry with a timestamp > pts.
+static int upper_bound(struct mp_seek_index *idx, double pts)
+{
+    int lo = 0, hi = idx->num_entries;
+    while (lo < hi) {
+        int mid = lo + (hi - lo) / 2;
+        if (idx->entries[mid].pts <= pts) {
+            lo = mid + 1;
+        } else {
+            hi = mid;
+        }
+    }
+    return lo;
+}
+
+bool mp_seek_index_add(struct mp_seek_index *idx, double pts, int64_t pos)
+{
+    if (!isfinite(pts) || pos < 0)
+        return false;
+
+    int i = upper_bound(idx, pts);
+    struct seek_entry *prev = i > 0 ? &idx->entries[i - 1] : NULL;
+    struct seek_entry *next = i < idx->num_entries ? &idx->entries[i] : NULL;
+
+    if (prev && (pts - prev->pts < idx->min_interval || pos <= prev->pos))
+        return false;
+    if (next && (next->pts - pts < idx->min_interval || pos >= next->pos))
+        return false;
+
+    MP_TARRAY_INSERT_AT(idx, idx->entries, idx->num_entries, i,
+                        (struct seek_entry){pts, pos});
+    return true;
+}
+
+bool mp_seek_index_find(struct mp_seek_index *idx, double pts,
+                        double *out_pts, int64_t *out_pos)
+{
+    int i = upper_bound(idx, pts);
+    if (i == 0)
+        return false;
+    *out_pts = idx->entries[i - 1].pts;
+    *out_pos = idx->entries[i - 1].pos;
+    return true;
+}
+
+int mp_seek_index_get_count(struct mp_seek_index *idx)
+{
+    return idx->num_entries;
+}
+
+char *mp_seek_index_save(struct mp_seek_index *idx, void *ta_ctx,
+                         int64_t file_size)
+{
+    char *s = talloc_asprintf(ta_ctx, "%s\nsize %"PRId64"\n", INDEX_MAGIC,
+                              file_size);
+    for (int n = 0; n < idx->num_entries; n++) {
+        struct seek_entry *e = &idx->entries[n];
+        s = talloc_asprintf_append_buffer(s, "%.6f %"PRId64"\n", e->pts, e->pos);
+    }
+    return s;
+}
+
+bool mp_seek_index_load(struct mp_seek_index *idx, bstr data, int64_t file_size)
+{
+    bstr line = bstr_strip_linebreaks(bstr_getline(data, &data));
+    if (!bstr_equals0(line, INDEX_MAGIC))
+        return false;
+
+    line = bstr_strip_linebreaks(bstr_getline(data, &data));
+    if (!bstr_eatstart0(&line, "size ") || bstrtoll(line, NULL, 10) != file_size)
+        return false;
+
+    while (data.len) {
+        line = bstr_strip_linebreaks(bstr_getline(data, &data));
+        if (!line.len)
+            continue;
+        bstr rest;
+        double pts = bstrtod(line, &rest);
+        if (rest.len == line.len)
+            return false;
+        line = bstr_lstrip(rest);
+        long long pos = bstrtoll(line, &rest, 10);
+        if (rest.len == line.len)
+            return false;
+        mp_seek_index_add(idx, pts, pos);
+    }
+    return true;
+}
@@ -0,0 +1,53 @@
+/*
+ * This file is part of mpv.
+ *
+ * mpv is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * mpv is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with mpv.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef MP_SEEK_INDEX_H_
+#define MP_SEEK_INDEX_H_
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "misc/bstr.h"
+
+// Index of (timestamp, byte position) pairs learned from demuxed packets.
+// Both timestamps and positions are strictly increasing, so the index can be
+// used for streams that don't have a usable index of their own (VBR MP3,
+// ADTS AAC).
+struct mp_seek_index;
+
+// min_interval: minimum distance between entries, in seconds.
+struct mp_seek_index *mp_seek_index_create(void *ta_parent, double min_interval);
+
+// Record the position of a packet that can be used as seek point. Entries
+// which would violate monotonicity are ignored. Returns whether it was added.
+bool mp_seek_index_add(struct mp_seek_index *idx, double pts, int64_t pos);
+
+// Find the entry with the highest timestamp <= pts.
+bool mp_seek_index_find(struct mp_seek_index *idx, double pts,
+                        double *out_pts, int64_t *out_pos);
+
+int mp_seek_index_get_count(struct mp_seek_index *idx);
+
+// Serialize to a text format, tagged with the size of the source file.
+char *mp_seek_index_save(struct mp_seek_index *idx, void *ta_ctx,
+                         int64_t file_size);
+
+// Add the entries from data as returned by mp_seek_index_save(). Fails if the
+// file size doesn't match or the data is broken.
+bool mp_seek_index_load(struct mp_seek_index *idx, bstr data, int64_t file_size);
+
+#endif
@@ -0,0 +1,145 @@
+#include "audio/aframe.h"
+#include "common/common.h"
+#include "common/msg.h"
+
+#include "f_audio_overlay.h"
+#include "filter_internal.h"
+
+// Time over which the ducking gain changes.
+#define DUCK_RAMP_SECONDS 0.02
+
+struct clip {
+    struct mp_aframe *data;
+    int pos;
+    float gain;
+    float duck;
+};
+
+struct priv {
+    struct clip *clips;
+    int num_clips;
+    float duck_gain; // current gain applied to the main audio
+};
+
+static void remove_clip(struct priv *p, int index)
+{
+    talloc_free(p->clips[index].data);
+    MP_TARRAY_REMOVE_AT(p->clips, p->num_clips, index);
+}
+
+static void mix(struct mp_filter *f, struct mp_aframe *frame)
+{
+    struct priv *p = f->priv;
+
+    int samples = mp_aframe_get_size(frame);
+    if (!samples)
+        return;
+
+    float duck = 1.0;
+    for (int n = 0; n < p->num_clips; n++)
+        duck = MPMIN(duck, p->clips[n].duck);
+
+    if (duck != p->duck_gain) {
+        float max_step = samples / (mp_aframe_get_rate(frame) * DUCK_RAMP_SECONDS);
+        float next = p->duck_gain + MPCLAMP(duck - p->duck_gain,
+                                            -max_step, max_step);
+        mp_aframe_gain_ramp(frame, 0, samples, p->duck_gain, next);
+        p->duck_gain = next;
+    } else if (duck != 1.0f) {
+        mp_aframe_gain_ramp(frame, 0, samples, duck, duck);
+    }
+
+    for (int n = p->num_clips - 1; n >= 0; n--) {
+        struct clip *c = &p->clips[n];
+        int num = MPMIN(samples, mp_aframe_get_size(c->data) - c->pos);
+        if (!mp_aframe_mix_samples(frame, 0, c->data, c->pos, num, c->gain)) {
+            MP_WARN(f, "Dropping overlay with mismatching format %s.\n",
+                    mp_aframe_format_str(c->data));
+            num = -1;
+        }
+        c->pos += num;
+        if (num < 0 || c->pos >= mp_aframe_get_size(c->data)) {
+            MP_VERBOSE(f, "Overlay ended.\n");
+            remove_clip(p, n);
+        }
+    }
+}
+
+static void process(struct mp_filter *f)
+{
+    if (!mp_pin_can_transfer_data(f->ppins[1], f->ppins[0]))
+        return;
+
+    struct mp_frame frame = mp_pin_out_read(f->ppins[0]);
+    if (frame.type == MP_FRAME_AUDIO)
+        mix(f, frame.data);
+    mp_pin_in_write(f->ppins[1], frame);
+}
+
+static void reset(struct mp_filter *f)
+{
+    struct priv *p = f->priv;
+
+    // Clips keep playing across seeks; only the ducking restarts.
+    p->duck_gain = 1.0;
+}
+
+static void destroy(struct mp_filter *f)
+{
+    struct priv *p = f->priv;
+
+    while (p->num_clips)
+        remove_clip(p, p->num_clips - 1);
+}
+
+static const struct mp_filter_info audio_overlay_filter = {
+    .name = "overlay",
+    .priv_size = sizeof(struct priv),
+    .process = process,
+    .reset = reset,
+    .destroy = destroy,
+};
+
+struct mp_audio_overlay *mp_audio_overlay_create(struct mp_filter *parent)
+{
+    struct mp_filter *f = mp_filter_create(parent, &audio_overlay_filter);
+    if (!f)
+        return NULL;
+
+    mp_filter_add_pin(f, MP_PIN_IN, "in");
+    mp_filter_add_pin(f, MP_PIN_OUT, "out");
+
+    struct priv *p = f->priv;
+    p->duck_gain = 1.0;
+
+    struct mp_audio_overlay *o = talloc_zero(f, struct mp_audio_overlay);
+    o->f = f;
+    return o;
+}
+
+void mp_audio_overlay_add(struct mp_audio_overlay *o, struct mp_aframe *clip,
+                          float gain, float duck)
+{
+    struct priv *p = o->f->priv;
+
+    struct mp_aframe *ref = mp_aframe_new_ref(clip);
+    if (!ref)
+        abort();
+
+    MP_TARRAY_APPEND(p, p->clips, p->num_clips, (struct clip){
+        .data = ref,
+        .gain = gain,
+        .duck = MPCLAMP(duck, 0.0, 1.0),
+    });
+}
+
+void mp_audio_overlay_clear(struct mp_audio_overlay *o)
+{
+    destroy(o->f);
+}
+
+int mp_audio_overlay_get_active(struct mp_audio_overlay *o)
+{
+    struct priv *p = o->f->priv;
+    return p->num_clips;
+}
@@ -0,0 +1,27 @@
+#pragma once
+
+#include "filter.h"
+
+struct mp_aframe;
+
+// Filter with 1 input and 1 output, which mixes overlay clips (such as
+// notification sounds) into the audio passing through. Clips must have the
+// same format as the passing audio; normally it's placed after the final
+// conversion to the AO format.
+struct mp_audio_overlay {
+    struct mp_filter *f;
+};
+
+struct mp_audio_overlay *mp_audio_overlay_create(struct mp_filter *parent);
+
+// Start mixing in the clip (a new reference is taken) at the next audio frame,
+// scaled by gain. While the clip plays, the main audio is attenuated by duck
+// (1.0 for no ducking).
+void mp_audio_overlay_add(struct mp_audio_overlay *o, struct mp_aframe *clip,
+                          float gain, float duck);
+
+// Stop all clips.
+void mp_audio_overlay_clear(struct mp_audio_overlay *o);
+
+// Number of clips that are still playing.
+int mp_audio_overlay_get_active(struct mp_audio_overlay *o);
@@ -280,13 +280,17 @@ static void feed_packet(struct priv *p)
     assert(p->packet.type == MP_FRAME_PACKET || p->packet.type == MP_FRAME_EOF);
     struct demux_packet *packet = p->packet.data;
 
-    // For video framedropping, including parts of the hr-seek logic.
+    // For framedropping, including parts of the hr-seek logic.
     if (p->decoder->control) {
         double start_pts = p->start_pts;
         if (p->start != MP_NOPTS_VALUE && (start_pts == MP_NOPTS_VALUE ||
                                            p->start > start_pts))
             start_pts = p->start;
 
+        double audio_start = p->has_broken_packet_pts ? MP_NOPTS_VALUE
+                                                      : start_pts;
+        p->decoder->control(p->decoder->f, ADCTRL_SET_START_PTS, &audio_start);
+
         int framedrop_type = 0;
 
         if (p->public.attempt_framedrops)
@@ -75,6 +75,9 @@ enum dec_ctrl {
     VDCTRL_GET_BFRAMES,
     // framedrop mode: 0=none, 1=standard, 2=hrseek
     VDCTRL_SET_FRAMEDROP,
+    // double*: decoded audio before this PTS can be discarded (hr-seek), or
+    // MP_NOPTS_VALUE
+    ADCTRL_SET_START_PTS,
 };
 
 int mp_decoder_wrapper_control(struct mp_decoder_wrapper *d,
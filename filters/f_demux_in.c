@@ -5,9 +5,15 @@
 #include "f_demux_in.h"
 #include "filter_internal.h"
 
+// Maximum number of packets taken from the demuxer at once.
+#define PACKET_BATCH 8
+
 struct priv {
     struct sh_stream *src;
     bool eof_returned;
+    // Packets read from the demuxer, but not passed on yet.
+    struct demux_packet *pkts[PACKET_BATCH];
+    int num_pkts, pkt_pos;
 };
 
 static void wakeup(void *ctx)
@@ -24,9 +30,17 @@ static void process(struct mp_filter *f)
     if (!mp_pin_in_needs_data(f->ppins[0]))
         return;
 
+    if (p->pkt_pos == p->num_pkts) {
+        p->pkt_pos = p->num_pkts = 0;
+        int r = demux_read_packets_async(p->src, p->pkts, PACKET_BATCH);
+        if (r == 0)
+            return; // wait
+        p->num_pkts = MPMAX(r, 0);
+    }
+
     struct demux_packet *pkt = NULL;
-    if (demux_read_packet_async(p->src, &pkt) == 0)
-        return; // wait
+    if (p->pkt_pos < p->num_pkts)
+        pkt = p->pkts[p->pkt_pos++];
 
     struct mp_frame frame = {MP_FRAME_PACKET, pkt};
     if (pkt) {
@@ -43,10 +57,18 @@ static void process(struct mp_filter *f)
     mp_pin_in_write(f->ppins[0], frame);
 }
 
+static void flush_packets(struct priv *p)
+{
+    for (int n = p->pkt_pos; n < p->num_pkts; n++)
+        talloc_free(p->pkts[n]);
+    p->pkt_pos = p->num_pkts = 0;
+}
+
 static void reset(struct mp_filter *f)
 {
     struct priv *p = f->priv;
 
+    flush_packets(p);
     p->eof_returned = false;
 }
 
@@ -54,6 +76,7 @@ static void destroy(struct mp_filter *f)
 {
     struct priv *p = f->priv;
 
+    flush_packets(p);
     demux_set_stream_wakeup_cb(p->src, NULL, NULL);
 }
 
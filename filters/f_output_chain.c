@@ -7,6 +7,7 @@
 //#include "video/out/vo.h"
 
 #include "filter_internal.h"
+#include "f_audio_overlay.h"
 #include "f_auto_filters.h"
 #include "f_autoconvert.h"
 #include "f_lavfi.h"
@@ -40,6 +41,9 @@ struct chain {
     struct mp_user_filter *input, *output, *convert_wrapper;
     struct mp_autoconvert *convert;
 
+    struct mp_user_filter *overlay_wrapper;
+    struct mp_audio_overlay *overlay;
+
     struct ao *ao;
 
     struct mp_output_chain public;
@@ -354,6 +358,37 @@ static void on_audio_format_change(void *opaque)
     mp_filter_wakeup(p->f);
 }
 
+bool mp_output_chain_add_overlay(struct mp_output_chain *c,
+                                 struct mp_aframe *clip, float gain, float duck)
+{
+    struct chain *p = c->f->priv;
+
+    if (!p->overlay || !p->ao)
+        return false;
+
+    int rate, format;
+    struct mp_chmap channels;
+    ao_get_format(p->ao, &rate, &format, &channels);
+    struct mp_chmap clip_channels = {0};
+    mp_aframe_get_chmap(clip, &clip_channels);
+    if (mp_aframe_get_rate(clip) != rate ||
+        mp_aframe_get_format(clip) != format ||
+        !mp_chmap_equals(&clip_channels, &channels))
+        return false;
+
+    mp_audio_overlay_add(p->overlay, clip, gain, duck);
+    mp_filter_wakeup(p->f);
+    return true;
+}
+
+void mp_output_chain_clear_overlays(struct mp_output_chain *c)
+{
+    struct chain *p = c->f->priv;
+
+    if (p->overlay)
+        mp_audio_overlay_clear(p->overlay);
+}
+
 static struct mp_user_filter *find_by_label(struct chain *p, const char *label)
 {
     for (int n = 0; n < p->num_user_filters; n++) {
@@ -629,6 +664,16 @@ struct mp_output_chain *mp_output_chain_create(struct mp_filter *parent,
     if (type == MP_OUTPUT_CHAIN_AUDIO) {
         p->convert->on_audio_format_change = on_audio_format_change;
         p->convert->on_audio_format_change_opaque = p;
+
+        // Mixes in overlay clips, after conversion to the AO format.
+        p->overlay_wrapper = create_wrapper_filter(p);
+        p->overlay = mp_audio_overlay_create(p->overlay_wrapper->wrapper);
+        if (!p->overlay)
+            abort();
+        p->overlay_wrapper->name = "overlay";
+        p->overlay_wrapper->f = p->overlay->f;
+        MP_TARRAY_APPEND(p, p->post_filters, p->num_post_filters,
+                         p->overlay_wrapper);
     }
 
     // Dummy filter for reporting and logging the output format.
@@ -62,6 +62,17 @@ struct m_obj_settings;
 bool mp_output_chain_update_filters(struct mp_output_chain *p,
                                     struct m_obj_settings *list);
 
+// Mix an overlay clip (see mp_audio_overlay_add()) into the output. The clip
+// must use the AO format. Returns false if there is no AO, or if the format
+// does not match.
+// For type==MP_OUTPUT_CHAIN_AUDIO only.
+struct mp_aframe;
+bool mp_output_chain_add_overlay(struct mp_output_chain *p,
+                                 struct mp_aframe *clip, float gain, float duck);
+
+// Stop all overlay clips.
+void mp_output_chain_clear_overlays(struct mp_output_chain *p);
+
 // Desired audio speed, with resample being strict resampling.
 void mp_output_chain_set_audio_speed(struct mp_output_chain *p,
                                      double speed, double resample);
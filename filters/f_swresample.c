@@ -26,6 +26,7 @@
 #include "audio/aframe.h"
 #include "audio/fmt-conversion.h"
 #include "audio/format.h"
+#include "audio/polyphase.h"
 #include "common/common.h"
 #include "common/av_common.h"
 #include "common/msg.h"
@@ -64,6 +65,7 @@ struct priv {
     struct mp_aframe *pool_fmt; // format used to allocate frames for avrctx output
     struct mp_aframe *pre_out_fmt; // format before final conversion
     struct AVAudioResampleContext *avrctx_out; // for output channel reordering
+    struct mp_polyphase *pp; // built-in resampler (used instead of avrctx)
     struct mp_resample_opts *opts; // opts requested by the user
     // At least libswresample keeps a pointer around for this:
     int reorder_in[MP_NUM_CHANNELS];
@@ -99,6 +101,9 @@ const struct m_sub_options resample_conf = {
         OPT_FLAG("audio-normalize-downmix", normalize, 0),
         OPT_DOUBLE("audio-resample-max-output-size", max_output_frame_size, 0),
         OPT_KEYVALUELIST("audio-swresample-o", avopts, 0),
+        OPT_CHOICE("audio-resample-backend", backend, 0,
+                   ({"swresample", RESAMPLE_BACKEND_LAVR},
+                    {"builtin", RESAMPLE_BACKEND_BUILTIN})),
         {0}
     },
     .size = sizeof(struct mp_resample_opts),
@@ -107,27 +112,46 @@ const struct m_sub_options resample_conf = {
 };
 
 #if HAVE_LIBAVRESAMPLE
-static double get_delay(struct priv *p)
+static double get_lavrr_delay(struct priv *p)
 {
     return avresample_get_delay(p->avrctx) / (double)p->in_rate +
            avresample_available(p->avrctx) / (double)p->out_rate;
 }
-static int get_out_samples(struct priv *p, int in_samples)
+static int get_lavrr_out_samples(struct priv *p, int in_samples)
 {
     return avresample_get_out_samples(p->avrctx, in_samples);
 }
 #else
-static double get_delay(struct priv *p)
+static double get_lavrr_delay(struct priv *p)
 {
     int64_t base = p->in_rate * (int64_t)p->out_rate;
     return swr_get_delay(p->avrctx, base) / (double)base;
 }
-static int get_out_samples(struct priv *p, int in_samples)
+static int get_lavrr_out_samples(struct priv *p, int in_samples)
 {
     return swr_get_out_samples(p->avrctx, in_samples);
 }
 #endif
 
+static double get_delay(struct priv *p)
+{
+    if (p->pp)
+        return mp_polyphase_get_delay(p->pp);
+    return get_lavrr_delay(p);
+}
+
+static int get_out_samples(struct priv *p, int in_samples)
+{
+    if (p->pp)
+        return mp_polyphase_get_out_samples(p->pp, in_samples);
+    return get_lavrr_out_samples(p, in_samples);
+}
+
+static bool is_configured(struct priv *p)
+{
+    return p->avrctx || p->pp;
+}
+
 static void close_lavrr(struct priv *p)
 {
     if (p->avrctx)
@@ -136,6 +160,7 @@ static void close_lavrr(struct priv *p)
     if (p->avrctx_out)
         avresample_close(p->avrctx_out);
     avresample_free(&p->avrctx_out);
+    TA_FREEP(&p->pp);
 
     TA_FREEP(&p->pre_out_fmt);
     TA_FREEP(&p->avrctx_fmt);
@@ -194,6 +219,46 @@ static void transpose_order(int *map, int num)
     memcpy(map, nmap, sizeof(nmap));
 }
 
+static double get_cutoff(struct priv *p)
+{
+    double cutoff = p->opts->cutoff;
+    if (cutoff <= 0.0)
+        cutoff = MPMAX(1.0 - 6.5 / (p->opts->filter_size + 8), 0.80);
+    return cutoff;
+}
+
+// The built-in resampler only handles pure sample rate conversion of float
+// audio. Returns false if it can't be used.
+static bool configure_builtin(struct priv *p)
+{
+    int format = p->in_format;
+    if (p->opts->backend != RESAMPLE_BACKEND_BUILTIN ||
+        (format != AF_FORMAT_FLOAT && format != AF_FORMAT_FLOATP) ||
+        p->out_format != format || p->in_rate == p->out_rate ||
+        !mp_chmap_equals(&p->in_channels, &p->out_channels))
+        return false;
+
+    p->pp = mp_polyphase_create(NULL, p->in_channels.num,
+                                format == AF_FORMAT_FLOATP, p->in_rate,
+                                p->out_rate, MPMAX(p->opts->filter_size, 1),
+                                get_cutoff(p));
+    if (!p->pp)
+        return false;
+
+    p->pre_out_fmt = mp_aframe_create();
+    mp_aframe_set_rate(p->pre_out_fmt, p->out_rate);
+    mp_aframe_set_chmap(p->pre_out_fmt, &p->out_channels);
+    mp_aframe_set_format(p->pre_out_fmt, p->out_format);
+
+    p->pool_fmt = mp_aframe_create();
+    mp_aframe_config_copy(p->pool_fmt, p->pre_out_fmt);
+
+    p->is_resampling = false;
+
+    MP_VERBOSE(p, "Using built-in resampler.\n");
+    return true;
+}
+
 static bool configure_lavrr(struct priv *p, bool verbose)
 {
     close_lavrr(p);
@@ -206,6 +271,9 @@ static bool configure_lavrr(struct priv *p, bool verbose)
                p->out_rate, mp_chmap_to_str(&p->out_channels),
                af_fmt_to_str(p->out_format));
 
+    if (configure_builtin(p))
+        return true;
+
     p->avrctx = avresample_alloc_context();
     p->avrctx_out = avresample_alloc_context();
     if (!p->avrctx || !p->avrctx_out)
@@ -228,10 +296,7 @@ static bool configure_lavrr(struct priv *p, bool verbose)
     av_opt_set_int(p->avrctx, "phase_shift",        p->opts->phase_shift, 0);
     av_opt_set_int(p->avrctx, "linear_interp",      p->opts->linear, 0);
 
-    double cutoff = p->opts->cutoff;
-    if (cutoff <= 0.0)
-        cutoff = MPMAX(1.0 - 6.5 / (p->opts->filter_size + 8), 0.80);
-    av_opt_set_double(p->avrctx, "cutoff",          cutoff, 0);
+    av_opt_set_double(p->avrctx, "cutoff",          get_cutoff(p), 0);
 
     int normalize = p->opts->normalize;
 #if HAVE_LIBSWRESAMPLE
@@ -361,6 +426,8 @@ static void reset(struct mp_filter *f)
     p->current_pts = MP_NOPTS_VALUE;
     TA_FREEP(&p->input);
 
+    if (p->pp)
+        mp_polyphase_reset(p->pp);
     if (!p->avrctx)
         return;
 #if HAVE_LIBSWRESAMPLE
@@ -446,12 +513,23 @@ static int resample_frame(struct AVAudioResampleContext *r,
         av_i ? MPMIN(av_i->nb_samples, consume_in) : 0);
 }
 
+static int resample_builtin(struct mp_polyphase *pp, struct mp_aframe *out,
+                            struct mp_aframe *in, int consume_in)
+{
+    float **out_planes = (float **)mp_aframe_get_data_rw(out);
+    if (!out_planes)
+        return -1;
+    float **in_planes = in ? (float **)mp_aframe_get_data_ro(in) : NULL;
+    return mp_polyphase_process(pp, out_planes, mp_aframe_get_size(out),
+                                in_planes, in_planes ? consume_in : 0);
+}
+
 static struct mp_frame filter_resample_output(struct priv *p,
                                               struct mp_aframe *in)
 {
     struct mp_aframe *out = NULL;
 
-    if (!p->avrctx)
+    if (!is_configured(p))
         goto error;
 
     // Limit the filtered data size for better latency when changing speed.
@@ -469,8 +547,10 @@ static struct mp_frame filter_resample_output(struct priv *p,
         goto error;
 
     int out_samples = 0;
-    if (samples) {
-        out_samples = resample_frame(p->avrctx, out, in, consume_in);
+    // (The built-in resampler must always be fed, as it buffers the input.)
+    if (samples || p->pp) {
+        out_samples = p->pp ? resample_builtin(p->pp, out, in, consume_in)
+                            : resample_frame(p->avrctx, out, in, consume_in);
         if (out_samples < 0 || out_samples > samples)
             goto error;
         mp_aframe_set_size(out, out_samples);
@@ -479,10 +559,10 @@ static struct mp_frame filter_resample_output(struct priv *p,
     struct mp_chmap out_chmap;
     if (!mp_aframe_get_chmap(p->pool_fmt, &out_chmap))
         goto error;
-    if (!reorder_planes(out, p->reorder_out, &out_chmap))
+    if (p->avrctx && !reorder_planes(out, p->reorder_out, &out_chmap))
         goto error;
 
-    if (!mp_aframe_config_equals(out, p->pre_out_fmt)) {
+    if (p->avrctx && !mp_aframe_config_equals(out, p->pre_out_fmt)) {
         struct mp_aframe *new = mp_aframe_create();
         mp_aframe_config_copy(new, p->pre_out_fmt);
         if (mp_aframe_pool_allocate(p->reorder_buffer, new, out_samples) < 0) {
@@ -550,7 +630,7 @@ static void process(struct mp_filter *f)
             return;
         }
 
-        if (!input && !p->avrctx) {
+        if (!input && !is_configured(p)) {
             // Obviously no draining needed.
             mp_pin_in_write(f->ppins[1], MP_EOF_FRAME);
             return;
@@ -585,9 +665,9 @@ static void process(struct mp_filter *f)
             p->out_rate != out_rate ||
             p->out_format != out_format ||
             !mp_chmap_equals(&p->out_channels, &out_channels) ||
-            !p->avrctx)
+            !is_configured(p))
         {
-            if (p->avrctx) {
+            if (is_configured(p)) {
                 // drain remaining audio
                 struct mp_frame out = filter_resample_output(p, NULL);
                 if (out.type) {
@@ -631,7 +711,11 @@ static void process(struct mp_filter *f)
     // resampling, we might have to disable previously enabled compensation.
     if (exact_rate && !p->is_resampling)
         use_comp = false;
-    if (p->avrctx && use_comp) {
+    if (p->pp) {
+        // The built-in resampler adjusts the ratio without reinitialization.
+        if (mp_polyphase_set_in_rate(p->pp, p->speed * p->in_rate_user))
+            exact_rate = true;
+    } else if (p->avrctx && use_comp) {
         AVRational r =
             av_d2q(p->speed * p->in_rate_user / p->in_rate, INT_MAX / 2);
         // Essentially, swr/avresample_set_compensation() does 2 things:
@@ -740,7 +824,7 @@ struct mp_swresample *mp_swresample_create(struct mp_filter *parent,
     }
 
     p->reorder_buffer = mp_aframe_pool_create(p);
-    p->out_pool = mp_aframe_pool_create(p);
+    p->out_pool = mp_filter_get_aframe_pool(f);
 
     return &p->public;
 }
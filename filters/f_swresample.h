@@ -5,7 +5,8 @@
 #include "audio/chmap.h"
 #include "filter.h"
 
-// Resampler filter, wrapping libswresample or libavresample.
+// Resampler filter, wrapping libswresample or libavresample, or using the
+// built-in polyphase resampler.
 struct mp_swresample {
     struct mp_filter *f;
     // Desired output parameters. For unset parameters, passes through the
@@ -25,6 +26,12 @@ struct mp_resample_opts {
     int allow_passthrough;
     double max_output_frame_size;
     char **avopts;
+    int backend;
+};
+
+enum {
+    RESAMPLE_BACKEND_LAVR = 0,  // libswresample/libavresample
+    RESAMPLE_BACKEND_BUILTIN,   // audio/polyphase.c, if the format allows it
 };
 
 #define MP_RESAMPLE_OPTS_DEF {  \
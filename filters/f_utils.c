@@ -197,22 +197,36 @@ static void fixed_aframe_size_process(struct mp_filter *f)
     }
 
     if (p->in) {
-        if (!p->out) {
-            p->out = mp_aframe_create();
-            mp_aframe_config_copy(p->out, p->in);
-            mp_aframe_copy_attributes(p->out, p->in);
-            if (mp_aframe_pool_allocate(p->pool, p->out, p->samples) < 0) {
-                mp_filter_internal_mark_failed(f);
-                return;
+        int in_samples = mp_aframe_get_size(p->in);
+        if (!p->out && in_samples >= p->samples) {
+            // Enough data to pass on a slice of the input without copying.
+            if (in_samples == p->samples) {
+                p->out = p->in;
+                p->in = NULL;
+            } else {
+                p->out = mp_aframe_new_view(p->in, 0, p->samples);
+                mp_aframe_skip_samples(p->in, p->samples);
             }
-            p->out_written = 0;
+            p->out_written = p->samples;
+        } else {
+            if (!p->out) {
+                p->out = mp_aframe_create();
+                mp_aframe_config_copy(p->out, p->in);
+                mp_aframe_copy_attributes(p->out, p->in);
+                if (mp_aframe_pool_allocate(p->pool, p->out, p->samples) < 0) {
+                    mp_filter_internal_mark_failed(f);
+                    return;
+                }
+                p->out_written = 0;
+            }
+            int copy = MPMIN(in_samples, p->samples - p->out_written);
+            if (!mp_aframe_copy_samples(p->out, p->out_written, p->in, 0, copy))
+                assert(0);
+            mp_filter_internal_add_bytes_copied(f, copy *
+                mp_aframe_get_sstride(p->in) * mp_aframe_get_planes(p->in));
+            mp_aframe_skip_samples(p->in, copy);
+            p->out_written += copy;
         }
-        int in_samples = mp_aframe_get_size(p->in);
-        int copy = MPMIN(in_samples, p->samples - p->out_written);
-        if (!mp_aframe_copy_samples(p->out, p->out_written, p->in, 0, copy))
-            assert(0);
-        mp_aframe_skip_samples(p->in, copy);
-        p->out_written += copy;
     }
 
     // p->in not set means draining for EOF or format change
@@ -265,7 +279,7 @@ struct mp_filter *mp_fixed_aframe_size_create(struct mp_filter *parent,
     struct fixed_aframe_size_priv *p = f->priv;
     p->samples = samples;
     p->pad_silence = pad_silence;
-    p->pool = mp_aframe_pool_create(p);
+    p->pool = mp_filter_get_aframe_pool(f);
 
     return f;
 }
@@ -74,5 +74,7 @@ struct mp_filter *mp_bidir_nop_filter_create(struct mp_filter *parent);
 // A filter which repacks audio frame to fixed frame sizes with the given
 // number of samples. On hard format changes (sample format/channels/srate),
 // the frame can be shorter, unless pad_silence is true. Fails on non-aframes.
+// If an input frame contains enough samples, output frames reference its data
+// instead of copying it.
 struct mp_filter *mp_fixed_aframe_size_create(struct mp_filter *parent,
                                               int samples, bool pad_silence);
@@ -1,8 +1,11 @@
+#include <inttypes.h>
 #include <pthread.h>
 
+#include "audio/aframe.h"
 #include "common/common.h"
 #include "common/global.h"
 #include "common/msg.h"
+#include "osdep/threads.h"
 
 #include "filter.h"
 #include "filter_internal.h"
@@ -64,13 +67,30 @@ struct filter_runner {
 
     struct mp_filter *root_filter;
 
+    // Memory account for all filters of this graph.
+    struct ta_account *mem_account;
+
     // If we're currently running the filter graph (for avoiding recursion).
     bool filtering;
 
     // Set of filters which need process() to be called. A filter is in this
-    // array iff mp_filter_internal.pending==true.
+    // array iff mp_filter_internal.pending==true. This is a binary min-heap
+    // ordered by (mp_filter_internal.rank, mp_filter_internal.pending_seq),
+    // so filters are run in data flow order, i.e. from sources towards sinks.
     struct mp_filter **pending;
     int num_pending;
+    uint64_t pending_seq;
+
+    // Connections or filters were added or removed; ranks must be recomputed.
+    bool topology_changed;
+
+    // Frame pool shared by all audio filters of this graph (lazily created).
+    struct mp_aframe_pool *aframe_pool;
+
+    // Statistics.
+    uint64_t num_runs;
+    uint64_t process_calls;
+    uint64_t last_run_calls;
 
     // Any outside pins have changed state.
     bool external_pending;
@@ -104,8 +124,157 @@ struct mp_filter_internal {
     bool pending;
     bool async_pending;
     bool failed;
+
+    // Scheduling order (lower values run first), and insertion order of the
+    // pending entry for stable ordering of filters with the same rank.
+    int rank;
+    uint64_t pending_seq;
+    // Temporary during update_ranks().
+    int sched_index;
+    int sched_deps;
+
+    uint64_t process_calls;
+    uint64_t bytes_copied;
 };
 
+static bool pending_less(struct mp_filter *a, struct mp_filter *b)
+{
+    if (a->in->rank != b->in->rank)
+        return a->in->rank < b->in->rank;
+    return a->in->pending_seq < b->in->pending_seq;
+}
+
+static void pending_sift_up(struct filter_runner *r, int n)
+{
+    while (n > 0) {
+        int parent = (n - 1) / 2;
+        if (!pending_less(r->pending[n], r->pending[parent]))
+            break;
+        MPSWAP(struct mp_filter *, r->pending[n], r->pending[parent]);
+        n = parent;
+    }
+}
+
+static void pending_sift_down(struct filter_runner *r, int n)
+{
+    while (1) {
+        int min = n;
+        for (int c = n * 2 + 1; c <= n * 2 + 2 && c < r->num_pending; c++) {
+            if (pending_less(r->pending[c], r->pending[min]))
+                min = c;
+        }
+        if (min == n)
+            break;
+        MPSWAP(struct mp_filter *, r->pending[n], r->pending[min]);
+        n = min;
+    }
+}
+
+static void pending_remove_at(struct filter_runner *r, int n)
+{
+    r->num_pending -= 1;
+    if (n == r->num_pending)
+        return;
+    r->pending[n] = r->pending[r->num_pending];
+    pending_sift_down(r, n);
+    pending_sift_up(r, n);
+}
+
+static void collect_filters(void *ta_ctx, struct mp_filter *f,
+                            struct mp_filter ***list, int *num)
+{
+    f->in->sched_index = *num;
+    f->in->sched_deps = 0;
+    f->in->rank = -1;
+    MP_TARRAY_APPEND(ta_ctx, *list, *num, f);
+    for (int n = 0; n < f->in->num_children; n++)
+        collect_filters(ta_ctx, f->in->children[n], list, num);
+}
+
+// Assign each filter a rank according to the data flow between filters
+// (topological sort). Cycles, which exist e.g. because a parent filter feeds
+// its children and reads their output, are broken by preferring filters which
+// are higher up in the filter tree. Runs in O(filters + connections).
+static void update_ranks(struct filter_runner *r)
+{
+    void *tmp = talloc_new(NULL);
+
+    struct mp_filter **filters = NULL;
+    int num_filters = 0;
+    collect_filters(tmp, r->root_filter, &filters, &num_filters);
+
+    // Downstream filters of filters[n] are edges[first[n]..first[n + 1]-1].
+    // The first pass counts the edges, the second one fills them in.
+    int *first = talloc_zero_array(tmp, int, num_filters + 1);
+    int *fill = NULL;
+    struct mp_filter **edges = NULL;
+    for (int pass = 0; pass < 2; pass++) {
+        for (int n = 0; n < num_filters; n++) {
+            struct mp_filter *f = filters[n];
+            for (int i = 0; i < f->num_pins * 2; i++) {
+                struct mp_pin *p = i < f->num_pins ? f->pins[i]
+                                                   : f->ppins[i - f->num_pins];
+                // Only the writable end of a connection, so each is seen once.
+                if (p->dir != MP_PIN_IN || !p->conn)
+                    continue;
+                struct mp_filter *from = p->manual_connection;
+                struct mp_filter *to = p->conn->manual_connection;
+                // The root filter is the sink of the outside connections.
+                if (!from || !to || from == to || to == r->root_filter ||
+                    from->in->runner != r || to->in->runner != r)
+                    continue;
+                if (pass == 0) {
+                    first[from->in->sched_index + 1] += 1;
+                    to->in->sched_deps += 1;
+                } else {
+                    edges[fill[from->in->sched_index]++] = to;
+                }
+            }
+        }
+        if (pass == 0) {
+            for (int n = 0; n < num_filters; n++)
+                first[n + 1] += first[n];
+            edges = talloc_array(tmp, struct mp_filter *, first[num_filters]);
+            fill = talloc_memdup(tmp, first, num_filters * sizeof(first[0]));
+        }
+    }
+
+    // Filters whose inputs are all ranked, in the order they became ready.
+    struct mp_filter **ready = talloc_array(tmp, struct mp_filter *, num_filters);
+    int ready_rd = 0, ready_wr = 0;
+    for (int n = 0; n < num_filters; n++) {
+        if (!filters[n]->in->sched_deps)
+            ready[ready_wr++] = filters[n];
+    }
+
+    int rank = 0, unranked = 0;
+    while (rank < num_filters) {
+        struct mp_filter *next;
+        if (ready_rd < ready_wr) {
+            next = ready[ready_rd++];
+        } else {
+            // Only cycles left: take the first unranked filter in tree order.
+            while (filters[unranked]->in->rank >= 0)
+                unranked++;
+            next = filters[unranked];
+        }
+        next->in->rank = rank++;
+        int idx = next->in->sched_index;
+        for (int n = first[idx]; n < first[idx + 1]; n++) {
+            struct mp_filter *to = edges[n];
+            to->in->sched_deps -= 1;
+            if (!to->in->sched_deps && to->in->rank < 0)
+                ready[ready_wr++] = to;
+        }
+    }
+
+    // All keys may have changed.
+    for (int n = r->num_pending / 2; n >= 0; n--)
+        pending_sift_down(r, n);
+
+    r->topology_changed = false;
+    talloc_free(tmp);
+}
 
 // Called when new work needs to be done on a pin belonging to the filter:
 //  - new data was requested
@@ -117,13 +286,14 @@ static void add_pending(struct mp_filter *f)
 {
     struct filter_runner *r = f->in->runner;
 
+    // Repeated notifications are coalesced into a single process() call.
     if (f->in->pending)
         return;
 
-    // This should probably really be some sort of priority queue, but for now
-    // something naive and dumb does the job too.
     f->in->pending = true;
+    f->in->pending_seq = r->pending_seq++;
     MP_TARRAY_APPEND(r, r->pending, r->num_pending, f);
+    pending_sift_up(r, r->num_pending - 1);
 
     // Need to tell user that something changed.
     if (f == r->root_filter)
@@ -161,7 +331,7 @@ void mp_filter_internal_mark_progress(struct mp_filter *f)
 // sync notifications don't need any locking.
 static void flush_async_notifications(struct filter_runner *r)
 {
-    pthread_mutex_lock(&r->async_lock);
+    mp_mutex_lock(&r->async_lock);
     for (int n = 0; n < r->num_async_pending; n++) {
         struct mp_filter *f = r->async_pending[n];
         add_pending(f);
@@ -169,7 +339,7 @@ static void flush_async_notifications(struct filter_runner *r)
     }
     r->num_async_pending = 0;
     r->async_wakeup_sent = false;
-    pthread_mutex_unlock(&r->async_lock);
+    mp_mutex_unlock(&r->async_lock);
 }
 
 bool mp_filter_run(struct mp_filter *filter)
@@ -184,15 +354,29 @@ bool mp_filter_run(struct mp_filter *filter)
 
     flush_async_notifications(r);
 
+    uint64_t calls = 0;
     while (r->num_pending) {
-        struct mp_filter *next = r->pending[r->num_pending - 1];
-        r->num_pending -= 1;
+        // (process() can connect or create filters)
+        if (r->topology_changed)
+            update_ranks(r);
+
+        struct mp_filter *next = r->pending[0];
+        pending_remove_at(r, 0);
         next->in->pending = false;
 
-        if (next->in->info->process)
+        if (next->in->info->process) {
             next->in->info->process(next);
+            next->in->process_calls += 1;
+            calls += 1;
+        }
     }
 
+    r->num_runs += 1;
+    r->process_calls += calls;
+    r->last_run_calls = calls;
+    if (calls)
+        MP_TRACE(r->root_filter, "filter run: %"PRIu64" process calls\n", calls);
+
     r->filtering = false;
 
     bool externals = r->external_pending;
@@ -347,6 +531,8 @@ static void init_connection(struct mp_pin *p)
     out->conn = in;
     out->within_conn = false;
 
+    in->owner->in->runner->topology_changed = true;
+
     // Scheduling so far will be messed up.
     add_pending(in->manual_connection);
     add_pending(out->manual_connection);
@@ -398,6 +584,8 @@ static void deinit_connection(struct mp_pin *p)
 
     p = find_connected_end(p);
 
+    p->owner->in->runner->topology_changed = true;
+
     while (p) {
         p->conn = p->other->conn = NULL;
         p->within_conn = p->other->within_conn = false;
@@ -470,6 +658,19 @@ void mp_filter_set_error_handler(struct mp_filter *f, struct mp_filter *handler)
     f->in->error_handler = handler;
 }
 
+void mp_filter_internal_add_bytes_copied(struct mp_filter *f, size_t bytes)
+{
+    f->in->bytes_copied += bytes;
+}
+
+struct mp_aframe_pool *mp_filter_get_aframe_pool(struct mp_filter *f)
+{
+    struct filter_runner *r = f->in->runner;
+    if (!r->aframe_pool)
+        r->aframe_pool = mp_aframe_pool_create(r);
+    return r->aframe_pool;
+}
+
 void mp_filter_internal_mark_failed(struct mp_filter *f)
 {
     while (f) {
@@ -587,7 +788,7 @@ bool mp_filter_command(struct mp_filter *f, struct mp_filter_command *cmd)
 static void filter_wakeup(struct mp_filter *f, bool mark_only)
 {
     struct filter_runner *r = f->in->runner;
-    pthread_mutex_lock(&r->async_lock);
+    mp_mutex_lock(&r->async_lock);
     if (!f->in->async_pending) {
         f->in->async_pending = true;
         // (not using a talloc parent for thread safety reasons)
@@ -598,7 +799,7 @@ static void filter_wakeup(struct mp_filter *f, bool mark_only)
             r->async_wakeup_sent = true;
         }
     }
-    pthread_mutex_unlock(&r->async_lock);
+    mp_mutex_unlock(&r->async_lock);
 }
 
 void mp_filter_wakeup(struct mp_filter *f)
@@ -620,6 +821,11 @@ static void filter_destructor(void *p)
     if (f->in->info->destroy)
         f->in->info->destroy(f);
 
+    if (f->in->bytes_copied) {
+        MP_VERBOSE(f, "copied %"PRIu64" bytes of frame data.\n",
+                   f->in->bytes_copied);
+    }
+
     // For convenience, free child filters.
     mp_filter_free_children(f);
 
@@ -632,10 +838,11 @@ static void filter_destructor(void *p)
 
     for (int n = 0; n < r->num_pending; n++) {
         if (r->pending[n] == f) {
-            MP_TARRAY_REMOVE_AT(r->pending, r->num_pending, n);
+            pending_remove_at(r, n);
             break;
         }
     }
+    r->topology_changed = true;
 
     if (f->in->parent) {
         struct mp_filter_internal *p_in = f->in->parent->in;
@@ -649,7 +856,7 @@ static void filter_destructor(void *p)
 
     if (r->root_filter == f) {
         assert(!f->in->parent);
-        pthread_mutex_destroy(&r->async_lock);
+        mp_mutex_destroy(&r->async_lock);
         talloc_free(r->async_pending);
         talloc_free(r);
     }
@@ -658,7 +865,12 @@ static void filter_destructor(void *p)
 
 struct mp_filter *mp_filter_create_with_params(struct mp_filter_params *params)
 {
+    struct ta_account *account = params->parent
+        ? params->parent->in->runner->mem_account
+        : ta_account_get("filters", NULL);
+
     struct mp_filter *f = talloc(NULL, struct mp_filter);
+    ta_set_account(f, account);
     talloc_set_destructor(f, filter_destructor);
     *f = (struct mp_filter){
         .priv = params->info->priv_size ?
@@ -676,16 +888,21 @@ struct mp_filter *mp_filter_create_with_params(struct mp_filter_params *params)
         assert(params->global);
 
         f->in->runner = talloc(NULL, struct filter_runner);
+        ta_set_account(f->in->runner, account);
         *f->in->runner = (struct filter_runner){
             .global = params->global,
             .root_filter = f,
+            .mem_account = account,
         };
         pthread_mutex_init(&f->in->runner->async_lock, NULL);
+        mp_mutex_set_name(&f->in->runner->async_lock, "filter-async");
     }
 
     if (!f->global)
         f->global = f->in->runner->global;
 
+    f->in->runner->topology_changed = true;
+
     if (f->in->parent) {
         struct mp_filter_internal *parent = f->in->parent->in;
         MP_TARRAY_APPEND(parent, parent->children, parent->num_children, f);
@@ -735,10 +952,10 @@ void mp_filter_root_set_wakeup_cb(struct mp_filter *root,
                                   void (*wakeup_cb)(void *ctx), void *ctx)
 {
     struct filter_runner *r = root->in->runner;
-    pthread_mutex_lock(&r->async_lock);
+    mp_mutex_lock(&r->async_lock);
     r->wakeup_cb = wakeup_cb;
     r->wakeup_ctx = ctx;
-    pthread_mutex_unlock(&r->async_lock);
+    mp_mutex_unlock(&r->async_lock);
 }
 
 static const char *filt_name(struct mp_filter *f)
@@ -758,10 +975,32 @@ static void dump_pin_state(struct mp_filter *f, struct mp_pin *pin)
         mp_frame_type_str(pin->data.type));
 }
 
+uint64_t mp_filter_get_process_calls(struct mp_filter *f)
+{
+    return f->in->process_calls;
+}
+
+uint64_t mp_filter_get_bytes_copied(struct mp_filter *f)
+{
+    return f->in->bytes_copied;
+}
+
+void mp_filter_get_run_stats(struct mp_filter *f,
+                             struct mp_filter_run_stats *stats)
+{
+    struct filter_runner *r = f->in->runner;
+    *stats = (struct mp_filter_run_stats){
+        .runs = r->num_runs,
+        .process_calls = r->process_calls,
+        .last_run_calls = r->last_run_calls,
+    };
+}
+
 void mp_filter_dump_states(struct mp_filter *f)
 {
-    MP_WARN(f, "%s[%p] (%s[%p])\n", filt_name(f), f,
-            filt_name(f->in->parent), f->in->parent);
+    MP_WARN(f, "%s[%p] (%s[%p]) rank=%d calls=%"PRIu64" copied=%"PRIu64"\n",
+            filt_name(f), f, filt_name(f->in->parent), f->in->parent,
+            f->in->rank, f->in->process_calls, f->in->bytes_copied);
     for (int n = 0; n < f->num_pins; n++) {
         dump_pin_state(f, f->pins[n]);
         dump_pin_state(f, f->ppins[n]);
@@ -1,10 +1,12 @@
 #pragma once
 
 #include <stdbool.h>
+#include <stdint.h>
 
 #include "frame.h"
 
 struct mpv_global;
+struct mp_aframe_pool;
 struct mp_filter;
 
 // A filter input or output. These always come in pairs: one mp_pin is for
@@ -407,5 +409,25 @@ struct mp_filter *mp_filter_create_root(struct mpv_global *global);
 void mp_filter_root_set_wakeup_cb(struct mp_filter *root,
                                   void (*wakeup_cb)(void *ctx), void *ctx);
 
+// Number of process() calls of this filter so far.
+uint64_t mp_filter_get_process_calls(struct mp_filter *f);
+
+// Number of bytes of frame data the filter copied so far.
+uint64_t mp_filter_get_bytes_copied(struct mp_filter *f);
+
+// Scheduler statistics of the filter graph f belongs to.
+struct mp_filter_run_stats {
+    uint64_t runs;              // number of mp_filter_run() calls
+    uint64_t process_calls;     // total number of process() calls
+    uint64_t last_run_calls;    // process() calls in the last mp_filter_run()
+};
+void mp_filter_get_run_stats(struct mp_filter *f,
+                             struct mp_filter_run_stats *stats);
+
+// Return an audio frame pool shared by all filters in the graph f belongs to.
+// Using it instead of a per-filter pool lets filters recycle each other's
+// buffers. Like all filter functions, it must be used from the filter thread.
+struct mp_aframe_pool *mp_filter_get_aframe_pool(struct mp_filter *f);
+
 // Debugging internal stuff.
 void mp_filter_dump_states(struct mp_filter *f);
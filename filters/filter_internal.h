@@ -21,6 +21,10 @@ void mp_filter_mark_async_progress(struct mp_filter *f);
 // In practice, this means process() is repeated.
 void mp_filter_internal_mark_progress(struct mp_filter *f);
 
+// Account for frame data the filter had to copy (e.g. to repack samples). Used
+// for statistics only; see mp_filter_get_bytes_copied().
+void mp_filter_internal_add_bytes_copied(struct mp_filter *f, size_t bytes);
+
 // Flag the filter as having failed, and propagate the error to the parent
 // filter. The error propagation stops either at the root filter, or if a filter
 // has an error handler set.
@@ -16,12 +16,14 @@
  */
 
 #include <stddef.h>
+#include <pthread.h>
 
 #include "misc/bstr.h"
 #include "misc/node.h"
 #include "common/common.h"
 #include "common/msg.h"
 #include "options/m_option.h"
+#include "osdep/threads.h"
 
 #include "cmd.h"
 #include "input.h"
@@ -67,6 +69,15 @@ static bool apply_flag(struct mp_cmd *cmd, bstr str)
     return false;
 }
 
+static bool is_flag(bstr str)
+{
+    for (int n = 0; cmd_flags[n].name; n++) {
+        if (bstr_equals0(str, cmd_flags[n].name))
+            return true;
+    }
+    return false;
+}
+
 static bool find_cmd(struct mp_log *log, struct mp_cmd *cmd, bstr name)
 {
     if (name.len == 0) {
@@ -476,7 +487,8 @@ done:
     return cmd;
 }
 
-struct mp_cmd *mp_input_parse_cmd_strv(struct mp_log *log, const char **argv)
+static struct mp_cmd *parse_cmd_strv(struct mp_cmd_cache *cache,
+                                     struct mp_log *log, const char **argv)
 {
     int count = 0;
     while (argv[count])
@@ -488,11 +500,16 @@ struct mp_cmd *mp_input_parse_cmd_strv(struct mp_log *log, const char **argv)
         items[n] = (mpv_node){.format = MPV_FORMAT_STRING,
                               .u = {.string = (char *)argv[n]}};
     }
-    struct mp_cmd *res = mp_input_parse_cmd_node(log, &node);
+    struct mp_cmd *res = mp_cmd_cache_parse_node(cache, log, &node);
     talloc_free(items);
     return res;
 }
 
+struct mp_cmd *mp_input_parse_cmd_strv(struct mp_log *log, const char **argv)
+{
+    return parse_cmd_strv(NULL, log, argv);
+}
+
 void mp_cmd_free(mp_cmd_t *cmd)
 {
     talloc_free(cmd);
@@ -582,6 +599,223 @@ void mp_print_cmd_list(struct mp_log *out)
     }
 }
 
+// Number of parsed commands kept by struct mp_cmd_cache.
+#define CMD_CACHE_SIZE 32
+
+struct cmd_cache_entry {
+    // For text commands: the command text, num_strs==0.
+    // For node arrays: the string items; the first num_prefix are the flags
+    // and the command name, the rest are the arguments cmd was parsed from.
+    char *text;
+    char **strs;
+    int num_strs;
+    int num_prefix;
+    struct mp_cmd *cmd;     // parsed template, cloned on a hit
+    uint64_t last_use;
+};
+
+struct mp_cmd_cache {
+    pthread_mutex_t lock;
+    struct cmd_cache_entry entries[CMD_CACHE_SIZE];
+    int num_entries;
+    uint64_t use_counter;
+    uint64_t hits;
+};
+
+static void destroy_cmd_cache(void *ptr)
+{
+    struct mp_cmd_cache *cache = ptr;
+    mp_mutex_destroy(&cache->lock);
+}
+
+struct mp_cmd_cache *mp_cmd_cache_alloc(void *ta_parent)
+{
+    struct mp_cmd_cache *cache = talloc_zero(ta_parent, struct mp_cmd_cache);
+    pthread_mutex_init(&cache->lock, NULL);
+    mp_mutex_set_name(&cache->lock, "cmd-cache");
+    talloc_set_destructor(cache, destroy_cmd_cache);
+    return cache;
+}
+
+uint64_t mp_cmd_cache_get_hits(struct mp_cmd_cache *cache)
+{
+    mp_mutex_lock(&cache->lock);
+    uint64_t hits = cache->hits;
+    mp_mutex_unlock(&cache->lock);
+    return hits;
+}
+
+// Return a free entry, evicting the least recently used one if necessary.
+// Must be called locked.
+static struct cmd_cache_entry *cache_new_entry(struct mp_cmd_cache *cache)
+{
+    struct cmd_cache_entry *e = NULL;
+    if (cache->num_entries < CMD_CACHE_SIZE) {
+        e = &cache->entries[cache->num_entries++];
+    } else {
+        e = &cache->entries[0];
+        for (int n = 1; n < cache->num_entries; n++) {
+            if (cache->entries[n].last_use < e->last_use)
+                e = &cache->entries[n];
+        }
+        talloc_free(e->cmd);
+        talloc_free(e->strs);
+        talloc_free(e->text);
+    }
+    *e = (struct cmd_cache_entry){.last_use = ++cache->use_counter};
+    return e;
+}
+
+struct mp_cmd *mp_cmd_cache_parse_str(struct mp_cmd_cache *cache,
+                                      struct mp_log *log, bstr str,
+                                      const char *loc)
+{
+    if (!cache)
+        return mp_input_parse_cmd_str(log, str, loc);
+
+    struct mp_cmd *res = NULL;
+    mp_mutex_lock(&cache->lock);
+    for (int n = 0; n < cache->num_entries; n++) {
+        struct cmd_cache_entry *e = &cache->entries[n];
+        if (e->text && bstr_equals0(str, e->text)) {
+            e->last_use = ++cache->use_counter;
+            cache->hits++;
+            res = mp_cmd_clone(e->cmd);
+            break;
+        }
+    }
+    mp_mutex_unlock(&cache->lock);
+    if (res)
+        return res;
+
+    res = mp_input_parse_cmd_str(log, str, loc);
+    if (!res)
+        return NULL;
+
+    mp_mutex_lock(&cache->lock);
+    struct cmd_cache_entry *e = cache_new_entry(cache);
+    e->text = bstrto0(cache, str);
+    e->cmd = talloc_steal(cache, mp_cmd_clone(res));
+    mp_mutex_unlock(&cache->lock);
+    return res;
+}
+
+// Rebuild a command from the template e->cmd. Arguments that are the same
+// strings as the ones the template was parsed from are copied, the others are
+// parsed, and become part of the template. Must be called locked.
+static struct mp_cmd *cache_reuse_node(struct mp_log *log,
+                                       struct cmd_cache_entry *e,
+                                       mpv_node_list *items)
+{
+    struct mp_cmd *tmpl = e->cmd;
+    struct mp_cmd *cmd = talloc_ptrtype(NULL, cmd);
+    talloc_set_destructor(cmd, destroy_cmd);
+    *cmd = (struct mp_cmd) {
+        .name = (char *)tmpl->def->name,
+        .def = tmpl->def,
+        .flags = tmpl->flags,
+        .scale = 1,
+        .scale_units = 1,
+    };
+
+    for (int n = e->num_prefix; n < items->num; n++) {
+        const char *s = items->values[n].u.string;
+        int i = cmd->nargs;
+        if (strcmp(s, e->strs[n]) == 0) {
+            struct mp_cmd_arg arg = {.type = tmpl->args[i].type};
+            m_option_copy(arg.type, &arg.v, &tmpl->args[i].v);
+            MP_TARRAY_APPEND(cmd, cmd->args, cmd->nargs, arg);
+        } else if (!set_node_arg(log, cmd, i, &items->values[n])) {
+            talloc_free(cmd);
+            return NULL;
+        }
+    }
+
+    if (!finish_cmd(log, cmd)) {
+        talloc_free(cmd);
+        return NULL;
+    }
+
+    for (int n = e->num_prefix; n < items->num; n++) {
+        const char *s = items->values[n].u.string;
+        int i = n - e->num_prefix;
+        if (strcmp(s, e->strs[n]) != 0) {
+            m_option_free(tmpl->args[i].type, &tmpl->args[i].v);
+            m_option_copy(tmpl->args[i].type, &tmpl->args[i].v, &cmd->args[i].v);
+            talloc_free(e->strs[n]);
+            e->strs[n] = talloc_strdup(e->strs, s);
+        }
+    }
+
+    return cmd;
+}
+
+struct mp_cmd *mp_cmd_cache_parse_node(struct mp_cmd_cache *cache,
+                                       struct mp_log *log, mpv_node *node)
+{
+    if (!cache || node->format != MPV_FORMAT_NODE_ARRAY)
+        return mp_input_parse_cmd_node(log, node);
+
+    // Only plain string arrays (like mpv_command() or most IPC commands) are
+    // cached. They are keyed by the flags and command name, and by the number
+    // of arguments.
+    mpv_node_list *items = node->u.list;
+    int num_prefix = 0;
+    for (int n = 0; n < items->num; n++) {
+        if (items->values[n].format != MPV_FORMAT_STRING)
+            return mp_input_parse_cmd_node(log, node);
+        if (num_prefix == n && is_flag(bstr0(items->values[n].u.string)))
+            num_prefix++;
+    }
+    if (num_prefix >= items->num)
+        return mp_input_parse_cmd_node(log, node);
+    num_prefix++; // command name
+
+    struct mp_cmd *res = NULL;
+    bool found = false;
+    mp_mutex_lock(&cache->lock);
+    for (int n = 0; n < cache->num_entries; n++) {
+        struct cmd_cache_entry *e = &cache->entries[n];
+        if (e->num_strs != items->num || e->num_prefix != num_prefix)
+            continue;
+        bool match = true;
+        for (int i = 0; i < num_prefix; i++)
+            match &= strcmp(e->strs[i], items->values[i].u.string) == 0;
+        if (!match)
+            continue;
+        e->last_use = ++cache->use_counter;
+        res = cache_reuse_node(log, e, items);
+        if (res)
+            cache->hits++;
+        found = true;
+        break;
+    }
+    mp_mutex_unlock(&cache->lock);
+    if (found)
+        return res;
+
+    res = mp_input_parse_cmd_node(log, node);
+    if (!res)
+        return NULL;
+
+    mp_mutex_lock(&cache->lock);
+    struct cmd_cache_entry *e = cache_new_entry(cache);
+    e->strs = talloc_zero_array(cache, char *, items->num);
+    for (int n = 0; n < items->num; n++)
+        e->strs[n] = talloc_strdup(e->strs, items->values[n].u.string);
+    e->num_strs = items->num;
+    e->num_prefix = num_prefix;
+    e->cmd = talloc_steal(cache, mp_cmd_clone(res));
+    mp_mutex_unlock(&cache->lock);
+    return res;
+}
+
+struct mp_cmd *mp_cmd_cache_parse_strv(struct mp_cmd_cache *cache,
+                                       struct mp_log *log, const char **argv)
+{
+    return parse_cmd_strv(cache, log, argv);
+}
+
 static int parse_cycle_dir(struct mp_log *log, const struct m_option *opt,
                            struct bstr name, struct bstr param, void *dst)
 {
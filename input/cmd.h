@@ -138,6 +138,27 @@ struct mp_cmd *mp_input_parse_cmd_strv(struct mp_log *log, const char **argv);
 
 struct mp_cmd *mp_input_parse_cmd_node(struct mp_log *log, struct mpv_node *node);
 
+// LRU cache of parsed commands, for callers which send the same commands
+// repeatedly (key bindings, client API, IPC). Thread-safe.
+struct mp_cmd_cache;
+struct mp_cmd_cache *mp_cmd_cache_alloc(void *ta_parent);
+
+// Number of commands returned from the cache so far.
+uint64_t mp_cmd_cache_get_hits(struct mp_cmd_cache *cache);
+
+// Like the mp_input_parse_cmd_*() functions, but return a copy of a cached
+// command if possible. String arrays are matched by flags, command name and
+// argument count, and only arguments that differ from the cached command are
+// parsed again. cache==NULL is allowed, and disables caching.
+struct mp_cmd *mp_cmd_cache_parse_str(struct mp_cmd_cache *cache,
+                                      struct mp_log *log, bstr str,
+                                      const char *loc);
+struct mp_cmd *mp_cmd_cache_parse_strv(struct mp_cmd_cache *cache,
+                                       struct mp_log *log, const char **argv);
+struct mp_cmd *mp_cmd_cache_parse_node(struct mp_cmd_cache *cache,
+                                       struct mp_log *log,
+                                       struct mpv_node *node);
+
 // After getting a command from mp_input_get_cmd you need to free it using this
 // function
 void mp_cmd_free(struct mp_cmd *cmd);
@@ -112,6 +112,9 @@ struct input_ctx {
     // List of command binding sections
     struct cmd_bind_section *cmd_bind_sections;
 
+    // Key bindings from input.conf are loaded on first use (--input-lazy-config).
+    bool config_pending;
+
     // List currently active command sections
     struct active_section active_sections[MAX_ACTIVE_SECTIONS];
     int num_active_sections;
@@ -123,6 +126,9 @@ struct input_ctx {
 
     struct cmd_queue cmd_queue;
 
+    // Parsed key binding and client commands
+    struct mp_cmd_cache *cmd_cache;
+
     void (*wakeup_cb)(void *ctx);
     void *wakeup_ctx;
 };
@@ -130,6 +136,7 @@ struct input_ctx {
 static int parse_config(struct input_ctx *ictx, bool builtin, bstr data,
                         const char *location, const char *restrict_section);
 static void close_input_sources(struct input_ctx *ictx);
+static void load_pending_config(struct input_ctx *ictx);
 
 #define OPT_BASE_STRUCT struct input_opts
 struct input_opts {
@@ -145,6 +152,7 @@ struct input_opts {
     int default_bindings;
     int test;
     int allow_win_drag;
+    int lazy_config;
 };
 
 const struct m_sub_options input_config = {
@@ -159,6 +167,7 @@ const struct m_sub_options input_config = {
         OPT_INTRANGE("input-doubleclick-time", doubleclick_time, 0, 0, 1000),
         OPT_FLAG("input-right-alt-gr", use_alt_gr, 0),
         OPT_INTRANGE("input-key-fifo-size", key_fifo_size, 0, 2, 65000),
+        OPT_FLAG("input-lazy-config", lazy_config, M_OPT_FIXED),
         {0}
     },
     .size = sizeof(struct input_opts),
@@ -218,8 +227,8 @@ static void append_bind_info(struct input_ctx *ictx, char **pmsg,
                              struct cmd_bind *bind)
 {
     char *msg = *pmsg;
-    struct mp_cmd *cmd = mp_input_parse_cmd(ictx, bstr0(bind->cmd),
-                                            bind->location);
+    struct mp_cmd *cmd = mp_input_parse_cmd_str(ictx->log, bstr0(bind->cmd),
+                                                bind->location);
     bstr stripped = cmd ? cmd->original : bstr0(bind->cmd);
     msg = talloc_asprintf_append(msg, " '%.*s'", BSTR_P(stripped));
     if (!cmd)
@@ -372,6 +381,8 @@ static struct cmd_bind *find_any_bind_for_key(struct input_ctx *ictx,
 static mp_cmd_t *get_cmd_from_keys(struct input_ctx *ictx, char *force_section,
                                    int code)
 {
+    load_pending_config(ictx);
+
     if (ictx->opts->test)
         return handle_test(ictx, code);
 
@@ -746,6 +757,8 @@ void mp_input_define_section(struct input_ctx *ictx, char *name, char *location,
     if (!name || !name[0])
         return; // parse_config() changes semantics with restrict_section==empty
     input_lock(ictx);
+    // The config must not override bindings defined later.
+    load_pending_config(ictx);
     // Delete:
     struct cmd_bind_section *bs = get_bind_section(ictx, bstr0(name));
     if ((!bs->owner || (owner && strcmp(bs->owner, owner) != 0)) &&
@@ -898,7 +911,7 @@ static int parse_config(struct input_ctx *ictx, bool builtin, bstr data,
         n_binds++;
 
         // Print warnings if invalid commands are encountered.
-        talloc_free(mp_input_parse_cmd(ictx, command, cur_loc));
+        talloc_free(mp_input_parse_cmd_str(ictx->log, command, cur_loc));
     }
 
     talloc_free(cur_loc);
@@ -947,6 +960,7 @@ struct input_ctx *mp_input_init(struct mpv_global *global,
         .ar_state = -1,
         .log = mp_log_new(ictx, global->log, "input"),
         .opts_cache = m_config_cache_alloc(ictx, global, &input_config),
+        .cmd_cache = mp_cmd_cache_alloc(ictx),
         .wakeup_cb = wakeup_cb,
         .wakeup_ctx = wakeup_ctx,
     };
@@ -974,12 +988,9 @@ void mp_input_update_opts(struct input_ctx *ictx)
     input_unlock(ictx);
 }
 
-void mp_input_load_config(struct input_ctx *ictx)
+// Parse the builtin and user key bindings. Must be called with the lock held.
+static void load_bindings(struct input_ctx *ictx)
 {
-    input_lock(ictx);
-
-    reload_opts(ictx, false);
-
     // "Uncomment" the default key bindings in etc/input.conf and add them.
     // All lines that do not start with '# ' are parsed.
     bstr builtin = bstr0(builtin_input_conf);
@@ -1001,6 +1012,28 @@ void mp_input_load_config(struct input_ctx *ictx)
             parse_config_file(ictx, files[n], false);
         talloc_free(tmp);
     }
+}
+
+static void load_pending_config(struct input_ctx *ictx)
+{
+    if (ictx->config_pending) {
+        ictx->config_pending = false;
+        MP_VERBOSE(ictx, "Loading key bindings on first use.\n");
+        load_bindings(ictx);
+    }
+}
+
+void mp_input_load_config(struct input_ctx *ictx)
+{
+    input_lock(ictx);
+
+    reload_opts(ictx, false);
+
+    if (ictx->opts->lazy_config) {
+        ictx->config_pending = true;
+    } else {
+        load_bindings(ictx);
+    }
 
 #if HAVE_WIN32_PIPES
     char *ifile;
@@ -1049,7 +1082,12 @@ bool mp_input_use_alt_gr(struct input_ctx *ictx)
 struct mp_cmd *mp_input_parse_cmd(struct input_ctx *ictx, bstr str,
                                   const char *location)
 {
-    return mp_input_parse_cmd_str(ictx->log, str, location);
+    return mp_cmd_cache_parse_str(ictx->cmd_cache, ictx->log, str, location);
+}
+
+struct mp_cmd_cache *mp_input_get_cmd_cache(struct input_ctx *ictx)
+{
+    return ictx->cmd_cache;
 }
 
 struct mp_input_src_internal {
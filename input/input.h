@@ -108,6 +108,9 @@ struct mp_cmd *mp_input_read_cmd(struct input_ctx *ictx);
 struct mp_cmd *mp_input_parse_cmd(struct input_ctx *ictx, bstr str,
                                   const char *location);
 
+// Cache used by mp_input_parse_cmd(), for parsing other commands (thread-safe).
+struct mp_cmd_cache *mp_input_get_cmd_cache(struct input_ctx *ictx);
+
 // Set current input section. The section is appended on top of the list of
 // active sections, so its bindings are considered first. If the section was
 // already active, it's moved to the top as well.
@@ -294,6 +294,36 @@ static char *json_execute_command(struct mpv_handle *client, void *ta_parent,
 
         rc = mpv_set_property(client, cmd_node->u.list->values[1].u.string,
                               MPV_FORMAT_NODE, &cmd_node->u.list->values[2]);
+    } else if (!strcmp("get_properties", cmd)) {
+        int num = cmd_node->u.list->num;
+        const char **names = talloc_array(ta_parent, const char *, num);
+        for (int n = 1; n < num; n++) {
+            if (cmd_node->u.list->values[n].format != MPV_FORMAT_STRING) {
+                rc = MPV_ERROR_INVALID_PARAMETER;
+                goto error;
+            }
+            names[n - 1] = cmd_node->u.list->values[n].u.string;
+        }
+        names[num - 1] = NULL;
+
+        mpv_node result_node;
+        rc = mpv_get_properties(client, names, &result_node);
+        if (rc >= 0) {
+            mpv_node_map_add(ta_parent, &reply_node, "data", &result_node);
+            mpv_free_node_contents(&result_node);
+        }
+    } else if (!strcmp("set_properties", cmd)) {
+        if (cmd_node->u.list->num != 2) {
+            rc = MPV_ERROR_INVALID_PARAMETER;
+            goto error;
+        }
+
+        if (cmd_node->u.list->values[1].format != MPV_FORMAT_NODE_MAP) {
+            rc = MPV_ERROR_INVALID_PARAMETER;
+            goto error;
+        }
+
+        rc = mpv_set_properties(client, &cmd_node->u.list->values[1]);
     } else if (!strcmp("observe_property", cmd)) {
         if (cmd_node->u.list->num != 3) {
             rc = MPV_ERROR_INVALID_PARAMETER;
@@ -334,6 +364,43 @@ static char *json_execute_command(struct mpv_handle *client, void *ta_parent,
                                   cmd_node->u.list->values[1].u.int64,
                                   cmd_node->u.list->values[2].u.string,
                                   MPV_FORMAT_STRING);
+    } else if (!strcmp("observe_property_limits", cmd)) {
+        int num = cmd_node->u.list->num;
+        if (num < 4 || num > 5) {
+            rc = MPV_ERROR_INVALID_PARAMETER;
+            goto error;
+        }
+
+        if (cmd_node->u.list->values[1].format != MPV_FORMAT_INT64) {
+            rc = MPV_ERROR_INVALID_PARAMETER;
+            goto error;
+        }
+
+        double limits[2];
+        for (int n = 0; n < 2; n++) {
+            mpv_node *v = &cmd_node->u.list->values[2 + n];
+            if (v->format == MPV_FORMAT_INT64) {
+                limits[n] = v->u.int64;
+            } else if (v->format == MPV_FORMAT_DOUBLE) {
+                limits[n] = v->u.double_;
+            } else {
+                rc = MPV_ERROR_INVALID_PARAMETER;
+                goto error;
+            }
+        }
+
+        int latest_only = 0;
+        if (num == 5) {
+            if (cmd_node->u.list->values[4].format != MPV_FORMAT_FLAG) {
+                rc = MPV_ERROR_INVALID_PARAMETER;
+                goto error;
+            }
+            latest_only = cmd_node->u.list->values[4].u.flag;
+        }
+
+        rc = mpv_observe_property_limits(client,
+                                         cmd_node->u.list->values[1].u.int64,
+                                         limits[0], limits[1], latest_only);
     } else if (!strcmp("unobserve_property", cmd)) {
         if (cmd_node->u.list->num != 2) {
             rc = MPV_ERROR_INVALID_PARAMETER;
@@ -223,7 +223,7 @@ extern "C" {
  * relational operators (<, >, <=, >=).
  */
 #define MPV_MAKE_VERSION(major, minor) (((major) << 16) | (minor) | 0UL)
-#define MPV_CLIENT_API_VERSION MPV_MAKE_VERSION(1, 103)
+#define MPV_CLIENT_API_VERSION MPV_MAKE_VERSION(1, 107)
 
 /**
  * The API user is allowed to "#define MPV_ENABLE_DEPRECATED 0" before
@@ -1164,6 +1164,67 @@ char *mpv_get_property_osd_string(mpv_handle *ctx, const char *name);
 int mpv_get_property_async(mpv_handle *ctx, uint64_t reply_userdata,
                            const char *name, mpv_format format);
 
+/**
+ * Read the values of several properties at once. All properties are read
+ * while holding the core lock once, so this is cheaper than calling
+ * mpv_get_property() for each of them, and the values are consistent with
+ * each other (no playback state change can happen in between).
+ *
+ * Properties which can't be read (for example because they are unavailable
+ * or don't exist) are left out of the result. If a name is listed multiple
+ * times, it is read only once.
+ *
+ * @param[in] names NULL-terminated array of property names.
+ * @param[out] result Set to a MPV_FORMAT_NODE_MAP, which maps each property
+ *                    name to its value (as with MPV_FORMAT_NODE). Free it
+ *                    with mpv_free_node_contents().
+ * @return error code (only for errors which prevented reading any property)
+ */
+int mpv_get_properties(mpv_handle *ctx, const char **names, mpv_node *result);
+
+/**
+ * Like mpv_get_properties(), but asynchronous. You will receive the result as
+ * MPV_EVENT_GET_PROPERTY_REPLY event, whose mpv_event_property has the name
+ * field set to "" and the data field to the result map (MPV_FORMAT_NODE).
+ *
+ * Safe to be called from mpv render API threads.
+ *
+ * @param reply_userdata see section about asynchronous calls
+ * @param[in] names NULL-terminated array of property names. It will be
+ *                  copied by the function.
+ * @return error code if sending the request failed
+ */
+int mpv_get_properties_async(mpv_handle *ctx, uint64_t reply_userdata,
+                             const char **names);
+
+/**
+ * Set several properties at once, while holding the core lock once. The
+ * properties are set in the order of the map entries. A failure to set one
+ * property does not prevent the following ones from being set.
+ *
+ * Before mpv_initialize(), this behaves like calling mpv_set_property() for
+ * each entry.
+ *
+ * @param[in] values MPV_FORMAT_NODE_MAP, mapping property names to values.
+ *                   It will never be modified by the client API.
+ * @return error code of the first property that could not be set, or 0
+ */
+int mpv_set_properties(mpv_handle *ctx, mpv_node *values);
+
+/**
+ * Like mpv_set_properties(), but asynchronous. You will receive the result
+ * as MPV_EVENT_SET_PROPERTY_REPLY event.
+ *
+ * Safe to be called from mpv render API threads.
+ *
+ * @param reply_userdata see section about asynchronous calls
+ * @param[in] values see mpv_set_properties(). It will be copied by the
+ *                   function.
+ * @return error code if sending the request failed
+ */
+int mpv_set_properties_async(mpv_handle *ctx, uint64_t reply_userdata,
+                             mpv_node *values);
+
 /**
  * Get a notification whenever the given property changes. You will receive
  * updates as MPV_EVENT_PROPERTY_CHANGE. Note that this is not very precise:
@@ -1231,6 +1292,38 @@ int mpv_observe_property(mpv_handle *mpv, uint64_t reply_userdata,
  */
 int mpv_unobserve_property(mpv_handle *mpv, uint64_t registered_reply_userdata);
 
+/**
+ * Limit how often MPV_EVENT_PROPERTY_CHANGE events are generated for the
+ * properties observed with the given reply_userdata. This is useful for
+ * properties which change all the time during playback (like "time-pos"),
+ * if the client does not need every single update. Limited updates are
+ * skipped before the property value is retrieved, so they cost nearly nothing.
+ *
+ * The limits apply to each observed property separately. Changes are never
+ * lost entirely: the event is only delayed, and carries the latest value.
+ *
+ * Safe to be called from mpv render API threads.
+ *
+ * @param registered_reply_userdata ID that was passed to mpv_observe_property
+ * @param max_rate Maximum number of change events per second. 0 means no
+ *                 limit.
+ * @param min_delta Changes of numeric values (MPV_FORMAT_INT64,
+ *                  MPV_FORMAT_DOUBLE, or MPV_FORMAT_NODE containing these)
+ *                  smaller than this (compared to the last value returned in
+ *                  a change event) are not reported. 0 means no limit.
+ * @param latest_only If 0, a change delayed by max_rate is reported as soon
+ *                    as the interval has passed. If 1, it is reported only
+ *                    on the next change notification after the interval has
+ *                    passed (possibly much later, but this avoids extra
+ *                    wakeups for properties which change constantly anyway).
+ * @return negative value is an error code, >=0 is number of affected
+ *         properties on success
+ */
+int mpv_observe_property_limits(mpv_handle *mpv,
+                                uint64_t registered_reply_userdata,
+                                double max_rate, double min_delta,
+                                int latest_only);
+
 typedef enum mpv_event_id {
     /**
      * Nothing happened. Happens on timeouts or sporadic wakeups.
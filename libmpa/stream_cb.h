@@ -147,6 +147,61 @@ typedef int64_t (*mpv_stream_cb_size_fn)(void *cookie);
  */
 typedef void (*mpv_stream_cb_close_fn)(void *cookie);
 
+/**
+ * Opaque handle for a pending asynchronous read request. See
+ * mpv_stream_cb_read_async_fn.
+ */
+typedef struct mpv_stream_cb_request mpv_stream_cb_request;
+
+/**
+ * Asynchronous read callback used to implement a custom stream. This is an
+ * alternative to mpv_stream_cb_read_fn for sources which would block for a
+ * long time (like network or decryption), and which can process several
+ * requests at once.
+ *
+ * The callback must not block. It starts reading up to nbytes bytes at the
+ * given offset into buf, and returns. When the data is available, the
+ * user calls mpv_stream_cb_read_complete() with the request handle, from any
+ * thread (it may also be called from within this callback). Until then, buf
+ * remains valid, and must not be accessed after that.
+ *
+ * libmpv keeps up to mpv_stream_cb_info.prefetch_depth requests in flight,
+ * for consecutive ranges of the stream. The offsets are explicit, so the
+ * requests don't depend on the seek callback, which is only used to test
+ * whether the stream is seekable (see mpv_stream_cb_seek_fn). After a seek,
+ * requests that are still in flight must still be completed; their data is
+ * discarded.
+ *
+ * Every request must be completed eventually. The close callback is called
+ * only after all requests were completed, so a user that wants to abort them
+ * should complete them with an error.
+ *
+ * @param cookie opaque cookie identifying the stream,
+ *               returned from mpv_stream_cb_open_fn
+ * @param req handle to pass to mpv_stream_cb_read_complete()
+ * @param offset byte position in the stream to read from
+ * @param buf buffer to read data into
+ * @param nbytes size of the buffer
+ */
+typedef void (*mpv_stream_cb_read_async_fn)(void *cookie,
+                                            mpv_stream_cb_request *req,
+                                            int64_t offset, char *buf,
+                                            uint64_t nbytes);
+
+/**
+ * Complete a request started with mpv_stream_cb_read_async_fn. Must be called
+ * exactly once for each request. The result has the same meaning as the return
+ * value of mpv_stream_cb_read_fn: the number of bytes read (short reads are
+ * allowed), 0 on EOF, or -1 on error.
+ *
+ * Safe to be called from any thread, and from within the read_async_fn
+ * callback. The request handle is invalid after this call.
+ *
+ * @param req the request passed to the mpv_stream_cb_read_async_fn callback
+ * @param result number of bytes written to the buffer, 0 on EOF, -1 on error
+ */
+void mpv_stream_cb_read_complete(mpv_stream_cb_request *req, int64_t result);
+
 /**
  * See mpv_stream_cb_open_ro_fn callback.
  */
@@ -164,12 +219,26 @@ typedef struct mpv_stream_cb_info {
      * Callbacks set by the user in the mpv_stream_cb_open_ro_fn callback. Some
      * of them are optional, and can be left unset.
      *
-     * The following callbacks are mandatory: read_fn, close_fn
+     * The following callbacks are mandatory: read_fn or read_async_fn,
+     * close_fn
      */
     mpv_stream_cb_read_fn read_fn;
     mpv_stream_cb_seek_fn seek_fn;
     mpv_stream_cb_size_fn size_fn;
     mpv_stream_cb_close_fn close_fn;
+
+    /**
+     * If set, this is used for reading instead of read_fn (since API version
+     * 1.106).
+     */
+    mpv_stream_cb_read_async_fn read_async_fn;
+
+    /**
+     * Maximum number of requests to read_async_fn in flight at the same time.
+     * Each request is for up to 64 KiB. 0 selects the default (4). Ignored if
+     * read_async_fn is not set. (Since API version 1.106.)
+     */
+    int prefetch_depth;
 } mpv_stream_cb_info;
 
 /**
@@ -216,6 +285,52 @@ typedef int (*mpv_stream_cb_open_ro_fn)(void *user_data, char *uri,
 int mpv_stream_cb_add_ro(mpv_handle *ctx, const char *protocol, void *user_data,
                          mpv_stream_cb_open_ro_fn open_fn);
 
+/**
+ * Called when a memory source is not used anymore. See
+ * mpv_add_memory_source().
+ *
+ * @param opaque the opaque pointer passed to mpv_add_memory_source()
+ */
+typedef void (*mpv_memory_source_free_fn)(void *opaque);
+
+/**
+ * Register a memory buffer owned by the user, which can then be played with
+ * `loadfile mem://name`. Unlike memory:// URLs, the data is not copied: reads
+ * and seeks are served from the buffer directly, and demuxers which support
+ * it (currently --demuxer=rawaudio) create packets that reference the buffer.
+ *
+ * The buffer is reference counted. It is referenced by the registration and
+ * by each stream that plays it. The data must stay valid and unchanged until
+ * free_fn is called, which happens after the source was removed with
+ * mpv_remove_memory_source() (or the core was destroyed), and no stream
+ * references it anymore. free_fn can be called from any thread, including
+ * from within mpv_remove_memory_source().
+ *
+ * Like custom protocols, sources remain registered until the mpv core is
+ * destroyed.
+ *
+ * @param name name used in the mem:// URL
+ * @param data start of the buffer
+ * @param size size of the buffer in bytes (must be less than 2 GiB)
+ * @param free_fn called when the buffer is not used anymore, can be NULL
+ * @param opaque passed to free_fn
+ * @return error code; MPV_ERROR_INVALID_PARAMETER if a source with the same
+ *         name already exists, or if the size is too large
+ */
+int mpv_add_memory_source(mpv_handle *ctx, const char *name, const void *data,
+                          uint64_t size, mpv_memory_source_free_fn free_fn,
+                          void *opaque);
+
+/**
+ * Unregister a memory source added with mpv_add_memory_source(). Streams which
+ * currently play it continue to work. New mem:// URLs with this name fail to
+ * open.
+ *
+ * @return error code; MPV_ERROR_INVALID_PARAMETER if there is no such source,
+ *         or if name is NULL
+ */
+int mpv_remove_memory_source(mpv_handle *ctx, const char *name);
+
 #ifdef __cplusplus
 }
 #endif
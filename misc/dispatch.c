@@ -17,15 +17,44 @@
 
 #include <stdbool.h>
 #include <assert.h>
+#include <sched.h>
 
 #include "common/common.h"
+#include "osdep/atomic.h"
 #include "osdep/threads.h"
 #include "osdep/timer.h"
 
 #include "dispatch.h"
 
+// Number of preallocated items. If all are in use, items are allocated and
+// freed on demand.
+#define POOL_SIZE 64
+
+struct mp_dispatch_item {
+    mp_dispatch_fn fn;          // NULL if canceled (or the stub item)
+    void *fn_data;
+    bool asynchronous;
+    bool autofree;              // talloc_free(fn_data) after running
+    bool completed;
+    atomic_bool *pending;       // see mp_dispatch_enqueue_notify()
+    int pool_index;             // index+1 into queue->pool_items, or 0
+    mp_atomic_ptr next;         // queue link
+    atomic_uint pool_next;      // free list link (pool index+1, or 0)
+};
+
 struct mp_dispatch_queue {
-    struct mp_dispatch_item *head, *tail;
+    // Items are appended without taking the lock (intrusive MPSC queue: the
+    // producers only exchange the tail pointer). The consumer side (head) is
+    // protected by the lock, so that mp_dispatch_cancel_fn() can walk it.
+    // The stub item is requeued whenever the queue runs empty, so the queue
+    // always contains at least one item.
+    mp_atomic_ptr tail;
+    struct mp_dispatch_item *head;
+    struct mp_dispatch_item stub;
+    // Free list of pool_items. The upper 32 bits are a generation counter to
+    // avoid ABA problems, the lower 32 bits the index+1 of the first item.
+    atomic_ullong pool_head;
+    struct mp_dispatch_item pool_items[POOL_SIZE];
     pthread_mutex_t lock;
     pthread_cond_t cond;
     void (*wakeup_fn)(void *wakeup_ctx);
@@ -33,7 +62,10 @@ struct mp_dispatch_queue {
     // Time at which mp_dispatch_queue_process() should return.
     int64_t wait;
     // Make mp_dispatch_queue_process() exit if it's idle.
-    bool interrupted;
+    atomic_bool interrupted;
+    // The target thread is (about to start) waiting on cond for new items.
+    // Producers signal cond only if this is set.
+    atomic_bool sleeping;
     // The target thread is in mp_dispatch_queue_process() (and either idling,
     // locked, or running a dispatch callback).
     bool in_process;
@@ -49,30 +81,114 @@ struct mp_dispatch_queue {
     pthread_t locked_explicit_thread;
 };
 
-struct mp_dispatch_item {
-    mp_dispatch_fn fn;
-    void *fn_data;
-    bool asynchronous;
-    bool mergeable;
-    bool completed;
-    struct mp_dispatch_item *next;
-};
+static bool queue_is_empty(struct mp_dispatch_queue *queue)
+{
+    return queue->head == &queue->stub && atomic_load(&queue->tail) == &queue->stub;
+}
+
+static void queue_push(struct mp_dispatch_queue *queue,
+                       struct mp_dispatch_item *item)
+{
+    atomic_store(&item->next, NULL);
+    struct mp_dispatch_item *prev = atomic_exchange(&queue->tail, item);
+    // (Between these two steps, the item is invisible to the consumer.)
+    atomic_store(&prev->next, item);
+}
+
+// Remove the first item. Returns NULL if the queue is empty, or if a producer
+// is in the middle of queue_push(). Must be called with the lock held.
+static struct mp_dispatch_item *queue_pop(struct mp_dispatch_queue *queue)
+{
+    struct mp_dispatch_item *head = queue->head;
+    struct mp_dispatch_item *next = atomic_load(&head->next);
+    if (head == &queue->stub) {
+        if (!next)
+            return NULL;
+        queue->head = head = next;
+        next = atomic_load(&head->next);
+    }
+    if (!next) {
+        if (atomic_load(&queue->tail) != head)
+            return NULL;
+        // head is the last item; requeue the stub so it can be removed.
+        queue_push(queue, &queue->stub);
+        next = atomic_load(&head->next);
+        if (!next)
+            return NULL;
+    }
+    queue->head = next;
+    return head;
+}
+
+static struct mp_dispatch_item *item_alloc(struct mp_dispatch_queue *queue)
+{
+    unsigned long long head = atomic_load(&queue->pool_head);
+    while (head & 0xFFFFFFFFu) {
+        struct mp_dispatch_item *item =
+            &queue->pool_items[(head & 0xFFFFFFFFu) - 1];
+        unsigned long long new_head =
+            (((head >> 32) + 1) << 32) | atomic_load(&item->pool_next);
+        if (atomic_compare_exchange_strong(&queue->pool_head, &head, new_head))
+            return item;
+    }
+    struct mp_dispatch_item *item = talloc_ptrtype(NULL, item);
+    item->pool_index = 0;
+    return item;
+}
+
+static void item_free(struct mp_dispatch_queue *queue,
+                      struct mp_dispatch_item *item)
+{
+    if (!item->pool_index) {
+        talloc_free(item);
+        return;
+    }
+    unsigned long long head = atomic_load(&queue->pool_head);
+    while (1) {
+        atomic_store(&item->pool_next, (unsigned int)(head & 0xFFFFFFFFu));
+        unsigned long long new_head =
+            (((head >> 32) + 1) << 32) | (unsigned int)item->pool_index;
+        if (atomic_compare_exchange_strong(&queue->pool_head, &head, new_head))
+            break;
+    }
+}
+
+static struct mp_dispatch_item *item_new(struct mp_dispatch_queue *queue,
+                                         mp_dispatch_fn fn, void *fn_data)
+{
+    struct mp_dispatch_item *item = item_alloc(queue);
+    item->fn = fn;
+    item->fn_data = fn_data;
+    item->asynchronous = true;
+    item->autofree = false;
+    item->completed = false;
+    item->pending = NULL;
+    return item;
+}
 
 static void queue_dtor(void *p)
 {
     struct mp_dispatch_queue *queue = p;
-    assert(!queue->head);
+    // Items removed with mp_dispatch_cancel_fn() may still be linked.
+    mp_mutex_lock(&queue->lock);
+    struct mp_dispatch_item *item;
+    while ((item = queue_pop(queue))) {
+        assert(!item->fn);
+        item_free(queue, item);
+    }
+    mp_mutex_unlock(&queue->lock);
+    assert(queue_is_empty(queue));
     assert(!queue->in_process);
     assert(!queue->lock_requests);
     assert(!queue->locked);
     pthread_cond_destroy(&queue->cond);
-    pthread_mutex_destroy(&queue->lock);
+    mp_mutex_destroy(&queue->lock);
 }
 
 // A dispatch queue lets other threads run callbacks in a target thread.
 // The target thread is the thread which calls mp_dispatch_queue_process().
 // Free the dispatch queue with talloc_free(). At the time of destruction,
-// the queue must be empty. The easiest way to guarantee this is to
+// the queue must be empty (canceled items don't count). The easiest way to guarantee this is to
 // terminate all potential senders, then call mp_dispatch_run() with a
 // function that e.g. makes the target thread exit, then pthread_join() the
 // target thread, and finally destroy the queue. Another way is calling
@@ -84,7 +200,17 @@ struct mp_dispatch_queue *mp_dispatch_create(void *ta_parent)
     *queue = (struct mp_dispatch_queue){0};
     talloc_set_destructor(queue, queue_dtor);
     pthread_mutex_init(&queue->lock, NULL);
+    mp_mutex_set_name(&queue->lock, "dispatch");
     pthread_cond_init(&queue->cond, NULL);
+    atomic_store(&queue->stub.next, NULL);
+    atomic_store(&queue->tail, &queue->stub);
+    queue->head = &queue->stub;
+    for (int n = 0; n < POOL_SIZE; n++) {
+        struct mp_dispatch_item *item = &queue->pool_items[n];
+        item->pool_index = n + 1;
+        atomic_store(&item->pool_next, n + 1 < POOL_SIZE ? n + 2 : 0);
+    }
+    atomic_store(&queue->pool_head, 1);
     return queue;
 }
 
@@ -107,34 +233,21 @@ void mp_dispatch_set_wakeup_fn(struct mp_dispatch_queue *queue,
 static void mp_dispatch_append(struct mp_dispatch_queue *queue,
                                struct mp_dispatch_item *item)
 {
-    pthread_mutex_lock(&queue->lock);
-    if (item->mergeable) {
-        for (struct mp_dispatch_item *cur = queue->head; cur; cur = cur->next) {
-            if (cur->mergeable && cur->fn == item->fn &&
-                cur->fn_data == item->fn_data)
-            {
-                talloc_free(item);
-                pthread_mutex_unlock(&queue->lock);
-                return;
-            }
-        }
-    }
-
-    if (queue->tail) {
-        queue->tail->next = item;
-    } else {
-        queue->head = item;
-    }
-    queue->tail = item;
+    queue_push(queue, item);
 
-    // Wake up the main thread; note that other threads might wait on this
-    // condition for reasons, so broadcast the condition.
-    pthread_cond_broadcast(&queue->cond);
     // No wakeup callback -> assume mp_dispatch_queue_process() needs to be
     // interrupted instead.
     if (!queue->wakeup_fn)
-        queue->interrupted = true;
-    pthread_mutex_unlock(&queue->lock);
+        atomic_store(&queue->interrupted, true);
+
+    // Wake up the target thread only if it's actually waiting. It sets
+    // sleeping before checking the queue, so either it sees the new item,
+    // or we see the flag.
+    if (atomic_load(&queue->sleeping)) {
+        mp_mutex_lock(&queue->lock);
+        pthread_cond_broadcast(&queue->cond);
+        mp_mutex_unlock(&queue->lock);
+    }
 
     if (queue->wakeup_fn)
         queue->wakeup_fn(queue->wakeup_ctx);
@@ -149,13 +262,7 @@ static void mp_dispatch_append(struct mp_dispatch_queue *queue,
 void mp_dispatch_enqueue(struct mp_dispatch_queue *queue,
                          mp_dispatch_fn fn, void *fn_data)
 {
-    struct mp_dispatch_item *item = talloc_ptrtype(NULL, item);
-    *item = (struct mp_dispatch_item){
-        .fn = fn,
-        .fn_data = fn_data,
-        .asynchronous = true,
-    };
-    mp_dispatch_append(queue, item);
+    mp_dispatch_append(queue, item_new(queue, fn, fn_data));
 }
 
 // Like mp_dispatch_enqueue(), but the queue code will call talloc_free(fn_data)
@@ -165,26 +272,25 @@ void mp_dispatch_enqueue(struct mp_dispatch_queue *queue,
 void mp_dispatch_enqueue_autofree(struct mp_dispatch_queue *queue,
                                   mp_dispatch_fn fn, void *fn_data)
 {
-    struct mp_dispatch_item *item = talloc_ptrtype(NULL, item);
-    *item = (struct mp_dispatch_item){
-        .fn = fn,
-        .fn_data = talloc_steal(item, fn_data),
-        .asynchronous = true,
-    };
+    struct mp_dispatch_item *item = item_new(queue, fn, fn_data);
+    item->autofree = true;
     mp_dispatch_append(queue, item);
 }
 
-// Like mp_dispatch_enqueue(), but
+// Like mp_dispatch_enqueue(), but do nothing if the same notification is
+// already queued. *pending is a flag owned by the caller (usually part of the
+// notified object), which must be false initially, and must not be accessed
+// otherwise while the queue is in use. It's set while the item is queued, and
+// cleared right before fn is run, so a notification that happens while fn is
+// running is not lost.
 void mp_dispatch_enqueue_notify(struct mp_dispatch_queue *queue,
-                                mp_dispatch_fn fn, void *fn_data)
+                                mp_dispatch_fn fn, void *fn_data,
+                                atomic_bool *pending)
 {
-    struct mp_dispatch_item *item = talloc_ptrtype(NULL, item);
-    *item = (struct mp_dispatch_item){
-        .fn = fn,
-        .fn_data = fn_data,
-        .mergeable = true,
-        .asynchronous = true,
-    };
+    if (atomic_exchange(pending, true))
+        return;
+    struct mp_dispatch_item *item = item_new(queue, fn, fn_data);
+    item->pending = pending;
     mp_dispatch_append(queue, item);
 }
 
@@ -196,23 +302,25 @@ void mp_dispatch_enqueue_notify(struct mp_dispatch_queue *queue,
 // canceled anymore. This function is mostly for being called from the same
 // context as mp_dispatch_queue_process(), where the "currently executing" case
 // can be excluded.
+// Items that are being enqueued concurrently may or may not be canceled.
 void mp_dispatch_cancel_fn(struct mp_dispatch_queue *queue,
                            mp_dispatch_fn fn, void *fn_data)
 {
-    pthread_mutex_lock(&queue->lock);
-    struct mp_dispatch_item **pcur = &queue->head;
-    queue->tail = NULL;
-    while (*pcur) {
-        struct mp_dispatch_item *cur = *pcur;
-        if (cur->fn == fn && cur->fn_data == fn_data) {
-            *pcur = cur->next;
-            talloc_free(cur);
-        } else {
-            queue->tail = cur;
-            pcur = &cur->next;
+    mp_mutex_lock(&queue->lock);
+    // Canceled items stay in the queue, and are skipped when they're removed.
+    struct mp_dispatch_item *cur = queue->head;
+    while (cur) {
+        if (cur != &queue->stub && cur->fn == fn && cur->fn_data == fn_data &&
+            !cur->autofree && cur->asynchronous)
+        {
+            cur->fn = NULL;
+            if (cur->pending)
+                atomic_store(cur->pending, false);
+            cur->pending = NULL;
         }
+        cur = atomic_load(&cur->next);
     }
-    pthread_mutex_unlock(&queue->lock);
+    mp_mutex_unlock(&queue->lock);
 }
 
 // Run fn(fn_data) on the target thread synchronously. This function enqueues
@@ -228,10 +336,13 @@ void mp_dispatch_run(struct mp_dispatch_queue *queue,
     };
     mp_dispatch_append(queue, &item);
 
-    pthread_mutex_lock(&queue->lock);
+    // (The item is not freed by the target thread, and is only accessed under
+    // the lock after it was run.)
+
+    mp_mutex_lock(&queue->lock);
     while (!item.completed)
-        pthread_cond_wait(&queue->cond, &queue->lock);
-    pthread_mutex_unlock(&queue->lock);
+        mp_cond_wait(&queue->cond, &queue->lock);
+    mp_mutex_unlock(&queue->lock);
 }
 
 // Process any outstanding dispatch items in the queue. This also handles
@@ -252,7 +363,7 @@ void mp_dispatch_run(struct mp_dispatch_queue *queue,
 // no enqueued callback can call the lock/unlock functions).
 void mp_dispatch_queue_process(struct mp_dispatch_queue *queue, double timeout)
 {
-    pthread_mutex_lock(&queue->lock);
+    mp_mutex_lock(&queue->lock);
     queue->wait = timeout > 0 ? mp_add_timeout(mp_time_us(), timeout) : 0;
     assert(!queue->in_process); // recursion not allowed
     queue->in_process = true;
@@ -261,47 +372,66 @@ void mp_dispatch_queue_process(struct mp_dispatch_queue *queue, double timeout)
     if (queue->lock_requests)
         pthread_cond_broadcast(&queue->cond);
     while (1) {
+        struct mp_dispatch_item *item = NULL;
         if (queue->lock_requests) {
             // Block due to something having called mp_dispatch_lock().
-            pthread_cond_wait(&queue->cond, &queue->lock);
-        } else if (queue->head) {
-            struct mp_dispatch_item *item = queue->head;
-            queue->head = item->next;
-            if (!queue->head)
-                queue->tail = NULL;
-            item->next = NULL;
+            mp_cond_wait(&queue->cond, &queue->lock);
+        } else if ((item = queue_pop(queue))) {
+            if (!item->fn) {
+                // Canceled with mp_dispatch_cancel_fn().
+                item_free(queue, item);
+                continue;
+            }
+            if (item->pending)
+                atomic_store(item->pending, false);
             // Unlock, because we want to allow other threads to queue items
             // while the dispatch item is processed.
             // At the same time, we must prevent other threads from returning
             // from mp_dispatch_lock(), which is done by locked=true.
             assert(!queue->locked);
             queue->locked = true;
-            pthread_mutex_unlock(&queue->lock);
+            mp_mutex_unlock(&queue->lock);
 
             item->fn(item->fn_data);
 
-            pthread_mutex_lock(&queue->lock);
+            mp_mutex_lock(&queue->lock);
             assert(queue->locked);
             queue->locked = false;
-            // Wakeup mp_dispatch_run(), also mp_dispatch_lock().
-            pthread_cond_broadcast(&queue->cond);
             if (item->asynchronous) {
-                talloc_free(item);
+                if (item->autofree)
+                    talloc_free(item->fn_data);
+                item_free(queue, item);
+                // Wakeup mp_dispatch_lock().
+                if (queue->lock_requests)
+                    pthread_cond_broadcast(&queue->cond);
             } else {
                 item->completed = true;
+                // Wakeup mp_dispatch_run(), also mp_dispatch_lock().
+                pthread_cond_broadcast(&queue->cond);
+            }
+        } else if (!queue_is_empty(queue)) {
+            // A producer is in the middle of queue_push(); the item will
+            // become visible very soon.
+            mp_mutex_unlock(&queue->lock);
+            sched_yield();
+            mp_mutex_lock(&queue->lock);
+        } else if (queue->wait > 0 && !atomic_load(&queue->interrupted)) {
+            atomic_store(&queue->sleeping, true);
+            // Check again after setting the flag (see mp_dispatch_append()).
+            if (queue_is_empty(queue) && !atomic_load(&queue->interrupted)) {
+                struct timespec ts = mp_time_us_to_timespec(queue->wait);
+                if (mp_cond_timedwait(&queue->cond, &queue->lock, &ts))
+                    queue->wait = 0;
             }
-        } else if (queue->wait > 0 && !queue->interrupted) {
-            struct timespec ts = mp_time_us_to_timespec(queue->wait);
-            if (pthread_cond_timedwait(&queue->cond, &queue->lock, &ts))
-                queue->wait = 0;
+            atomic_store(&queue->sleeping, false);
         } else {
             break;
         }
     }
     assert(!queue->locked);
     queue->in_process = false;
-    queue->interrupted = false;
-    pthread_mutex_unlock(&queue->lock);
+    atomic_store(&queue->interrupted, false);
+    mp_mutex_unlock(&queue->lock);
 }
 
 // If the queue is inside of mp_dispatch_queue_process(), make it return as
@@ -312,10 +442,10 @@ void mp_dispatch_queue_process(struct mp_dispatch_queue *queue, double timeout)
 // wakeup the main thread from another thread in a race free way).
 void mp_dispatch_interrupt(struct mp_dispatch_queue *queue)
 {
-    pthread_mutex_lock(&queue->lock);
-    queue->interrupted = true;
+    mp_mutex_lock(&queue->lock);
+    atomic_store(&queue->interrupted, true);
     pthread_cond_broadcast(&queue->cond);
-    pthread_mutex_unlock(&queue->lock);
+    mp_mutex_unlock(&queue->lock);
 }
 
 // If a mp_dispatch_queue_process() call is in progress, then adjust the maximum
@@ -328,12 +458,12 @@ void mp_dispatch_interrupt(struct mp_dispatch_queue *queue)
 // to wait in external APIs.
 void mp_dispatch_adjust_timeout(struct mp_dispatch_queue *queue, int64_t until)
 {
-    pthread_mutex_lock(&queue->lock);
+    mp_mutex_lock(&queue->lock);
     if (queue->in_process && queue->wait > until) {
         queue->wait = until;
         pthread_cond_broadcast(&queue->cond);
     }
-    pthread_mutex_unlock(&queue->lock);
+    mp_mutex_unlock(&queue->lock);
 }
 
 // Grant exclusive access to the target thread's state. While this is active,
@@ -345,7 +475,7 @@ void mp_dispatch_adjust_timeout(struct mp_dispatch_queue *queue, int64_t until)
 // already holding the dispatch lock.
 void mp_dispatch_lock(struct mp_dispatch_queue *queue)
 {
-    pthread_mutex_lock(&queue->lock);
+    mp_mutex_lock(&queue->lock);
     // Must not be called recursively from dispatched callbacks.
     if (queue->in_process)
         assert(!pthread_equal(queue->in_process_thread, pthread_self()));
@@ -357,17 +487,17 @@ void mp_dispatch_lock(struct mp_dispatch_queue *queue)
     // mp_dispatch_queue_process() call, which will mean we get exclusive
     // access to the target's thread state.
     while (!queue->in_process) {
-        pthread_mutex_unlock(&queue->lock);
+        mp_mutex_unlock(&queue->lock);
         if (queue->wakeup_fn)
             queue->wakeup_fn(queue->wakeup_ctx);
-        pthread_mutex_lock(&queue->lock);
+        mp_mutex_lock(&queue->lock);
         if (queue->in_process)
             break;
-        pthread_cond_wait(&queue->cond, &queue->lock);
+        mp_cond_wait(&queue->cond, &queue->lock);
     }
     // Wait until we can get the lock.
     while (!queue->in_process || queue->locked)
-        pthread_cond_wait(&queue->cond, &queue->lock);
+        mp_cond_wait(&queue->cond, &queue->lock);
     // "Lock".
     assert(queue->lock_requests);
     assert(!queue->locked);
@@ -375,13 +505,13 @@ void mp_dispatch_lock(struct mp_dispatch_queue *queue)
     queue->locked = true;
     queue->locked_explicit = true;
     queue->locked_explicit_thread = pthread_self();
-    pthread_mutex_unlock(&queue->lock);
+    mp_mutex_unlock(&queue->lock);
 }
 
 // Undo mp_dispatch_lock().
 void mp_dispatch_unlock(struct mp_dispatch_queue *queue)
 {
-    pthread_mutex_lock(&queue->lock);
+    mp_mutex_lock(&queue->lock);
     assert(queue->locked);
     // Must be called after a mp_dispatch_lock(), from the same thread.
     assert(queue->locked_explicit);
@@ -393,5 +523,5 @@ void mp_dispatch_unlock(struct mp_dispatch_queue *queue)
     // Wakeup mp_dispatch_queue_process(), and maybe other mp_dispatch_lock()s.
     // (Would be nice to wake up only 1 other locker if lock_requests>0.)
     pthread_cond_broadcast(&queue->cond);
-    pthread_mutex_unlock(&queue->lock);
+    mp_mutex_unlock(&queue->lock);
 }
@@ -3,6 +3,8 @@
 
 #include <stdint.h>
 
+#include "osdep/atomic.h"
+
 typedef void (*mp_dispatch_fn)(void *data);
 struct mp_dispatch_queue;
 
@@ -15,7 +17,8 @@ void mp_dispatch_enqueue(struct mp_dispatch_queue *queue,
 void mp_dispatch_enqueue_autofree(struct mp_dispatch_queue *queue,
                                   mp_dispatch_fn fn, void *fn_data);
 void mp_dispatch_enqueue_notify(struct mp_dispatch_queue *queue,
-                                mp_dispatch_fn fn, void *fn_data);
+                                mp_dispatch_fn fn, void *fn_data,
+                                atomic_bool *pending);
 void mp_dispatch_cancel_fn(struct mp_dispatch_queue *queue,
                            mp_dispatch_fn fn, void *fn_data);
 void mp_dispatch_run(struct mp_dispatch_queue *queue,
@@ -91,6 +91,10 @@ struct m_config_data {
 struct m_group_data {
     char *udata;        // pointer to group user option struct
     long long ts;       // incremented on every write access
+    // Per option change timestamp, indexed by m_config_option index minus
+    // m_config_group.co_index. Allocated on the first change (in practice
+    // only used by the shadow data). NULL means no option changed yet.
+    long long *opt_ts;
 };
 
 struct m_profile {
@@ -1294,7 +1298,10 @@ struct m_config_cache *m_config_cache_alloc(void *ta_parent,
     return cache;
 }
 
-static bool update_options(struct m_config_data *dst, struct m_config_data *src)
+// Copy the options that changed in src since dst was last updated. If cache
+// is not NULL, record the changed options for m_config_cache_get_next_changed().
+static bool update_options(struct m_config_data *dst, struct m_config_data *src,
+                           struct m_config_cache *cache)
 {
     assert(dst->root == src->root);
 
@@ -1314,14 +1321,21 @@ static bool update_options(struct m_config_data *dst, struct m_config_data *src)
 
         if (gdst->ts >= gsrc->ts)
             continue;
+        long long seen_ts = gdst->ts;
         gdst->ts = gsrc->ts;
         res = true;
 
         for (int i = g->co_index; i < g->co_end_index; i++) {
             struct m_config_option *co = &dst->root->opts[i];
+            if (gsrc->opt_ts && gsrc->opt_ts[i - g->co_index] <= seen_ts)
+                continue;
             if (co->opt->offset >= 0 && co->opt->type->size) {
                 m_option_copy(co->opt, gdst->udata + co->opt->offset,
                                        gsrc->udata + co->opt->offset);
+                if (cache) {
+                    MP_TARRAY_APPEND(cache, cache->changed_opts,
+                                     cache->num_changed_opts, i);
+                }
             }
         }
     }
@@ -1333,6 +1347,9 @@ bool m_config_cache_update(struct m_config_cache *cache)
 {
     struct m_config_shadow *shadow = cache->shadow;
 
+    cache->num_changed_opts = 0;
+    cache->next_changed_opt = 0;
+
     // Using atomics and checking outside of the lock - it's unknown whether
     // this makes it faster or slower. Just cargo culting it.
     if (atomic_load_explicit(&cache->data->ts, memory_order_relaxed) >=
@@ -1340,11 +1357,31 @@ bool m_config_cache_update(struct m_config_cache *cache)
         return false;
 
     pthread_mutex_lock(&shadow->lock);
-    bool res = update_options(cache->data, shadow->data);
+    bool res = update_options(cache->data, shadow->data, cache);
     pthread_mutex_unlock(&shadow->lock);
     return res;
 }
 
+bool m_config_cache_get_next_changed(struct m_config_cache *cache,
+                                     void **out_ptr)
+{
+    struct m_config_data *data = cache->data;
+    struct m_config *root = data->root;
+
+    while (cache->next_changed_opt < cache->num_changed_opts) {
+        int i = cache->changed_opts[cache->next_changed_opt++];
+        struct m_config_option *co = &root->opts[i];
+        struct m_group_data *gdata = m_config_gdata(data, co->group_index);
+        if (gdata) {
+            *out_ptr = gdata->udata + co->opt->offset;
+            return true;
+        }
+    }
+
+    *out_ptr = NULL;
+    return false;
+}
+
 void m_config_notify_change_co(struct m_config *config,
                                struct m_config_option *co)
 {
@@ -1360,6 +1397,15 @@ void m_config_notify_change_co(struct m_config *config,
 
         gdata->ts = atomic_fetch_add(&data->ts, 1) + 1;
 
+        struct m_config_group *g = &config->groups[co->group_index];
+        if (!gdata->opt_ts) {
+            gdata->opt_ts = talloc_zero_array(data, long long,
+                                              g->co_end_index - g->co_index);
+        }
+        int co_index = co - config->opts;
+        assert(co_index >= g->co_index && co_index < g->co_end_index);
+        gdata->opt_ts[co_index - g->co_index] = gdata->ts;
+
         m_option_copy(co->opt, gdata->udata + co->opt->offset, co->data);
 
         for (int n = 0; n < shadow->num_listeners; n++) {
@@ -1431,7 +1477,8 @@ static void dispatch_notify(void *p)
     assert(cache->wakeup_dispatch_queue);
     mp_dispatch_enqueue_notify(cache->wakeup_dispatch_queue,
                                cache->wakeup_dispatch_cb,
-                               cache->wakeup_dispatch_cb_ctx);
+                               cache->wakeup_dispatch_cb_ctx,
+                               &cache->wakeup_dispatch_pending);
 }
 
 void m_config_cache_set_dispatch_change_cb(struct m_config_cache *cache,
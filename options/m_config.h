@@ -23,6 +23,7 @@
 #include <stdbool.h>
 
 #include "misc/bstr.h"
+#include "osdep/atomic.h"
 
 // m_config provides an API to manipulate the config variables in MPlayer.
 // It makes use of the Options API to provide a context stack that
@@ -85,6 +86,9 @@ typedef struct m_config {
     // For the command line parser
     int recursion_depth;
 
+    // If set, config file parsing is recorded (see m_config_snapshot_begin()).
+    struct m_config_snapshot *snapshot;
+
     void *optstruct; // struct mpopts or other
 
     // Private. List of m_sub_options instances.
@@ -273,6 +277,12 @@ struct m_config_cache {
     struct mp_dispatch_queue *wakeup_dispatch_queue;
     void (*wakeup_dispatch_cb)(void *ctx);
     void *wakeup_dispatch_cb_ctx;
+    atomic_bool wakeup_dispatch_pending; // notification is queued
+    // Options changed by the last m_config_cache_update() (indexes into
+    // m_config.opts[]), see m_config_cache_get_next_changed().
+    int *changed_opts;
+    int num_changed_opts;
+    int next_changed_opt;
     // --- Protected by shadow->lock
     void (*wakeup_cb)(void *ctx);
     void *wakeup_cb_ctx;
@@ -316,6 +326,15 @@ void m_config_cache_set_dispatch_change_cb(struct m_config_cache *cache,
 // data itself will (e.g. string options might be reallocated).
 bool m_config_cache_update(struct m_config_cache *cache);
 
+// Return the options that were changed by the last m_config_cache_update()
+// call, one per call, by setting *out_ptr to the option field in cache->opts
+// (or one of its sub-structs). Returns false (and sets *out_ptr to NULL) if
+// there are no more changed options.
+// Since only changed options are copied on update, comparing *out_ptr with
+// the address of a field (e.g. &opts->volume) tells whether it changed.
+bool m_config_cache_get_next_changed(struct m_config_cache *cache,
+                                     void **out_ptr);
+
 // Like m_config_cache_alloc(), but return the struct (m_config_cache->opts)
 // directly, with no way to update the config. Basically this returns a copy
 // with a snapshot of the current option values.
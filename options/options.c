@@ -48,8 +48,10 @@ static void print_version(struct mp_log *log)
 }
 
 extern const struct m_sub_options stream_lavf_conf;
+extern const struct m_sub_options stream_ranges_conf;
 extern const struct m_sub_options demux_rawaudio_conf;
 extern const struct m_sub_options demux_lavf_conf;
+extern const struct m_sub_options demux_timeline_conf;
 extern const struct m_sub_options ad_lavc_conf;
 extern const struct m_sub_options input_config;
 extern const struct m_sub_options ao_alsa_conf;
@@ -112,6 +114,8 @@ const m_option_t mp_opts[] = {
     OPT_FLAG("config", load_config, M_OPT_FIXED | CONF_PRE_PARSE),
     OPT_STRING("config-dir", force_configdir,
                M_OPT_FIXED | CONF_NOCFG | CONF_PRE_PARSE | M_OPT_FILE),
+    OPT_STRING("config-snapshot", config_snapshot,
+               M_OPT_FIXED | CONF_NOCFG | CONF_PRE_PARSE | M_OPT_FILE),
     OPT_STRINGLIST("reset-on-next-file", reset_options, 0),
 
 // ------------------------- stream options --------------------
@@ -187,6 +191,7 @@ const m_option_t mp_opts[] = {
     OPT_DOUBLE("mf-fps", mf_fps, 0),
     OPT_STRING("mf-type", mf_type, 0),
     OPT_SUBSTRUCT("", stream_lavf_opts, stream_lavf_conf, 0),
+    OPT_SUBSTRUCT("", stream_ranges_opts, stream_ranges_conf, 0),
 
 // ------------------------- a-v sync options --------------------
 
@@ -219,6 +224,7 @@ const m_option_t mp_opts[] = {
 
     OPT_SUBSTRUCT("", demux_lavf, demux_lavf_conf, 0),
     OPT_SUBSTRUCT("demuxer-rawaudio", demux_rawaudio, demux_rawaudio_conf, 0),
+    OPT_SUBSTRUCT("", demux_timeline, demux_timeline_conf, 0),
 
 //---------------------- libao/libvo options ------------------------
     OPT_SUBSTRUCT("", ao_opts, ao_conf, 0),
@@ -245,6 +251,9 @@ const m_option_t mp_opts[] = {
                ({"no", 0},
                 {"yes", 1},
                 {"weak", -1})),
+    OPT_FLAG("audio-sticky-output", audio_sticky_output, 0),
+    OPT_BYTE_SIZE("audio-overlay-cache-size", audio_overlay_cache_size, 0,
+                  0, INT_MAX),
 
     OPT_CHOICE("osd-level", osd_level, 0,
                ({"0", 0}, {"1", 1}, {"2", 2}, {"3", 3})),
@@ -252,6 +261,7 @@ const m_option_t mp_opts[] = {
     OPT_FLAG("osd-fractions", osd_fractions, 0),
 
     OPT_DOUBLE("sstep", step_sec, CONF_MIN, 0),
+    OPT_FLAG("hr-seek-framedrop", hr_seek_framedrop, 0),
 
     OPT_CHOICE("framedrop", frame_dropping, 0,
                ({"no", 0},
@@ -281,6 +291,7 @@ const m_option_t mp_opts[] = {
     OPT_FLAG("write-filename-in-watch-later-config", write_filename_in_watch_later_config, 0),
     OPT_FLAG("ignore-path-in-watch-later-config", ignore_path_in_watch_later_config, 0),
     OPT_STRING("watch-later-directory", watch_later_directory, M_OPT_FILE),
+    OPT_FLAG("save-seek-index", save_seek_index, 0),
 
     OPT_FLAG("ordered-chapters", ordered_chapters, 0),
     OPT_STRING("ordered-chapters-files", ordered_chapters_files, M_OPT_FILE),
@@ -371,6 +382,7 @@ const struct MPOpts mp_default_opts = {
     .softvol_volume = 100,
     .softvol_mute = 0,
     .gapless_audio = -1,
+    .audio_overlay_cache_size = 16 * 1024 * 1024,
     .osd_level = 1,
     .osd_duration = 1000,
     .loop_times = 1,
@@ -35,6 +35,8 @@ typedef struct MPOpts {
     int softvol_mute;
     float softvol_max;
     int gapless_audio;
+    int audio_sticky_output;
+    int64_t audio_overlay_cache_size;
 
     struct ao_opts *ao_opts;
 
@@ -63,6 +65,7 @@ typedef struct MPOpts {
     int quiet;
     int load_config;
     char *force_configdir;
+    char *config_snapshot;
     int use_filedir_conf;
     int hls_bitrate;
     int chapterrange[2];
@@ -102,6 +105,7 @@ typedef struct MPOpts {
     int write_filename_in_watch_later_config;
     int ignore_path_in_watch_later_config;
     char *watch_later_directory;
+    int save_seek_index;
     int pause;
     int keep_open;
     int keep_open_pause;
@@ -146,12 +150,14 @@ typedef struct MPOpts {
     int w32_priority;
 
     struct stream_lavf_params *stream_lavf_opts;
+    struct stream_ranges_opts *stream_ranges_opts;
 
     double mf_fps;
     char *mf_type;
 
     struct demux_rawaudio_opts *demux_rawaudio;
     struct demux_lavf_opts *demux_lavf;
+    struct demux_timeline_opts *demux_timeline;
 
     struct demux_opts *demux_opts;
 
@@ -22,6 +22,9 @@
 #include <string.h>
 #include <errno.h>
 #include <assert.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <unistd.h>
 
 #include "osdep/io.h"
 
@@ -32,6 +35,48 @@
 #include "m_option.h"
 #include "m_config.h"
 
+enum snapshot_entry_kind {
+    SNAPSHOT_PROFILE,   // profile declaration
+    SNAPSHOT_OPTION,    // option added to a profile
+    SNAPSHOT_FINISH,    // end of a top-level config file: apply default profile
+};
+
+struct snapshot_source {
+    char *path;
+    int64_t mtime, size;
+};
+
+struct snapshot_entry {
+    uint32_t kind;
+    uint32_t flags;
+    char *profile, *option, *value;
+};
+
+// Result of parsing the top-level config files, replayable without reading
+// or tokenizing them again.
+struct m_config_snapshot {
+    struct snapshot_source *sources;
+    int num_sources;
+    struct snapshot_entry *entries;
+    int num_entries;
+};
+
+static void record_entry(struct m_config *config, int kind, int flags,
+                         bstr profile, bstr option, bstr value)
+{
+    struct m_config_snapshot *s = config->snapshot;
+    if (!s || config->recursion_depth > 0)
+        return;
+    struct snapshot_entry e = {
+        .kind = kind,
+        .flags = flags,
+        .profile = bstrto0(s, profile),
+        .option = bstrto0(s, option),
+        .value = bstrto0(s, value),
+    };
+    MP_TARRAY_APPEND(s, s->entries, s->num_entries, e);
+}
+
 // Skip whitespace and comments (assuming there are no line breaks)
 static bool skip_ws(bstr *s)
 {
@@ -45,6 +90,9 @@ int m_config_parse(m_config_t *config, const char *location, bstr data,
                    char *initial_section, int flags)
 {
     m_profile_t *profile = m_config_add_profile(config, initial_section);
+    bstr profile_name = bstr0(initial_section);
+    record_entry(config, SNAPSHOT_PROFILE, 0, profile_name, (bstr){0},
+                 (bstr){0});
     void *tmp = talloc_new(NULL);
     int line_no = 0;
     int errors = 0;
@@ -76,6 +124,9 @@ int m_config_parse(m_config_t *config, const char *location, bstr data,
                 goto error;
             }
             profile = m_config_add_profile(config, bstrto0(tmp, profilename));
+            profile_name = profilename;
+            record_entry(config, SNAPSHOT_PROFILE, 0, profile_name, (bstr){0},
+                         (bstr){0});
             continue;
         }
 
@@ -139,6 +190,7 @@ int m_config_parse(m_config_t *config, const char *location, bstr data,
                    loc, BSTR_P(option), BSTR_P(value));
             goto error;
         }
+        record_entry(config, SNAPSHOT_OPTION, 0, profile_name, option, value);
 
         ok = true;
     error:
@@ -150,8 +202,11 @@ int m_config_parse(m_config_t *config, const char *location, bstr data,
         }
     }
 
-    if (config->recursion_depth == 0)
+    if (config->recursion_depth == 0) {
         m_config_finish_default_profile(config, flags);
+        record_entry(config, SNAPSHOT_FINISH, flags, (bstr){0}, (bstr){0},
+                     (bstr){0});
+    }
 
     talloc_free(tmp);
     return 1;
@@ -201,7 +256,234 @@ int m_config_parse_config_file(m_config_t *config, const char *conffile,
     if (!data.start)
         return 0;
 
+    struct m_config_snapshot *s = config->snapshot;
+    if (s && config->recursion_depth == 0) {
+        // Included files are not part of the snapshot; they are read again
+        // when the "include" option is replayed.
+        struct stat st;
+        if (stat(conffile, &st) == 0) {
+            struct snapshot_source src = {
+                .path = talloc_strdup(s, conffile),
+                .mtime = st.st_mtime,
+                .size = st.st_size,
+            };
+            MP_TARRAY_APPEND(s, s->sources, s->num_sources, src);
+        } else {
+            // Can't validate it later.
+            TA_FREEP(&config->snapshot);
+        }
+    }
+
     int r = m_config_parse(config, conffile, data, initial_section, flags);
     talloc_free(data.start);
     return r;
 }
+
+#define SNAPSHOT_MAGIC "MPACFGS\x01"
+
+// Start recording the top-level config files parsed with
+// m_config_parse_config_file(), for m_config_snapshot_write().
+void m_config_snapshot_begin(m_config_t *config)
+{
+    talloc_free(config->snapshot);
+    config->snapshot = talloc_zero(config, struct m_config_snapshot);
+}
+
+static void write_u32(FILE *f, uint32_t v)
+{
+    fwrite(&v, sizeof(v), 1, f);
+}
+
+static void write_i64(FILE *f, int64_t v)
+{
+    fwrite(&v, sizeof(v), 1, f);
+}
+
+static void write_str(FILE *f, const char *s)
+{
+    write_u32(f, strlen(s));
+    fwrite(s, strlen(s), 1, f);
+}
+
+// Stop recording, and write the snapshot to filename (atomically replacing
+// it). Returns false if nothing was written, e.g. on I/O errors.
+bool m_config_snapshot_write(m_config_t *config, const char *filename)
+{
+    struct m_config_snapshot *s = config->snapshot;
+    config->snapshot = NULL;
+    if (!s)
+        return false;
+
+    bool ok = false;
+    char *tmpname = talloc_asprintf(s, "%s.tmp", filename);
+    FILE *f = fopen(tmpname, "wb");
+    if (!f) {
+        MP_WARN(config, "Can't write config snapshot %s: %s\n", tmpname,
+                mp_strerror(errno));
+        goto done;
+    }
+
+    fwrite(SNAPSHOT_MAGIC, 8, 1, f);
+    write_str(f, mpa_version);
+    write_u32(f, s->num_sources);
+    for (int n = 0; n < s->num_sources; n++) {
+        write_str(f, s->sources[n].path);
+        write_i64(f, s->sources[n].mtime);
+        write_i64(f, s->sources[n].size);
+    }
+    write_u32(f, s->num_entries);
+    for (int n = 0; n < s->num_entries; n++) {
+        struct snapshot_entry *e = &s->entries[n];
+        write_u32(f, e->kind);
+        write_u32(f, e->flags);
+        write_str(f, e->profile);
+        write_str(f, e->option);
+        write_str(f, e->value);
+    }
+
+    ok = !ferror(f);
+    ok &= fclose(f) == 0;
+    if (ok && rename(tmpname, filename) != 0) {
+        // Windows can't rename over existing files.
+        unlink(filename);
+        ok = rename(tmpname, filename) == 0;
+    }
+    if (!ok) {
+        MP_WARN(config, "Writing config snapshot %s failed.\n", filename);
+        unlink(tmpname);
+    } else {
+        MP_VERBOSE(config, "Wrote config snapshot %s\n", filename);
+    }
+
+done:
+    talloc_free(s);
+    return ok;
+}
+
+static bool read_u32(bstr *d, uint32_t *v)
+{
+    if (d->len < sizeof(*v))
+        return false;
+    memcpy(v, d->start, sizeof(*v));
+    *d = bstr_cut(*d, sizeof(*v));
+    return true;
+}
+
+static bool read_i64(bstr *d, int64_t *v)
+{
+    if (d->len < sizeof(*v))
+        return false;
+    memcpy(v, d->start, sizeof(*v));
+    *d = bstr_cut(*d, sizeof(*v));
+    return true;
+}
+
+static bool read_str(void *ta_ctx, bstr *d, char **s)
+{
+    uint32_t len;
+    if (!read_u32(d, &len))
+        return false;
+    if (len > d->len)
+        return false;
+    *s = bstrto0(ta_ctx, (bstr){d->start, len});
+    *d = bstr_cut(*d, len);
+    return true;
+}
+
+static bool parse_snapshot(struct m_config_snapshot *s, bstr d)
+{
+    char *version;
+    if (!bstr_eatstart0(&d, SNAPSHOT_MAGIC) || !read_str(s, &d, &version) ||
+        strcmp(version, mpa_version) != 0)
+        return false;
+
+    uint32_t num;
+    if (!read_u32(&d, &num) || num > d.len)
+        return false;
+    for (uint32_t n = 0; n < num; n++) {
+        struct snapshot_source src = {0};
+        if (!read_str(s, &d, &src.path) ||
+            !read_i64(&d, &src.mtime) || !read_i64(&d, &src.size))
+            return false;
+        MP_TARRAY_APPEND(s, s->sources, s->num_sources, src);
+    }
+
+    if (!read_u32(&d, &num) || num > d.len)
+        return false;
+    for (uint32_t n = 0; n < num; n++) {
+        struct snapshot_entry e = {0};
+        if (!read_u32(&d, &e.kind) || e.kind > SNAPSHOT_FINISH ||
+            !read_u32(&d, &e.flags) || !read_str(s, &d, &e.profile) ||
+            !read_str(s, &d, &e.option) || !read_str(s, &d, &e.value))
+            return false;
+        MP_TARRAY_APPEND(s, s->entries, s->num_entries, e);
+    }
+
+    return d.len == 0;
+}
+
+// Apply the snapshot in filename as if the given top-level config files were
+// parsed with m_config_parse_config_file(). Returns false without changing
+// anything if the snapshot is missing, broken, or out of date.
+bool m_config_snapshot_load(m_config_t *config, const char *filename,
+                            char **files)
+{
+    struct m_config_snapshot *s = talloc_zero(NULL, struct m_config_snapshot);
+    bool ok = false;
+
+    bstr data = read_file(mp_null_log, filename);
+    if (!data.start)
+        goto done;
+    talloc_steal(s, data.start);
+
+    if (!parse_snapshot(s, data)) {
+        MP_WARN(config, "Ignoring invalid config snapshot %s\n", filename);
+        goto done;
+    }
+
+    int num_files = 0;
+    while (files && files[num_files])
+        num_files++;
+    if (num_files != s->num_sources)
+        goto outdated;
+    for (int n = 0; n < s->num_sources; n++) {
+        struct snapshot_source *src = &s->sources[n];
+        struct stat st;
+        if (strcmp(src->path, files[n]) != 0 || stat(src->path, &st) != 0 ||
+            st.st_mtime != src->mtime || st.st_size != src->size)
+            goto outdated;
+    }
+
+    MP_VERBOSE(config, "Loading config snapshot %s\n", filename);
+    for (int n = 0; n < s->num_entries; n++) {
+        struct snapshot_entry *e = &s->entries[n];
+        m_profile_t *p;
+        switch (e->kind) {
+        case SNAPSHOT_PROFILE:
+            m_config_add_profile(config, e->profile);
+            break;
+        case SNAPSHOT_OPTION:
+            p = m_config_add_profile(config, e->profile);
+            if (strcmp(e->option, "profile-desc") == 0) {
+                m_profile_set_desc(p, bstr0(e->value));
+            } else if (m_config_set_profile_option(config, p, bstr0(e->option),
+                                                   bstr0(e->value)) < 0)
+            {
+                MP_ERR(config, "%s: setting option %s failed.\n", filename,
+                       e->option);
+            }
+            break;
+        case SNAPSHOT_FINISH:
+            m_config_finish_default_profile(config, e->flags);
+            break;
+        }
+    }
+    ok = true;
+    goto done;
+
+outdated:
+    MP_VERBOSE(config, "Config snapshot %s is out of date.\n", filename);
+done:
+    talloc_free(s);
+    return ok;
+}
@@ -26,4 +26,9 @@ int m_config_parse_config_file(m_config_t* config, const char *conffile,
 int m_config_parse(m_config_t *config, const char *location, bstr data,
                    char *initial_section, int flags);
 
+void m_config_snapshot_begin(m_config_t *config);
+bool m_config_snapshot_write(m_config_t *config, const char *filename);
+bool m_config_snapshot_load(m_config_t *config, const char *filename,
+                            char **files);
+
 #endif /* MPLAYER_PARSER_CFG_H */
@@ -16,11 +16,13 @@
  */
 
 #include <stdio.h>
+#include <string.h>
 #include <errno.h>
 #include <pthread.h>
 
 #include "config.h"
 
+#include "atomic.h"
 #include "threads.h"
 #include "timer.h"
 
@@ -49,3 +51,206 @@ void mpthread_set_name(const char *name)
     pthread_setname_np(tname);
 #endif
 }
+
+#if HAVE_LOCK_PROFILING
+
+#define MAX_LOCK_NAMES 64
+#define MAX_LOCKS 4096 // power of 2
+
+struct lock_name {
+    const char *name;
+    atomic_ullong acquisitions;
+    atomic_ullong contended;
+    atomic_ullong wait_total_us;
+    atomic_ullong max_wait_us;
+    atomic_ullong max_hold_us;
+    atomic_ullong wait_hist[MP_LOCK_WAIT_BUCKETS];
+};
+
+// Per named mutex state. The key is set and cleared with lock_registry_lock
+// held, but looked up without it. Everything else except ln is protected by
+// the mutex itself.
+struct lock_slot {
+    mp_atomic_ptr key;          // pthread_mutex_t*, NULL, or &tombstone
+    struct lock_name *ln;
+    int64_t locked_at;
+    int depth;                  // for recursive mutexes
+};
+
+static pthread_mutex_t lock_registry_lock = PTHREAD_MUTEX_INITIALIZER;
+static struct lock_name lock_names[MAX_LOCK_NAMES];
+static atomic_int num_lock_names;
+static struct lock_slot lock_slots[MAX_LOCKS];
+static char tombstone;
+
+static unsigned int lock_hash(pthread_mutex_t *mutex)
+{
+    uintptr_t v = (uintptr_t)mutex;
+    return (v ^ (v >> 7) ^ (v >> 17)) & (MAX_LOCKS - 1);
+}
+
+static struct lock_slot *find_slot(pthread_mutex_t *mutex)
+{
+    unsigned int h = lock_hash(mutex);
+    for (int n = 0; n < MAX_LOCKS; n++) {
+        struct lock_slot *slot = &lock_slots[(h + n) & (MAX_LOCKS - 1)];
+        void *key = atomic_load_explicit(&slot->key, memory_order_relaxed);
+        if (key == mutex)
+            return slot;
+        if (!key)
+            break;
+    }
+    return NULL;
+}
+
+void mp_mutex_set_name(pthread_mutex_t *mutex, const char *name)
+{
+    pthread_mutex_lock(&lock_registry_lock);
+
+    struct lock_name *ln = NULL;
+    int num = atomic_load(&num_lock_names);
+    for (int n = 0; n < num; n++) {
+        if (strcmp(lock_names[n].name, name) == 0)
+            ln = &lock_names[n];
+    }
+    if (!ln && num < MAX_LOCK_NAMES) {
+        ln = &lock_names[num];
+        ln->name = name;
+        atomic_store(&num_lock_names, num + 1);
+    }
+
+    if (ln && !find_slot(mutex)) {
+        unsigned int h = lock_hash(mutex);
+        for (int n = 0; n < MAX_LOCKS; n++) {
+            struct lock_slot *slot = &lock_slots[(h + n) & (MAX_LOCKS - 1)];
+            void *key = atomic_load(&slot->key);
+            if (!key || key == &tombstone) {
+                slot->ln = ln;
+                slot->depth = 0;
+                atomic_store(&slot->key, (void *)mutex);
+                break;
+            }
+        }
+    }
+
+    pthread_mutex_unlock(&lock_registry_lock);
+}
+
+int mp_mutex_destroy(pthread_mutex_t *mutex)
+{
+    pthread_mutex_lock(&lock_registry_lock);
+    struct lock_slot *slot = find_slot(mutex);
+    if (slot)
+        atomic_store(&slot->key, (void *)&tombstone);
+    pthread_mutex_unlock(&lock_registry_lock);
+
+    return pthread_mutex_destroy(mutex);
+}
+
+static void update_max(atomic_ullong *max, unsigned long long v)
+{
+    unsigned long long cur = atomic_load_explicit(max, memory_order_relaxed);
+    while (v > cur && !atomic_compare_exchange_strong(max, &cur, v)) {}
+}
+
+static void locked(struct lock_slot *slot, int64_t wait_start)
+{
+    struct lock_name *ln = slot->ln;
+    int64_t now = mp_time_us();
+
+    atomic_fetch_add(&ln->acquisitions, 1);
+    if (wait_start >= 0) {
+        unsigned long long wait = now - wait_start;
+        int bucket = 0;
+        while (bucket < MP_LOCK_WAIT_BUCKETS - 1 && wait >= (1ull << bucket))
+            bucket++;
+        atomic_fetch_add(&ln->contended, 1);
+        atomic_fetch_add(&ln->wait_total_us, wait);
+        atomic_fetch_add(&ln->wait_hist[bucket], 1);
+        update_max(&ln->max_wait_us, wait);
+    }
+
+    if (slot->depth++ == 0)
+        slot->locked_at = now;
+}
+
+static void unlocking(struct lock_slot *slot)
+{
+    if (--slot->depth == 0)
+        update_max(&slot->ln->max_hold_us, mp_time_us() - slot->locked_at);
+}
+
+int mp_mutex_lock(pthread_mutex_t *mutex)
+{
+    struct lock_slot *slot = find_slot(mutex);
+    if (!slot)
+        return pthread_mutex_lock(mutex);
+
+    int64_t wait_start = -1;
+    int r = pthread_mutex_trylock(mutex);
+    if (r == EBUSY) {
+        wait_start = mp_time_us();
+        r = pthread_mutex_lock(mutex);
+    }
+    if (r == 0)
+        locked(slot, wait_start);
+    return r;
+}
+
+int mp_mutex_unlock(pthread_mutex_t *mutex)
+{
+    struct lock_slot *slot = find_slot(mutex);
+    if (slot)
+        unlocking(slot);
+    return pthread_mutex_unlock(mutex);
+}
+
+int mp_cond_timedwait(pthread_cond_t *cond, pthread_mutex_t *mutex,
+                      const struct timespec *abstime)
+{
+    struct lock_slot *slot = find_slot(mutex);
+    if (!slot) {
+        return abstime ? pthread_cond_timedwait(cond, mutex, abstime)
+                       : pthread_cond_wait(cond, mutex);
+    }
+
+    // The wait releases the mutex, so it ends the hold time. Reacquiring it
+    // after the wakeup counts as acquisition, but it's impossible to tell
+    // whether it was contended.
+    int depth = slot->depth;
+    slot->depth = 1;
+    unlocking(slot);
+    int r = abstime ? pthread_cond_timedwait(cond, mutex, abstime)
+                    : pthread_cond_wait(cond, mutex);
+    locked(slot, -1);
+    slot->depth = depth;
+    return r;
+}
+
+int mp_cond_wait(pthread_cond_t *cond, pthread_mutex_t *mutex)
+{
+    return mp_cond_timedwait(cond, mutex, NULL);
+}
+
+int mp_lock_stats_get(struct mp_lock_stats *out, int max)
+{
+    int num = atomic_load(&num_lock_names);
+    if (num > max)
+        num = max;
+    for (int n = 0; n < num; n++) {
+        struct lock_name *ln = &lock_names[n];
+        out[n] = (struct mp_lock_stats){
+            .name = ln->name,
+            .acquisitions = atomic_load(&ln->acquisitions),
+            .contended = atomic_load(&ln->contended),
+            .wait_total_us = atomic_load(&ln->wait_total_us),
+            .max_wait_us = atomic_load(&ln->max_wait_us),
+            .max_hold_us = atomic_load(&ln->max_hold_us),
+        };
+        for (int i = 0; i < MP_LOCK_WAIT_BUCKETS; i++)
+            out[n].wait_hist[i] = atomic_load(&ln->wait_hist[i]);
+    }
+    return num;
+}
+
+#endif
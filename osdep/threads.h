@@ -3,6 +3,9 @@
 
 #include <pthread.h>
 #include <inttypes.h>
+#include <stdbool.h>
+
+#include "config.h"
 
 // Helper to reduce boiler plate.
 int mpthread_mutex_init_recursive(pthread_mutex_t *mutex);
@@ -10,4 +13,57 @@ int mpthread_mutex_init_recursive(pthread_mutex_t *mutex);
 // Set thread name (for debuggers).
 void mpthread_set_name(const char *name);
 
+// Lock profiling. Locks that should show up in the lock statistics use the
+// mp_mutex_*()/mp_cond_*() functions below instead of the pthread ones, and are
+// named with mp_mutex_set_name() after initialization (name must be a static
+// string). All locks with the same name are accounted together (e.g. all
+// demuxer instances). All lock/unlock/wait calls on a named mutex must use
+// these functions. Without HAVE_LOCK_PROFILING, these are plain pthread calls.
+// mp_mutex_set_name() must be called before the mutex is used by other
+// threads, and mp_mutex_destroy() must be used to destroy named mutexes.
+
+// Wait time histogram bucket n counts waits of less than 2^n microseconds (the
+// last bucket counts all longer waits).
+#define MP_LOCK_WAIT_BUCKETS 16
+
+struct mp_lock_stats {
+    const char *name;
+    uint64_t acquisitions;      // total lock calls (including cond. wakeups)
+    uint64_t contended;         // lock calls that had to wait
+    uint64_t wait_total_us;     // total time spent waiting for the lock
+    uint64_t max_wait_us;
+    uint64_t max_hold_us;       // longest time the lock was held at once
+    uint64_t wait_hist[MP_LOCK_WAIT_BUCKETS]; // contended waits only
+};
+
+#if HAVE_LOCK_PROFILING
+
+void mp_mutex_set_name(pthread_mutex_t *mutex, const char *name);
+int mp_mutex_destroy(pthread_mutex_t *mutex);
+int mp_mutex_lock(pthread_mutex_t *mutex);
+int mp_mutex_unlock(pthread_mutex_t *mutex);
+int mp_cond_wait(pthread_cond_t *cond, pthread_mutex_t *mutex);
+int mp_cond_timedwait(pthread_cond_t *cond, pthread_mutex_t *mutex,
+                      const struct timespec *abstime);
+
+// Copy the statistics of up to max lock names to out[], and return the number
+// of entries written. The names are static and stay valid forever.
+int mp_lock_stats_get(struct mp_lock_stats *out, int max);
+
+#else
+
+#define mp_mutex_set_name(mutex, name) ((void)(mutex), (void)(name))
+#define mp_mutex_destroy pthread_mutex_destroy
+#define mp_mutex_lock pthread_mutex_lock
+#define mp_mutex_unlock pthread_mutex_unlock
+#define mp_cond_wait pthread_cond_wait
+#define mp_cond_timedwait pthread_cond_timedwait
+
+static inline int mp_lock_stats_get(struct mp_lock_stats *out, int max)
+{
+    return 0;
+}
+
+#endif
+
 #endif
@@ -30,11 +30,15 @@
 #include "common/common.h"
 #include "osdep/timer.h"
 
+#include "audio/aframe.h"
 #include "audio/audio_buffer.h"
 #include "audio/format.h"
 #include "audio/out/ao.h"
 #include "demux/demux.h"
+#include "filters/f_autoconvert.h"
 #include "filters/f_decoder_wrapper.h"
+#include "filters/f_output_chain.h"
+#include "misc/thread_tools.h"
 
 #include "core.h"
 #include "command.h"
@@ -232,6 +236,8 @@ static void ao_chain_uninit(struct ao_chain *ao_c)
 void uninit_audio_chain(struct MPContext *mpctx)
 {
     if (mpctx->ao_chain) {
+        MP_VERBOSE(mpctx, "Audio output buffer copied %"PRIu64" bytes.\n",
+                   mp_audio_buffer_get_bytes_copied(mpctx->ao_chain->ao_buffer));
         ao_chain_uninit(mpctx->ao_chain);
         mpctx->ao_chain = NULL;
 
@@ -281,6 +287,16 @@ done:
     return res;
 }
 
+// With --audio-sticky-output, keep the AO across PCM format changes, and let
+// the output chain convert to the AO's format instead.
+static bool keep_sticky_format(struct MPContext *mpctx, struct mp_aframe *new)
+{
+    return mpctx->opts->audio_sticky_output && mpctx->ao &&
+           mpctx->ao_filter_fmt &&
+           af_fmt_is_pcm(mp_aframe_get_format(mpctx->ao_filter_fmt)) &&
+           af_fmt_is_pcm(mp_aframe_get_format(new));
+}
+
 static void reinit_audio_filters_and_output(struct MPContext *mpctx)
 {
     struct MPOpts *opts = mpctx->opts;
@@ -317,8 +333,18 @@ static void reinit_audio_filters_and_output(struct MPContext *mpctx)
     // Strong gapless: always keep the AO
     if ((mpctx->ao_filter_fmt && mpctx->ao && opts->gapless_audio < 0 &&
          keep_weak_gapless_format(mpctx->ao_filter_fmt, out_fmt)) ||
-        (mpctx->ao && opts->gapless_audio > 0))
+        (mpctx->ao && opts->gapless_audio > 0) ||
+        keep_sticky_format(mpctx, out_fmt))
     {
+        char tmp[192];
+        struct mp_chmap out_channels = {0};
+        mp_aframe_get_chmap(out_fmt, &out_channels);
+        MP_VERBOSE(mpctx, "Keeping AO, converting from %s\n",
+                   audio_config_to_str_buf(tmp, sizeof(tmp),
+                                           mp_aframe_get_rate(out_fmt),
+                                           mp_aframe_get_format(out_fmt),
+                                           out_channels));
+        mpctx->ao_keep_count++;
         mp_output_chain_set_ao(ao_c->filter, mpctx->ao);
         talloc_free(out_fmt);
         return;
@@ -356,10 +382,16 @@ static void reinit_audio_filters_and_output(struct MPContext *mpctx)
 
     mpctx->ao_filter_fmt = out_fmt;
 
+    int64_t open_start = mp_time_us();
     mpctx->ao = ao_init_best(mpctx->global, ao_flags, mp_wakeup_core_cb,
                              mpctx, mpctx->encode_lavc_ctx, out_rate,
                              out_format, out_channels);
     ao_c->ao = mpctx->ao;
+    mpctx->ao_open_time = (mp_time_us() - open_start) / 1e6;
+    mpctx->ao_open_time_total += mpctx->ao_open_time;
+    mpctx->ao_open_count++;
+    MP_VERBOSE(mpctx, "Opening AO took %.1f ms (%d opens so far).\n",
+               mpctx->ao_open_time * 1e3, mpctx->ao_open_count);
 
     int ao_rate = 0;
     int ao_format = 0;
@@ -1010,3 +1042,211 @@ void clear_audio_output_buffers(struct MPContext *mpctx)
     if (mpctx->ao)
         ao_reset(mpctx->ao);
 }
+
+static int64_t overlay_bytes(struct mp_aframe *f)
+{
+    return (int64_t)mp_aframe_get_size(f) * mp_aframe_get_sstride(f) *
+           mp_aframe_get_planes(f);
+}
+
+// Decode the first audio stream of url completely, converted to the format of
+// fmt. Fails if the decoded audio is larger than max_bytes (this also stops
+// endless streams). Returns NULL on failure. Doesn't access the player state,
+// so it can be called with the core unlocked.
+static struct mp_aframe *decode_overlay(struct mpv_global *global,
+                                        struct mp_log *log, const char *url,
+                                        struct mp_aframe *fmt,
+                                        int64_t max_bytes,
+                                        struct mp_cancel *cancel)
+{
+    struct mp_aframe *res = NULL;
+    struct mp_aframe **frames = NULL;
+    int num_frames = 0;
+    int64_t samples = 0;
+    int64_t bytes = 0;
+
+    struct demuxer_params params = {0};
+    struct demuxer *demuxer = demux_open_url(url, &params, cancel, global);
+    if (!demuxer) {
+        mp_err(log, "Could not open overlay %s.\n", url);
+        return NULL;
+    }
+
+    struct mp_filter *root = mp_filter_create_root(global);
+
+    struct sh_stream *sh = NULL;
+    for (int n = 0; n < demux_get_num_stream(demuxer); n++) {
+        struct sh_stream *s = demux_get_stream(demuxer, n);
+        if (s->type == STREAM_AUDIO) {
+            sh = s;
+            break;
+        }
+    }
+    if (!sh) {
+        mp_err(log, "No audio stream in overlay %s.\n", url);
+        goto done;
+    }
+    demuxer_select_track(demuxer, sh, MP_NOPTS_VALUE, true);
+
+    struct mp_decoder_wrapper *dec = mp_decoder_wrapper_create(root, sh);
+    if (!dec || !mp_decoder_wrapper_reinit(dec))
+        goto done;
+
+    struct mp_autoconvert *conv = mp_autoconvert_create(root);
+    if (!conv)
+        goto done;
+    struct mp_chmap chmap = {0};
+    mp_aframe_get_chmap(fmt, &chmap);
+    mp_autoconvert_add_afmt(conv, mp_aframe_get_format(fmt));
+    mp_autoconvert_add_srate(conv, mp_aframe_get_rate(fmt));
+    mp_autoconvert_add_chmap(conv, &chmap);
+    mp_pin_connect(conv->f->pins[0], dec->f->pins[0]);
+
+    // The demuxer is not threaded, so the graph never waits for anything
+    // external, and stops making progress only on errors.
+    struct mp_pin *out = conv->f->pins[1];
+    while (!mp_cancel_test(cancel)) {
+        struct mp_frame frame = mp_pin_out_read(out);
+        if (frame.type == MP_FRAME_EOF)
+            break;
+        if (frame.type == MP_FRAME_AUDIO) {
+            struct mp_aframe *aframe = frame.data;
+            samples += mp_aframe_get_size(aframe);
+            bytes += overlay_bytes(aframe);
+            MP_TARRAY_APPEND(NULL, frames, num_frames, aframe);
+            // The concatenated copy doubles the peak memory use, so check
+            // before decoding more.
+            if (bytes > max_bytes || samples > INT_MAX) {
+                mp_err(log, "Overlay %s is larger than "
+                       "--audio-overlay-cache-size.\n", url);
+                goto done;
+            }
+            continue;
+        }
+        mp_frame_unref(&frame);
+        mp_filter_run(root);
+        struct mp_filter_run_stats stats;
+        mp_filter_get_run_stats(root, &stats);
+        if (!stats.last_run_calls || mp_filter_has_failed(dec->f))
+            goto done;
+    }
+    if (!num_frames || mp_cancel_test(cancel))
+        goto done;
+
+    // Concatenate everything, so mixing is a simple copy loop.
+    res = mp_aframe_create();
+    mp_aframe_config_copy(res, frames[0]);
+    struct mp_aframe_pool *pool = mp_aframe_pool_create(NULL);
+    if (mp_aframe_pool_allocate(pool, res, samples) < 0) {
+        TA_FREEP(&res);
+    } else {
+        int pos = 0;
+        for (int n = 0; n < num_frames; n++) {
+            int size = mp_aframe_get_size(frames[n]);
+            if (!mp_aframe_copy_samples(res, pos, frames[n], 0, size)) {
+                TA_FREEP(&res);
+                break;
+            }
+            pos += size;
+        }
+    }
+    talloc_free(pool);
+
+done:
+    for (int n = 0; n < num_frames; n++)
+        talloc_free(frames[n]);
+    talloc_free(frames);
+    talloc_free(root);
+    demux_free(demuxer);
+    return res;
+}
+
+static struct mp_aframe *get_cached_overlay(struct MPContext *mpctx,
+                                            const char *url,
+                                            struct mp_aframe *fmt)
+{
+    for (int n = 0; n < mpctx->num_overlay_cache; n++) {
+        struct overlay_clip c = mpctx->overlay_cache[n];
+        if (strcmp(c.url, url) == 0 && mp_aframe_config_equals(c.data, fmt)) {
+            // Move to the end (most recently used).
+            MP_TARRAY_REMOVE_AT(mpctx->overlay_cache, mpctx->num_overlay_cache, n);
+            MP_TARRAY_APPEND(mpctx, mpctx->overlay_cache,
+                             mpctx->num_overlay_cache, c);
+            return c.data;
+        }
+    }
+    return NULL;
+}
+
+static void add_cached_overlay(struct MPContext *mpctx, const char *url,
+                               struct mp_aframe *data)
+{
+    struct overlay_clip c = {
+        .url = talloc_strdup(mpctx, url),
+        .data = talloc_steal(mpctx, data),
+    };
+    MP_TARRAY_APPEND(mpctx, mpctx->overlay_cache, mpctx->num_overlay_cache, c);
+
+    int64_t total = 0;
+    for (int n = 0; n < mpctx->num_overlay_cache; n++)
+        total += overlay_bytes(mpctx->overlay_cache[n].data);
+    // Evict the least recently used clips, but never the new one. (Clips
+    // that are still playing hold their own reference.)
+    while (mpctx->num_overlay_cache > 1 &&
+           total > mpctx->opts->audio_overlay_cache_size)
+    {
+        struct overlay_clip *old = &mpctx->overlay_cache[0];
+        total -= overlay_bytes(old->data);
+        talloc_free(old->url);
+        talloc_free(old->data);
+        MP_TARRAY_REMOVE_AT(mpctx->overlay_cache, mpctx->num_overlay_cache, 0);
+    }
+}
+
+// Decode url (or use the cached decoded clip), and mix it into the current
+// audio output. gain scales the clip, duck the main audio while it plays.
+bool mp_play_audio_overlay(struct MPContext *mpctx, const char *url,
+                           float gain, float duck, struct mp_cancel *cancel)
+{
+    if (!mpctx->ao_chain || !mpctx->ao) {
+        MP_ERR(mpctx, "Audio overlays require active audio output.\n");
+        return false;
+    }
+
+    int rate, format;
+    struct mp_chmap channels;
+    ao_get_format(mpctx->ao, &rate, &format, &channels);
+    if (!af_fmt_is_pcm(format)) {
+        MP_ERR(mpctx, "Audio overlays are not supported with passthrough.\n");
+        return false;
+    }
+
+    struct mp_aframe *fmt = mp_aframe_create();
+    mp_aframe_set_format(fmt, format);
+    mp_aframe_set_rate(fmt, rate);
+    mp_aframe_set_chmap(fmt, &channels);
+
+    struct mp_aframe *clip = get_cached_overlay(mpctx, url, fmt);
+    if (!clip) {
+        int64_t max_bytes = mpctx->opts->audio_overlay_cache_size;
+        mp_core_unlock(mpctx);
+        clip = decode_overlay(mpctx->global, mpctx->log, url, fmt, max_bytes,
+                              cancel);
+        mp_core_lock(mpctx);
+        if (clip)
+            add_cached_overlay(mpctx, url, clip);
+    }
+    talloc_free(fmt);
+    if (!clip)
+        return false;
+
+    // The AO could have been reconfigured while decoding.
+    struct ao_chain *ao_c = mpctx->ao_chain;
+    if (!ao_c || !mp_output_chain_add_overlay(ao_c->filter, clip, gain, duck)) {
+        MP_ERR(mpctx, "Audio output changed while loading overlay.\n");
+        return false;
+    }
+    MP_VERBOSE(mpctx, "Playing overlay %s (%.3f s).\n", url,
+               mp_aframe_duration(clip));
+    return true;
+}
@@ -21,6 +21,10 @@
 #include <errno.h>
 #include <math.h>
 #include <assert.h>
+#include <limits.h>
+
+#include <libavutil/buffer.h>
+
 
 #include "common/common.h"
 #include "common/global.h"
@@ -60,6 +64,12 @@
  *
  */
 
+// See mpv_add_memory_source().
+struct mp_memory_source {
+    char *name;
+    AVBufferRef *buf;
+};
+
 struct mp_client_api {
     struct MPContext *mpctx;
 
@@ -77,6 +87,9 @@ struct mp_client_api {
     struct mp_custom_protocol *custom_protocols;
     int num_custom_protocols;
 
+    struct mp_memory_source *memory_sources;
+    int num_memory_sources;
+
     struct mpv_render_context *render_context;
     struct mpv_opengl_cb_context *gl_cb_ctx;
 };
@@ -94,6 +107,11 @@ struct observe_property {
     bool new_value_valid, user_value_valid;
     union m_option_value new_value, user_value;
     struct mpv_handle *client;
+    // Delivery limits (see mpv_observe_property_limits()).
+    int64_t min_interval;   // minimum time between updates (us), or 0
+    double min_delta;       // minimum change of numeric values, or 0
+    bool latest_only;       // don't schedule delayed updates
+    int64_t last_update;    // mp_time_us() of last value retrieval/event
 };
 
 struct mpv_handle {
@@ -136,6 +154,7 @@ struct mpv_handle {
     int lowest_changed;     // attempt at making change processing incremental
     int properties_updating;
     uint64_t property_event_masks; // or-ed together event masks of all properties
+    int64_t property_deadline; // mp_time_us() of next rate-limited update, or 0
 
     bool fuzzy_initialized; // see scripting.c wait_loaded()
     bool is_weak;           // can not keep core alive on its own
@@ -171,6 +190,10 @@ void mp_clients_destroy(struct MPContext *mpctx)
         abort();
     }
 
+    // Streams using them are closed at this point; free_fn is called now.
+    for (int n = 0; n < mpctx->clients->num_memory_sources; n++)
+        av_buffer_unref(&mpctx->clients->memory_sources[n].buf);
+
     pthread_mutex_destroy(&mpctx->clients->lock);
     talloc_free(mpctx->clients);
     mpctx->clients = NULL;
@@ -184,9 +207,9 @@ bool mp_clients_all_initialized(struct MPContext *mpctx)
     pthread_mutex_lock(&mpctx->clients->lock);
     for (int n = 0; n < mpctx->clients->num_clients; n++) {
         struct mpv_handle *ctx = mpctx->clients->clients[n];
-        pthread_mutex_lock(&ctx->lock);
+        mp_mutex_lock(&ctx->lock);
         all_ok &= ctx->fuzzy_initialized;
-        pthread_mutex_unlock(&ctx->lock);
+        mp_mutex_unlock(&ctx->lock);
     }
     pthread_mutex_unlock(&mpctx->clients->lock);
     return all_ok;
@@ -243,6 +266,7 @@ struct mpv_handle *mp_new_client(struct mp_client_api *clients, const char *name
     int num_events = 1000;
 
     struct mpv_handle *client = talloc_ptrtype(NULL, client);
+    ta_set_account(client, ta_account_get("clients", NULL));
     *client = (struct mpv_handle){
         .log = mp_log_new(client, clients->mpctx->log, nname),
         .mpctx = clients->mpctx,
@@ -254,6 +278,7 @@ struct mpv_handle *mp_new_client(struct mp_client_api *clients, const char *name
         .wakeup_pipe = {-1, -1},
     };
     pthread_mutex_init(&client->lock, NULL);
+    mp_mutex_set_name(&client->lock, "client");
     pthread_mutex_init(&client->wakeup_lock, NULL);
     pthread_cond_init(&client->wakeup, NULL);
 
@@ -274,9 +299,9 @@ struct mpv_handle *mp_new_client(struct mp_client_api *clients, const char *name
 
 void mp_client_set_weak(struct mpv_handle *ctx)
 {
-    pthread_mutex_lock(&ctx->lock);
+    mp_mutex_lock(&ctx->lock);
     ctx->is_weak = true;
-    pthread_mutex_unlock(&ctx->lock);
+    mp_mutex_unlock(&ctx->lock);
 }
 
 const char *mpv_client_name(mpv_handle *ctx)
@@ -322,7 +347,7 @@ static void wakeup_client(struct mpv_handle *ctx)
 static int wait_wakeup(struct mpv_handle *ctx, int64_t end)
 {
     int r = 0;
-    pthread_mutex_unlock(&ctx->lock);
+    mp_mutex_unlock(&ctx->lock);
     pthread_mutex_lock(&ctx->wakeup_lock);
     if (!ctx->need_wakeup) {
         struct timespec ts = mp_time_us_to_timespec(end);
@@ -331,7 +356,7 @@ static int wait_wakeup(struct mpv_handle *ctx, int64_t end)
     if (r == 0)
         ctx->need_wakeup = false;
     pthread_mutex_unlock(&ctx->wakeup_lock);
-    pthread_mutex_lock(&ctx->lock);
+    mp_mutex_lock(&ctx->lock);
     return r;
 }
 
@@ -366,10 +391,10 @@ static void unlock_core(mpv_handle *ctx)
 
 void mpv_wait_async_requests(mpv_handle *ctx)
 {
-    pthread_mutex_lock(&ctx->lock);
+    mp_mutex_lock(&ctx->lock);
     while (ctx->reserved_events || ctx->properties_updating)
         wait_wakeup(ctx, INT64_MAX);
-    pthread_mutex_unlock(&ctx->lock);
+    mp_mutex_unlock(&ctx->lock);
 }
 
 // Send abort signal to all matching work items.
@@ -438,7 +463,7 @@ static void mp_destroy_client(mpv_handle *ctx, bool terminate)
             mp_msg_log_buffer_destroy(ctx->messages);
             pthread_cond_destroy(&ctx->wakeup);
             pthread_mutex_destroy(&ctx->wakeup_lock);
-            pthread_mutex_destroy(&ctx->lock);
+            mp_mutex_destroy(&ctx->lock);
             if (ctx->wakeup_pipe[0] != -1) {
                 close(ctx->wakeup_pipe[0]);
                 close(ctx->wakeup_pipe[1]);
@@ -665,13 +690,13 @@ static void dup_event_data(struct mpv_event *ev)
 static int reserve_reply(struct mpv_handle *ctx)
 {
     int res = MPV_ERROR_EVENT_QUEUE_FULL;
-    pthread_mutex_lock(&ctx->lock);
+    mp_mutex_lock(&ctx->lock);
     if (ctx->reserved_events + ctx->num_events < ctx->max_events && !ctx->choked)
     {
         ctx->reserved_events++;
         res = 0;
     }
-    pthread_mutex_unlock(&ctx->lock);
+    mp_mutex_unlock(&ctx->lock);
     return res;
 }
 
@@ -691,7 +716,7 @@ static int append_event(struct mpv_handle *ctx, struct mpv_event event, bool cop
 
 static int send_event(struct mpv_handle *ctx, struct mpv_event *event, bool copy)
 {
-    pthread_mutex_lock(&ctx->lock);
+    mp_mutex_lock(&ctx->lock);
     uint64_t mask = 1ULL << event->event_id;
     if (ctx->property_event_masks & mask)
         notify_property_events(ctx, mask);
@@ -707,7 +732,7 @@ static int send_event(struct mpv_handle *ctx, struct mpv_event *event, bool copy
             ctx->choked = true;
         }
     }
-    pthread_mutex_unlock(&ctx->lock);
+    mp_mutex_unlock(&ctx->lock);
     return r;
 }
 
@@ -717,13 +742,13 @@ static void send_reply(struct mpv_handle *ctx, uint64_t userdata,
                        struct mpv_event *event)
 {
     event->reply_userdata = userdata;
-    pthread_mutex_lock(&ctx->lock);
+    mp_mutex_lock(&ctx->lock);
     // If this fails, reserve_reply() probably wasn't called.
     assert(ctx->reserved_events > 0);
     ctx->reserved_events--;
     if (append_event(ctx, *event, false) < 0)
         abort(); // not reached
-    pthread_mutex_unlock(&ctx->lock);
+    mp_mutex_unlock(&ctx->lock);
 }
 
 // Return whether there's any client listening to this event.
@@ -737,9 +762,9 @@ bool mp_client_event_is_registered(struct MPContext *mpctx, int event)
     if (!clients->event_masks) { // lazy update
         for (int n = 0; n < clients->num_clients; n++) {
             struct mpv_handle *ctx = clients->clients[n];
-            pthread_mutex_lock(&ctx->lock);
+            mp_mutex_lock(&ctx->lock);
             clients->event_masks |= ctx->event_mask | ctx->property_event_masks;
-            pthread_mutex_unlock(&ctx->lock);
+            mp_mutex_unlock(&ctx->lock);
         }
     }
     bool r = clients->event_masks & (1ULL << event);
@@ -824,10 +849,10 @@ int mpv_request_event(mpv_handle *ctx, mpv_event_id event, int enable)
     if (event == MPV_EVENT_SHUTDOWN && !enable)
         return MPV_ERROR_INVALID_PARAMETER;
     assert(event < (int)INTERNAL_EVENT_BASE); // excluded above; they have no name
-    pthread_mutex_lock(&ctx->lock);
+    mp_mutex_lock(&ctx->lock);
     uint64_t bit = 1ULL << event;
     ctx->event_mask = enable ? ctx->event_mask | bit : ctx->event_mask & ~bit;
-    pthread_mutex_unlock(&ctx->lock);
+    mp_mutex_unlock(&ctx->lock);
     invalidate_global_event_mask(ctx);
     return 0;
 }
@@ -836,7 +861,7 @@ mpv_event *mpv_wait_event(mpv_handle *ctx, double timeout)
 {
     mpv_event *event = ctx->cur_event;
 
-    pthread_mutex_lock(&ctx->lock);
+    mp_mutex_lock(&ctx->lock);
 
     if (!ctx->fuzzy_initialized)
         mp_wakeup_core(ctx->clients->mpctx);
@@ -877,23 +902,27 @@ mpv_event *mpv_wait_event(mpv_handle *ctx, double timeout)
         // Pop item from message queue, and return as event.
         if (gen_log_message_event(ctx))
             break;
-        int r = wait_wakeup(ctx, deadline);
-        if (r == ETIMEDOUT)
+        // Also wake up for rate-limited property updates.
+        int64_t end = deadline;
+        if (ctx->property_deadline)
+            end = MPMIN(end, ctx->property_deadline);
+        int r = wait_wakeup(ctx, end);
+        if (r == ETIMEDOUT && end == deadline)
             break;
     }
     ctx->queued_wakeup = false;
 
-    pthread_mutex_unlock(&ctx->lock);
+    mp_mutex_unlock(&ctx->lock);
 
     return event;
 }
 
 void mpv_wakeup(mpv_handle *ctx)
 {
-    pthread_mutex_lock(&ctx->lock);
+    mp_mutex_lock(&ctx->lock);
     ctx->queued_wakeup = true;
     wakeup_client(ctx);
-    pthread_mutex_unlock(&ctx->lock);
+    mp_mutex_unlock(&ctx->lock);
 }
 
 // map client API types to internal types
@@ -1074,13 +1103,17 @@ static int run_client_command(mpv_handle *ctx, struct mp_cmd *cmd, mpv_node *res
 
 int mpv_command(mpv_handle *ctx, const char **args)
 {
-    return run_client_command(ctx, mp_input_parse_cmd_strv(ctx->log, args), NULL);
+    struct mp_cmd_cache *cache = mp_input_get_cmd_cache(ctx->mpctx->input);
+    return run_client_command(ctx, mp_cmd_cache_parse_strv(cache, ctx->log, args),
+                              NULL);
 }
 
 int mpv_command_node(mpv_handle *ctx, mpv_node *args, mpv_node *result)
 {
     struct mpv_node rn = {.format = MPV_FORMAT_NONE};
-    int r = run_client_command(ctx, mp_input_parse_cmd_node(ctx->log, args), &rn);
+    struct mp_cmd_cache *cache = mp_input_get_cmd_cache(ctx->mpctx->input);
+    int r = run_client_command(ctx, mp_cmd_cache_parse_node(cache, ctx->log, args),
+                               &rn);
     if (result && r >= 0)
         *result = rn;
     return r;
@@ -1161,12 +1194,14 @@ static int run_async_cmd(mpv_handle *ctx, uint64_t ud, struct mp_cmd *cmd)
 
 int mpv_command_async(mpv_handle *ctx, uint64_t ud, const char **args)
 {
-    return run_async_cmd(ctx, ud, mp_input_parse_cmd_strv(ctx->log, args));
+    struct mp_cmd_cache *cache = mp_input_get_cmd_cache(ctx->mpctx->input);
+    return run_async_cmd(ctx, ud, mp_cmd_cache_parse_strv(cache, ctx->log, args));
 }
 
 int mpv_command_node_async(mpv_handle *ctx, uint64_t ud, mpv_node *args)
 {
-    return run_async_cmd(ctx, ud, mp_input_parse_cmd_node(ctx->log, args));
+    struct mp_cmd_cache *cache = mp_input_get_cmd_cache(ctx->mpctx->input);
+    return run_async_cmd(ctx, ud, mp_cmd_cache_parse_node(cache, ctx->log, args));
 }
 
 void mpv_abort_async_command(mpv_handle *ctx, uint64_t reply_userdata)
@@ -1436,6 +1471,184 @@ int mpv_get_property_async(mpv_handle *ctx, uint64_t ud, const char *name,
     return run_async(ctx, getproperty_fn, req);
 }
 
+struct getproperties_request {
+    struct MPContext *mpctx;
+    char **names;
+    struct mpv_node *res;
+    struct mpv_handle *reply_ctx;
+    uint64_t userdata;
+};
+
+static void getproperties_fn(void *arg)
+{
+    struct getproperties_request *req = arg;
+
+    struct mpv_node res;
+    node_init(&res, MPV_FORMAT_NODE_MAP, NULL);
+    for (int n = 0; req->names[n]; n++) {
+        const char *name = req->names[n];
+        if (node_map_get(&res, name))
+            continue;
+        struct mpv_node node;
+        struct getproperty_request preq = {
+            .mpctx = req->mpctx,
+            .name = name,
+            .format = MPV_FORMAT_NODE,
+            .data = &node,
+        };
+        getproperty_fn(&preq);
+        if (preq.status < 0)
+            continue;
+        struct mpv_node *dst = node_map_add(&res, name, MPV_FORMAT_NONE);
+        *dst = node;
+        talloc_steal(res.u.list, node_get_alloc(dst));
+    }
+
+    if (req->reply_ctx) {
+        struct mpv_event_property *prop = talloc_ptrtype(NULL, prop);
+        *prop = (struct mpv_event_property){
+            .name = "",
+            .format = MPV_FORMAT_NODE,
+            .data = talloc_zero(prop, struct mpv_node),
+        };
+        *(struct mpv_node *)prop->data = res;
+        talloc_set_destructor(prop, free_prop_data);
+        struct mpv_event reply = {
+            .event_id = MPV_EVENT_GET_PROPERTY_REPLY,
+            .data = prop,
+        };
+        send_reply(req->reply_ctx, req->userdata, &reply);
+        talloc_free(req);
+    } else {
+        *req->res = res;
+    }
+}
+
+int mpv_get_properties(mpv_handle *ctx, const char **names, mpv_node *result)
+{
+    if (!ctx->mpctx->initialized)
+        return MPV_ERROR_UNINITIALIZED;
+    if (!names || !result)
+        return MPV_ERROR_INVALID_PARAMETER;
+
+    struct getproperties_request req = {
+        .mpctx = ctx->mpctx,
+        .names = (char **)names,
+        .res = result,
+    };
+    run_locked(ctx, getproperties_fn, &req);
+    return 0;
+}
+
+int mpv_get_properties_async(mpv_handle *ctx, uint64_t ud, const char **names)
+{
+    if (!ctx->mpctx->initialized)
+        return MPV_ERROR_UNINITIALIZED;
+    if (!names)
+        return MPV_ERROR_INVALID_PARAMETER;
+
+    struct getproperties_request *req = talloc_ptrtype(NULL, req);
+    *req = (struct getproperties_request){
+        .mpctx = ctx->mpctx,
+        .reply_ctx = ctx,
+        .userdata = ud,
+    };
+    int num_names = 0;
+    for (int n = 0; names[n]; n++)
+        MP_TARRAY_APPEND(req, req->names, num_names, talloc_strdup(req, names[n]));
+    MP_TARRAY_APPEND(req, req->names, num_names, NULL);
+    return run_async(ctx, getproperties_fn, req);
+}
+
+struct setproperties_request {
+    struct MPContext *mpctx;
+    struct mpv_node *values;
+    int status;
+    struct mpv_handle *reply_ctx;
+    uint64_t userdata;
+};
+
+static void setproperties_fn(void *arg)
+{
+    struct setproperties_request *req = arg;
+    struct mpv_node_list *list = req->values->u.list;
+
+    req->status = 0;
+    for (int n = 0; list && n < list->num; n++) {
+        struct setproperty_request preq = {
+            .mpctx = req->mpctx,
+            .name = list->keys[n],
+            .format = MPV_FORMAT_NODE,
+            .data = &list->values[n],
+        };
+        setproperty_fn(&preq);
+        if (preq.status < 0 && req->status >= 0)
+            req->status = preq.status;
+    }
+
+    if (req->reply_ctx) {
+        struct mpv_event reply = {
+            .event_id = MPV_EVENT_SET_PROPERTY_REPLY,
+            .error = req->status,
+        };
+        send_reply(req->reply_ctx, req->userdata, &reply);
+        talloc_free(req);
+    }
+}
+
+int mpv_set_properties(mpv_handle *ctx, mpv_node *values)
+{
+    if (!values || values->format != MPV_FORMAT_NODE_MAP)
+        return MPV_ERROR_INVALID_PARAMETER;
+
+    if (!ctx->mpctx->initialized) {
+        struct mpv_node_list *list = values->u.list;
+        int status = 0;
+        for (int n = 0; list && n < list->num; n++) {
+            int r = mpv_set_property(ctx, list->keys[n], MPV_FORMAT_NODE,
+                                     &list->values[n]);
+            if (r < 0 && status >= 0)
+                status = r;
+        }
+        return status;
+    }
+
+    struct setproperties_request req = {
+        .mpctx = ctx->mpctx,
+        .values = values,
+    };
+    run_locked(ctx, setproperties_fn, &req);
+    return req.status;
+}
+
+static void free_props_set_req(void *ptr)
+{
+    struct setproperties_request *req = ptr;
+    mpv_free_node_contents(req->values);
+}
+
+int mpv_set_properties_async(mpv_handle *ctx, uint64_t ud, mpv_node *values)
+{
+    if (!ctx->mpctx->initialized)
+        return MPV_ERROR_UNINITIALIZED;
+    if (!values || values->format != MPV_FORMAT_NODE_MAP)
+        return MPV_ERROR_INVALID_PARAMETER;
+
+    struct setproperties_request *req = talloc_ptrtype(NULL, req);
+    *req = (struct setproperties_request){
+        .mpctx = ctx->mpctx,
+        .values = talloc_zero(req, struct mpv_node),
+        .reply_ctx = ctx,
+        .userdata = ud,
+    };
+
+    static const struct m_option type = { .type = CONF_TYPE_NODE };
+    m_option_copy(&type, req->values, values);
+    talloc_set_destructor(req, free_props_set_req);
+
+    return run_async(ctx, setproperties_fn, req);
+}
+
 static void property_free(void *p)
 {
     struct observe_property *prop = p;
@@ -1455,7 +1668,7 @@ int mpv_observe_property(mpv_handle *ctx, uint64_t userdata,
     if (format == MPV_FORMAT_OSD_STRING)
         return MPV_ERROR_PROPERTY_FORMAT;
 
-    pthread_mutex_lock(&ctx->lock);
+    mp_mutex_lock(&ctx->lock);
     struct observe_property *prop = talloc_ptrtype(ctx, prop);
     talloc_set_destructor(prop, property_free);
     *prop = (struct observe_property){
@@ -1471,14 +1684,14 @@ int mpv_observe_property(mpv_handle *ctx, uint64_t userdata,
     MP_TARRAY_APPEND(ctx, ctx->properties, ctx->num_properties, prop);
     ctx->property_event_masks |= prop->event_mask;
     ctx->lowest_changed = 0;
-    pthread_mutex_unlock(&ctx->lock);
+    mp_mutex_unlock(&ctx->lock);
     invalidate_global_event_mask(ctx);
     return 0;
 }
 
 int mpv_unobserve_property(mpv_handle *ctx, uint64_t userdata)
 {
-    pthread_mutex_lock(&ctx->lock);
+    mp_mutex_lock(&ctx->lock);
     ctx->property_event_masks = 0;
     int count = 0;
     for (int n = ctx->num_properties - 1; n >= 0; n--) {
@@ -1500,11 +1713,90 @@ int mpv_unobserve_property(mpv_handle *ctx, uint64_t userdata)
             ctx->property_event_masks |= prop->event_mask;
     }
     ctx->lowest_changed = 0;
-    pthread_mutex_unlock(&ctx->lock);
+    mp_mutex_unlock(&ctx->lock);
     invalidate_global_event_mask(ctx);
     return count;
 }
 
+int mpv_observe_property_limits(mpv_handle *ctx, uint64_t userdata,
+                                double max_rate, double min_delta,
+                                int latest_only)
+{
+    if (!(max_rate >= 0) || !(min_delta >= 0))
+        return MPV_ERROR_INVALID_PARAMETER;
+
+    mp_mutex_lock(&ctx->lock);
+    int count = 0;
+    for (int n = 0; n < ctx->num_properties; n++) {
+        struct observe_property *prop = ctx->properties[n];
+        if (prop->reply_id == userdata) {
+            prop->min_interval = max_rate > 0 ? 1e6 / max_rate : 0;
+            prop->min_delta = min_delta;
+            prop->latest_only = latest_only;
+            count++;
+        }
+    }
+    ctx->lowest_changed = 0;
+    mp_mutex_unlock(&ctx->lock);
+    return count;
+}
+
+// Return the numeric value of a property value, or NAN if it has none.
+static double prop_value_number(mpv_format format, void *data)
+{
+    if (format == MPV_FORMAT_NODE) {
+        struct mpv_node *node = data;
+        format = node->format;
+        data = &node->u;
+    }
+    switch (format) {
+    case MPV_FORMAT_INT64:  return *(int64_t *)data;
+    case MPV_FORMAT_DOUBLE: return *(double *)data;
+    default:                return NAN;
+    }
+}
+
+// Whether the new value differs enough from what the user has seen.
+static bool prop_value_changed(struct observe_property *prop)
+{
+    if (prop->user_value_valid != prop->new_value_valid)
+        return true;
+    if (!prop->new_value_valid)
+        return false;
+    if (equal_mpv_value(&prop->user_value, &prop->new_value, prop->format))
+        return false;
+    if (prop->min_delta > 0) {
+        double a = prop_value_number(prop->format, &prop->user_value);
+        double b = prop_value_number(prop->format, &prop->new_value);
+        if (isfinite(a) && isfinite(b) && fabs(a - b) < prop->min_delta)
+            return false;
+    }
+    return true;
+}
+
+// Wake up clients whose rate-limited property updates are due, and make sure
+// the playloop runs again for the next one. Called on the core thread.
+void mp_client_update_deferred_properties(struct MPContext *mpctx)
+{
+    struct mp_client_api *clients = mpctx->clients;
+    int64_t now = mp_time_us();
+
+    pthread_mutex_lock(&clients->lock);
+    for (int n = 0; n < clients->num_clients; n++) {
+        struct mpv_handle *client = clients->clients[n];
+        mp_mutex_lock(&client->lock);
+        int64_t deadline = client->property_deadline;
+        if (deadline && deadline <= now) {
+            client->property_deadline = 0;
+            wakeup_client(client);
+        } else if (deadline) {
+            mp_set_timeout(mpctx, (deadline - now) / 1e6);
+        }
+        mp_mutex_unlock(&client->lock);
+    }
+    pthread_mutex_unlock(&clients->lock);
+}
+
 static void mark_property_changed(struct mpv_handle *client, int index)
 {
     struct observe_property *prop = client->properties[index];
@@ -1523,14 +1815,14 @@ void mp_client_property_change(struct MPContext *mpctx, const char *name)
 
     for (int n = 0; n < clients->num_clients; n++) {
         struct mpv_handle *client = clients->clients[n];
-        pthread_mutex_lock(&client->lock);
+        mp_mutex_lock(&client->lock);
         for (int i = 0; i < client->num_properties; i++) {
             if (client->properties[i]->id == id)
                 mark_property_changed(client, i);
         }
         if (client->lowest_changed < client->num_properties)
             wakeup_client(client);
-        pthread_mutex_unlock(&client->lock);
+        mp_mutex_unlock(&client->lock);
     }
 
     pthread_mutex_unlock(&clients->lock);
@@ -1565,23 +1857,19 @@ static void update_prop(void *p)
 
     getproperty_fn(&req);
 
-    pthread_mutex_lock(&ctx->lock);
+    mp_mutex_lock(&ctx->lock);
     ctx->properties_updating--;
     prop->updating = false;
     m_option_free(type, &prop->new_value);
     prop->new_value_valid = req.status >= 0;
     if (prop->new_value_valid)
         memcpy(&prop->new_value, &val, type->type->size);
-    if (prop->user_value_valid != prop->new_value_valid) {
+    if (prop_value_changed(prop))
         prop->changed = true;
-    } else if (prop->user_value_valid && prop->new_value_valid) {
-        if (!equal_mpv_value(&prop->user_value, &prop->new_value, prop->format))
-            prop->changed = true;
-    }
     if (prop->dead)
         talloc_steal(ctx->cur_event, prop);
     wakeup_client(ctx);
-    pthread_mutex_unlock(&ctx->lock);
+    mp_mutex_unlock(&ctx->lock);
 }
 
 // Set ctx->cur_event to a generated property change event, if there is any
@@ -1592,10 +1880,31 @@ static bool gen_property_change_event(struct mpv_handle *ctx)
         return false;
     int start = ctx->lowest_changed;
     ctx->lowest_changed = ctx->num_properties;
+    int64_t now = 0;
+    ctx->property_deadline = 0;
     for (int n = start; n < ctx->num_properties; n++) {
         struct observe_property *prop = ctx->properties[n];
         if ((prop->changed || prop->updating) && n < ctx->lowest_changed)
             ctx->lowest_changed = n;
+        // Rate limit retrieving new values (or sending events if there is no
+        // value). Leave it marked as changed, so the latest value is
+        // retrieved once the interval has passed.
+        bool limit = prop->need_new_value || !prop->format;
+        if (prop->changed && prop->min_interval && limit && !prop->updating) {
+            now = now ? now : mp_time_us();
+            int64_t next = prop->last_update + prop->min_interval;
+            if (prop->last_update && now < next) {
+                if (!prop->latest_only) {
+                    int64_t prev = ctx->property_deadline;
+                    if (!prev || next < prev) {
+                        ctx->property_deadline = next;
+                        mp_wakeup_core(ctx->mpctx);
+                    }
+                }
+                continue;
+            }
+            prop->last_update = now;
+        }
         if (prop->changed) {
             bool get_value = prop->need_new_value;
             prop->need_new_value = false;
@@ -1678,7 +1987,7 @@ int mpv_request_log_messages(mpv_handle *ctx, const char *min_level)
     if (level < 0 && strcmp(min_level, "no") != 0)
         return MPV_ERROR_INVALID_PARAMETER;
 
-    pthread_mutex_lock(&ctx->lock);
+    mp_mutex_lock(&ctx->lock);
     mp_msg_log_buffer_destroy(ctx->messages);
     ctx->messages = NULL;
     if (level >= 0) {
@@ -1686,7 +1995,7 @@ int mpv_request_log_messages(mpv_handle *ctx, const char *min_level)
         ctx->messages = mp_msg_log_buffer_new(ctx->mpctx->global, size, level,
                                               msg_wakeup, ctx);
     }
-    pthread_mutex_unlock(&ctx->lock);
+    mp_mutex_unlock(&ctx->lock);
     return 0;
 }
 
@@ -1853,6 +2162,104 @@ int mpv_stream_cb_add_ro(mpv_handle *ctx, const char *protocol, void *user_data,
     return r;
 }
 
+// memory sources
+
+struct memory_source_free {
+    mpv_memory_source_free_fn free_fn;
+    void *opaque;
+};
+
+static void free_memory_source(void *opaque, uint8_t *data)
+{
+    struct memory_source_free *f = opaque;
+    if (f->free_fn)
+        f->free_fn(f->opaque);
+    talloc_free(f);
+}
+
+int mpv_add_memory_source(mpv_handle *ctx, const char *name, const void *data,
+                          uint64_t size, mpv_memory_source_free_fn free_fn,
+                          void *opaque)
+{
+    if (!name || !data || size > INT_MAX)
+        return MPV_ERROR_INVALID_PARAMETER;
+
+    struct mp_client_api *clients = ctx->clients;
+    int r = 0;
+    pthread_mutex_lock(&clients->lock);
+    for (int n = 0; n < clients->num_memory_sources; n++) {
+        if (strcmp(clients->memory_sources[n].name, name) == 0) {
+            r = MPV_ERROR_INVALID_PARAMETER;
+            break;
+        }
+    }
+    if (r >= 0) {
+        struct memory_source_free *f = talloc_ptrtype(NULL, f);
+        *f = (struct memory_source_free){free_fn, opaque};
+        // The buffer is never written to.
+        AVBufferRef *buf = av_buffer_create((uint8_t *)data, size,
+                                            free_memory_source, f,
+                                            AV_BUFFER_FLAG_READONLY);
+        if (buf) {
+            struct mp_memory_source src = {
+                .name = talloc_strdup(clients, name),
+                .buf = buf,
+            };
+            MP_TARRAY_APPEND(clients, clients->memory_sources,
+                             clients->num_memory_sources, src);
+        } else {
+            talloc_free(f);
+            r = MPV_ERROR_NOMEM;
+        }
+    }
+    pthread_mutex_unlock(&clients->lock);
+    return r;
+}
+
+int mpv_remove_memory_source(mpv_handle *ctx, const char *name)
+{
+    if (!name)
+        return MPV_ERROR_INVALID_PARAMETER;
+
+    struct mp_client_api *clients = ctx->clients;
+    AVBufferRef *buf = NULL;
+    pthread_mutex_lock(&clients->lock);
+    for (int n = 0; n < clients->num_memory_sources; n++) {
+        struct mp_memory_source *src = &clients->memory_sources[n];
+        if (strcmp(src->name, name) == 0) {
+            buf = src->buf;
+            talloc_free(src->name);
+            MP_TARRAY_REMOVE_AT(clients->memory_sources,
+                                clients->num_memory_sources, n);
+            break;
+        }
+    }
+    pthread_mutex_unlock(&clients->lock);
+    if (!buf)
+        return MPV_ERROR_INVALID_PARAMETER;
+    // Might call free_fn, so do it without holding the lock.
+    av_buffer_unref(&buf);
+    return 0;
+}
+
+// Return a new reference to the source's data, or NULL if not found.
+struct AVBufferRef *mp_memory_source_lookup(struct mpv_global *g,
+                                            const char *name)
+{
+    struct mp_client_api *clients = g->client_api;
+    AVBufferRef *res = NULL;
+    pthread_mutex_lock(&clients->lock);
+    for (int n = 0; n < clients->num_memory_sources; n++) {
+        struct mp_memory_source *src = &clients->memory_sources[n];
+        if (strcmp(src->name, name) == 0) {
+            res = av_buffer_ref(src->buf);
+            break;
+        }
+    }
+    pthread_mutex_unlock(&clients->lock);
+    return res;
+}
+
 bool mp_streamcb_lookup(struct mpv_global *g, const char *protocol,
                         void **out_user_data, mpv_stream_cb_open_ro_fn *out_fn)
 {
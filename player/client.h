@@ -31,6 +31,7 @@ int mp_client_send_event_dup(struct MPContext *mpctx, const char *client_name,
                              int event, void *data);
 bool mp_client_event_is_registered(struct MPContext *mpctx, int event);
 void mp_client_property_change(struct MPContext *mpctx, const char *name);
+void mp_client_update_deferred_properties(struct MPContext *mpctx);
 
 struct mpv_handle *mp_new_client(struct mp_client_api *clients, const char *name);
 void mp_client_set_weak(struct mpv_handle *ctx);
@@ -55,4 +56,8 @@ void kill_video_async(struct mp_client_api *client_api, void (*fin)(void *ctx),
 bool mp_streamcb_lookup(struct mpv_global *g, const char *protocol,
                         void **out_user_data, mpv_stream_cb_open_ro_fn *out_fn);
 
+struct AVBufferRef;
+struct AVBufferRef *mp_memory_source_lookup(struct mpv_global *g,
+                                            const char *name);
+
 #endif
@@ -39,6 +39,7 @@
 #include "common/msg.h"
 #include "common/msg_control.h"
 #include "filters/f_decoder_wrapper.h"
+#include "filters/f_output_chain.h"
 #include "command.h"
 #include "osdep/timer.h"
 #include "common/common.h"
@@ -62,6 +63,7 @@
 
 #include "osdep/io.h"
 #include "osdep/subprocess.h"
+#include "osdep/threads.h"
 
 #include "core.h"
 
@@ -92,6 +94,11 @@ struct command_ctx {
     char *cur_ipc_input;
 
     int silence_option_deprecations;
+
+    // Last demuxer-cache-state value, valid for the given reader state
+    // generation of the current demuxer (0 if none).
+    struct mpv_node cache_state;
+    uint64_t cache_state_gen;
 };
 
 
@@ -1064,6 +1071,15 @@ static int mp_property_demuxer_cache_state(void *ctx, struct m_property *prop,
     if (demux_control(mpctx->demuxer, DEMUXER_CTRL_GET_READER_STATE, &s) < 1)
         return M_PROPERTY_UNAVAILABLE;
 
+    // Nothing changed since the last time the node was built.
+    struct command_ctx *cmd = mpctx->command_ctx;
+    if (cmd->cache_state_gen && s.generation == cmd->cache_state_gen) {
+        *(struct mpv_node *)arg = (struct mpv_node){{0}};
+        m_option_copy(&(struct m_option){.type = CONF_TYPE_NODE}, arg,
+                      &cmd->cache_state);
+        return M_PROPERTY_OK;
+    }
+
     struct mpv_node *r = (struct mpv_node *)arg;
     node_init(r, MPV_FORMAT_NODE_MAP, NULL);
 
@@ -1087,11 +1103,18 @@ static int mp_property_demuxer_cache_state(void *ctx, struct m_property *prop,
     node_map_add_flag(r, "idle", s.idle);
     node_map_add_int64(r, "total-bytes", s.total_bytes);
     node_map_add_int64(r, "fw-bytes", s.fw_bytes);
+    node_map_add_double(r, "readahead-target", s.readahead_target);
     if (s.seeking != MP_NOPTS_VALUE)
         node_map_add_double(r, "debug-seeking", s.seeking);
     node_map_add_int64(r, "debug-low-level-seeks", s.low_level_seeks);
     if (s.ts_last != MP_NOPTS_VALUE)
         node_map_add_double(r, "debug-ts-last", s.ts_last);
+    node_map_add_int64(r, "debug-packet-locks", s.packet_locks);
+    node_map_add_int64(r, "debug-packet-wakeups", s.packet_wakeups);
+
+    m_option_copy(&(struct m_option){.type = CONF_TYPE_NODE},
+                  &cmd->cache_state, r);
+    cmd->cache_state_gen = s.generation;
 
     return M_PROPERTY_OK;
 }
@@ -1356,6 +1379,26 @@ static int mp_property_ao(void *ctx, struct m_property *p, int action, void *arg
                                     mpctx->ao ? ao_get_name(mpctx->ao) : NULL);
 }
 
+static int mp_property_ao_open_stats(void *ctx, struct m_property *prop,
+                                     int action, void *arg)
+{
+    MPContext *mpctx = ctx;
+    if (action == M_PROPERTY_GET_TYPE) {
+        *(struct m_option *)arg = (struct m_option){.type = CONF_TYPE_NODE};
+        return M_PROPERTY_OK;
+    }
+    if (action != M_PROPERTY_GET)
+        return M_PROPERTY_NOT_IMPLEMENTED;
+
+    struct mpv_node *r = (struct mpv_node *)arg;
+    node_init(r, MPV_FORMAT_NODE_MAP, NULL);
+    node_map_add_int64(r, "opens", mpctx->ao_open_count);
+    node_map_add_int64(r, "kept", mpctx->ao_keep_count);
+    node_map_add_double(r, "last-open-time", mpctx->ao_open_time);
+    node_map_add_double(r, "total-open-time", mpctx->ao_open_time_total);
+    return M_PROPERTY_OK;
+}
+
 /// Audio delay (RW)
 static int mp_property_audio_delay(void *ctx, struct m_property *prop,
                                    int action, void *arg)
@@ -1746,6 +1789,102 @@ static int mp_property_ffmpeg(void *ctx, struct m_property *prop,
     return m_property_strdup_ro(action, arg, av_version_info());
 }
 
+static int mp_property_lock_stats(void *ctx, struct m_property *prop,
+                                  int action, void *arg)
+{
+    struct mp_lock_stats stats[64];
+    int num = mp_lock_stats_get(stats, MP_ARRAY_SIZE(stats));
+    if (!num)
+        return M_PROPERTY_UNAVAILABLE;
+
+    if (action == M_PROPERTY_GET_TYPE) {
+        *(struct m_option *)arg = (struct m_option){.type = CONF_TYPE_NODE};
+        return M_PROPERTY_OK;
+    }
+    if (action != M_PROPERTY_GET)
+        return M_PROPERTY_NOT_IMPLEMENTED;
+
+    struct mpv_node *r = (struct mpv_node *)arg;
+    node_init(r, MPV_FORMAT_NODE_ARRAY, NULL);
+
+    for (int n = 0; n < num; n++) {
+        struct mp_lock_stats *s = &stats[n];
+        struct mpv_node *sub = node_array_add(r, MPV_FORMAT_NODE_MAP);
+        node_map_add_string(sub, "name", s->name);
+        node_map_add_int64(sub, "acquisitions", s->acquisitions);
+        node_map_add_int64(sub, "contended", s->contended);
+        node_map_add_double(sub, "wait-total", s->wait_total_us / 1e6);
+        node_map_add_double(sub, "max-wait", s->max_wait_us / 1e6);
+        node_map_add_double(sub, "max-hold", s->max_hold_us / 1e6);
+        struct mpv_node *hist =
+            node_map_add(sub, "wait-histogram", MPV_FORMAT_NODE_ARRAY);
+        for (int i = 0; i < MP_LOCK_WAIT_BUCKETS; i++)
+            node_array_add(hist, MPV_FORMAT_INT64)->u.int64 = s->wait_hist[i];
+    }
+
+    return M_PROPERTY_OK;
+}
+
+static int mp_property_command_cache_hits(void *ctx, struct m_property *prop,
+                                          int action, void *arg)
+{
+    MPContext *mpctx = ctx;
+    struct mp_cmd_cache *cache = mp_input_get_cmd_cache(mpctx->input);
+    return m_property_int64_ro(action, arg, mp_cmd_cache_get_hits(cache));
+}
+
+static int mp_property_memory_usage(void *ctx, struct m_property *prop,
+                                    int action, void *arg)
+{
+    if (action == M_PROPERTY_GET_TYPE) {
+        *(struct m_option *)arg = (struct m_option){.type = CONF_TYPE_NODE};
+        return M_PROPERTY_OK;
+    }
+    if (action != M_PROPERTY_GET)
+        return M_PROPERTY_NOT_IMPLEMENTED;
+
+    struct ta_account_info accounts[64];
+    int num = ta_account_list(accounts, MP_ARRAY_SIZE(accounts));
+
+    struct mpv_node *r = (struct mpv_node *)arg;
+    node_init(r, MPV_FORMAT_NODE_MAP, NULL);
+
+    for (int n = 0; n < num; n++) {
+        struct ta_account_info *a = &accounts[n];
+        struct mpv_node *sub = node_map_add(r, a->name, MPV_FORMAT_NODE_MAP);
+        node_map_add_int64(sub, "bytes", a->bytes);
+        node_map_add_int64(sub, "allocations", a->count);
+        if (a->parent)
+            node_map_add_string(sub, "parent", a->parent);
+    }
+
+    return M_PROPERTY_OK;
+}
+
+static int mp_property_startup_trace(void *ctx, struct m_property *prop,
+                                     int action, void *arg)
+{
+    MPContext *mpctx = ctx;
+    if (action == M_PROPERTY_GET_TYPE) {
+        *(struct m_option *)arg = (struct m_option){.type = CONF_TYPE_NODE};
+        return M_PROPERTY_OK;
+    }
+    if (action != M_PROPERTY_GET)
+        return M_PROPERTY_NOT_IMPLEMENTED;
+
+    struct mpv_node *r = (struct mpv_node *)arg;
+    node_init(r, MPV_FORMAT_NODE_ARRAY, NULL);
+
+    for (int n = 0; n < mpctx->num_startup_phases; n++) {
+        struct mp_startup_phase *p = &mpctx->startup_phases[n];
+        struct mpv_node *sub = node_array_add(r, MPV_FORMAT_NODE_MAP);
+        node_map_add_string(sub, "phase", p->name);
+        node_map_add_double(sub, "time", p->time);
+    }
+
+    return M_PROPERTY_OK;
+}
+
 static int mp_property_alias(void *ctx, struct m_property *prop,
                              int action, void *arg)
 {
@@ -2020,6 +2159,7 @@ static const struct m_property mp_properties_base[] = {
     {"audio-device", mp_property_audio_device},
     {"audio-device-list", mp_property_audio_devices},
     {"current-ao", mp_property_ao},
+    {"ao-open-stats", mp_property_ao_open_stats},
 
     {"af", mp_property_af},
 
@@ -2045,6 +2185,10 @@ static const struct m_property mp_properties_base[] = {
     {"mpv-version", mp_property_version},
     {"mpv-configuration", mp_property_configuration},
     {"ffmpeg-version", mp_property_ffmpeg},
+    {"lock-stats", mp_property_lock_stats},
+    {"memory-usage", mp_property_memory_usage},
+    {"command-cache-hits", mp_property_command_cache_hits},
+    {"startup-trace", mp_property_startup_trace},
 
     {"options", mp_property_options},
     {"file-local-options", mp_property_local_options},
@@ -2089,7 +2233,7 @@ static const char *const *const mp_event_property_change[] = {
     E(MPV_EVENT_AUDIO_RECONFIG, "audio-format", "audio-codec", "audio-bitrate",
       "samplerate", "channels", "audio", "volume", "mute",
       "current-ao", "audio-codec-name", "audio-params",
-      "audio-out-params", "volume-max", "mixer-active"),
+      "audio-out-params", "volume-max", "mixer-active", "ao-open-stats"),
     E(MPV_EVENT_SEEK, "seeking", "core-idle", "eof-reached"),
     E(MPV_EVENT_PLAYBACK_RESTART, "seeking", "core-idle", "eof-reached"),
     E(MPV_EVENT_METADATA_UPDATE, "metadata", "filtered-metadata", "media-title"),
@@ -3098,6 +3242,25 @@ static void cmd_track_add(void *p)
         print_track_list(mpctx, "Track added:");
 }
 
+static void cmd_audio_overlay(void *p)
+{
+    struct mp_cmd_ctx *cmd = p;
+    struct MPContext *mpctx = cmd->mpctx;
+
+    cmd->success = mp_play_audio_overlay(mpctx, cmd->args[0].v.s,
+                                         cmd->args[1].v.d, cmd->args[2].v.d,
+                                         cmd->abort->cancel);
+}
+
+static void cmd_audio_overlay_stop(void *p)
+{
+    struct mp_cmd_ctx *cmd = p;
+    struct MPContext *mpctx = cmd->mpctx;
+
+    if (mpctx->ao_chain)
+        mp_output_chain_clear_overlays(mpctx->ao_chain->filter);
+}
+
 static void cmd_track_remove(void *p)
 {
     struct mp_cmd_ctx *cmd = p;
@@ -3573,6 +3736,17 @@ const struct mp_cmd_def mp_cmds[] = {
         .abort_on_playback_end = true,
     },
 
+    { "audio-overlay", cmd_audio_overlay,
+        {
+            OPT_STRING("url", v.s, 0),
+            OPT_DOUBLE("gain", v.d, 0, OPTDEF_DOUBLE(1)),
+            OPT_DOUBLE("duck", v.d, 0, OPTDEF_DOUBLE(1)),
+        },
+        .spawn_thread = true,
+        .can_abort = true,
+    },
+    { "audio-overlay-stop", cmd_audio_overlay_stop },
+
     { "loadfile", cmd_loadfile,
         {
             OPT_STRING("url", v.s, 0),
@@ -3709,8 +3883,10 @@ const struct mp_cmd_def mp_cmds[] = {
 
 void command_uninit(struct MPContext *mpctx)
 {
-    ao_hotplug_destroy(mpctx->command_ctx->hotplug);
-    talloc_free(mpctx->command_ctx);
+    struct command_ctx *ctx = mpctx->command_ctx;
+    ao_hotplug_destroy(ctx->hotplug);
+    m_option_free(&(struct m_option){.type = CONF_TYPE_NODE}, &ctx->cache_state);
+    talloc_free(ctx);
     mpctx->command_ctx = NULL;
 }
 
@@ -3763,6 +3939,9 @@ static void command_event(struct MPContext *mpctx, int event, void *arg)
     if (event == MPV_EVENT_START_FILE) {
         ctx->last_seek_pts = MP_NOPTS_VALUE;
         ctx->marked_pts = MP_NOPTS_VALUE;
+        // Generations are per demuxer.
+        ctx->cache_state_gen = 0;
+        mpctx->cache_state_gen = 0;
     }
 
     if (event == MPV_EVENT_IDLE)
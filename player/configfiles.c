@@ -40,6 +40,7 @@
 #include "options/m_property.h"
 
 #include "stream/stream.h"
+#include "demux/demux.h"
 
 #include "core.h"
 #include "command.h"
@@ -58,10 +59,29 @@ static void load_all_cfgfiles(struct MPContext *mpctx, char *section,
 
 void mp_parse_cfgfiles(struct MPContext *mpctx)
 {
+    struct MPOpts *opts = mpctx->opts;
+
     mp_mk_config_dir(mpctx->global, "");
 
     char *section = NULL;
-    load_all_cfgfiles(mpctx, section, "mpa.conf|config");
+    char *snapshot = NULL;
+    if (opts->config_snapshot && opts->config_snapshot[0])
+        snapshot = mp_get_user_path(NULL, mpctx->global, opts->config_snapshot);
+    if (!snapshot) {
+        load_all_cfgfiles(mpctx, section, "mpa.conf|config");
+        return;
+    }
+
+    // The snapshot is valid only for the same set of unchanged config files.
+    char **cf = mp_find_all_config_files(NULL, mpctx->global, "mpa.conf|config");
+    if (!m_config_snapshot_load(mpctx->mconfig, snapshot, cf)) {
+        m_config_snapshot_begin(mpctx->mconfig);
+        for (int i = 0; cf && cf[i]; i++)
+            m_config_parse_config_file(mpctx->mconfig, cf[i], section, 0);
+        m_config_snapshot_write(mpctx->mconfig, snapshot);
+    }
+    talloc_free(cf);
+    talloc_free(snapshot);
 }
 
 static int try_load_config(struct MPContext *mpctx, const char *file, int flags,
@@ -383,6 +403,61 @@ void mp_load_playback_resume(struct MPContext *mpctx, const char *file)
     talloc_free(fname);
 }
 
+static char *get_seek_index_filename(struct MPContext *mpctx)
+{
+    char *conf = mp_get_playback_resume_config_filename(mpctx, mpctx->filename);
+    if (!conf)
+        return NULL;
+    char *res = talloc_asprintf(NULL, "%s.seek-index", conf);
+    talloc_free(conf);
+    return res;
+}
+
+// Store the seek points the demuxer learned while playing the current file,
+// so the next playback can seek directly to them.
+void mp_write_seek_index(struct MPContext *mpctx)
+{
+    if (!mpctx->opts->save_seek_index || !mpctx->demuxer || !mpctx->filename)
+        return;
+
+    char *data = NULL;
+    if (demux_control(mpctx->demuxer, DEMUXER_CTRL_GET_SEEK_INDEX, &data) < 1)
+        return;
+
+    char *fname = get_seek_index_filename(mpctx);
+    if (fname) {
+        mp_mk_config_dir(mpctx->global, mpctx->cached_watch_later_configdir);
+        FILE *file = fopen(fname, "wb");
+        if (file) {
+            MP_VERBOSE(mpctx, "Saving seek index to %s\n", fname);
+            fputs(data, file);
+            fclose(file);
+        }
+    }
+    talloc_free(fname);
+    talloc_free(data);
+}
+
+void mp_load_seek_index(struct MPContext *mpctx)
+{
+    if (!mpctx->opts->save_seek_index || !mpctx->demuxer)
+        return;
+
+    char *fname = get_seek_index_filename(mpctx);
+    if (fname && mp_path_exists(fname)) {
+        bstr data = stream_read_file(fname, fname, mpctx->global, 16 << 20);
+        if (data.start &&
+            demux_control(mpctx->demuxer, DEMUXER_CTRL_SET_SEEK_INDEX,
+                          &data) == CONTROL_ERROR)
+        {
+            // Stale (file changed) or broken.
+            MP_VERBOSE(mpctx, "Ignoring seek index %s\n", fname);
+            unlink(fname);
+        }
+    }
+    talloc_free(fname);
+}
+
 // Returns the first file that has a resume config.
 // Compared to hashing the playlist file or contents and managing separate
 // resume file for them, this is simpler, and also has the nice property
@@ -274,6 +274,18 @@ typedef struct MPContext {
 
     struct ao *ao;
     struct mp_aframe *ao_filter_fmt; // for weak gapless audio check
+    // Number of AO (re)opens, and of format changes handled without reopening.
+    int ao_open_count;
+    int ao_keep_count;
+    double ao_open_time;        // time the last ao_init_best() call took
+    double ao_open_time_total;
+
+    // Decoded clips for the audio-overlay command, least recently used first.
+    struct overlay_clip {
+        char *url;
+        struct mp_aframe *data;     // in the format of the AO it was used for
+    } *overlay_cache;
+    int num_overlay_cache;
 
     struct ao_chain *ao_chain;
     struct vo_chain *vo_chain;
@@ -341,6 +353,16 @@ typedef struct MPContext {
 
     double last_idle_tick;
     double next_cache_update;
+    double next_lock_stats;
+
+    // Time spent in each startup phase, until audio playback first starts.
+    struct mp_startup_phase {
+        const char *name;
+        double time;                // seconds since the previous phase
+    } *startup_phases;
+    int num_startup_phases;
+    int64_t startup_last;           // mp_time_us() of the last phase end
+    bool startup_done;
 
     double sleeptime;      // number of seconds to sleep before next iteration
 
@@ -375,6 +397,8 @@ typedef struct MPContext {
     bool playing_msg_shown;
 
     bool paused_for_cache;
+    bool cache_underrun;        // last reported demuxer underrun state
+    uint64_t cache_state_gen;   // reader state generation last notified
     double cache_stop_time;
     int cache_buffer;
 
@@ -440,6 +464,9 @@ void reinit_audio_chain_src(struct MPContext *mpctx, struct track *track);
 void audio_update_volume(struct MPContext *mpctx);
 void audio_update_balance(struct MPContext *mpctx);
 void reload_audio_output(struct MPContext *mpctx);
+struct mp_cancel;
+bool mp_play_audio_overlay(struct MPContext *mpctx, const char *url,
+                           float gain, float duck, struct mp_cancel *cancel);
 
 // configfiles.c
 void mp_parse_cfgfiles(struct MPContext *mpctx);
@@ -447,6 +474,8 @@ void mp_load_auto_profiles(struct MPContext *mpctx);
 void mp_get_resume_defaults(struct MPContext *mpctx);
 void mp_load_playback_resume(struct MPContext *mpctx, const char *file);
 void mp_write_watch_later_conf(struct MPContext *mpctx);
+void mp_write_seek_index(struct MPContext *mpctx);
+void mp_load_seek_index(struct MPContext *mpctx);
 struct playlist_entry *mp_check_playlist_resume(struct MPContext *mpctx,
                                                 struct playlist *playlist);
 
@@ -502,6 +531,7 @@ void merge_playlist_files(struct playlist *pl);
 void error_on_track(struct MPContext *mpctx, struct track *track);
 int stream_dump(struct MPContext *mpctx, const char *source_filename);
 double get_track_seek_offset(struct MPContext *mpctx, struct track *track);
+void mp_startup_mark(struct MPContext *mpctx, const char *phase);
 
 // osd.c
 bool set_osd_msg(struct MPContext *mpctx, int level, int time,
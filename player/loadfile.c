@@ -604,7 +604,8 @@ void mp_switch_track_n(struct MPContext *mpctx, int order, enum stream_type type
         if (type == STREAM_AUDIO) {
             clear_audio_output_buffers(mpctx);
             uninit_audio_chain(mpctx);
-            uninit_audio_out(mpctx);
+            if (!mpctx->opts->audio_sticky_output)
+                uninit_audio_out(mpctx);
         }
     }
 
@@ -1250,6 +1251,8 @@ static void play_current_file(struct MPContext *mpctx)
     if (!mpctx->demuxer || mpctx->stop_play)
         goto terminate_playback;
 
+    mp_startup_mark(mpctx, "open-demuxer");
+
     if (mpctx->demuxer->playlist) {
         struct playlist *pl = mpctx->demuxer->playlist;
         int entry_stream_flags = 0;
@@ -1268,6 +1271,7 @@ static void play_current_file(struct MPContext *mpctx)
 
     if (mpctx->opts->rebase_start_time)
         demux_set_ts_offset(mpctx->demuxer, -mpctx->demuxer->start_time);
+    mp_load_seek_index(mpctx);
     enable_demux_thread(mpctx, mpctx->demuxer);
 
     add_demuxer_tracks(mpctx, mpctx->demuxer);
@@ -1324,6 +1328,8 @@ static void play_current_file(struct MPContext *mpctx)
 
     reinit_audio_chain(mpctx);
 
+    mp_startup_mark(mpctx, "init-audio");
+
     if (!mpctx->vo_chain && !mpctx->ao_chain && opts->stream_auto_sel) {
         MP_FATAL(mpctx, "No video or audio streams selected.\n");
         mpctx->error_playing = MPV_ERROR_NOTHING_TO_PLAY;
@@ -1394,11 +1400,18 @@ terminate_playback:
 
     uninit_audio_chain(mpctx);
 
-    if (!opts->gapless_audio && !mpctx->encode_lavc_ctx)
-        uninit_audio_out(mpctx);
+    if (!opts->gapless_audio && !mpctx->encode_lavc_ctx) {
+        // The final chunk was played completely; make the AO accept new data.
+        if (opts->audio_sticky_output && mpctx->ao) {
+            ao_reset(mpctx->ao);
+        } else {
+            uninit_audio_out(mpctx);
+        }
+    }
 
     mpctx->playback_initialized = false;
 
+    mp_write_seek_index(mpctx);
     uninit_demuxer(mpctx);
 
     // Possibly stop ongoing async commands.
@@ -239,6 +239,7 @@ struct MPContext *mp_create(void)
         talloc_enable_leak_report();
 
     mp_time_init();
+    int64_t start_time = mp_time_us();
 
     struct MPContext *mpctx = talloc(NULL, MPContext);
     *mpctx = (struct MPContext){
@@ -249,6 +250,7 @@ struct MPContext *mp_create(void)
         .playback_abort = mp_cancel_new(mpctx),
         .thread_pool = mp_thread_pool_create(mpctx, 0, 1, 30),
         .stop_play = PT_STOP,
+        .startup_last = start_time,
     };
 
     pthread_mutex_init(&mpctx->abort_lock, NULL);
@@ -280,6 +282,8 @@ struct MPContext *mp_create(void)
 
     mp_clients_init(mpctx);
 
+    mp_startup_mark(mpctx, "create");
+
 #if 0
     char *verbose_env = getenv("MPV_VERBOSE");
     if (verbose_env)
@@ -320,8 +324,12 @@ int mp_initialize(struct MPContext *mpctx, char **options)
 
     mp_print_version(mpctx->log, false);
 
+    mp_startup_mark(mpctx, "logging");
+
     mp_parse_cfgfiles(mpctx);
 
+    mp_startup_mark(mpctx, "config-files");
+
     if (options) {
         int r = m_config_parse_mp_command_line(mpctx->mconfig, mpctx->playlist,
                                                mpctx->global, options);
@@ -337,8 +345,12 @@ int mp_initialize(struct MPContext *mpctx, char **options)
 
     mp_get_resume_defaults(mpctx);
 
+    mp_startup_mark(mpctx, "command-line");
+
     mp_input_load_config(mpctx->input);
 
+    mp_startup_mark(mpctx, "input-config");
+
     // From this point on, all mpctx members are initialized.
     mpctx->initialized = true;
     mpctx->mconfig->option_set_callback = mp_on_set_option;
@@ -348,6 +360,8 @@ int mp_initialize(struct MPContext *mpctx, char **options)
     // Run all update handlers.
     mp_option_change_callback(mpctx, NULL, UPDATE_OPTS_MASK);
 
+    mp_startup_mark(mpctx, "option-updates");
+
     if (handle_help_options(mpctx))
         return 1; // help
 
@@ -374,6 +388,7 @@ int mp_initialize(struct MPContext *mpctx, char **options)
     }
 
     MP_STATS(mpctx, "end init");
+    mp_startup_mark(mpctx, "end-init");
 
     return 0;
 }
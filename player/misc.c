@@ -19,6 +19,7 @@
 #include <stdbool.h>
 #include <errno.h>
 #include <assert.h>
+#include <string.h>
 
 #include "config.h"
 #include "mpa_talloc.h"
@@ -279,3 +280,32 @@ void merge_playlist_files(struct playlist *pl)
     playlist_add_file(pl, edl);
     talloc_free(edl);
 }
+
+// Record the end of a startup phase (name must be a static string). Once the
+// last phase ("first-audio") was reached, the trace is logged and frozen.
+void mp_startup_mark(struct MPContext *mpctx, const char *phase)
+{
+    if (mpctx->startup_done)
+        return;
+    int64_t now = mp_time_us();
+    struct mp_startup_phase entry = {
+        .name = phase,
+        .time = (now - mpctx->startup_last) / 1e6,
+    };
+    MP_TARRAY_APPEND(mpctx, mpctx->startup_phases, mpctx->num_startup_phases,
+                     entry);
+    mpctx->startup_last = now;
+    MP_STATS(mpctx, "value %f startup-%s", entry.time, phase);
+
+    if (strcmp(phase, "first-audio") == 0) {
+        mpctx->startup_done = true;
+        double total = 0;
+        MP_VERBOSE(mpctx, "Startup trace:\n");
+        for (int n = 0; n < mpctx->num_startup_phases; n++) {
+            struct mp_startup_phase *p = &mpctx->startup_phases[n];
+            MP_VERBOSE(mpctx, "  %-16s %8.3f ms\n", p->name, p->time * 1e3);
+            total += p->time;
+        }
+        MP_VERBOSE(mpctx, "  %-16s %8.3f ms\n", "total", total * 1e3);
+    }
+}
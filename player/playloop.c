@@ -35,6 +35,7 @@
 
 #include "misc/dispatch.h"
 #include "osdep/terminal.h"
+#include "osdep/threads.h"
 #include "osdep/timer.h"
 
 #include "audio/out/ao.h"
@@ -111,6 +112,7 @@ void mp_process_input(struct MPContext *mpctx)
         run_command(mpctx, cmd, NULL, NULL, NULL);
     }
     mp_set_timeout(mpctx, mp_input_get_delay(mpctx->input));
+    mp_client_update_deferred_properties(mpctx);
 }
 
 double get_relative_time(struct MPContext *mpctx)
@@ -582,6 +584,13 @@ static void handle_pause_on_low_cache(struct MPContext *mpctx)
     struct demux_ctrl_reader_state s = {.idle = true, .ts_duration = -1};
     demux_control(mpctx->demuxer, DEMUXER_CTRL_GET_READER_STATE, &s);
 
+    // Report new underruns during playback, so the demuxer can read further
+    // ahead.
+    bool underrun = s.underrun && mpctx->restart_complete;
+    if (underrun && !mpctx->cache_underrun)
+        demux_report_underrun(mpctx->demuxer);
+    mpctx->cache_underrun = underrun;
+
     int cache_buffer = 100;
     bool use_pause_on_low_cache = demux_is_network_cached(mpctx->demuxer) &&
                                   opts->cache_pause;
@@ -648,8 +657,14 @@ static void handle_pause_on_low_cache(struct MPContext *mpctx)
     if (s.eof && !busy)
         prefetch_next(mpctx);
 
-    if (force_update)
+    if (force_update) {
         mp_notify(mpctx, MP_EVENT_CACHE_UPDATE, NULL);
+        // Observers of demuxer-cache-state get notified only if it changed.
+        if (s.generation != mpctx->cache_state_gen) {
+            mpctx->cache_state_gen = s.generation;
+            mp_notify_property(mpctx, "demuxer-cache-state");
+        }
+    }
 }
 
 int get_cache_buffering_percentage(struct MPContext *mpctx)
@@ -802,6 +817,7 @@ static void handle_playback_restart(struct MPContext *mpctx)
     if (mpctx->audio_status == STATUS_READY) {
 
         MP_VERBOSE(mpctx, "starting audio playback\n");
+        mp_startup_mark(mpctx, "first-audio");
 
         mpctx->audio_status = STATUS_PLAYING;
 
@@ -851,6 +867,32 @@ static void handle_eof(struct MPContext *mpctx)
     }
 }
 
+// Write lock statistics to the --dump-stats file once per second.
+static void handle_lock_stats(struct MPContext *mpctx)
+{
+#if HAVE_LOCK_PROFILING
+    if (!mp_msg_test(mpctx->log, MSGL_STATS))
+        return;
+
+    double now = mp_time_sec();
+    if (now < mpctx->next_lock_stats)
+        return;
+    mpctx->next_lock_stats = now + 1;
+
+    struct mp_lock_stats stats[64];
+    int num = mp_lock_stats_get(stats, MP_ARRAY_SIZE(stats));
+    for (int n = 0; n < num; n++) {
+        struct mp_lock_stats *s = &stats[n];
+        MP_STATS(mpctx, "value %"PRIu64" lock-%s-contended", s->contended,
+                 s->name);
+        MP_STATS(mpctx, "value %f lock-%s-wait", s->wait_total_us / 1e6,
+                 s->name);
+        MP_STATS(mpctx, "value %f lock-%s-max-hold", s->max_hold_us / 1e6,
+                 s->name);
+    }
+#endif
+}
+
 void run_playloop(struct MPContext *mpctx)
 {
 
@@ -883,6 +925,8 @@ void run_playloop(struct MPContext *mpctx)
 
     update_core_idle_state(mpctx);
 
+    handle_lock_stats(mpctx);
+
     if (mpctx->stop_play)
         return;
 
@@ -51,8 +51,10 @@ extern const stream_info_t stream_info_ffmpeg;
 extern const stream_info_t stream_info_ffmpeg_unsafe;
 extern const stream_info_t stream_info_file;
 extern const stream_info_t stream_info_cb;
+extern const stream_info_t stream_info_ranges;
 
 static const stream_info_t *const stream_list[] = {
+    &stream_info_ranges,
     &stream_info_ffmpeg,
     &stream_info_ffmpeg_unsafe,
     &stream_info_memory,
@@ -54,6 +54,7 @@ enum stream_ctrl {
 
     // stream_memory.c
     STREAM_CTRL_SET_CONTENTS,
+    STREAM_CTRL_GET_BUFFER,             // AVBufferRef** (new reference)
 
     // stream_rar.c
     STREAM_CTRL_GET_BASE_FILENAME,
@@ -237,6 +238,7 @@ char *mp_file_url_to_filename(void *talloc_ctx, bstr url);
 char *mp_file_get_path(void *talloc_ctx, bstr url);
 
 // stream_lavf.c
+char *mp_normalize_av_url(void *ta_parent, const char *filename);
 struct AVDictionary;
 void mp_setup_av_network_options(struct AVDictionary **dict,
                                  struct mpv_global *global,
@@ -6,8 +6,12 @@
 #include <fcntl.h>
 #include <unistd.h>
 #include <errno.h>
+#include <pthread.h>
 
 #include "osdep/io.h"
+#include "osdep/threads.h"
+#include "osdep/timer.h"
+#include "misc/thread_tools.h"
 
 #include "common/common.h"
 #include "common/msg.h"
@@ -18,8 +22,39 @@
 #include "player/client.h"
 #include "libmpa/stream_cb.h"
 
+#define ASYNC_READ_SIZE (64 * 1024)
+#define DEFAULT_PREFETCH_DEPTH 4
+#define MAX_PREFETCH_DEPTH 64
+
+enum request_state {
+    REQ_FREE,           // unused
+    REQ_QUEUED,         // in flight or completed, part of the read queue
+    REQ_STALE,          // in flight, result will be discarded
+};
+
+struct mpv_stream_cb_request {
+    struct priv *p;
+    enum request_state state;
+    bool done;          // completed (for REQ_QUEUED)
+    int64_t offset;
+    int64_t result;
+    int64_t consumed;   // bytes already returned from buf
+    char *buf;
+};
+
 struct priv {
     mpv_stream_cb_info info;
+
+    // For read_async_fn.
+    pthread_mutex_t lock;
+    pthread_cond_t wakeup;
+    struct mpv_stream_cb_request *reqs;
+    int num_reqs;
+    // Requests in stream order; queue[0] is read from next.
+    struct mpv_stream_cb_request **queue;
+    int num_queue;
+    int64_t next_offset;    // offset of the next request to issue
+    bool eof;               // don't issue requests until the next seek
 };
 
 static int fill_buffer(stream_t *s, char *buffer, int max_len)
@@ -34,6 +69,127 @@ static int seek(stream_t *s, int64_t newpos)
     return p->info.seek_fn(p->info.cookie, newpos) >= 0;
 }
 
+void mpv_stream_cb_read_complete(mpv_stream_cb_request *req, int64_t result)
+{
+    struct priv *p = req->p;
+    mp_mutex_lock(&p->lock);
+    if (req->state == REQ_STALE) {
+        req->state = REQ_FREE;
+    } else {
+        req->done = true;
+        req->result = result;
+    }
+    pthread_cond_broadcast(&p->wakeup);
+    mp_mutex_unlock(&p->lock);
+}
+
+// Drop all queued requests (e.g. on seek). Must be called locked.
+static void flush_queue(struct priv *p, int64_t offset)
+{
+    for (int n = 0; n < p->num_queue; n++) {
+        struct mpv_stream_cb_request *req = p->queue[n];
+        req->state = req->done ? REQ_FREE : REQ_STALE;
+    }
+    p->num_queue = 0;
+    p->next_offset = offset;
+    p->eof = false;
+}
+
+// Start requests until the prefetch depth is reached. Must be called locked;
+// the lock is released while calling the user.
+static void issue_requests(struct priv *p)
+{
+    struct mpv_stream_cb_request *issue[MAX_PREFETCH_DEPTH];
+    int num_issue = 0;
+    for (int n = 0; n < p->num_reqs && !p->eof; n++) {
+        struct mpv_stream_cb_request *req = &p->reqs[n];
+        if (req->state != REQ_FREE)
+            continue;
+        *req = (struct mpv_stream_cb_request){
+            .p = p,
+            .state = REQ_QUEUED,
+            .offset = p->next_offset,
+            .buf = req->buf,
+        };
+        p->next_offset += ASYNC_READ_SIZE;
+        MP_TARRAY_APPEND(p, p->queue, p->num_queue, req);
+        issue[num_issue++] = req;
+    }
+    if (!num_issue)
+        return;
+
+    // The user may complete requests from within the callback.
+    mp_mutex_unlock(&p->lock);
+    for (int n = 0; n < num_issue; n++) {
+        struct mpv_stream_cb_request *req = issue[n];
+        p->info.read_async_fn(p->info.cookie, req, req->offset, req->buf,
+                              ASYNC_READ_SIZE);
+    }
+    mp_mutex_lock(&p->lock);
+}
+
+static int fill_buffer_async(stream_t *s, char *buffer, int max_len)
+{
+    struct priv *p = s->priv;
+    int res = -1;
+
+    mp_mutex_lock(&p->lock);
+    issue_requests(p);
+    while (1) {
+        if (p->eof) {
+            res = 0;
+            break;
+        }
+        // Wait for the first request to complete, or, if all were discarded
+        // by a seek, for one to become free.
+        struct mpv_stream_cb_request *req = p->num_queue ? p->queue[0] : NULL;
+        if (!req || !req->done) {
+            if (mp_cancel_test(s->cancel))
+                break;
+            struct timespec ts = mp_rel_time_to_timespec(0.1);
+            mp_cond_timedwait(&p->wakeup, &p->lock, &ts);
+            issue_requests(p);
+            continue;
+        }
+        if (req->result <= 0) {
+            // EOF or error; later requests are meaningless.
+            if (req->result < 0)
+                MP_ERR(s, "Error reading at position %"PRId64".\n", req->offset);
+            res = req->result < 0 ? -1 : 0;
+            flush_queue(p, req->offset);
+            p->eof = true;
+            break;
+        }
+        int64_t avail = MPMIN(req->result, ASYNC_READ_SIZE) - req->consumed;
+        res = MPMIN(max_len, avail);
+        memcpy(buffer, req->buf + req->consumed, res);
+        req->consumed += res;
+        if (res == avail) {
+            int64_t end = req->offset + req->consumed;
+            MP_TARRAY_REMOVE_AT(p->queue, p->num_queue, 0);
+            req->state = REQ_FREE;
+            // After a short read, the following requests are at the wrong
+            // offsets.
+            if (req->result < ASYNC_READ_SIZE)
+                flush_queue(p, end);
+            issue_requests(p);
+        }
+        break;
+    }
+    mp_mutex_unlock(&p->lock);
+
+    return res;
+}
+
+static int seek_async(stream_t *s, int64_t newpos)
+{
+    struct priv *p = s->priv;
+    mp_mutex_lock(&p->lock);
+    flush_queue(p, newpos);
+    mp_mutex_unlock(&p->lock);
+    return 1;
+}
+
 static int control(stream_t *s, int cmd, void *arg)
 {
     struct priv *p = s->priv;
@@ -55,12 +211,28 @@ static int control(stream_t *s, int cmd, void *arg)
 static void s_close(stream_t *s)
 {
     struct priv *p = s->priv;
+    if (p->info.read_async_fn) {
+        // The user may still write to the buffers of pending requests.
+        mp_mutex_lock(&p->lock);
+        flush_queue(p, 0);
+        while (1) {
+            bool pending = false;
+            for (int n = 0; n < p->num_reqs; n++)
+                pending |= p->reqs[n].state != REQ_FREE;
+            if (!pending)
+                break;
+            mp_cond_wait(&p->wakeup, &p->lock);
+        }
+        mp_mutex_unlock(&p->lock);
+        pthread_cond_destroy(&p->wakeup);
+        mp_mutex_destroy(&p->lock);
+    }
     p->info.close_fn(p->info.cookie);
 }
 
 static int open_cb(stream_t *stream)
 {
-    struct priv *p = talloc_ptrtype(stream, p);
+    struct priv *p = talloc_zero(stream, struct priv);
     stream->priv = p;
 
     bstr bproto = mp_split_proto(bstr0(stream->url), NULL);
@@ -81,7 +253,7 @@ static int open_cb(stream_t *stream)
         return STREAM_ERROR;
     }
 
-    if (!info.read_fn || !info.close_fn) {
+    if ((!info.read_fn && !info.read_async_fn) || !info.close_fn) {
         MP_FATAL(stream, "required read_fn or close_fn callbacks not set.\n");
         return STREAM_ERROR;
     }
@@ -94,6 +266,23 @@ static int open_cb(stream_t *stream)
     }
     stream->fast_skip = true;
     stream->fill_buffer = fill_buffer;
+    if (p->info.read_async_fn) {
+        int depth = p->info.prefetch_depth;
+        if (depth <= 0)
+            depth = DEFAULT_PREFETCH_DEPTH;
+        p->num_reqs = MPMIN(depth, MAX_PREFETCH_DEPTH);
+        p->reqs = talloc_zero_array(p, struct mpv_stream_cb_request, p->num_reqs);
+        for (int n = 0; n < p->num_reqs; n++)
+            p->reqs[n].buf = talloc_size(p, ASYNC_READ_SIZE);
+        pthread_mutex_init(&p->lock, NULL);
+        mp_mutex_set_name(&p->lock, "stream_cb");
+        pthread_cond_init(&p->wakeup, NULL);
+        stream->fill_buffer = fill_buffer_async;
+        if (stream->seekable)
+            stream->seek = seek_async;
+        MP_VERBOSE(stream, "Asynchronous reads, %d requests in flight.\n",
+                   p->num_reqs);
+    }
     stream->control = control;
     stream->read_chunk = 64 * 1024;
     stream->close = s_close;
@@ -238,7 +238,7 @@ void mp_setup_av_network_options(AVDictionary **dict, struct mpv_global *global,
 // Escape http URLs with unescaped, invalid characters in them.
 // libavformat's http protocol does not do this, and a patch to add this
 // in a 100% safe case (spaces only) was rejected.
-static char *normalize_url(void *ta_parent, const char *filename)
+char *mp_normalize_av_url(void *ta_parent, const char *filename)
 {
     bstr proto = mp_split_proto(bstr0(filename), NULL);
     for (int n = 0; http_like[n]; n++) {
@@ -301,7 +301,7 @@ static int open_f(stream_t *stream)
         .opaque = stream,
     };
 
-    filename = normalize_url(stream, filename);
+    filename = mp_normalize_av_url(stream, filename);
 
     if (strncmp(filename, "rtmp", 4) == 0) {
         stream->demuxer = "lavf";
@@ -15,12 +15,16 @@
  * License along with mpv.  If not, see <http://www.gnu.org/licenses/>.
  */
 
+#include <libavutil/buffer.h>
 #include <libavutil/common.h>
 
+#include "common/global.h"
+#include "player/client.h"
 #include "stream.h"
 
 struct priv {
     bstr data;
+    AVBufferRef *buf;   // for mem://, references data
 };
 
 static int fill_buffer(stream_t *s, char* buffer, int len)
@@ -48,13 +52,48 @@ static int control(stream_t *s, int cmd, void *arg)
         return 1;
     case STREAM_CTRL_SET_CONTENTS: ;
         bstr *data = (bstr *)arg;
-        talloc_free(p->data.start);
+        if (p->buf) {
+            av_buffer_unref(&p->buf);
+        } else {
+            talloc_free(p->data.start);
+        }
         p->data = bstrdup(s, *data);
         return 1;
+    case STREAM_CTRL_GET_BUFFER:
+        if (!p->buf)
+            break;
+        *(AVBufferRef **)arg = av_buffer_ref(p->buf);
+        return *(AVBufferRef **)arg ? 1 : STREAM_ERROR;
     }
     return STREAM_UNSUPPORTED;
 }
 
+static void close_mem(stream_t *s)
+{
+    struct priv *p = s->priv;
+    av_buffer_unref(&p->buf);
+}
+
+// mem://name: data owned by the API user (see mpv_add_memory_source()).
+static int open_mem(stream_t *stream)
+{
+    struct priv *p = stream->priv;
+
+    if (!stream->global->client_api) {
+        MP_FATAL(stream, "No memory sources available.\n");
+        return STREAM_ERROR;
+    }
+    p->buf = mp_memory_source_lookup(stream->global, stream->path);
+    if (!p->buf) {
+        MP_FATAL(stream, "Memory source '%s' not found.\n", stream->path);
+        return STREAM_ERROR;
+    }
+    p->data = (bstr){p->buf->data, p->buf->size};
+    stream->close = close_mem;
+
+    return STREAM_OK;
+}
+
 static int open_f(stream_t *stream)
 {
     stream->fill_buffer = fill_buffer;
@@ -66,6 +105,9 @@ static int open_f(stream_t *stream)
     struct priv *p = talloc_zero(stream, struct priv);
     stream->priv = p;
 
+    if (strncmp(stream->url, "mem://", 6) == 0)
+        return open_mem(stream);
+
     // Initial data
     bstr data = bstr0(stream->url);
     bool use_hex = bstr_eatstart0(&data, "hex://");
@@ -84,5 +126,5 @@ static int open_f(stream_t *stream)
 const stream_info_t stream_info_memory = {
     .name = "memory",
     .open = open_f,
-    .protocols = (const char*const[]){ "memory", "hex", NULL },
+    .protocols = (const char*const[]){ "memory", "hex", "mem", NULL },
 };
@@ -0,0 +1,422 @@
+/*
+ * This file is part of mpv.
+ *
+ * mpv is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * mpv is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with mpv.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+// HTTP stream that downloads fixed size byte ranges ("segments") of the file
+// over several connections in parallel. Each segment is fetched with its own
+// libavformat HTTP request. Completed segments are kept (up to a limit), so
+// seeking back into them doesn't need new requests.
+
+#include <pthread.h>
+#include <stdlib.h>
+
+#include <libavformat/avio.h>
+#include <libavutil/dict.h>
+#include <libavutil/opt.h>
+
+#include "common/common.h"
+#include "common/msg.h"
+#include "misc/thread_tools.h"
+#include "options/m_config.h"
+#include "options/m_option.h"
+#include "osdep/threads.h"
+#include "osdep/timer.h"
+#include "stream.h"
+
+#include "mpa_talloc.h"
+
+#define OPT_BASE_STRUCT struct stream_ranges_opts
+struct stream_ranges_opts {
+    int connections;
+    int64_t segment_size;
+    int64_t keep_bytes;
+};
+
+const struct m_sub_options stream_ranges_conf = {
+    .opts = (const m_option_t[]) {
+        OPT_INTRANGE("stream-http-connections", connections, 0, 1, 16),
+        OPT_BYTE_SIZE("stream-http-segment-size", segment_size, 0,
+                      64 * 1024, 64 * 1024 * 1024),
+        OPT_BYTE_SIZE("stream-http-keep-bytes", keep_bytes, 0, 0, INT64_MAX),
+        {0}
+    },
+    .size = sizeof(struct stream_ranges_opts),
+    .defaults = &(const struct stream_ranges_opts){
+        .connections = 1,
+        .segment_size = 1024 * 1024,
+        .keep_bytes = 64 * 1024 * 1024,
+    },
+};
+
+// Give up on a segment after this many failed requests.
+#define MAX_ERRORS 3
+
+// Size of the reads from a connection; data is visible to the reader at this
+// granularity.
+#define READ_CHUNK (64 * 1024)
+
+struct segment {
+    int64_t start;          // byte position in the file
+    int64_t size;           // full size of the segment
+    int64_t len;            // bytes received (data[0..len] is valid)
+    char *data;             // malloc'ed; NULL if not fetched
+    bool fetching;          // a worker thread is writing to it
+    bool done;              // data complete
+    int errors;             // number of failed requests
+    uint64_t last_use;
+};
+
+struct priv {
+    struct stream_ranges_opts *opts;
+    struct mp_log *log;
+    struct mp_cancel *cancel;
+    char *url;
+    AVDictionary *avopts;   // options for each request (read-only)
+    int64_t size;
+
+    pthread_t *threads;
+    int num_threads;
+
+    pthread_mutex_t lock;
+    pthread_cond_t wakeup;
+    // Fields below are protected by lock.
+    bool terminate;
+    struct segment *segs;
+    int num_segs;
+    int64_t read_pos;
+    int64_t cached_bytes;
+    uint64_t use_counter;
+    int requests;
+    int waits;              // number of times the reader had to wait
+};
+
+static int interrupt_cb(void *ctx)
+{
+    struct priv *p = ctx;
+    return mp_cancel_test(p->cancel);
+}
+
+// Segments that should be fetched or kept, starting with the one at the read
+// position.
+static void get_window(struct priv *p, int *first, int *last)
+{
+    *first = MPMIN(p->read_pos / p->opts->segment_size, p->num_segs);
+    *last = MPMIN(*first + p->num_threads * 2, p->num_segs);
+}
+
+// Return the next segment to fetch, or -1. Must be called locked.
+static int pick_segment(struct priv *p)
+{
+    int first, last;
+    get_window(p, &first, &last);
+    for (int n = first; n < last; n++) {
+        struct segment *seg = &p->segs[n];
+        if (!seg->done && !seg->fetching && seg->errors < MAX_ERRORS)
+            return n;
+    }
+    return -1;
+}
+
+// Free the least recently used segments outside of the read window until the
+// limit is met. Must be called locked.
+static void evict_segments(struct priv *p)
+{
+    int first, last;
+    get_window(p, &first, &last);
+    while (p->cached_bytes > p->opts->keep_bytes) {
+        struct segment *lru = NULL;
+        for (int n = 0; n < p->num_segs; n++) {
+            struct segment *seg = &p->segs[n];
+            if (seg->data && !seg->fetching && (n < first || n >= last) &&
+                (!lru || seg->last_use < lru->last_use))
+                lru = seg;
+        }
+        if (!lru)
+            break;
+        free(lru->data);
+        lru->data = NULL;
+        lru->len = 0;
+        lru->done = false;
+        p->cached_bytes -= lru->size;
+    }
+}
+
+// Download the segment into seg->data. Called unlocked; seg->len is updated
+// under the lock as data arrives.
+static bool fetch_segment(struct priv *p, struct segment *seg)
+{
+    AVDictionary *dict = NULL;
+    av_dict_copy(&dict, p->avopts, 0);
+    av_dict_set_int(&dict, "offset", seg->start, 0);
+    av_dict_set_int(&dict, "end_offset", seg->start + seg->size, 0);
+
+    AVIOInterruptCB cb = {
+        .callback = interrupt_cb,
+        .opaque = p,
+    };
+    AVIOContext *avio = NULL;
+    int err = avio_open2(&avio, p->url, AVIO_FLAG_READ, &cb, &dict);
+    av_dict_free(&dict);
+    if (err < 0)
+        return false;
+
+    int64_t len = 0;
+    while (len < seg->size) {
+        int r = avio_read(avio, seg->data + len, MPMIN(seg->size - len, READ_CHUNK));
+        if (r <= 0)
+            break;
+        len += r;
+        mp_mutex_lock(&p->lock);
+        seg->len = len;
+        pthread_cond_broadcast(&p->wakeup);
+        mp_mutex_unlock(&p->lock);
+    }
+    avio_closep(&avio);
+    return len == seg->size;
+}
+
+static void *worker_thread(void *arg)
+{
+    struct priv *p = arg;
+    mpthread_set_name("http-ranges");
+
+    mp_mutex_lock(&p->lock);
+    while (!p->terminate) {
+        int index = mp_cancel_test(p->cancel) ? -1 : pick_segment(p);
+        if (index < 0) {
+            mp_cond_wait(&p->wakeup, &p->lock);
+            continue;
+        }
+
+        struct segment *seg = &p->segs[index];
+        seg->fetching = true;
+        seg->len = 0;
+        if (!seg->data) {
+            seg->data = malloc(seg->size);
+            if (!seg->data) {
+                seg->fetching = false;
+                seg->errors = MAX_ERRORS;
+                pthread_cond_broadcast(&p->wakeup);
+                continue;
+            }
+            p->cached_bytes += seg->size;
+        }
+        p->requests++;
+        mp_mutex_unlock(&p->lock);
+
+        bool ok = fetch_segment(p, seg);
+
+        mp_mutex_lock(&p->lock);
+        seg->fetching = false;
+        if (ok) {
+            seg->done = true;
+            seg->last_use = ++p->use_counter;
+        } else if (!mp_cancel_test(p->cancel)) {
+            seg->errors++;
+            MP_WARN(p, "Request for bytes %"PRId64"-%"PRId64" failed (%d).\n",
+                    seg->start, seg->start + seg->size - 1, seg->errors);
+        }
+        evict_segments(p);
+        pthread_cond_broadcast(&p->wakeup);
+    }
+    mp_mutex_unlock(&p->lock);
+    return NULL;
+}
+
+static int fill_buffer(stream_t *s, char *buffer, int max_len)
+{
+    struct priv *p = s->priv;
+    int res = -1;
+
+    mp_mutex_lock(&p->lock);
+    while (1) {
+        if (p->read_pos >= p->size) {
+            res = 0;
+            break;
+        }
+        struct segment *seg = &p->segs[p->read_pos / p->opts->segment_size];
+        int64_t offset = p->read_pos - seg->start;
+        if (seg->len > offset) {
+            res = MPMIN(max_len, seg->len - offset);
+            memcpy(buffer, seg->data + offset, res);
+            p->read_pos += res;
+            seg->last_use = ++p->use_counter;
+            // Moved to the next segment: let the workers fetch further ahead.
+            if (p->read_pos == seg->start + seg->size)
+                pthread_cond_broadcast(&p->wakeup);
+            break;
+        }
+        if (seg->errors >= MAX_ERRORS) {
+            MP_ERR(s, "Could not fetch data at position %"PRId64".\n",
+                   p->read_pos);
+            break;
+        }
+        if (mp_cancel_test(p->cancel))
+            break;
+        p->waits++;
+        struct timespec ts = mp_rel_time_to_timespec(0.1);
+        mp_cond_timedwait(&p->wakeup, &p->lock, &ts);
+    }
+    mp_mutex_unlock(&p->lock);
+
+    return res;
+}
+
+static int seek(stream_t *s, int64_t newpos)
+{
+    struct priv *p = s->priv;
+
+    mp_mutex_lock(&p->lock);
+    p->read_pos = newpos;
+    pthread_cond_broadcast(&p->wakeup);
+    mp_mutex_unlock(&p->lock);
+
+    return 1;
+}
+
+static int control(stream_t *s, int cmd, void *arg)
+{
+    struct priv *p = s->priv;
+    switch (cmd) {
+    case STREAM_CTRL_GET_SIZE:
+        *(int64_t *)arg = p->size;
+        return 1;
+    }
+    return STREAM_UNSUPPORTED;
+}
+
+static void close_f(stream_t *s)
+{
+    struct priv *p = s->priv;
+
+    mp_cancel_trigger(p->cancel);
+    mp_mutex_lock(&p->lock);
+    p->terminate = true;
+    pthread_cond_broadcast(&p->wakeup);
+    mp_mutex_unlock(&p->lock);
+
+    for (int n = 0; n < p->num_threads; n++)
+        pthread_join(p->threads[n], NULL);
+
+    MP_VERBOSE(s, "%d requests, reader waited %d times.\n",
+               p->requests, p->waits);
+
+    for (int n = 0; n < p->num_segs; n++)
+        free(p->segs[n].data);
+    av_dict_free(&p->avopts);
+    pthread_cond_destroy(&p->wakeup);
+    mp_mutex_destroy(&p->lock);
+}
+
+// Check whether the server reports a size and accepts range requests.
+static bool probe(stream_t *stream, struct priv *p)
+{
+    AVDictionary *dict = NULL;
+    av_dict_copy(&dict, p->avopts, 0);
+    AVIOInterruptCB cb = {
+        .callback = interrupt_cb,
+        .opaque = p,
+    };
+    AVIOContext *avio = NULL;
+    int err = avio_open2(&avio, p->url, AVIO_FLAG_READ, &cb, &dict);
+    av_dict_free(&dict);
+    if (err < 0)
+        return false;
+
+    p->size = avio_size(avio);
+    bool seekable = avio->seekable & AVIO_SEEKABLE_NORMAL;
+    if (avio->av_class) {
+        uint8_t *mt = NULL;
+        if (av_opt_get(avio, "mime_type", AV_OPT_SEARCH_CHILDREN, &mt) >= 0) {
+            stream->mime_type = talloc_strdup(stream, mt);
+            av_free(mt);
+        }
+    }
+    avio_closep(&avio);
+
+    return p->size > 0 && seekable;
+}
+
+static int open_f(stream_t *stream)
+{
+    struct stream_ranges_opts *opts =
+        mp_get_config_group(stream, stream->global, &stream_ranges_conf);
+    if (opts->connections < 2 || stream->mode != STREAM_READ)
+        return STREAM_UNSUPPORTED;
+
+    struct priv *p = talloc_zero(stream, struct priv);
+    p->opts = opts;
+    p->log = stream->log;
+    p->cancel = mp_cancel_new(p);
+    mp_cancel_set_parent(p->cancel, stream->cancel);
+    p->url = mp_normalize_av_url(p, stream->url);
+
+    mp_setup_av_network_options(&p->avopts, stream->global, stream->log);
+    // Metadata is interleaved with the data; can't be used with ranges.
+    av_dict_set(&p->avopts, "icy", "0", 0);
+
+    if (!probe(stream, p)) {
+        MP_VERBOSE(stream, "No size or no range requests, using a single "
+                   "connection.\n");
+        av_dict_free(&p->avopts);
+        talloc_free(p);
+        return STREAM_UNSUPPORTED;
+    }
+
+    int64_t seg_size = opts->segment_size;
+    p->num_segs = (p->size + seg_size - 1) / seg_size;
+    p->segs = talloc_zero_array(p, struct segment, p->num_segs);
+    for (int n = 0; n < p->num_segs; n++) {
+        p->segs[n].start = n * seg_size;
+        p->segs[n].size = MPMIN(seg_size, p->size - n * seg_size);
+    }
+
+    pthread_mutex_init(&p->lock, NULL);
+    mp_mutex_set_name(&p->lock, "http-ranges");
+    pthread_cond_init(&p->wakeup, NULL);
+
+    stream->priv = p;
+    stream->seekable = true;
+    stream->seek = seek;
+    stream->fill_buffer = fill_buffer;
+    stream->control = control;
+    stream->close = close_f;
+    stream->streaming = true;
+
+    p->threads = talloc_zero_array(p, pthread_t, opts->connections);
+    for (int n = 0; n < opts->connections; n++) {
+        if (pthread_create(&p->threads[n], NULL, worker_thread, p))
+            break;
+        p->num_threads++;
+    }
+    if (!p->num_threads) {
+        close_f(stream);
+        return STREAM_ERROR;
+    }
+
+    MP_VERBOSE(stream, "%d connections, %d segments of %"PRId64" bytes.\n",
+               p->num_threads, p->num_segs, seg_size);
+
+    return STREAM_OK;
+}
+
+const stream_info_t stream_info_ranges = {
+    .name = "ranges",
+    .open = open_f,
+    .protocols = (const char *const[]){ "http", "https", NULL },
+    .is_safe = true,
+    .is_network = true,
+};
@@ -17,6 +17,9 @@
 #include <string.h>
 #include <stdio.h>
 #include <assert.h>
+#include <pthread.h>
+
+#include "osdep/atomic.h"
 
 #define TA_NO_WRAPPERS
 #include "ta.h"
@@ -34,6 +37,7 @@ struct ta_header {
     struct ta_header *prev;     // ring list containing siblings
     struct ta_header *next;
     struct ta_ext_header *ext;
+    struct ta_account *account; // see ta_set_account(), or NULL
 #ifdef TA_MEMORY_DEBUGGING
     unsigned int canary;
     struct ta_header *leak_next;
@@ -64,11 +68,54 @@ struct ta_ext_header {
     struct ta_header *header;  // points back to normal header
     struct ta_header children; // list of children, with this as sentinel
     void (*destructor)(void *);
+    struct ta_account *account; // set with ta_set_account()
 };
 
 // ta_ext_header.children.size is set to this
 #define CHILDREN_SENTINEL ((size_t)-1)
 
+struct ta_account {
+    const char *name;
+    struct ta_account *parent;
+    atomic_llong bytes;
+    atomic_llong count;
+};
+
+#define MAX_ACCOUNTS 64
+
+static pthread_mutex_t ta_account_mutex = PTHREAD_MUTEX_INITIALIZER;
+static struct ta_account ta_accounts[MAX_ACCOUNTS];
+static atomic_int ta_num_accounts;
+
+// Memory used by an allocation, as accounted.
+#define ACCOUNT_SIZE(h) ((long long)((h)->size + sizeof(union aligned_header)))
+
+static void account_add(struct ta_account *account, long long bytes,
+                        long long count)
+{
+    for (struct ta_account *a = account; a; a = a->parent) {
+        atomic_fetch_add(&a->bytes, bytes);
+        atomic_fetch_add(&a->count, count);
+    }
+}
+
+// Move h and its children (except those with their own account) to account.
+static void set_account(struct ta_header *h, struct ta_account *account)
+{
+    if (h->account == account)
+        return;
+    account_add(h->account, -ACCOUNT_SIZE(h), -1);
+    account_add(account, ACCOUNT_SIZE(h), 1);
+    h->account = account;
+    if (h->ext) {
+        struct ta_header *s;
+        for (s = h->ext->children.next; s != &h->ext->children; s = s->next) {
+            if (!s->ext || !s->ext->account)
+                set_account(s, account);
+        }
+    }
+}
+
 static void ta_dbg_add(struct ta_header *h);
 static void ta_dbg_check_header(struct ta_header *h);
 static void ta_dbg_remove(struct ta_header *h);
@@ -134,6 +181,9 @@ bool ta_set_parent(void *ptr, void *ta_parent)
         children->prev->next = ch;
         children->prev = ch;
     }
+    // Inherit the parent's memory account, unless ptr has its own.
+    if (!ch->ext || !ch->ext->account)
+        set_account(ch, parent_eh ? parent_eh->header->account : NULL);
     return true;
 }
 
@@ -210,6 +260,7 @@ void *ta_realloc_size(void *ta_parent, void *ptr, size_t size)
     ta_dbg_add(h ? h : old_h);
     if (!h)
         return NULL;
+    account_add(h->account, (long long)size - (long long)h->size, 0);
     h->size = size;
     if (h != old_h) {
         if (h->next) {
@@ -265,6 +316,7 @@ void ta_free(void *ptr)
         h->next->prev = h->prev;
         h->prev->next = h->next;
     }
+    account_add(h->account, -ACCOUNT_SIZE(h), -1);
     ta_dbg_remove(h);
     free(h->ext);
     free(h);
@@ -307,9 +359,87 @@ void *ta_find_parent(void *ptr)
     return NULL;
 }
 
-#ifdef TA_MEMORY_DEBUGGING
+/* Return the memory account with the given name, creating it if it doesn't
+ * exist yet. Memory accounted to an account is also accounted to its parent
+ * (if not NULL). The name must be a static string. Accounts are never freed.
+ * If the account is created, parent is used as its parent; for existing
+ * accounts it is ignored.
+ * Returns NULL if there are too many accounts.
+ */
+struct ta_account *ta_account_get(const char *name, struct ta_account *parent)
+{
+    struct ta_account *res = NULL;
+    pthread_mutex_lock(&ta_account_mutex);
+    int num = atomic_load(&ta_num_accounts);
+    for (int n = 0; n < num; n++) {
+        if (strcmp(ta_accounts[n].name, name) == 0) {
+            res = &ta_accounts[n];
+            break;
+        }
+    }
+    if (!res && num < MAX_ACCOUNTS) {
+        res = &ta_accounts[num];
+        res->name = name;
+        res->parent = parent;
+        atomic_store(&ta_num_accounts, num + 1);
+    }
+    pthread_mutex_unlock(&ta_account_mutex);
+    return res;
+}
 
-#include <pthread.h>
+/* Account the memory of ptr and all its direct and indirect children to the
+ * given account (including children allocated later). Children which have
+ * their own account set keep using it. If account is NULL, the allocation
+ * uses the parent's account again. Returns false if ptr==NULL, or on OOM.
+ *
+ * Warning: this has O(N) runtime complexity with N (recursive) children, and
+ * with account==NULL, also with N sibling allocations.
+ */
+bool ta_set_account(void *ptr, struct ta_account *account)
+{
+    struct ta_ext_header *eh = get_or_alloc_ext_header(ptr);
+    if (!eh)
+        return false;
+    eh->account = account;
+    if (!account) {
+        struct ta_header *parent = get_header(ta_find_parent(ptr));
+        account = parent ? parent->account : NULL;
+    }
+    set_account(eh->header, account);
+    return true;
+}
+
+/* Add memory not allocated with ta to an account (e.g. from other allocators).
+ * Use negative values to remove it again. account==NULL does nothing.
+ */
+void ta_account_add(struct ta_account *account, ptrdiff_t bytes,
+                    ptrdiff_t count)
+{
+    account_add(account, bytes, count);
+}
+
+/* Write the current state of up to max accounts to out[], and return the
+ * number of entries written. (This is a snapshot; the values can change while
+ * this is called.)
+ */
+int ta_account_list(struct ta_account_info *out, int max)
+{
+    int num = atomic_load(&ta_num_accounts);
+    if (num > max)
+        num = max;
+    for (int n = 0; n < num; n++) {
+        struct ta_account *a = &ta_accounts[n];
+        out[n] = (struct ta_account_info){
+            .name = a->name,
+            .parent = a->parent ? a->parent->name : NULL,
+            .bytes = atomic_load(&a->bytes),
+            .count = atomic_load(&a->count),
+        };
+    }
+    return num;
+}
+
+#ifdef TA_MEMORY_DEBUGGING
 
 static pthread_mutex_t ta_dbg_mutex = PTHREAD_MUTEX_INITIALIZER;
 static bool enable_leak_check; // pretty much constant
@@ -54,6 +54,20 @@ bool ta_set_destructor(void *ptr, void (*destructor)(void *));
 bool ta_set_parent(void *ptr, void *ta_parent);
 void *ta_find_parent(void *ptr);
 
+// Memory accounting
+struct ta_account;
+struct ta_account_info {
+    const char *name;
+    const char *parent;     // name of the parent account, or NULL
+    long long bytes;        // including allocation overhead
+    long long count;        // number of allocations
+};
+struct ta_account *ta_account_get(const char *name, struct ta_account *parent);
+bool ta_set_account(void *ptr, struct ta_account *account);
+void ta_account_add(struct ta_account *account, ptrdiff_t bytes,
+                    ptrdiff_t count);
+int ta_account_list(struct ta_account_info *out, int max);
+
 // Utility functions
 size_t ta_calc_array_size(size_t element_size, size_t count);
 size_t ta_calc_prealloc_elems(size_t nextidx);
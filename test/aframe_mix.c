@@ -0,0 +1,131 @@
+#include "test_helpers.h"
+
+#include "audio/aframe.h"
+#include "audio/chmap.h"
+#include "audio/format.h"
+#include "common/common.h"
+
+#define SAMPLES 16
+
+// Allocate a stereo frame of the given format, with every sample set to v.
+static struct mp_aframe *new_frame(struct mp_aframe_pool *pool, int format,
+                                   double v)
+{
+    struct mp_aframe *f = mp_aframe_create();
+    struct mp_chmap chmap;
+    mp_chmap_from_channels(&chmap, 2);
+    assert_true(mp_aframe_set_format(f, format));
+    assert_true(mp_aframe_set_chmap(f, &chmap));
+    assert_true(mp_aframe_set_rate(f, 48000));
+    assert_true(mp_aframe_pool_allocate(pool, f, SAMPLES) >= 0);
+
+    uint8_t **d = mp_aframe_get_data_rw(f);
+    int planes = mp_aframe_get_planes(f);
+    int num = mp_aframe_get_total_plane_samples(f);
+    for (int p = 0; p < planes; p++) {
+        for (int n = 0; n < num; n++) {
+            switch (af_fmt_from_planar(format)) {
+            case AF_FORMAT_U8:    ((uint8_t *)d[p])[n] = v; break;
+            case AF_FORMAT_S16:   ((int16_t *)d[p])[n] = v; break;
+            case AF_FORMAT_FLOAT: ((float *)d[p])[n] = v; break;
+            default: assert_true(false);
+            }
+        }
+    }
+    return f;
+}
+
+static int16_t s16_at(struct mp_aframe *f, int sample, int ch)
+{
+    return ((int16_t *)mp_aframe_get_data_ro(f)[0])[sample * 2 + ch];
+}
+
+static float floatp_at(struct mp_aframe *f, int sample, int ch)
+{
+    return ((float *)mp_aframe_get_data_ro(f)[ch])[sample];
+}
+
+static void test_mix(void **state)
+{
+    struct mp_aframe_pool *pool = mp_aframe_pool_create(NULL);
+
+    // Scaled mix, and clipping on both ends, in the given range only.
+    struct mp_aframe *dst = new_frame(pool, AF_FORMAT_S16, 1000);
+    struct mp_aframe *src = new_frame(pool, AF_FORMAT_S16, 30000);
+    assert_true(mp_aframe_mix_samples(dst, 2, src, 0, 4, 0.5));
+    assert_int_equal(s16_at(dst, 1, 1), 1000);
+    assert_int_equal(s16_at(dst, 2, 0), 16000);
+    assert_int_equal(s16_at(dst, 5, 1), 16000);
+    assert_int_equal(s16_at(dst, 6, 0), 1000);
+    assert_true(mp_aframe_mix_samples(dst, 0, src, 0, SAMPLES, 1));
+    assert_int_equal(s16_at(dst, 3, 0), INT16_MAX);
+    assert_true(mp_aframe_mix_samples(dst, 0, src, 0, SAMPLES, -3));
+    assert_int_equal(s16_at(dst, 3, 0), INT16_MIN);
+
+    // Out of range, or different formats.
+    assert_false(mp_aframe_mix_samples(dst, SAMPLES - 1, src, 0, 2, 1));
+    assert_false(mp_aframe_mix_samples(dst, 0, src, SAMPLES - 1, 2, 1));
+    struct mp_aframe *other = new_frame(pool, AF_FORMAT_FLOAT, 0);
+    assert_false(mp_aframe_mix_samples(dst, 0, other, 0, 1, 1));
+    talloc_free(dst);
+    talloc_free(src);
+    talloc_free(other);
+
+    // Unsigned samples mix around the center value.
+    dst = new_frame(pool, AF_FORMAT_U8, 128 + 10);
+    src = new_frame(pool, AF_FORMAT_U8, 128 - 20);
+    assert_true(mp_aframe_mix_samples(dst, 0, src, 0, SAMPLES, 1));
+    assert_int_equal(mp_aframe_get_data_ro(dst)[0][5], 128 - 10);
+    talloc_free(dst);
+    talloc_free(src);
+
+    // Planar float: all planes are mixed, and not clipped.
+    dst = new_frame(pool, AF_FORMAT_FLOATP, 0.5);
+    src = new_frame(pool, AF_FORMAT_FLOATP, 0.25);
+    assert_true(mp_aframe_mix_samples(dst, 0, src, 0, SAMPLES, 1));
+    assert_float_equal(floatp_at(dst, 0, 0), 0.75f);
+    assert_float_equal(floatp_at(dst, 0, 1), 0.75f);
+    assert_true(mp_aframe_mix_samples(dst, 0, src, 0, SAMPLES, 2));
+    assert_float_equal(floatp_at(dst, 7, 1), 1.25f);
+    talloc_free(dst);
+    talloc_free(src);
+
+    talloc_free(pool);
+}
+
+static void test_gain_ramp(void **state)
+{
+    struct mp_aframe_pool *pool = mp_aframe_pool_create(NULL);
+
+    // Linear ramp from 0 to 1 over 4 samples, same gain for all channels.
+    struct mp_aframe *f = new_frame(pool, AF_FORMAT_FLOATP, 1);
+    assert_true(mp_aframe_gain_ramp(f, 4, 4, 0, 1));
+    for (int ch = 0; ch < 2; ch++) {
+        assert_float_equal(floatp_at(f, 3, ch), 1.0f);
+        assert_float_equal(floatp_at(f, 4, ch) + 1, 1.0f);
+        assert_float_equal(floatp_at(f, 5, ch), 0.25f);
+        assert_float_equal(floatp_at(f, 7, ch), 0.75f);
+        assert_float_equal(floatp_at(f, 8, ch), 1.0f);
+    }
+    assert_false(mp_aframe_gain_ramp(f, SAMPLES - 2, 4, 0, 1));
+    talloc_free(f);
+
+    // Integer samples are rounded and clipped.
+    f = new_frame(pool, AF_FORMAT_S16, 20000);
+    assert_true(mp_aframe_gain_ramp(f, 0, SAMPLES, 2, 2));
+    assert_int_equal(s16_at(f, 0, 0), INT16_MAX);
+    assert_int_equal(s16_at(f, SAMPLES - 1, 1), INT16_MAX);
+    assert_true(mp_aframe_gain_ramp(f, 0, 1, 0.5, 0.5));
+    assert_int_equal(s16_at(f, 0, 1), 16384);
+    talloc_free(f);
+
+    talloc_free(pool);
+}
+
+int main(void) {
+    const struct CMUnitTest tests[] = {
+        cmocka_unit_test(test_mix),
+        cmocka_unit_test(test_gain_ramp),
+    };
+    return cmocka_run_group_tests(tests, NULL, NULL);
+}
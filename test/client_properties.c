@@ -0,0 +1,158 @@
+#include "test_helpers.h"
+
+#include "common/common.h"
+#include "libmpa/client.h"
+#include "misc/node.h"
+#include "osdep/timer.h"
+
+#define TICKS 2000
+
+// Roughly what a UI reads for each refresh.
+static const char *const ui_props[] = {
+    "pause", "idle-active", "core-idle", "volume", "mute", "speed",
+    "time-pos", "time-remaining", "duration", "percent-pos", "eof-reached",
+    "seeking", "paused-for-cache", "filename", "media-title", "path",
+    "playlist-pos", "playlist-count", "chapter", "chapters", "audio-codec",
+    "audio-params", "audio-bitrate", "loop-file", "loop-playlist",
+    NULL
+};
+
+static void test_get_set(void **state)
+{
+    mpv_handle *h = test_create_player("idle", "yes", "ao", "null", NULL);
+
+    mpv_node values;
+    node_init(&values, MPV_FORMAT_NODE_MAP, NULL);
+    node_map_add_double(&values, "volume", 42);
+    node_map_add_flag(&values, "pause", true);
+    node_map_add_string(&values, "speed", "1.5");
+    assert_int_equal(mpv_set_properties(h, &values), 0);
+    node_map_add_flag(&values, "does-not-exist", true);
+    assert_int_equal(mpv_set_properties(h, &values),
+                     MPV_ERROR_PROPERTY_NOT_FOUND);
+    mpv_free_node_contents(&values);
+
+    const char *names[] = {"volume", "pause", "speed", "does-not-exist",
+                           "volume", NULL};
+    mpv_node res;
+    assert_int_equal(mpv_get_properties(h, names, &res), 0);
+    assert_true(res.format == MPV_FORMAT_NODE_MAP);
+    assert_int_equal(res.u.list->num, 3);
+    mpv_node *v = node_map_get(&res, "volume");
+    assert_true(v && v->format == MPV_FORMAT_DOUBLE);
+    assert_true(v->u.double_ == 42);
+    v = node_map_get(&res, "pause");
+    assert_true(v && v->format == MPV_FORMAT_FLAG && v->u.flag);
+    v = node_map_get(&res, "speed");
+    assert_true(v && v->format == MPV_FORMAT_DOUBLE);
+    assert_true(v->u.double_ == 1.5);
+    mpv_free_node_contents(&res);
+
+    assert_int_equal(mpv_get_properties_async(h, 123, names), 0);
+    while (1) {
+        mpv_event *ev = mpv_wait_event(h, -1);
+        if (ev->event_id != MPV_EVENT_GET_PROPERTY_REPLY)
+            continue;
+        assert_true(ev->reply_userdata == 123);
+        mpv_event_property *prop = ev->data;
+        assert_true(prop->format == MPV_FORMAT_NODE);
+        mpv_node *map = prop->data;
+        assert_true(map->format == MPV_FORMAT_NODE_MAP);
+        assert_int_equal(map->u.list->num, 3);
+        break;
+    }
+
+    mpv_terminate_destroy(h);
+}
+
+// Return the number of change events for the observed volume, and the last
+// value seen.
+static int drain_volume_events(mpv_handle *h, double timeout, double *value)
+{
+    int count = 0;
+    while (1) {
+        mpv_event *ev = mpv_wait_event(h, timeout);
+        if (ev->event_id == MPV_EVENT_NONE)
+            return count;
+        if (ev->event_id != MPV_EVENT_PROPERTY_CHANGE)
+            continue;
+        mpv_event_property *prop = ev->data;
+        assert_true(prop->format == MPV_FORMAT_DOUBLE);
+        *value = *(double *)prop->data;
+        count++;
+    }
+}
+
+static void test_observe_limits(void **state)
+{
+    mpv_handle *h = test_create_player("idle", "yes", "ao", "null", NULL);
+    double volume = -1;
+
+    assert_int_equal(mpv_observe_property(h, 1, "volume", MPV_FORMAT_DOUBLE), 0);
+    assert_int_equal(mpv_observe_property_limits(h, 1, 5, 0, 0), 1);
+    assert_int_equal(mpv_observe_property_limits(h, 2, 5, 0, 0), 0);
+    drain_volume_events(h, 0.5, &volume);
+
+    // Many changes within a short time are delivered as few events, and the
+    // latest value is still delivered once the interval has passed.
+    int64_t start = mp_time_us();
+    int count = 0;
+    for (int n = 1; n <= 50; n++) {
+        assert_int_equal(mpv_set_property(h, "volume", MPV_FORMAT_DOUBLE,
+                                          &(double){n}), 0);
+        count += drain_volume_events(h, 0, &volume);
+    }
+    double elapsed = (mp_time_us() - start) / 1e6;
+    count += drain_volume_events(h, 0.5, &volume);
+    print_message("50 changes in %f s: %d events\n", elapsed, count);
+    assert_true(count <= 2 + elapsed * 5);
+    assert_true(volume == 50);
+
+    // Small changes are not reported.
+    assert_int_equal(mpv_observe_property_limits(h, 1, 0, 10, 0), 1);
+    mpv_set_property(h, "volume", MPV_FORMAT_DOUBLE, &(double){55});
+    assert_int_equal(drain_volume_events(h, 0.2, &volume), 0);
+    mpv_set_property(h, "volume", MPV_FORMAT_DOUBLE, &(double){65});
+    assert_int_equal(drain_volume_events(h, 0.2, &volume), 1);
+    assert_true(volume == 65);
+
+    mpv_terminate_destroy(h);
+}
+
+static void test_benchmark(void **state)
+{
+    mpv_handle *h = test_create_player("idle", "yes", "ao", "null", NULL);
+
+    int64_t t = mp_time_us();
+    for (int n = 0; n < TICKS; n++) {
+        for (int i = 0; ui_props[i]; i++) {
+            mpv_node node;
+            if (mpv_get_property(h, ui_props[i], MPV_FORMAT_NODE, &node) >= 0)
+                mpv_free_node_contents(&node);
+        }
+    }
+    double t_single = (mp_time_us() - t) / 1e6;
+
+    t = mp_time_us();
+    for (int n = 0; n < TICKS; n++) {
+        mpv_node res;
+        assert_int_equal(mpv_get_properties(h, (const char **)ui_props, &res), 0);
+        mpv_free_node_contents(&res);
+    }
+    double t_batch = (mp_time_us() - t) / 1e6;
+
+    print_message("%d ticks of %d properties: single %.3f s, batched %.3f s\n",
+                  TICKS, (int)MP_ARRAY_SIZE(ui_props) - 1, t_single, t_batch);
+
+    mpv_terminate_destroy(h);
+}
+
+int main(void) {
+    mp_time_init();
+    const struct CMUnitTest tests[] = {
+        cmocka_unit_test(test_get_set),
+        cmocka_unit_test(test_observe_limits),
+        cmocka_unit_test(test_benchmark),
+    };
+    return cmocka_run_group_tests(tests, NULL, NULL);
+}
@@ -0,0 +1,80 @@
+#include <string.h>
+
+#include "test_helpers.h"
+
+#include "common/common.h"
+#include "common/msg.h"
+#include "input/cmd.h"
+
+static struct mp_cmd *parse_strv(struct mp_cmd_cache *cache, const char **argv)
+{
+    return mp_cmd_cache_parse_strv(cache, mp_null_log, argv);
+}
+
+static void test_reuse(void **state)
+{
+    struct mp_cmd_cache *cache = mp_cmd_cache_alloc(NULL);
+
+    struct mp_cmd *cmd = parse_strv(cache, (const char *[]){"seek", "5", NULL});
+    assert_true(cmd && strcmp(cmd->name, "seek") == 0);
+    assert_true(cmd->args[0].v.d == 5);
+    talloc_free(cmd);
+    assert_int_equal(mp_cmd_cache_get_hits(cache), 0);
+
+    // Same shape, changed argument.
+    cmd = parse_strv(cache, (const char *[]){"seek", "7", NULL});
+    assert_true(cmd && cmd->args[0].v.d == 7);
+    assert_int_equal(mp_cmd_cache_get_hits(cache), 1);
+    talloc_free(cmd);
+
+    cmd = parse_strv(cache, (const char *[]){"seek", "7", NULL});
+    assert_true(cmd && cmd->args[0].v.d == 7);
+    assert_int_equal(mp_cmd_cache_get_hits(cache), 2);
+    talloc_free(cmd);
+
+    // Parse errors are still reported for a cached entry, but don't count as
+    // hits.
+    assert_true(!parse_strv(cache, (const char *[]){"seek", "x", NULL}));
+    assert_int_equal(mp_cmd_cache_get_hits(cache), 2);
+    cmd = parse_strv(cache, (const char *[]){"seek", "7", NULL});
+    assert_true(cmd && cmd->args[0].v.d == 7);
+    talloc_free(cmd);
+    assert_int_equal(mp_cmd_cache_get_hits(cache), 3);
+
+    // Different flags or argument count are different entries.
+    cmd = parse_strv(cache, (const char *[]){"no-osd", "seek", "7", NULL});
+    assert_true(cmd && (cmd->flags & MP_ON_OSD_FLAGS) == MP_ON_OSD_NO);
+    talloc_free(cmd);
+    cmd = parse_strv(cache, (const char *[]){"seek", "7", "absolute", NULL});
+    assert_true(cmd && cmd->args[1].v.i == (4 | 2));
+    talloc_free(cmd);
+    assert_int_equal(mp_cmd_cache_get_hits(cache), 3);
+
+    // String arguments.
+    cmd = parse_strv(cache, (const char *[]){"set", "volume", "50", NULL});
+    assert_true(cmd && strcmp(cmd->args[1].v.s, "50") == 0);
+    talloc_free(cmd);
+    cmd = parse_strv(cache, (const char *[]){"set", "volume", "51", NULL});
+    assert_true(cmd && strcmp(cmd->args[0].v.s, "volume") == 0);
+    assert_true(strcmp(cmd->args[1].v.s, "51") == 0);
+    talloc_free(cmd);
+
+    // Text commands are matched exactly.
+    for (int n = 0; n < 2; n++) {
+        cmd = mp_cmd_cache_parse_str(cache, mp_null_log,
+                                     bstr0("seek 5 relative; show-text x"),
+                                     "test");
+        assert_true(cmd && cmd->def == &mp_cmd_list);
+        talloc_free(cmd);
+    }
+    assert_int_equal(mp_cmd_cache_get_hits(cache), 5);
+
+    talloc_free(cache);
+}
+
+int main(void) {
+    const struct CMUnitTest tests[] = {
+        cmocka_unit_test(test_reuse),
+    };
+    return cmocka_run_group_tests(tests, NULL, NULL);
+}
@@ -0,0 +1,133 @@
+#include <string.h>
+
+#include "test_helpers.h"
+
+#include "common/common.h"
+#include "common/global.h"
+#include "common/msg.h"
+#include "options/m_config.h"
+#include "options/options.h"
+#include "osdep/timer.h"
+
+#define NUM_CACHES 20
+#define NUM_SETS 20000
+
+struct setup {
+    struct mpv_global *global;
+    struct m_config *config;
+    struct m_config_cache *caches[NUM_CACHES];
+};
+
+static void create(struct setup *s)
+{
+    s->global = talloc_zero(NULL, struct mpv_global);
+    s->global->log = mp_null_log;
+    s->config = m_config_new(s->global, mp_null_log, sizeof(struct MPOpts),
+                             &mp_default_opts, mp_opts);
+    s->config->global = s->global;
+    m_config_create_shadow(s->config);
+    for (int n = 0; n < NUM_CACHES; n++)
+        s->caches[n] = m_config_cache_alloc(s->global, s->global, GLOBAL_CONFIG);
+}
+
+static void destroy(struct setup *s)
+{
+    struct m_config_shadow *shadow = s->global->config;
+    talloc_free(s->global);
+    talloc_free(shadow);
+}
+
+static void set_volume(struct setup *s, float v)
+{
+    struct m_config_option *co = m_config_get_co(s->config, bstr0("volume"));
+    assert_true(co);
+    assert_true(m_config_set_option_raw(s->config, co, &v, 0) >= 0);
+}
+
+static void test_changed(void **state)
+{
+    struct setup s = {0};
+    create(&s);
+
+    struct m_config_cache *cache = s.caches[0];
+    struct MPOpts *opts = cache->opts;
+    struct m_config_option *co = m_config_get_co(s.config, bstr0("audio-spdif"));
+    assert_true(m_config_set_option_raw(s.config, co, &(char *){"ac3"}, 0) >= 0);
+    assert_true(m_config_cache_update(cache));
+    char *spdif = opts->audio_spdif;
+    assert_true(spdif && strcmp(spdif, "ac3") == 0);
+
+    set_volume(&s, 42);
+    assert_true(m_config_cache_update(cache));
+    assert_true(opts->softvol_volume == 42);
+
+    // Only the changed option is reported (and copied).
+    void *ptr;
+    assert_true(m_config_cache_get_next_changed(cache, &ptr));
+    assert_true(ptr == &opts->softvol_volume);
+    assert_true(!m_config_cache_get_next_changed(cache, &ptr));
+    assert_true(!ptr);
+    assert_true(opts->audio_spdif == spdif);
+
+    // No change.
+    assert_true(!m_config_cache_update(cache));
+    assert_true(!m_config_cache_get_next_changed(cache, &ptr));
+
+    // Several changes between updates are merged.
+    set_volume(&s, 10);
+    set_volume(&s, 11);
+    co = m_config_get_co(s.config, bstr0("speed"));
+    assert_true(m_config_set_option_raw(s.config, co, &(double){2}, 0) >= 0);
+    assert_true(m_config_cache_update(cache));
+    int num = 0;
+    bool have_volume = false, have_speed = false;
+    while (m_config_cache_get_next_changed(cache, &ptr)) {
+        have_volume |= ptr == &opts->softvol_volume;
+        have_speed |= ptr == &opts->playback_speed;
+        num++;
+    }
+    assert_int_equal(num, 2);
+    assert_true(have_volume && have_speed);
+    assert_true(opts->softvol_volume == 11 && opts->playback_speed == 2);
+
+    // A cache that was not updated in between sees all changes.
+    assert_true(m_config_cache_update(s.caches[1]));
+    struct MPOpts *opts1 = s.caches[1]->opts;
+    assert_true(opts1->softvol_volume == 11 && opts1->playback_speed == 2);
+
+    // An update that finds no changes drops what wasn't fetched before.
+    set_volume(&s, 12);
+    assert_true(m_config_cache_update(cache));
+    assert_true(!m_config_cache_update(cache));
+    assert_true(!m_config_cache_get_next_changed(cache, &ptr));
+    assert_true(!ptr);
+
+    destroy(&s);
+}
+
+static void test_benchmark(void **state)
+{
+    struct setup s = {0};
+    create(&s);
+
+    int64_t t = mp_time_us();
+    for (int n = 0; n < NUM_SETS; n++) {
+        set_volume(&s, n % 100);
+        for (int i = 0; i < NUM_CACHES; i++)
+            m_config_cache_update(s.caches[i]);
+    }
+    double secs = (mp_time_us() - t) / 1e6;
+    print_message("%d option sets with %d caches: %.3f s (%.0f sets/s)\n",
+                  NUM_SETS, NUM_CACHES, secs, NUM_SETS / secs);
+
+    destroy(&s);
+}
+
+int main(void) {
+    mp_time_init();
+    const struct CMUnitTest tests[] = {
+        cmocka_unit_test(test_changed),
+        cmocka_unit_test(test_benchmark),
+    };
+    return cmocka_run_group_tests(tests, NULL, NULL);
+}
@@ -0,0 +1,244 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+#include "test_helpers.h"
+
+#include "common/common.h"
+#include "demux/demux.h"
+#include "libmpa/client.h"
+#include "libmpa/stream_cb.h"
+#include "misc/node.h"
+#include "osdep/timer.h"
+
+// Media file to play through the throttled stream. The test is skipped if
+// this isn't set.
+#define FILE_ENV "MPA_READAHEAD_FILE"
+#define PLAY_SECONDS 20
+
+struct source {
+    FILE *f;
+    double rate;        // bytes per second
+    int64_t start;      // time of the first read
+    int64_t bytes;      // bytes read so far
+};
+
+// Deliver data at the given rate, and stall for a second every 4 seconds,
+// like a flaky wireless link.
+static int64_t source_read(void *cookie, char *buf, uint64_t nbytes)
+{
+    struct source *s = cookie;
+    if (!s->start)
+        s->start = mp_time_us();
+    nbytes = MPMIN(nbytes, 4096);
+    double t = s->bytes / s->rate;
+    t += (int)(t / 3) * 1.0;
+    int64_t wait = s->start + (int64_t)(t * 1e6) - mp_time_us();
+    if (wait > 0)
+        usleep(wait);
+    size_t r = fread(buf, 1, nbytes, s->f);
+    s->bytes += r;
+    return r;
+}
+
+static int64_t source_seek(void *cookie, int64_t offset)
+{
+    struct source *s = cookie;
+    return fseeko(s->f, offset, SEEK_SET) ? MPV_ERROR_GENERIC : offset;
+}
+
+static int64_t source_size(void *cookie)
+{
+    struct source *s = cookie;
+    off_t pos = ftello(s->f);
+    fseeko(s->f, 0, SEEK_END);
+    off_t size = ftello(s->f);
+    fseeko(s->f, pos, SEEK_SET);
+    return size;
+}
+
+static void source_close(void *cookie)
+{
+    struct source *s = cookie;
+    fclose(s->f);
+    free(s);
+}
+
+static double source_rate;
+
+static int source_open(void *user_data, char *uri, mpv_stream_cb_info *info)
+{
+    struct source *s = calloc(1, sizeof(*s));
+    s->f = fopen(user_data, "rb");
+    s->rate = source_rate;
+    if (!s->f) {
+        free(s);
+        return MPV_ERROR_LOADING_FAILED;
+    }
+    *info = (mpv_stream_cb_info){
+        .cookie = s,
+        .read_fn = source_read,
+        .seek_fn = source_seek,
+        .size_fn = source_size,
+        .close_fn = source_close,
+    };
+    return 0;
+}
+
+static mpv_handle *create_player(const char *adaptive)
+{
+    return test_create_player("idle", "yes", "ao", "null", "vo", "null",
+                              "cache", "no", "demuxer-readahead-secs", "1",
+                              "demuxer-readahead-adaptive", adaptive, NULL);
+}
+
+static bool wait_event(mpv_handle *h, mpv_event_id id)
+{
+    while (1) {
+        mpv_event *ev = mpv_wait_event(h, -1);
+        if (ev->event_id == id)
+            return true;
+        if (ev->event_id == MPV_EVENT_END_FILE)
+            return false;
+    }
+}
+
+// Play the file through the throttled stream, and return the number of
+// underruns. *target is set to the read-ahead target at the end.
+static int play(const char *path, const char *adaptive, double *target)
+{
+    mpv_handle *h = create_player(adaptive);
+    assert_int_equal(mpv_stream_cb_add_ro(h, "slow", (void *)path,
+                                          source_open), 0);
+
+    int underruns = 0;
+    const char *cmd[] = {"loadfile", "slow://", NULL};
+    assert_int_equal(mpv_command(h, cmd), 0);
+    if (!wait_event(h, MPV_EVENT_PLAYBACK_RESTART))
+        goto done;
+
+    bool was_underrun = false;
+    int64_t end = mp_time_us() + PLAY_SECONDS * MP_SECOND_US;
+    while (mp_time_us() < end) {
+        mpv_event *ev = mpv_wait_event(h, 0.05);
+        if (ev->event_id == MPV_EVENT_END_FILE)
+            break;
+        mpv_node state;
+        if (mpv_get_property(h, "demuxer-cache-state", MPV_FORMAT_NODE,
+                             &state) < 0)
+            continue;
+        mpv_node *v = node_map_get(&state, "underrun");
+        bool underrun = v && v->format == MPV_FORMAT_FLAG && v->u.flag;
+        underruns += underrun && !was_underrun;
+        was_underrun = underrun;
+        v = node_map_get(&state, "readahead-target");
+        if (v && v->format == MPV_FORMAT_DOUBLE)
+            *target = v->u.double_;
+        mpv_free_node_contents(&state);
+    }
+
+done:
+    mpv_terminate_destroy(h);
+    return underruns;
+}
+
+// Step through the target adaption with synthetic input rates.
+static void test_adapt(void **state)
+{
+    const double media = 100 * 1024;
+    struct demux_readahead r = {
+        .target = 1,
+        .min_secs = 1,
+        .max_secs = 20,
+        .max_bytes = 150 * 1024 * 1024,
+        .read_rate = media * 4,
+        .media_rate = media,
+    };
+
+    // Input fast enough, and not calm for long enough: no change.
+    assert_null(demux_readahead_next(&r));
+    assert_double_equal(r.target, 1);
+
+    // Underruns double the target, up to the maximum.
+    r.underrun = true;
+    assert_string_equal(demux_readahead_next(&r), "underrun");
+    assert_double_equal(r.target, 2);
+    for (int n = 0; n < 5; n++)
+        demux_readahead_next(&r);
+    assert_double_equal(r.target, 20);
+    r.underrun = false;
+
+    // The byte limit caps the target without a reason.
+    r.max_bytes = media * 8;
+    assert_null(demux_readahead_next(&r));
+    assert_double_equal(r.target, 8);
+    r.max_bytes = 150 * 1024 * 1024;
+
+    // Input barely faster than the media: grow by 50%.
+    r.read_rate = media * 1.5;
+    assert_string_equal(demux_readahead_next(&r), "slow input");
+    assert_double_equal(r.target, 12);
+
+    // Fast input shrinks the target only after 10 seconds without change.
+    r.read_rate = media * 10;
+    r.calm_us = 9 * MP_SECOND_US;
+    assert_null(demux_readahead_next(&r));
+    assert_double_equal(r.target, 12);
+    r.calm_us = 10 * MP_SECOND_US;
+    assert_string_equal(demux_readahead_next(&r), "stable input");
+    assert_double_equal(r.target, 9);
+
+    // ...but not while the input is only moderately faster.
+    r.read_rate = media * 4;
+    assert_null(demux_readahead_next(&r));
+    assert_double_equal(r.target, 9);
+
+    // Shrinking stops at the configured value. An unknown media rate counts
+    // as fast input.
+    r.media_rate = 0;
+    for (int n = 0; n < 20; n++)
+        demux_readahead_next(&r);
+    assert_double_equal(r.target, 1);
+}
+
+static void test_throttled(void **state)
+{
+    const char *path = getenv(FILE_ENV);
+    if (!path || !path[0]) {
+        print_message("%s not set, skipping\n", FILE_ENV);
+        skip();
+    }
+
+    // Determine the average bitrate, and deliver the file slightly faster
+    // than that (apart from the stalls).
+    mpv_handle *h = create_player("no");
+    const char *cmd[] = {"loadfile", path, NULL};
+    assert_int_equal(mpv_command(h, cmd), 0);
+    assert_true(wait_event(h, MPV_EVENT_FILE_LOADED));
+    double duration = 0;
+    int64_t size = 0;
+    mpv_get_property(h, "duration", MPV_FORMAT_DOUBLE, &duration);
+    mpv_get_property(h, "file-size", MPV_FORMAT_INT64, &size);
+    mpv_terminate_destroy(h);
+    assert_true(duration > PLAY_SECONDS && size > 0);
+    source_rate = size / duration * 1.5;
+
+    double target_static = 0, target_adaptive = 0;
+    int u_static = play(path, "no", &target_static);
+    int u_adaptive = play(path, "yes", &target_adaptive);
+    print_message("static: %d underruns, adaptive: %d underruns, "
+                  "target %.1f s\n", u_static, u_adaptive, target_adaptive);
+    assert_true(target_static == 1);
+    assert_true(u_adaptive <= u_static);
+    if (u_static)
+        assert_true(target_adaptive > 1);
+}
+
+int main(void) {
+    mp_time_init();
+    const struct CMUnitTest tests[] = {
+        cmocka_unit_test(test_adapt),
+        cmocka_unit_test(test_throttled),
+    };
+    return cmocka_run_group_tests(tests, NULL, NULL);
+}
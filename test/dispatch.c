@@ -0,0 +1,162 @@
+#include <pthread.h>
+
+#include "test_helpers.h"
+
+#include "common/common.h"
+#include "misc/dispatch.h"
+#include "osdep/atomic.h"
+#include "osdep/timer.h"
+
+#define NUM_PRODUCERS 8
+#define NUM_ITEMS 200000
+
+struct state {
+    struct mp_dispatch_queue *queue;
+    atomic_bool stop;
+    atomic_int count;
+    atomic_int notify_count;
+    atomic_int sync_count;
+    atomic_bool notify_pending;
+};
+
+static void count_fn(void *p)
+{
+    struct state *s = p;
+    atomic_fetch_add(&s->count, 1);
+}
+
+static void notify_fn(void *p)
+{
+    struct state *s = p;
+    atomic_fetch_add(&s->notify_count, 1);
+}
+
+static void sync_fn(void *p)
+{
+    struct state *s = p;
+    atomic_fetch_add(&s->sync_count, 1);
+}
+
+static void stop_fn(void *p)
+{
+    struct state *s = p;
+    atomic_store(&s->stop, true);
+}
+
+static void *consumer_thread(void *p)
+{
+    struct state *s = p;
+    while (!atomic_load(&s->stop))
+        mp_dispatch_queue_process(s->queue, 1000);
+    return NULL;
+}
+
+static void *producer_thread(void *p)
+{
+    struct state *s = p;
+    for (int n = 0; n < NUM_ITEMS; n++) {
+        mp_dispatch_enqueue(s->queue, count_fn, s);
+        if (n % 16 == 0) {
+            mp_dispatch_enqueue_notify(s->queue, notify_fn, s,
+                                       &s->notify_pending);
+        }
+        if (n % 4096 == 0)
+            mp_dispatch_run(s->queue, sync_fn, s);
+    }
+    return NULL;
+}
+
+static void test_contention(void **state)
+{
+    struct state s = { .queue = mp_dispatch_create(NULL) };
+
+    pthread_t consumer;
+    assert_int_equal(pthread_create(&consumer, NULL, consumer_thread, &s), 0);
+
+    int64_t start = mp_time_us();
+    pthread_t producers[NUM_PRODUCERS];
+    for (int n = 0; n < NUM_PRODUCERS; n++) {
+        assert_int_equal(pthread_create(&producers[n], NULL, producer_thread,
+                                        &s), 0);
+    }
+    for (int n = 0; n < NUM_PRODUCERS; n++)
+        pthread_join(producers[n], NULL);
+    mp_dispatch_enqueue(s.queue, stop_fn, &s);
+    pthread_join(consumer, NULL);
+    double t = (mp_time_us() - start) / 1e6;
+
+    int total = NUM_PRODUCERS * NUM_ITEMS;
+    int notifies = NUM_PRODUCERS * ((NUM_ITEMS + 15) / 16);
+    print_message("%d producers, %d items: %.3f s (%.0f items/s), "
+                  "%d of %d notifications run\n", NUM_PRODUCERS, total, t,
+                  total / t, atomic_load(&s.notify_count), notifies);
+    assert_int_equal(atomic_load(&s.count), total);
+    assert_int_equal(atomic_load(&s.sync_count),
+                     NUM_PRODUCERS * ((NUM_ITEMS + 4095) / 4096));
+    assert_true(atomic_load(&s.notify_count) >= 1);
+    assert_true(atomic_load(&s.notify_count) <= notifies);
+    assert_true(!atomic_load(&s.notify_pending));
+
+    talloc_free(s.queue);
+}
+
+static void test_notify_cancel(void **state)
+{
+    struct state s = { .queue = mp_dispatch_create(NULL) };
+
+    // Notifications are merged while queued.
+    for (int n = 0; n < 10; n++)
+        mp_dispatch_enqueue_notify(s.queue, notify_fn, &s, &s.notify_pending);
+    mp_dispatch_enqueue(s.queue, count_fn, &s);
+    mp_dispatch_queue_process(s.queue, 0);
+    assert_int_equal(atomic_load(&s.notify_count), 1);
+    assert_int_equal(atomic_load(&s.count), 1);
+
+    // Canceled items are not run, and the notification can be queued again.
+    mp_dispatch_enqueue_notify(s.queue, notify_fn, &s, &s.notify_pending);
+    mp_dispatch_enqueue(s.queue, count_fn, &s);
+    mp_dispatch_enqueue(s.queue, count_fn, &s);
+    mp_dispatch_cancel_fn(s.queue, notify_fn, &s);
+    mp_dispatch_cancel_fn(s.queue, count_fn, &s);
+    assert_true(!atomic_load(&s.notify_pending));
+    mp_dispatch_enqueue_notify(s.queue, notify_fn, &s, &s.notify_pending);
+    mp_dispatch_queue_process(s.queue, 0);
+    assert_int_equal(atomic_load(&s.notify_count), 2);
+    assert_int_equal(atomic_load(&s.count), 1);
+
+    // More items than the pool holds.
+    for (int n = 0; n < 1000; n++)
+        mp_dispatch_enqueue(s.queue, count_fn, &s);
+    mp_dispatch_queue_process(s.queue, 0);
+    assert_int_equal(atomic_load(&s.count), 1001);
+
+    talloc_free(s.queue);
+}
+
+static void test_cancel_free(void **state)
+{
+    struct state s = { .queue = mp_dispatch_create(NULL) };
+
+    // Freeing a queue with only canceled items (more than the pool holds)
+    // must not run or leak them.
+    for (int n = 0; n < 100; n++)
+        mp_dispatch_enqueue(s.queue, count_fn, &s);
+    mp_dispatch_enqueue_notify(s.queue, notify_fn, &s, &s.notify_pending);
+    mp_dispatch_cancel_fn(s.queue, count_fn, &s);
+    mp_dispatch_cancel_fn(s.queue, notify_fn, &s);
+    talloc_free(s.queue);
+
+    assert_int_equal(atomic_load(&s.count), 0);
+    assert_int_equal(atomic_load(&s.notify_count), 0);
+    assert_true(!atomic_load(&s.notify_pending));
+}
+
+int main(void) {
+    mp_time_init();
+    const struct CMUnitTest tests[] = {
+        cmocka_unit_test(test_notify_cancel),
+        cmocka_unit_test(test_cancel_free),
+        cmocka_unit_test(test_contention),
+    };
+    return cmocka_run_group_tests(tests, NULL, NULL);
+}
@@ -0,0 +1,122 @@
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "test_helpers.h"
+
+#include "common/common.h"
+#include "common/msg.h"
+#include "common/tags.h"
+#include "demux/demux.h"
+#include "demux/media_info.h"
+#include "demux/stheader.h"
+#include "libmpa/client.h"
+#include "player/client.h"
+#include "stream/stream.h"
+
+#define DATA_SIZE (44100 * 4)
+
+static void write_file(const char *path, int size)
+{
+    FILE *f = fopen(path, "wb");
+    assert_true(f);
+    for (int n = 0; n < size; n++)
+        fputc(n & 0xFF, f);
+    assert_int_equal(fclose(f), 0);
+}
+
+static void test_roundtrip(void **state)
+{
+    char dir[] = "/tmp/media_info.XXXXXX";
+    assert_true(mkdtemp(dir));
+    char *path = talloc_asprintf(NULL, "%s/audio.raw", dir);
+    write_file(path, DATA_SIZE);
+
+    mpv_handle *h = test_create_player(NULL);
+    struct mpv_global *global = mp_client_get_global(h);
+    struct mp_log *log = mp_null_log;
+
+    struct demuxer_params params = {.force_format = "rawaudio"};
+    struct demuxer *demuxer = demux_open_url(path, &params, NULL, global);
+    assert_true(demuxer);
+    struct stream *s = stream_create(path, STREAM_READ, NULL, global);
+    assert_true(s);
+
+    // Nothing stored yet.
+    assert_null(mp_media_info_load(NULL, log, global, dir, s));
+
+    // Fill in what rawaudio doesn't provide, so every field is written.
+    demuxer->start_time = 0.5;
+    demuxer->duration = 12.25;
+    mp_tags_set_str(demuxer->metadata, "artist", "someone");
+    mp_tags_set_str(demuxer->metadata, "album", "something");
+    demuxer_add_chapter(demuxer, "intro", 0, 0);
+    demuxer_add_chapter(demuxer, "outro", 10.5, 1);
+    assert_int_equal(demux_get_num_stream(demuxer), 1);
+    struct mp_codec_params *c = demux_get_stream(demuxer, 0)->codec;
+    struct replaygain_data *rg = talloc_zero(demuxer, struct replaygain_data);
+    *rg = (struct replaygain_data){
+        .track_gain = -3.5,
+        .track_peak = 0.75,
+        .album_gain = -4.25,
+        .album_peak = 0.875,
+    };
+    c->replaygain_data = rg;
+
+    mp_media_info_store(log, global, dir, s, demuxer);
+
+    struct mp_media_info *info = mp_media_info_load(NULL, log, global, dir, s);
+    assert_true(info);
+    assert_string_equal(info->demuxer, demuxer->desc->name);
+    if (demuxer->filetype) {
+        assert_string_equal(info->filetype, demuxer->filetype);
+    } else {
+        assert_null(info->filetype);
+    }
+    assert_double_equal(info->start_time, 0.5);
+    assert_double_equal(info->duration, 12.25);
+
+    assert_int_equal(info->num_streams, 1);
+    struct mp_media_info_stream *st = &info->streams[0];
+    assert_int_equal(st->type, STREAM_AUDIO);
+    assert_string_equal(st->codec, c->codec);
+    assert_int_equal(st->samplerate, c->samplerate);
+    assert_int_equal(st->channels, c->channels.num);
+    assert_true(st->has_replaygain);
+    assert_double_equal(st->replaygain.track_gain, -3.5);
+    assert_double_equal(st->replaygain.track_peak, 0.75);
+    assert_double_equal(st->replaygain.album_gain, -4.25);
+    assert_double_equal(st->replaygain.album_peak, 0.875);
+
+    assert_int_equal(info->metadata->num_keys, 2);
+    assert_string_equal(mp_tags_get_str(info->metadata, "artist"), "someone");
+    assert_string_equal(mp_tags_get_str(info->metadata, "album"), "something");
+
+    assert_int_equal(info->num_chapters, 2);
+    assert_double_equal(info->chapters[0].pts, 0);
+    assert_string_equal(mp_tags_get_str(info->chapters[0].metadata, "TITLE"),
+                        "intro");
+    assert_double_equal(info->chapters[1].pts, 10.5);
+    assert_string_equal(mp_tags_get_str(info->chapters[1].metadata, "TITLE"),
+                        "outro");
+    talloc_free(info);
+
+    // A changed file invalidates the entry.
+    write_file(path, DATA_SIZE + 4);
+    assert_null(mp_media_info_load(NULL, log, global, dir, s));
+
+    free_stream(s);
+    demux_free(demuxer);
+    mpv_terminate_destroy(h);
+
+    char *cmd = talloc_asprintf(path, "rm -rf '%s'", dir);
+    assert_int_equal(system(cmd), 0);
+    talloc_free(path);
+}
+
+int main(void) {
+    const struct CMUnitTest tests[] = {
+        cmocka_unit_test(test_roundtrip),
+    };
+    return cmocka_run_group_tests(tests, NULL, NULL);
+}
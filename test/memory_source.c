@@ -0,0 +1,155 @@
+#include <string.h>
+
+#include "test_helpers.h"
+
+#include "common/common.h"
+#include "demux/demux.h"
+#include "demux/packet.h"
+#include "libmpa/client.h"
+#include "libmpa/stream_cb.h"
+#include "player/client.h"
+#include "stream/stream.h"
+
+// Not a multiple of the rawaudio packet size, and not of the read size.
+#define DATA_SIZE (100 * 1000 + 2)
+#define NUM_SEEKS 50
+
+static uint8_t data[DATA_SIZE];
+static int num_frees;
+
+static void free_data(void *opaque)
+{
+    assert_ptr_equal(opaque, data);
+    num_frees++;
+}
+
+static void check_data(const char *buf, int64_t pos, int len)
+{
+    if (memcmp(buf, data + pos, len) != 0)
+        fail_msg("wrong data at position %lld", (long long)pos);
+}
+
+static void setup_data(void)
+{
+    for (int n = 0; n < DATA_SIZE; n++)
+        data[n] = n * 7 / 3;
+    num_frees = 0;
+}
+
+static void test_stream(void **state)
+{
+    setup_data();
+    mpv_handle *h = test_create_player(NULL);
+    struct mpv_global *global = mp_client_get_global(h);
+
+    assert_int_equal(mpv_add_memory_source(h, "test", data, DATA_SIZE,
+                                           free_data, data), 0);
+    assert_int_equal(mpv_add_memory_source(h, "test", data, DATA_SIZE,
+                                           free_data, data),
+                     MPV_ERROR_INVALID_PARAMETER);
+    assert_int_equal(mpv_remove_memory_source(h, NULL),
+                     MPV_ERROR_INVALID_PARAMETER);
+    assert_int_equal(mpv_remove_memory_source(h, "other"),
+                     MPV_ERROR_INVALID_PARAMETER);
+
+    struct stream *s = stream_create("mem://test", STREAM_READ, NULL, global);
+    assert_true(s && s->seekable);
+    assert_int_equal(stream_get_size(s), DATA_SIZE);
+
+    char buf[4096];
+    int64_t pos = 0;
+    while (1) {
+        int r = stream_read(s, buf, sizeof(buf));
+        if (r <= 0)
+            break;
+        check_data(buf, pos, r);
+        pos += r;
+    }
+    assert_int_equal(pos, DATA_SIZE);
+
+    srand(1);
+    for (int n = 0; n < NUM_SEEKS; n++) {
+        pos = rand() % DATA_SIZE;
+        assert_true(stream_seek(s, pos));
+        int len = MPMIN(sizeof(buf), DATA_SIZE - pos);
+        assert_int_equal(stream_read(s, buf, len), len);
+        check_data(buf, pos, len);
+    }
+
+    // The open stream keeps the data alive after removal.
+    assert_int_equal(mpv_remove_memory_source(h, "test"), 0);
+    assert_int_equal(num_frees, 0);
+    assert_true(!stream_create("mem://test", STREAM_READ, NULL, global));
+    assert_true(stream_seek(s, 1000));
+    assert_int_equal(stream_read(s, buf, 10), 10);
+    check_data(buf, 1000, 10);
+
+    free_stream(s);
+    assert_int_equal(num_frees, 1);
+
+    mpv_terminate_destroy(h);
+    assert_int_equal(num_frees, 1);
+}
+
+static void test_destroy(void **state)
+{
+    setup_data();
+    mpv_handle *h = test_create_player(NULL);
+    assert_int_equal(mpv_add_memory_source(h, "test", data, DATA_SIZE,
+                                           free_data, data), 0);
+    // Sources that were never removed are freed with the core.
+    mpv_terminate_destroy(h);
+    assert_int_equal(num_frees, 1);
+}
+
+static void test_rawaudio(void **state)
+{
+    setup_data();
+    mpv_handle *h = test_create_player(NULL);
+    struct mpv_global *global = mp_client_get_global(h);
+    assert_int_equal(mpv_add_memory_source(h, "test", data, DATA_SIZE,
+                                           free_data, data), 0);
+
+    struct demuxer_params params = {.force_format = "rawaudio"};
+    struct demuxer *demuxer = demux_open_url("mem://test", &params, NULL,
+                                             global);
+    assert_true(demuxer);
+    assert_int_equal(mpv_remove_memory_source(h, "test"), 0);
+
+    struct demux_packet **pkts = NULL;
+    int num_pkts = 0, num_refs = 0;
+    int64_t pos = 0;
+    struct demux_packet *pkt;
+    while ((pkt = demux_read_any_packet(demuxer))) {
+        assert_int_equal(pkt->pos, pos);
+        check_data((char *)pkt->buffer, pos, pkt->len);
+        // All but the last packet (which needs padding) point into the data.
+        if (pkt->buffer == data + pos)
+            num_refs++;
+        pos += pkt->len;
+        MP_TARRAY_APPEND(NULL, pkts, num_pkts, pkt);
+    }
+    assert_int_equal(pos, DATA_SIZE);
+    assert_true(num_pkts >= 2);
+    assert_int_equal(num_refs, num_pkts - 1);
+
+    // The packets keep the data alive after the demuxer is gone.
+    demux_free(demuxer);
+    assert_int_equal(num_frees, 0);
+    for (int n = 0; n < num_pkts; n++)
+        talloc_free(pkts[n]);
+    talloc_free(pkts);
+    assert_int_equal(num_frees, 1);
+
+    mpv_terminate_destroy(h);
+    assert_int_equal(num_frees, 1);
+}
+
+int main(void) {
+    const struct CMUnitTest tests[] = {
+        cmocka_unit_test(test_stream),
+        cmocka_unit_test(test_destroy),
+        cmocka_unit_test(test_rawaudio),
+    };
+    return cmocka_run_group_tests(tests, NULL, NULL);
+}
@@ -0,0 +1,254 @@
+#include "config.h"
+
+#define HAVE_LIBSWRESAMPLE (!HAVE_LIBAV)
+
+#if HAVE_LIBSWRESAMPLE
+#include <libswresample/swresample.h>
+#include <libavutil/channel_layout.h>
+#include <libavutil/samplefmt.h>
+#endif
+
+#include "test_helpers.h"
+
+#include "audio/polyphase.h"
+#include "common/common.h"
+#include "osdep/timer.h"
+
+#define CHANNELS 2
+#define FILTER_SIZE 16
+#define CUTOFF 0.8
+
+// Resample a stereo sine tone (right channel inverted), feeding the input in
+// chunks of varying size, and draining at the end. Returns the number of
+// output samples; the left channel is written to out.
+static int run_sine(struct mp_polyphase *p, int in_rate, double freq,
+                    int in_samples, float *out, int out_size,
+                    int rate_switch, double new_in_rate)
+{
+    float buf[CHANNELS * 1024];
+    float obuf[CHANNELS * 4096];
+    int in_pos = 0, out_pos = 0;
+    int chunk = 1;
+    while (1) {
+        int n = MPMIN(chunk, in_samples - in_pos);
+        for (int i = 0; i < n; i++) {
+            float v = 0.5 * sin(2 * M_PI * freq * (in_pos + i) / in_rate);
+            buf[i * CHANNELS + 0] = v;
+            buf[i * CHANNELS + 1] = -v;
+        }
+        if (rate_switch && in_pos >= rate_switch) {
+            assert_true(mp_polyphase_set_in_rate(p, new_in_rate));
+            rate_switch = 0;
+        }
+        int max = mp_polyphase_get_out_samples(p, n);
+        assert_true(max <= 4096);
+        float *planes[1] = {buf};
+        float *oplanes[1] = {obuf};
+        int got = mp_polyphase_process(p, oplanes, max, n ? planes : NULL, n);
+        assert_true(got <= max);
+        for (int i = 0; i < got; i++) {
+            assert_true(obuf[i * CHANNELS + 0] == -obuf[i * CHANNELS + 1]);
+            if (out_pos < out_size)
+                out[out_pos++] = obuf[i * CHANNELS];
+        }
+        in_pos += n;
+        if (!n && !got)
+            break;
+        chunk = (chunk * 7 + 13) % 1000 + 1;
+    }
+    return out_pos;
+}
+
+// Fit a sine of the given frequency (plus DC) to data, and return the power
+// of the residual relative to the power of the fit in dB (THD+N).
+static double thd_n(float *data, int num, int rate, double freq)
+{
+    // Normal equations for x = [sin, cos, 1].
+    double m[3][3] = {{0}}, v[3] = {0};
+    for (int i = 0; i < num; i++) {
+        double b[3] = {sin(2 * M_PI * freq * i / rate),
+                       cos(2 * M_PI * freq * i / rate), 1};
+        for (int r = 0; r < 3; r++) {
+            for (int c = 0; c < 3; c++)
+                m[r][c] += b[r] * b[c];
+            v[r] += b[r] * data[i];
+        }
+    }
+    // Gaussian elimination.
+    for (int c = 0; c < 3; c++) {
+        for (int r = c + 1; r < 3; r++) {
+            double f = m[r][c] / m[c][c];
+            for (int k = c; k < 3; k++)
+                m[r][k] -= f * m[c][k];
+            v[r] -= f * v[c];
+        }
+    }
+    double x[3];
+    for (int r = 2; r >= 0; r--) {
+        double s = v[r];
+        for (int k = r + 1; k < 3; k++)
+            s -= m[r][k] * x[k];
+        x[r] = s / m[r][r];
+    }
+    double sig = 0, noise = 0;
+    for (int i = 0; i < num; i++) {
+        double fit = x[0] * sin(2 * M_PI * freq * i / rate) +
+                     x[1] * cos(2 * M_PI * freq * i / rate);
+        double e = data[i] - fit - x[2];
+        sig += fit * fit;
+        noise += e * e;
+    }
+    return 10 * log10(noise / sig);
+}
+
+static double rms_db(float *data, int num)
+{
+    double sum = 0;
+    for (int i = 0; i < num; i++)
+        sum += data[i] * data[i];
+    return 10 * log10(sum / num + 1e-30);
+}
+
+static void test_quality(int in_rate, int out_rate, double freq)
+{
+    struct mp_polyphase *p = mp_polyphase_create(NULL, CHANNELS, false,
+                                                 in_rate, out_rate,
+                                                 FILTER_SIZE, CUTOFF);
+    assert_true(p);
+
+    int in_samples = in_rate;
+    int out_size = out_rate * 2;
+    float *out = talloc_array(p, float, out_size);
+    int num = run_sine(p, in_rate, freq, in_samples, out, out_size, 0, 0);
+
+    // Drained completely, without adding samples.
+    int expected = (int64_t)in_samples * out_rate / in_rate;
+    print_message("%d -> %d: %d samples (expected %d)\n",
+                  in_rate, out_rate, num, expected);
+    assert_true(abs(num - expected) <= 1);
+
+    // Skip the filter's start/end transients.
+    int skip = out_rate / 100;
+    double db = thd_n(out + skip, num - skip * 2, out_rate, freq);
+    print_message("%d -> %d: %.0f Hz THD+N %.1f dB\n",
+                  in_rate, out_rate, freq, db);
+    assert_true(db < -80);
+
+    talloc_free(p);
+}
+
+static void test_aliasing(void **state)
+{
+    // 12 kHz is above the Nyquist frequency of the output.
+    struct mp_polyphase *p = mp_polyphase_create(NULL, CHANNELS, false,
+                                                 48000, 16000,
+                                                 FILTER_SIZE, CUTOFF);
+    float *out = talloc_array(p, float, 32000);
+    int num = run_sine(p, 48000, 12000, 48000, out, 32000, 0, 0);
+    double db = rms_db(out + 160, num - 320) - rms_db(&(float){0.5 / M_SQRT2}, 1);
+    print_message("48000 -> 16000: 12 kHz alias level %.1f dB\n", db);
+    assert_true(db < -70);
+    talloc_free(p);
+}
+
+static void test_fixed_ratios(void **state)
+{
+    test_quality(44100, 48000, 1000);
+    test_quality(44100, 48000, 15000);
+    test_quality(48000, 16000, 1000);
+    test_quality(48000, 16000, 5000);
+    test_quality(48000, 44100, 1000);
+    // Ratio without exact phase table.
+    test_quality(44100, 47999, 1000);
+}
+
+static void test_rate_change(void **state)
+{
+    // Switching to a slightly higher input rate (as with speed compensation)
+    // must be seamless, and shift the output frequency accordingly.
+    int in_rate = 44100, out_rate = 48000;
+    double speed = 1.01;
+    struct mp_polyphase *p = mp_polyphase_create(NULL, CHANNELS, false,
+                                                 in_rate, out_rate,
+                                                 FILTER_SIZE, CUTOFF);
+    int out_size = out_rate * 2;
+    float *out = talloc_array(p, float, out_size);
+    int num = run_sine(p, in_rate, 1000, in_rate, out, out_size,
+                       in_rate / 2, in_rate * speed);
+    int expected = out_rate / 2 + out_rate / 2 / speed;
+    print_message("rate change: %d samples (expected %d)\n", num, expected);
+    assert_true(abs(num - expected) <= 2);
+
+    // Audio before and after the switch, leaving out the switch point.
+    int split = out_rate / 2 + 256;
+    double db = thd_n(out + 480, split - 480 - 512, out_rate, 1000);
+    print_message("before: THD+N %.1f dB\n", db);
+    assert_true(db < -80);
+    db = thd_n(out + split, num - split - 480, out_rate, 1000 * speed);
+    print_message("after: THD+N %.1f dB\n", db);
+    assert_true(db < -80);
+
+    // Back to the nominal rate, and too large deviations.
+    assert_true(mp_polyphase_set_in_rate(p, in_rate));
+    assert_true(!mp_polyphase_set_in_rate(p, in_rate * 1.5));
+
+    talloc_free(p);
+}
+
+#define BENCH_SECONDS 20
+
+static void bench(int in_rate, int out_rate)
+{
+    int in_samples = 1024;
+    float *in = talloc_zero_array(NULL, float, in_samples * CHANNELS);
+    float *out = talloc_zero_array(in, float, in_samples * 4 * CHANNELS);
+    for (int i = 0; i < in_samples * CHANNELS; i++)
+        in[i] = sin(i * 0.01);
+    int iterations = BENCH_SECONDS * in_rate / in_samples;
+
+    struct mp_polyphase *p = mp_polyphase_create(in, CHANNELS, false,
+                                                 in_rate, out_rate,
+                                                 FILTER_SIZE, CUTOFF);
+    int64_t t = mp_time_us();
+    for (int n = 0; n < iterations; n++) {
+        int max = mp_polyphase_get_out_samples(p, in_samples);
+        mp_polyphase_process(p, &out, max, &in, in_samples);
+    }
+    double t_builtin = (mp_time_us() - t) / 1e6;
+
+    double t_swr = -1;
+#if HAVE_LIBSWRESAMPLE
+    SwrContext *swr = swr_alloc_set_opts(NULL,
+        AV_CH_LAYOUT_STEREO, AV_SAMPLE_FMT_FLT, out_rate,
+        AV_CH_LAYOUT_STEREO, AV_SAMPLE_FMT_FLT, in_rate, 0, NULL);
+    assert_true(swr && swr_init(swr) >= 0);
+    t = mp_time_us();
+    for (int n = 0; n < iterations; n++) {
+        swr_convert(swr, (uint8_t **)&out, in_samples * 4,
+                    (const uint8_t **)&in, in_samples);
+    }
+    t_swr = (mp_time_us() - t) / 1e6;
+    swr_free(&swr);
+#endif
+
+    print_message("%d -> %d, %d s stereo: builtin %.3f s, swr %.3f s\n",
+                  in_rate, out_rate, BENCH_SECONDS, t_builtin, t_swr);
+    talloc_free(in);
+}
+
+static void test_benchmark(void **state)
+{
+    bench(44100, 48000);
+    bench(48000, 16000);
+}
+
+int main(void) {
+    mp_time_init();
+    const struct CMUnitTest tests[] = {
+        cmocka_unit_test(test_fixed_ratios),
+        cmocka_unit_test(test_aliasing),
+        cmocka_unit_test(test_rate_change),
+        cmocka_unit_test(test_benchmark),
+    };
+    return cmocka_run_group_tests(tests, NULL, NULL);
+}
@@ -0,0 +1,98 @@
+#include "test_helpers.h"
+
+#include "common/common.h"
+#include "demux/seek_index.h"
+
+#define FILE_SIZE 1000000
+
+static void check_find(struct mp_seek_index *idx, double pts,
+                       double exp_pts, int64_t exp_pos)
+{
+    double found_pts = -1;
+    int64_t found_pos = -1;
+    assert_true(mp_seek_index_find(idx, pts, &found_pts, &found_pos));
+    assert_double_equal(found_pts, exp_pts);
+    assert_int_equal(found_pos, exp_pos);
+}
+
+static void test_add_find(void **state)
+{
+    struct mp_seek_index *idx = mp_seek_index_create(NULL, 1.0);
+    double pts;
+    int64_t pos;
+    assert_false(mp_seek_index_find(idx, 10, &pts, &pos));
+
+    assert_true(mp_seek_index_add(idx, 10, 1000));
+    assert_true(mp_seek_index_add(idx, 20, 2000));
+    // Out of order insertion.
+    assert_true(mp_seek_index_add(idx, 15, 1500));
+    assert_true(mp_seek_index_add(idx, 5, 500));
+    assert_int_equal(mp_seek_index_get_count(idx), 4);
+
+    // Too close to a neighbour.
+    assert_false(mp_seek_index_add(idx, 10.5, 1050));
+    assert_false(mp_seek_index_add(idx, 19.5, 1950));
+    // Position not between the neighbours' positions.
+    assert_false(mp_seek_index_add(idx, 12, 900));
+    assert_false(mp_seek_index_add(idx, 12, 1500));
+    assert_false(mp_seek_index_add(idx, 30, 2000));
+    assert_false(mp_seek_index_add(idx, 2, 600));
+    // Invalid values.
+    assert_false(mp_seek_index_add(idx, NAN, 3000));
+    assert_false(mp_seek_index_add(idx, INFINITY, 3000));
+    assert_false(mp_seek_index_add(idx, 40, -1));
+    assert_int_equal(mp_seek_index_get_count(idx), 4);
+
+    assert_false(mp_seek_index_find(idx, 4.9, &pts, &pos));
+    check_find(idx, 5, 5, 500);
+    check_find(idx, 9.99, 5, 500);
+    check_find(idx, 10, 10, 1000);
+    check_find(idx, 17, 15, 1500);
+    check_find(idx, 1e9, 20, 2000);
+
+    talloc_free(idx);
+}
+
+static void test_save_load(void **state)
+{
+    struct mp_seek_index *idx = mp_seek_index_create(NULL, 0.5);
+    for (int n = 0; n < 100; n++)
+        assert_true(mp_seek_index_add(idx, n * 0.75, n * 4321));
+    char *data = mp_seek_index_save(idx, idx, FILE_SIZE);
+
+    struct mp_seek_index *loaded = mp_seek_index_create(NULL, 0.5);
+    assert_true(mp_seek_index_load(loaded, bstr0(data), FILE_SIZE));
+    assert_int_equal(mp_seek_index_get_count(loaded), 100);
+    for (int n = 0; n < 100; n++)
+        check_find(loaded, n * 0.75 + 0.1, n * 0.75, n * 4321);
+
+    // Loading merges with existing entries, and drops conflicting ones.
+    struct mp_seek_index *merged = mp_seek_index_create(NULL, 0.5);
+    assert_true(mp_seek_index_add(merged, 0.2, 100));
+    assert_true(mp_seek_index_add(merged, 100, 999999));
+    assert_true(mp_seek_index_load(merged, bstr0(data), FILE_SIZE));
+    assert_int_equal(mp_seek_index_get_count(merged), 101);
+    check_find(merged, 0.3, 0.2, 100);
+    check_find(merged, 0.75, 0.75, 4321);
+    check_find(merged, 200, 100, 999999);
+
+    // Wrong file size, or broken data.
+    struct mp_seek_index *bad = mp_seek_index_create(NULL, 0.5);
+    assert_false(mp_seek_index_load(bad, bstr0(data), FILE_SIZE + 1));
+    assert_false(mp_seek_index_load(bad, bstr0("garbage\n"), FILE_SIZE));
+    char *broken = talloc_asprintf(bad, "%sx y\n", data);
+    assert_false(mp_seek_index_load(bad, bstr0(broken), FILE_SIZE));
+
+    talloc_free(idx);
+    talloc_free(loaded);
+    talloc_free(merged);
+    talloc_free(bad);
+}
+
+int main(void) {
+    const struct CMUnitTest tests[] = {
+        cmocka_unit_test(test_add_find),
+        cmocka_unit_test(test_save_load),
+    };
+    return cmocka_run_group_tests(tests, NULL, NULL);
+}
@@ -0,0 +1,105 @@
+#include <dirent.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "test_helpers.h"
+
+#include "common/common.h"
+#include "libmpa/client.h"
+#include "mpa_talloc.h"
+#include "osdep/timer.h"
+
+// Directory with one or more media files (e.g. FLAC, Opus, AAC, MP3, Vorbis
+// at various sample rates). The benchmark is skipped if this isn't set.
+#define CORPUS_ENV "MPA_SEEK_CORPUS"
+#define NUM_SEEKS 50
+
+// Wait for the given event; returns false if the file failed or ended.
+static bool wait_event(mpv_handle *h, mpv_event_id id)
+{
+    while (1) {
+        mpv_event *ev = mpv_wait_event(h, -1);
+        if (ev->event_id == id)
+            return true;
+        if (ev->event_id == MPV_EVENT_END_FILE)
+            return false;
+    }
+}
+
+// Return the average time in seconds from a precise seek to the playback
+// restart, or -1 if the file can't be played.
+static double bench_file(const char *path, const char *framedrop)
+{
+    mpv_handle *h = test_create_player("idle", "yes", "ao", "null",
+                                       "pause", "yes",
+                                       "hr-seek-framedrop", framedrop, NULL);
+    double res = -1;
+
+    const char *cmd[] = {"loadfile", path, NULL};
+    assert_int_equal(mpv_command(h, cmd), 0);
+    if (!wait_event(h, MPV_EVENT_PLAYBACK_RESTART))
+        goto done;
+
+    double duration = 0;
+    mpv_get_property(h, "duration", MPV_FORMAT_DOUBLE, &duration);
+    if (duration <= 1)
+        goto done;
+
+    // Same targets for every run, away from keyframes/frame boundaries.
+    srand(1);
+    int64_t total = 0;
+    for (int n = 0; n < NUM_SEEKS; n++) {
+        double target = (rand() / (double)RAND_MAX) * (duration - 1) + 0.0123;
+        char *t = talloc_asprintf(NULL, "%f", target);
+        const char *seek[] = {"seek", t, "absolute+exact", NULL};
+        int64_t start = mp_time_us();
+        assert_int_equal(mpv_command(h, seek), 0);
+        bool ok = wait_event(h, MPV_EVENT_PLAYBACK_RESTART);
+        total += mp_time_us() - start;
+        talloc_free(t);
+        if (!ok)
+            goto done;
+    }
+    res = total / 1e6 / NUM_SEEKS;
+
+done:
+    mpv_terminate_destroy(h);
+    return res;
+}
+
+static void test_benchmark(void **state)
+{
+    const char *dir = getenv(CORPUS_ENV);
+    if (!dir || !dir[0]) {
+        print_message("%s not set, skipping\n", CORPUS_ENV);
+        skip();
+    }
+
+    DIR *d = opendir(dir);
+    assert_true(d);
+    struct dirent *ent;
+    while ((ent = readdir(d))) {
+        if (ent->d_name[0] == '.')
+            continue;
+        char *path = talloc_asprintf(NULL, "%s/%s", dir, ent->d_name);
+        double t_trim = bench_file(path, "yes");
+        double t_full = bench_file(path, "no");
+        if (t_trim >= 0 && t_full >= 0) {
+            print_message("%s: %d seeks, decoder discard %.2f ms, "
+                          "full preroll %.2f ms\n", ent->d_name, NUM_SEEKS,
+                          t_trim * 1e3, t_full * 1e3);
+        } else {
+            print_message("%s: could not be played, ignored\n", ent->d_name);
+        }
+        talloc_free(path);
+    }
+    closedir(d);
+}
+
+int main(void) {
+    mp_time_init();
+    const struct CMUnitTest tests[] = {
+        cmocka_unit_test(test_benchmark),
+    };
+    return cmocka_run_group_tests(tests, NULL, NULL);
+}
@@ -0,0 +1,193 @@
+#include <pthread.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "test_helpers.h"
+
+#include "common/common.h"
+#include "libmpa/client.h"
+#include "libmpa/stream_cb.h"
+#include "player/client.h"
+#include "stream/stream.h"
+
+// Size of the generated stream; not a multiple of the request size.
+#define FILE_SIZE (1024 * 1024 + 1234)
+#define NUM_SEEKS 50
+
+struct pending {
+    mpv_stream_cb_request *req;
+    int64_t offset;
+    char *buf;
+    uint64_t nbytes;
+    int seq;
+};
+
+// Requests are completed by a separate thread, newest first, with every 5th
+// read cut short. Every 4th request is completed from within the callback.
+struct source {
+    pthread_mutex_t lock;
+    pthread_cond_t wakeup;
+    pthread_t thread;
+    struct pending pending[64];
+    int num_pending;
+    int issued, completed;
+    bool quit, closed;
+};
+
+static uint8_t byte_at(int64_t pos)
+{
+    return pos * 7 / 3;
+}
+
+static void complete(struct source *s, struct pending *p)
+{
+    int64_t res = 0;
+    if (p->offset < FILE_SIZE) {
+        res = MPMIN(p->nbytes, FILE_SIZE - p->offset);
+        if (p->seq % 5 == 1)
+            res = res / 3 + 1;
+        for (int64_t n = 0; n < res; n++)
+            p->buf[n] = byte_at(p->offset + n);
+    }
+    pthread_mutex_lock(&s->lock);
+    s->completed++;
+    pthread_mutex_unlock(&s->lock);
+    mpv_stream_cb_read_complete(p->req, res);
+}
+
+static void *complete_thread(void *arg)
+{
+    struct source *s = arg;
+    pthread_mutex_lock(&s->lock);
+    while (!s->quit || s->num_pending) {
+        if (!s->num_pending) {
+            pthread_cond_wait(&s->wakeup, &s->lock);
+            continue;
+        }
+        struct pending p = s->pending[--s->num_pending];
+        pthread_mutex_unlock(&s->lock);
+        usleep(100);
+        complete(s, &p);
+        pthread_mutex_lock(&s->lock);
+    }
+    pthread_mutex_unlock(&s->lock);
+    return NULL;
+}
+
+static void source_read_async(void *cookie, mpv_stream_cb_request *req,
+                              int64_t offset, char *buf, uint64_t nbytes)
+{
+    struct source *s = cookie;
+    pthread_mutex_lock(&s->lock);
+    struct pending p = {req, offset, buf, nbytes, s->issued++};
+    if (p.seq % 4 == 0) {
+        pthread_mutex_unlock(&s->lock);
+        complete(s, &p);
+        return;
+    }
+    assert_true(s->num_pending < MP_ARRAY_SIZE(s->pending));
+    s->pending[s->num_pending++] = p;
+    pthread_cond_signal(&s->wakeup);
+    pthread_mutex_unlock(&s->lock);
+}
+
+static int64_t source_seek(void *cookie, int64_t offset)
+{
+    return offset;
+}
+
+static int64_t source_size(void *cookie)
+{
+    return FILE_SIZE;
+}
+
+static void source_close(void *cookie)
+{
+    struct source *s = cookie;
+    pthread_mutex_lock(&s->lock);
+    // All requests must have been completed before closing.
+    assert_int_equal(s->num_pending, 0);
+    assert_int_equal(s->issued, s->completed);
+    s->closed = true;
+    pthread_mutex_unlock(&s->lock);
+}
+
+static int source_open(void *user_data, char *uri, mpv_stream_cb_info *info)
+{
+    *info = (mpv_stream_cb_info){
+        .cookie = user_data,
+        .read_async_fn = source_read_async,
+        .seek_fn = source_seek,
+        .size_fn = source_size,
+        .close_fn = source_close,
+        .prefetch_depth = 8,
+    };
+    return 0;
+}
+
+static void check_data(const char *buf, int64_t pos, int len)
+{
+    for (int n = 0; n < len; n++) {
+        if ((uint8_t)buf[n] != byte_at(pos + n))
+            fail_msg("wrong data at position %lld", (long long)(pos + n));
+    }
+}
+
+static void test_async(void **state)
+{
+    struct source s = {0};
+    pthread_mutex_init(&s.lock, NULL);
+    pthread_cond_init(&s.wakeup, NULL);
+    assert_int_equal(pthread_create(&s.thread, NULL, complete_thread, &s), 0);
+
+    mpv_handle *h = test_create_player(NULL);
+    assert_int_equal(mpv_stream_cb_add_ro(h, "async", &s, source_open), 0);
+
+    struct stream *stream = stream_create("async://", STREAM_READ, NULL,
+                                          mp_client_get_global(h));
+    assert_true(stream && stream->seekable);
+
+    // Linear read of the whole stream.
+    char buf[10000];
+    int64_t pos = 0;
+    while (1) {
+        int r = stream_read(stream, buf, sizeof(buf));
+        if (r <= 0)
+            break;
+        check_data(buf, pos, r);
+        pos += r;
+    }
+    assert_int_equal(pos, FILE_SIZE);
+
+    // Seeks while prefetch requests are in flight.
+    srand(1);
+    for (int n = 0; n < NUM_SEEKS; n++) {
+        pos = rand() % FILE_SIZE;
+        assert_true(stream_seek(stream, pos));
+        int len = MPMIN(sizeof(buf), FILE_SIZE - pos);
+        assert_int_equal(stream_read(stream, buf, len), len);
+        check_data(buf, pos, len);
+    }
+
+    // Closing waits until the source completed all pending requests.
+    free_stream(stream);
+    assert_true(s.closed);
+
+    mpv_terminate_destroy(h);
+
+    pthread_mutex_lock(&s.lock);
+    s.quit = true;
+    pthread_cond_signal(&s.wakeup);
+    pthread_mutex_unlock(&s.lock);
+    pthread_join(s.thread, NULL);
+    pthread_cond_destroy(&s.wakeup);
+    pthread_mutex_destroy(&s.lock);
+}
+
+int main(void) {
+    const struct CMUnitTest tests[] = {
+        cmocka_unit_test(test_async),
+    };
+    return cmocka_run_group_tests(tests, NULL, NULL);
+}
@@ -0,0 +1,207 @@
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include "test_helpers.h"
+
+#include "common/common.h"
+#include "libmpa/client.h"
+#include "osdep/atomic.h"
+#include "osdep/timer.h"
+
+// Local HTTP server with artificial latency and per-connection bandwidth,
+// serving FILE_SIZE bytes of generated data with range request support.
+#define FILE_SIZE (8 * 1024 * 1024)
+#define LATENCY_MS 50
+#define CONN_RATE (2 * 1024 * 1024)
+
+struct server {
+    int fd;
+    int port;
+    atomic_int requests;
+};
+
+struct conn {
+    struct server *server;
+    int fd;
+};
+
+static void *conn_thread(void *arg)
+{
+    struct conn *c = arg;
+    char req[4096];
+    int len = 0;
+    while (len < sizeof(req) - 1) {
+        int r = read(c->fd, req + len, sizeof(req) - 1 - len);
+        if (r <= 0)
+            goto done;
+        len += r;
+        req[len] = '\0';
+        if (strstr(req, "\r\n\r\n"))
+            break;
+    }
+    atomic_fetch_add(&c->server->requests, 1);
+
+    long long start = 0, end = FILE_SIZE - 1;
+    char *range = strstr(req, "Range: bytes=");
+    if (range)
+        sscanf(range, "Range: bytes=%lld-%lld", &start, &end);
+    end = MPMIN(end, FILE_SIZE - 1);
+
+    usleep(LATENCY_MS * 1000);
+
+    char head[512];
+    int head_len = snprintf(head, sizeof(head),
+        "HTTP/1.1 %s\r\n"
+        "Content-Type: application/octet-stream\r\n"
+        "Content-Length: %lld\r\n"
+        "Content-Range: bytes %lld-%lld/%d\r\n"
+        "Accept-Ranges: bytes\r\n"
+        "Connection: close\r\n\r\n",
+        range ? "206 Partial Content" : "200 OK", end - start + 1,
+        start, end, FILE_SIZE);
+    if (write(c->fd, head, head_len) != head_len)
+        goto done;
+
+    int64_t t_start = mp_time_us();
+    char buf[16 * 1024];
+    for (long long pos = start; pos <= end;) {
+        int n = MPMIN(sizeof(buf), end - pos + 1);
+        for (int i = 0; i < n; i++)
+            buf[i] = (pos + i) * 7 / 3;
+        if (write(c->fd, buf, n) != n)
+            break;
+        pos += n;
+        int64_t due = t_start + (pos - start) * 1000000LL / CONN_RATE;
+        int64_t wait = due - mp_time_us();
+        if (wait > 0)
+            usleep(wait);
+    }
+
+done:
+    close(c->fd);
+    free(c);
+    return NULL;
+}
+
+static void *server_thread(void *arg)
+{
+    struct server *s = arg;
+    while (1) {
+        int fd = accept(s->fd, NULL, NULL);
+        if (fd < 0)
+            break;
+        struct conn *c = calloc(1, sizeof(*c));
+        *c = (struct conn){s, fd};
+        pthread_t t;
+        if (pthread_create(&t, NULL, conn_thread, c)) {
+            close(fd);
+            free(c);
+            continue;
+        }
+        pthread_detach(t);
+    }
+    return NULL;
+}
+
+static void start_server(struct server *s)
+{
+    s->fd = socket(AF_INET, SOCK_STREAM, 0);
+    assert_true(s->fd >= 0);
+    struct sockaddr_in addr = {
+        .sin_family = AF_INET,
+        .sin_addr.s_addr = htonl(INADDR_LOOPBACK),
+    };
+    assert_int_equal(bind(s->fd, (struct sockaddr *)&addr, sizeof(addr)), 0);
+    assert_int_equal(listen(s->fd, 16), 0);
+    socklen_t addr_len = sizeof(addr);
+    getsockname(s->fd, (struct sockaddr *)&addr, &addr_len);
+    s->port = ntohs(addr.sin_port);
+    pthread_t t;
+    assert_int_equal(pthread_create(&t, NULL, server_thread, s), 0);
+    pthread_detach(t);
+}
+
+static void wait_eof(mpv_handle *h)
+{
+    assert_int_equal(mpv_observe_property(h, 0, "eof-reached", MPV_FORMAT_FLAG), 0);
+    while (1) {
+        mpv_event *ev = mpv_wait_event(h, -1);
+        assert_true(ev->event_id != MPV_EVENT_END_FILE);
+        if (ev->event_id == MPV_EVENT_PROPERTY_CHANGE) {
+            mpv_event_property *prop = ev->data;
+            if (prop->format == MPV_FORMAT_FLAG && *(int *)prop->data)
+                break;
+        }
+    }
+    mpv_unobserve_property(h, 0);
+}
+
+static void wait_event(mpv_handle *h, mpv_event_id id)
+{
+    while (mpv_wait_event(h, -1)->event_id != id) {}
+}
+
+// Read the whole file, then seek back to the start. Returns the time to read
+// the file.
+static double run(struct server *s, const char *connections)
+{
+    mpv_handle *h = test_create_player("idle", "yes", "ao", "null",
+                                       "ao-null-untimed", "yes",
+                                       "demuxer", "rawaudio", "cache", "no",
+                                       "keep-open", "yes",
+                                       "stream-http-connections", connections,
+                                       NULL);
+    char *url = talloc_asprintf(NULL, "http://127.0.0.1:%d/file", s->port);
+
+    int64_t start = mp_time_us();
+    const char *cmd[] = {"loadfile", url, NULL};
+    assert_int_equal(mpv_command(h, cmd), 0);
+    wait_eof(h);
+    double t = (mp_time_us() - start) / 1e6;
+
+    int requests = atomic_load(&s->requests);
+    const char *seek[] = {"seek", "0", "absolute", NULL};
+    assert_int_equal(mpv_command(h, seek), 0);
+    wait_event(h, MPV_EVENT_PLAYBACK_RESTART);
+    int seek_requests = atomic_load(&s->requests) - requests;
+
+    print_message("%s connection(s): %.3f s (%.1f MiB/s), %d requests for "
+                  "seeking back\n", connections, t, FILE_SIZE / t / (1 << 20),
+                  seek_requests);
+    // Kept segments are reused.
+    if (strcmp(connections, "1") != 0)
+        assert_int_equal(seek_requests, 0);
+
+    talloc_free(url);
+    mpv_terminate_destroy(h);
+    atomic_store(&s->requests, 0);
+    return t;
+}
+
+static void test_benchmark(void **state)
+{
+    // Connection threads may outlive the test function.
+    static struct server s;
+    start_server(&s);
+
+    double t_single = run(&s, "1");
+    double t_multi = run(&s, "4");
+    assert_true(t_multi < t_single);
+
+    shutdown(s.fd, SHUT_RDWR);
+    close(s.fd);
+}
+
+int main(void) {
+    mp_time_init();
+    const struct CMUnitTest tests[] = {
+        cmocka_unit_test(test_benchmark),
+    };
+    return cmocka_run_group_tests(tests, NULL, NULL);
+}
@@ -10,7 +10,28 @@
 #include <math.h>
 #include <float.h>
 
+#include "libmpa/client.h"
+
 #define assert_double_equal(a, b) assert_true(fabs((a) - (b)) <= DBL_EPSILON * fmax(fabs(a), fabs(b)))
 #define assert_float_equal(a, b) assert_true(fabsf((a) - (b)) <= FLT_EPSILON * fmaxf(fabsf(a), fabsf(b)))
 
+// Create and initialize a core with config=no and terminal=no. The arguments
+// are further option name/value pairs, terminated by a NULL name.
+static inline mpv_handle *test_create_player(const char *name, ...)
+{
+    mpv_handle *h = mpv_create();
+    assert_true(h);
+    assert_int_equal(mpv_set_option_string(h, "config", "no"), 0);
+    assert_int_equal(mpv_set_option_string(h, "terminal", "no"), 0);
+    va_list ap;
+    va_start(ap, name);
+    for (; name; name = va_arg(ap, const char *)) {
+        const char *value = va_arg(ap, const char *);
+        assert_int_equal(mpv_set_option_string(h, name, value), 0);
+    }
+    va_end(ap);
+    assert_int_equal(mpv_initialize(h), 0);
+    return h;
+}
+
 #endif
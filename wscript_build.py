@@ -65,6 +65,7 @@ def build(ctx):
         ( "audio/filter/af_scaletempo.c" ),
         ( "audio/fmt-conversion.c" ),
         ( "audio/format.c" ),
+        ( "audio/polyphase.c" ),
         ( "audio/out/ao.c" ),
         ( "audio/out/ao_alsa.c",                 "alsa" ),
         ( "audio/out/ao_audiounit.m",            "audiounit" ),
@@ -106,9 +107,12 @@ def build(ctx):
         ( "demux/demux_playlist.c" ),
         ( "demux/demux_raw.c" ),
         ( "demux/demux_timeline.c" ),
+        ( "demux/media_info.c" ),
         ( "demux/packet.c" ),
+        ( "demux/seek_index.c" ),
         ( "demux/timeline.c" ),
 
+        ( "filters/f_audio_overlay.c" ),
         ( "filters/f_auto_filters.c" ),
         ( "filters/f_autoconvert.c" ),
         ( "filters/f_decoder_wrapper.c" ),
@@ -168,6 +172,7 @@ def build(ctx):
         ( "stream/stream_lavf.c" ),
         ( "stream/stream_memory.c" ),
         ( "stream/stream_null.c" ),
+        ( "stream/stream_ranges.c" ),
 
         ## osdep
         ( getch2_c ),